@@ -0,0 +1,89 @@
+#include <cstdio>
+
+#include "bench_utils.h"
+
+/**
+ * 对比开盘前积压订单的两种处理方式：连续撮合逐个处理，以及集合竞价 —— 先全部挂单不撮合，再一次 UNCROSS
+ * 积压的订单两边价格有大量重叠，所以连续撮合会产生很多逐笔成交
+ * 记录撮合引擎处理的耗时（集合竞价单独记录 UNCROSS 本身），以及产生的回报 / 逐笔行情 / 价位行情 / BBO 的数量
+ */
+
+/// ./auction_benchmark [NUM_ORDERS] [ITERATIONS]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 20000);
+    const size_t iterations = (argc > 2 ? std::atol(argv[2]) : 5);
+    const size_t num_clients = 200;
+
+    // The pre-open backlog, bids and offers overlap by 10 ticks around 100.
+    srand(1);
+    std::vector<Exchange::MEClientRequest> backlog;
+    backlog.reserve(num_orders);
+    for (size_t i = 0; i < num_orders; ++i) {
+        const auto side = (rand() % 2 ? Side::BUY : Side::SELL);
+        backlog.push_back({Exchange::ClientRequestType::NEW,
+                           static_cast<ClientId>(i % num_clients),
+                           static_cast<TickerId>(rand() % ME_MAX_TICKERS),
+                           static_cast<OrderId>(i / num_clients),
+                           side,
+                           (side == Side::BUY ? 90 : 91) + static_cast<Price>(rand() % 20),
+                           static_cast<Qty>(1 + rand() % 100)});
+    }
+
+    auto request = [](Exchange::ClientRequestType type) {
+        return Exchange::MEClientRequest{type,          Exchange::ME_ADMIN_CLIENT_ID, TickerId_INVALID, OrderId_INVALID,
+                                         Side::INVALID, Price_INVALID,                Qty_INVALID};
+    };
+    const auto start_auction = request(Exchange::ClientRequestType::START_AUCTION);
+    const auto uncross = request(Exchange::ClientRequestType::UNCROSS);
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MEBBOUpdateLFQueue bbo_updates(ME_MAX_MARKET_UPDATES);
+    auto matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                        &level_updates, &bbo_updates);
+
+    // Empty the order books between runs so the order ids can be reused.
+    Benchmarks::Counts discard;
+    auto clearBooks = [&]() {
+        for (ClientId client_id = 0; client_id < num_clients; ++client_id) {
+            auto mass_cancel = request(Exchange::ClientRequestType::MASS_CANCEL);
+            mass_cancel.client_id_ = client_id;
+            matching_engine->processClientRequest(&mass_cancel);
+        }
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &discard);
+    };
+
+    Nanos continuous_nanos = 0, auction_nanos = 0, uncross_nanos = 0;
+    Benchmarks::Counts continuous_counts, auction_counts;
+    for (size_t i = 0; i < iterations; ++i) {
+        continuous_nanos += Benchmarks::timeNanos([&]() {
+            for (const auto& new_request : backlog)
+                matching_engine->processClientRequest(&new_request);
+        });
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &continuous_counts);
+        clearBooks();
+
+        auction_nanos += Benchmarks::timeNanos([&]() {
+            matching_engine->processClientRequest(&start_auction);
+            for (const auto& new_request : backlog)
+                matching_engine->processClientRequest(&new_request);
+            uncross_nanos += Benchmarks::timeNanos([&]() { matching_engine->processClientRequest(&uncross); });
+        });
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &auction_counts);
+        clearBooks();
+    }
+
+    for (const auto& [name, nanos, counts] : {std::tuple{"continuous", continuous_nanos, continuous_counts},
+                                             std::tuple{"auction   ", auction_nanos, auction_counts}}) {
+        printf("%s %zu orders: %10.1f us  responses:%zu market updates:%zu trades:%zu level updates:%zu "
+               "bbo updates:%zu\n",
+               name, num_orders, nanos / 1000.0 / iterations, counts.responses_ / iterations,
+               counts.market_updates_ / iterations, counts.trades_ / iterations, counts.level_updates_ / iterations,
+               counts.bbo_updates_ / iterations);
+    }
+    printf("uncross alone: %10.1f us\n", uncross_nanos / 1000.0 / iterations);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/**
+ * benchmark 共用的工具
+ * 订单流和 trading_main 里的 RANDOM 策略一样：每个 ticker 一个随机基准价，每发一个新订单就随机撤掉一个之前的订单
+ * 用真实的撮合引擎处理这些订单，得到的行情就是一段“录制”的交易时段
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include "common/types.h"
+#include "common/time_utils.h"
+
+#include "exchange/matcher/matching_engine.h"
+
+namespace Benchmarks
+{
+/// Generate a session of random client requests from num_clients clients, every new order is followed by a cancel of
+/// a random earlier order of the same client.
+inline auto makeRandomRequests(size_t num_orders, size_t num_clients, unsigned int seed)
+    -> std::vector<Exchange::MEClientRequest> {
+    srand(seed);
+
+    std::array<Price, ME_MAX_TICKERS> ticker_base_price;
+    for (auto& base_price : ticker_base_price)
+        base_price = (rand() % 100) + 100;
+
+    std::vector<Exchange::MEClientRequest> requests;
+    requests.reserve(num_orders * 2);
+    std::vector<std::vector<Exchange::MEClientRequest>> client_orders(num_clients);
+    for (size_t i = 0; i < num_orders; ++i) {
+        const ClientId client_id = i % num_clients;
+        auto& orders = client_orders[client_id];
+        const TickerId ticker_id = rand() % ME_MAX_TICKERS;
+
+        Exchange::MEClientRequest new_request;
+        new_request.type_ = Exchange::ClientRequestType::NEW;
+        new_request.client_id_ = client_id;
+        new_request.ticker_id_ = ticker_id;
+        new_request.order_id_ = orders.size();
+        new_request.side_ = (rand() % 2 ? Side::BUY : Side::SELL);
+        new_request.price_ = ticker_base_price[ticker_id] + (rand() % 10) + 1;
+        new_request.qty_ = 1 + (rand() % 100) + 1;
+        requests.push_back(new_request);
+        orders.push_back(new_request);
+
+        auto cancel_request = orders[rand() % orders.size()];
+        cancel_request.type_ = Exchange::ClientRequestType::CANCEL;
+        requests.push_back(cancel_request);
+    }
+
+    return requests;
+}
+
+/// Run the client requests through a matching engine and return the market updates it published.
+inline auto recordMarketUpdates(const std::vector<Exchange::MEClientRequest>& requests)
+    -> std::vector<Exchange::MEMarketUpdate> {
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MatchingEngine matching_engine(&client_requests, &client_responses, &market_updates, nullptr, nullptr);
+
+    std::vector<Exchange::MEMarketUpdate> updates;
+    updates.reserve(requests.size() * 2);
+    for (const auto& request : requests) {
+        matching_engine.processClientRequest(&request);
+
+        for (auto response = client_responses.getNextToRead(); response; response = client_responses.getNextToRead())
+            client_responses.updateReadIndex();
+        for (auto update = market_updates.getNextToRead(); update; update = market_updates.getNextToRead()) {
+            updates.push_back(*update);
+            market_updates.updateReadIndex();
+        }
+    }
+
+    return updates;
+}
+
+/// Number of messages of each kind the matching engine published.
+struct Counts {
+    size_t responses_ = 0, market_updates_ = 0, trades_ = 0, level_updates_ = 0, bbo_updates_ = 0;
+};
+
+/// Drain every queue the matching engine publishes to and count the messages, the level and BBO queues are optional.
+inline auto drain(Exchange::ClientResponseLFQueue* client_responses, Exchange::MEMarketUpdateLFQueue* market_updates,
+                  Exchange::MELevelUpdateLFQueue* level_updates, Exchange::MEBBOUpdateLFQueue* bbo_updates,
+                  Counts* counts) {
+    for (; client_responses->getNextToRead(); client_responses->updateReadIndex())
+        ++counts->responses_;
+    for (auto update = market_updates->getNextToRead(); update; update = market_updates->getNextToRead()) {
+        counts->trades_ += (update->type_ == Exchange::MarketUpdateType::TRADE);
+        ++counts->market_updates_;
+        market_updates->updateReadIndex();
+    }
+    for (; level_updates && level_updates->getNextToRead(); level_updates->updateReadIndex())
+        ++counts->level_updates_;
+    for (; bbo_updates && bbo_updates->getNextToRead(); bbo_updates->updateReadIndex())
+        ++counts->bbo_updates_;
+}
+
+/// Run fn and return the number of nanoseconds it took.
+template<typename F>
+inline auto timeNanos(F&& fn) {
+    const auto start = Common::getCurrentNanos();
+    fn();
+    return Common::getCurrentNanos() - start;
+}
+} // namespace Benchmarks
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <map>
+
+#include "trading/strategy/trade_engine.h"
+
+#include "bench_utils.h"
+
+/**
+ * 测量 MarketOrderBook 从 snapshot 恢复的耗时：
+ * 先把录制的行情灌进订单簿，然后反复模拟一次 snapshot 恢复 —— CLEAR，再按订单号顺序 ADD 所有存活订单
+ * 分别记录 CLEAR 本身、CLEAR 到两边都有报价（策略可以开始报价）、以及整个 snapshot 的耗时
+ */
+
+/// ./book_recovery_benchmark [NUM_ORDERS] [ITERATIONS]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 200000);
+    const size_t iterations = (argc > 2 ? std::atol(argv[2]) : 20);
+    const TickerId ticker_id = 0;
+
+    const auto requests = Benchmarks::makeRandomRequests(num_orders, 8, 1);
+    const auto updates = Benchmarks::recordMarketUpdates(requests);
+
+    // The snapshot the synthesizer would publish for the ticker at the end of the session.
+    std::map<OrderId, Exchange::MEMarketUpdate> live_orders;
+    for (const auto& update : updates) {
+        if (update.ticker_id_ != ticker_id) continue;
+        switch (update.type_) {
+        case Exchange::MarketUpdateType::ADD:
+            live_orders[update.order_id_] = update;
+            break;
+        case Exchange::MarketUpdateType::MODIFY:
+            live_orders[update.order_id_].qty_ = update.qty_;
+            break;
+        case Exchange::MarketUpdateType::CANCEL:
+            live_orders.erase(update.order_id_);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Exchange::MEMarketUpdate clear_update;
+    clear_update.type_ = Exchange::MarketUpdateType::CLEAR;
+    clear_update.ticker_id_ = ticker_id;
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    // Both hold hash maps sized for ME_MAX_ORDER_IDS which are too large for the stack.
+    auto trade_engine = new Trading::TradeEngine(0, AlgoType::RANDOM, TradeEngineCfgHashMap{}, &client_requests,
+                                                 &client_responses, &market_updates, nullptr, nullptr);
+
+    Common::Logger logger("book_recovery_benchmark.log");
+    auto book = new Trading::MarketOrderBook(ticker_id, &logger);
+    book->setTradeEngine(trade_engine);
+    for (const auto& update : updates) {
+        if (update.ticker_id_ == ticker_id)
+            book->onMarketUpdate(&update);
+    }
+    printf("session: %zu market updates, %zu live orders for ticker:%u\n", updates.size(), live_orders.size(),
+           ticker_id);
+
+    Nanos clear_nanos = 0, first_quote_nanos = 0, snapshot_nanos = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        const auto start = Common::getCurrentNanos();
+        book->onMarketUpdate(&clear_update);
+        clear_nanos += Common::getCurrentNanos() - start;
+
+        auto quoted = false;
+        for (const auto& [order_id, update] : live_orders) {
+            book->onMarketUpdate(&update);
+            if (!quoted && book->getBBO()->bid_price_ != Price_INVALID && book->getBBO()->ask_price_ != Price_INVALID) {
+                first_quote_nanos += Common::getCurrentNanos() - start;
+                quoted = true;
+            }
+        }
+        snapshot_nanos += Common::getCurrentNanos() - start;
+    }
+
+    printf("CLEAR %9.1f us  CLEAR to first two sided quote %9.1f us  full snapshot %9.1f us\n",
+           clear_nanos / 1000.0 / iterations, first_quote_nanos / 1000.0 / iterations,
+           snapshot_nanos / 1000.0 / iterations);
+
+    exit(EXIT_SUCCESS);
+}
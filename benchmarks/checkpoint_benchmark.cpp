@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "bench_utils.h"
+
+#include "exchange/market_data/snapshot_synthesizer.h"
+
+/**
+ * 测量冷启动恢复一个很大的订单簿的耗时：
+ * - 每个 ticker 挂上大量不成交的订单，请求都先写 journal
+ * - 没有 checkpoint 时用一个新的撮合引擎从 journal 逐个重放这些订单
+ * - 写一个按列存放的 checkpoint 镜像，再用一个新的撮合引擎从镜像恢复，不需要重放任何请求
+ * - 单独测量 checkpoint 里在撮合线程上的部分：把订单簿序列化到上一次用过的镜像缓冲区里，写盘由后台线程做
+ * - 用同一个镜像初始化 snapshot synthesizer
+ * 恢复出来的订单簿都和原来的订单簿逐字节比较 checkpoint
+ */
+
+namespace
+{
+const std::string prefix = "checkpoint_benchmark";
+
+auto removeFiles() {
+    std::remove((prefix + ".journal").c_str());
+    std::remove((prefix + ".checkpoint").c_str());
+}
+
+auto readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+/// Orders which never cross, the bids of every ticker rest below 1000 and the asks at 1000 and above, over
+/// ME_MAX_PRICE_LEVELS / 2 price levels per side, from every client.
+auto makeRestingOrders(size_t num_orders) {
+    std::vector<Exchange::MEClientRequest> requests(num_orders);
+    for (size_t i = 0; i < num_orders; ++i) {
+        auto& request = requests[i];
+        request.type_ = Exchange::ClientRequestType::NEW;
+        request.client_id_ = i % ME_MAX_NUM_CLIENTS;
+        request.ticker_id_ = (i / ME_MAX_NUM_CLIENTS) % ME_MAX_TICKERS;
+        request.order_id_ = i / ME_MAX_NUM_CLIENTS;
+        request.side_ = (i % 2 ? Side::BUY : Side::SELL);
+        const auto level = static_cast<Price>((i / 2) % (ME_MAX_PRICE_LEVELS / 2));
+        request.price_ = (request.side_ == Side::BUY ? 999 - level : 1000 + level);
+        request.qty_ = 1 + i % 100;
+    }
+
+    return requests;
+}
+} // namespace
+
+/// ./checkpoint_benchmark [NUM_ORDERS]
+/// The snapshot synthesizer holds fewer than ME_MAX_ORDER_IDS orders over all tickers.
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 1000000);
+    const auto capacity = num_orders + 1;
+
+    const auto requests = makeRestingOrders(num_orders);
+    printf("book: %zu resting orders over %zu tickers\n", requests.size(), static_cast<size_t>(ME_MAX_TICKERS));
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    auto makeMatchingEngine = [&]() {
+        return new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates, nullptr, nullptr);
+    };
+    auto drain = [&]() {
+        for (; client_responses.getNextToRead(); client_responses.updateReadIndex())
+            ;
+        for (; market_updates.getNextToRead(); market_updates.updateReadIndex())
+            ;
+    };
+
+    // The live session, every order is journaled before it is added.
+    removeFiles();
+    auto matching_engine = makeMatchingEngine();
+    matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    const auto live_nanos = Benchmarks::timeNanos([&]() {
+        for (const auto& request : requests) {
+            matching_engine->onClientRequest(&request);
+            drain();
+        }
+    });
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_expected.checkpoint"), "Unable to write checkpoint.");
+    delete matching_engine;
+    printf("live       %8zu orders %9.1f ms\n", requests.size(), live_nanos / 1e6);
+    const auto expected = readFile(prefix + "_expected.checkpoint");
+
+    // Cold start without a checkpoint, every order is replayed from the journal.
+    matching_engine = makeMatchingEngine();
+    size_t num_replayed = 0;
+    const auto replay_nanos = Benchmarks::timeNanos([&]() {
+        num_replayed = matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    });
+    drain(); // the resent responses, a checkpoint keeps the unread ones.
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_replayed.checkpoint"), "Unable to write checkpoint.");
+    printf("replay     %8zu orders %9.1f ms identical:%d\n", num_replayed, replay_nanos / 1e6,
+           readFile(prefix + "_replayed.checkpoint") == expected);
+
+    // enableJournal() checkpointed the replayed order books, time writing the image once more.
+    const auto checkpoint_nanos = Benchmarks::timeNanos([&]() { matching_engine->checkpoint(); });
+    printf("checkpoint %8zu bytes  %9.1f ms\n", readFile(prefix + ".checkpoint").size(), checkpoint_nanos / 1e6);
+
+    // The part of a checkpoint on the matching engine thread, into an image reused from the previous checkpoint.
+    std::vector<char> image;
+    matching_engine->serializeCheckpoint(&image);
+    const auto serialize_nanos = Benchmarks::timeNanos([&]() { matching_engine->serializeCheckpoint(&image); });
+    delete matching_engine;
+    printf("serialize  %8zu bytes  %9.1f ms identical:%d\n", image.size(), serialize_nanos / 1e6,
+           std::string(image.begin(), image.end()) == expected);
+
+    // Cold start from the image, nothing is left to replay.
+    matching_engine = makeMatchingEngine();
+    const auto restore_nanos = Benchmarks::timeNanos([&]() {
+        num_replayed = matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    });
+    drain(); // the resent responses, a checkpoint keeps the unread ones.
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_restored.checkpoint"), "Unable to write checkpoint.");
+    printf("restore    %8zu orders %9.1f ms replayed:%zu identical:%d\n", requests.size(), restore_nanos / 1e6,
+           num_replayed, readFile(prefix + "_restored.checkpoint") == expected);
+    delete matching_engine;
+
+    // The same image seeds the snapshot synthesizer, which is never started.
+    Exchange::MDPMarketUpdateLFQueue snapshot_md_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MDPLevelUpdateLFQueue snapshot_level_updates(ME_MAX_MARKET_UPDATES);
+    auto channels_cfg = Exchange::makeMDChannelsCfg(1, "233.252.14.", 1, 20000, 3, 20001);
+    Exchange::addMDLevelFeed(&channels_cfg, "233.252.14.", 2, 20100, 4, 20101);
+    auto synthesizer =
+        new Exchange::SnapshotSynthesizer(&snapshot_md_updates, &snapshot_level_updates, "lo", channels_cfg);
+    const auto seed_nanos =
+        Benchmarks::timeNanos([&]() { ASSERT(synthesizer->seedFromCheckpoint(prefix + ".checkpoint"), "No image."); });
+    printf("seed       %8zu orders %9.1f ms\n", requests.size(), seed_nanos / 1e6);
+    delete synthesizer;
+
+    exit(EXIT_SUCCESS);
+}
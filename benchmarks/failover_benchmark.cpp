@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <csignal>
+#include <thread>
+
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench_utils.h"
+
+#include "exchange/order_server/order_server.h"
+
+/**
+ * 测量热备 ME 的故障切换时间：
+ * - fork 出一个主 ME 处理一段随机订单流并写 journal，备 ME 在父进程里跟着 journal 撮合
+ * - 主 ME 处理完之后写下自己的 checkpoint、记录时间，然后 SIGKILL 自己模拟崩溃
+ * - 备 ME 发现主 ME 退出并接管 journal，记录从崩溃到接管完成的时间，订单簿和主 ME 的逐字节比较
+ * - 崩溃之前一个客户通过主 exchange 的 order server 下了几个订单，接管之后备 exchange 的 order server 从同一个会话文件
+ *   恢复，检查客户重新 LOGON 之后不需要重发请求，新的请求和回报接着之前的序号
+ * 作为对比，再用一个新的撮合引擎从 journal 完整重放恢复同一个订单簿，也就是没有热备时重启的耗时
+ */
+
+namespace
+{
+const std::string prefix = "failover_benchmark";
+constexpr int port = 12600;
+
+/// The client of the order server, not one of the clients of the random requests.
+constexpr ClientId client_id = 100;
+constexpr size_t num_client_orders = 3;
+
+/// State shared by the primary and the standby process.
+struct SharedState {
+    Nanos crash_time_ = 0;
+    volatile bool order_server_up_ = false; ///< the primary's order server accepts connections.
+    volatile bool client_done_ = false;     ///< the primary accepted the orders of the client.
+};
+
+auto removeFiles() {
+    std::remove((prefix + ".journal").c_str());
+    std::remove((prefix + ".checkpoint").c_str());
+    std::remove((prefix + ".sessions").c_str());
+}
+
+auto readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+/// A blocking loopback TCP connection to the order server, reads time out.
+auto connectClient() {
+    const auto fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT(fd >= 0, "socket() failed. error:" + std::string(std::strerror(errno)));
+    const timeval timeout{5, 0};
+    ASSERT(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0,
+           "setsockopt() SO_RCVTIMEO failed. error:" + std::string(std::strerror(errno)));
+    const sockaddr_in addr{AF_INET, htons(port), {htonl(INADDR_LOOPBACK)}, {}};
+    ASSERT(connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0,
+           "connect() failed. error:" + std::string(std::strerror(errno)));
+    return fd;
+}
+
+auto sendRequest(int fd, size_t seq_num, const Exchange::MEClientRequest& request) {
+    const Exchange::OMClientRequest om_client_request{seq_num, request};
+    ASSERT(::send(fd, &om_client_request, sizeof(om_client_request), MSG_NOSIGNAL) == sizeof(om_client_request),
+           "send() failed. error:" + std::string(std::strerror(errno)));
+}
+
+auto recvResponse(int fd) {
+    Exchange::OMClientResponse response;
+    ASSERT(recv(fd, &response, sizeof(response), MSG_WAITALL) == sizeof(response),
+           "No client response. error:" + std::string(std::strerror(errno)));
+    return response;
+}
+
+/// Log on having received the responses up to last_response_seq_num, returns the LOGGED_ON.
+auto logon(int fd, size_t last_response_seq_num) {
+    sendRequest(fd, 1, {Exchange::ClientRequestType::LOGON, client_id, TickerId_INVALID, last_response_seq_num,
+                        Side::INVALID, Price_INVALID, Qty_INVALID});
+    return recvResponse(fd).me_client_response_;
+}
+
+/// A buy order far below the random prices, it rests without trading.
+auto makeClientOrder(OrderId order_id) {
+    return Exchange::MEClientRequest{Exchange::ClientRequestType::NEW, client_id, 0, order_id, Side::BUY, 1, 10};
+}
+} // namespace
+
+/// ./failover_benchmark [NUM_ORDERS] [JOURNAL_CAPACITY]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 50000);
+    const size_t capacity = (argc > 2 ? std::atol(argv[2]) : 1024 * 1024);
+
+    const auto requests = Benchmarks::makeRandomRequests(num_orders, 8, 1);
+    printf("session: %zu requests, journal capacity:%zu records\n", requests.size(), capacity);
+    removeFiles();
+
+    auto shared = static_cast<SharedState*>(
+        mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    ASSERT(shared != MAP_FAILED, "Unable to mmap the shared state.");
+    *shared = SharedState{};
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    auto makeMatchingEngine = [&]() {
+        return new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates, nullptr, nullptr);
+    };
+
+    fflush(stdout); // not printed again by the primary.
+    const auto primary_pid = fork();
+    ASSERT(primary_pid >= 0, "Unable to fork the primary.");
+    if (!primary_pid) {
+        // The order server records every client response, its session file counts them for the standby.
+        auto primary = makeMatchingEngine();
+        primary->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+        auto order_server = new Exchange::OrderServer(&client_requests, &client_responses, "lo", port, 1, 0, {},
+                                                      false);
+        order_server->persistSessions(prefix + ".sessions");
+        order_server->start();
+        for (const auto& request : requests) {
+            primary->onClientRequest(&request);
+            for (; market_updates.getNextToRead(); market_updates.updateReadIndex())
+                ;
+            while (client_responses.size() > client_responses.capacity() / 2)
+                std::this_thread::yield();
+        }
+
+        // The orders of the client reach the matching engine through the order server.
+        primary->start();
+        shared->order_server_up_ = true;
+        while (!shared->client_done_)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        primary->stop();
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        ASSERT(primary->writeCheckpoint(prefix + "_expected.checkpoint"), "Unable to write checkpoint.");
+
+        shared->crash_time_ = Common::getCurrentNanos();
+        kill(getpid(), SIGKILL);
+    }
+
+    // The client of the primary, while the standby follows the journal.
+    int client_fd = -1;
+    std::thread client([&]() {
+        while (!shared->order_server_up_)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        client_fd = connectClient();
+        logon(client_fd, 0);
+        for (size_t seq_num = 1; seq_num <= num_client_orders; ++seq_num)
+            sendRequest(client_fd, seq_num, makeClientOrder(seq_num));
+        for (size_t seq_num = 1; seq_num <= num_client_orders; ++seq_num) {
+            const auto response = recvResponse(client_fd);
+            ASSERT(response.seq_num_ == seq_num &&
+                       response.me_client_response_.type_ == Exchange::ClientResponseType::ACCEPTED,
+                   "Unexpected response from the primary:" + response.toString());
+        }
+        shared->client_done_ = true;
+    });
+
+    auto standby = makeMatchingEngine();
+    const auto last_seq_num = standby->runStandby(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    const auto takeover_time = Common::getCurrentNanos();
+    waitpid(primary_pid, nullptr, 0);
+    client.join();
+
+    // The order server of the standby resumes the sessions from the primary's session file, it drops the responses
+    // the standby resends which the primary's order server recorded.
+    auto order_server =
+        new Exchange::OrderServer(&client_requests, &client_responses, "lo", port, 1, 0, {}, false);
+    order_server->persistSessions(prefix + ".sessions");
+    order_server->start();
+    while (client_responses.size())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    ASSERT(standby->writeCheckpoint(prefix + "_standby.checkpoint"), "Unable to write checkpoint.");
+    printf("failover took over at seq:%zu %9.3f ms after the crash identical:%d\n", last_seq_num,
+           (takeover_time - shared->crash_time_) / 1e6,
+           readFile(prefix + "_standby.checkpoint") == readFile(prefix + "_expected.checkpoint"));
+
+    standby->start();
+    close(client_fd);
+    client_fd = connectClient();
+    const auto logged_on = logon(client_fd, num_client_orders);
+    sendRequest(client_fd, logged_on.client_order_id_, makeClientOrder(num_client_orders + 1));
+    const auto response = recvResponse(client_fd);
+    printf("client resumed expecting request seq:%zu next response seq:%zu resumed:%d\n",
+           logged_on.client_order_id_, response.seq_num_,
+           logged_on.client_order_id_ == num_client_orders + 1 && response.seq_num_ == num_client_orders + 1 &&
+               response.me_client_response_.type_ == Exchange::ClientResponseType::ACCEPTED);
+    close(client_fd);
+    delete order_server;
+
+    standby->stop();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT(standby->writeCheckpoint(prefix + "_resumed.checkpoint"), "Unable to write checkpoint.");
+    const auto expected = readFile(prefix + "_resumed.checkpoint");
+    delete standby;
+
+    // Without a standby the order books are rebuilt from the whole journal.
+    std::remove((prefix + ".checkpoint").c_str());
+    auto restarted = makeMatchingEngine();
+    size_t num_replayed = 0;
+    const auto restart_nanos = Benchmarks::timeNanos([&]() {
+        num_replayed = restarted->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    });
+    for (; client_responses.getNextToRead(); client_responses.updateReadIndex()) // the resent responses.
+        ;
+    ASSERT(restarted->writeCheckpoint(prefix + "_restarted.checkpoint"), "Unable to write checkpoint.");
+    printf("restart replayed %zu requests %9.3f ms identical:%d\n", num_replayed, restart_nanos / 1e6,
+           readFile(prefix + "_restarted.checkpoint") == expected);
+    delete restarted;
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+#include "bench_utils.h"
+
+#include "exchange/order_server/fifo_sequencer.h"
+
+/**
+ * 测量 FIFO sequencer 每个请求的排序开销：
+ * - 1、8、64 个来源，每个来源按接收时间递增写入请求，接收时间在来源之间随机交错，只计时 sequenceAndPublish()
+ * - 作为对照，同样的请求放进一个 vector 用 std::stable_sort 按接收时间排序（之前每一轮的做法），同样每个请求写一行日志
+ * - 检查发布出来的请求按接收时间递增，同一个来源的请求保持 FIFO
+ * - 突发：ME 的队列很小、所有来源都是满的，每次只发布队列里空出来的数量，不会 FATAL
+ * - fairness window：有活跃的来源是空的时候，window 以内收到的请求要等到 window 过去才发布；空的来源不活跃时马上发布
+ */
+
+namespace
+{
+/// Write num_requests requests with interleaved ascending receive times to the sources, the order id of a request is
+/// its position in its source.
+auto fillSources(Exchange::FIFOSequencer* fifo_sequencer, std::vector<Exchange::RecvTimeClientRequestLFQueue*>& sources,
+                 size_t num_requests, Nanos* now, std::vector<OrderId>* next_order_ids) {
+    for (size_t i = 0; i < num_requests; ++i) {
+        const auto source_index = static_cast<size_t>(rand()) % sources.size();
+        auto source = sources[source_index];
+        if (source->size() + 1 >= source->capacity())
+            continue;
+
+        const Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW, static_cast<ClientId>(source_index),
+                                                0, (*next_order_ids)[source_index]++, Side::BUY, 100, 10};
+        *source->getNextToWriteTo() = Exchange::RecvTimeClientRequest{*now, request, false};
+        source->updateWriteIndex();
+        fifo_sequencer->sourceReady(source_index);
+        // Some requests of different sources are received at the same time.
+        *now += rand() % 2;
+    }
+}
+
+/// Drain the requests published to the matching engine's queue, returns false if they are out of order.
+auto drain(Exchange::ClientRequestLFQueue* client_requests, std::vector<OrderId>* next_exp_order_ids) {
+    auto ok = true;
+    for (auto request = client_requests->getNextToRead(); request; request = client_requests->getNextToRead()) {
+        ok = ok && (request->order_id_ == (*next_exp_order_ids)[request->client_id_]++);
+        client_requests->updateReadIndex();
+    }
+
+    return ok;
+}
+} // namespace
+
+/// ./fifo_sequencer_benchmark [NUM_REQUESTS] [BATCH]
+int main(int argc, char** argv) {
+    const size_t num_requests = (argc > 1 ? std::atol(argv[1]) : 1000000);
+    const size_t batch = (argc > 2 ? std::atol(argv[2]) : 256);
+
+    printf("%zu requests, %zu received between sequenceAndPublish() calls\n", num_requests, batch);
+
+    Common::Logger logger("fifo_sequencer_benchmark.log");
+    srand(1);
+    for (const size_t num_sources : {1, 8, 64}) {
+        Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+        Exchange::FIFOSequencer fifo_sequencer(&client_requests, 0, &logger);
+        std::vector<Exchange::RecvTimeClientRequestLFQueue*> sources;
+        for (size_t i = 0; i < num_sources; ++i) {
+            sources.push_back(new Exchange::RecvTimeClientRequestLFQueue(Exchange::ME_MAX_PENDING_REQUESTS));
+            fifo_sequencer.addSource(sources.back());
+        }
+
+        std::vector<OrderId> next_order_ids(num_sources, 0), next_exp_order_ids(num_sources, 0);
+        Nanos now = 1, last_recv_time = 0;
+        size_t num_published = 0;
+        auto ordered = true;
+        Nanos nanos = 0;
+        while (num_published < num_requests) {
+            fillSources(&fifo_sequencer, sources, batch, &now, &next_order_ids);
+            nanos += Benchmarks::timeNanos([&]() {
+                num_published += fifo_sequencer.sequenceAndPublish([&](const Exchange::RecvTimeClientRequest& request) {
+                    ordered = ordered && (request.recv_time_ >= last_recv_time);
+                    last_recv_time = request.recv_time_;
+                    return true;
+                });
+            });
+            ordered = drain(&client_requests, &next_exp_order_ids) && ordered;
+        }
+        printf("heap merge  sources:%-3zu %9zu requests %8.1f ns/request ordered:%d\n", num_sources, num_published,
+               static_cast<double>(nanos) / num_published, ordered);
+
+        // The same batches sorted all at once, logged like the FIFO sequencer does.
+        std::string time_str;
+        std::vector<Exchange::RecvTimeClientRequest> pending;
+        pending.reserve(batch);
+        nanos = 0;
+        size_t num_sorted = 0;
+        while (num_sorted < num_requests) {
+            fillSources(&fifo_sequencer, sources, batch, &now, &next_order_ids);
+            nanos += Benchmarks::timeNanos([&]() {
+                for (auto source : sources) {
+                    for (auto request = source->getNextToRead(); request; request = source->getNextToRead()) {
+                        pending.push_back(*request);
+                        source->updateReadIndex();
+                    }
+                }
+                std::stable_sort(pending.begin(), pending.end(), [](const auto& lhs, const auto& rhs) {
+                    return lhs.recv_time_ < rhs.recv_time_;
+                });
+                for (const auto& request : pending) {
+                    logger.log("%:% %() % Writing RX:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__,
+                               Common::getCurrentTimeStr(&time_str), request.recv_time_, request.request_.toString());
+                    *client_requests.getNextToWriteTo() = request.request_;
+                    client_requests.updateWriteIndex();
+                }
+            });
+            num_sorted += pending.size();
+            pending.clear();
+            drain(&client_requests, &next_exp_order_ids);
+        }
+        printf("stable sort sources:%-3zu %9zu requests %8.1f ns/request\n", num_sources, num_sorted,
+               static_cast<double>(nanos) / num_sorted);
+
+        for (auto source : sources)
+            delete source;
+    }
+
+    // A burst filling every source while the matching engine's queue only has room for a few requests.
+    {
+        const size_t num_sources = 64, me_capacity = 256;
+        Exchange::ClientRequestLFQueue client_requests(me_capacity);
+        Exchange::FIFOSequencer fifo_sequencer(&client_requests, 0, &logger);
+        std::vector<Exchange::RecvTimeClientRequestLFQueue*> sources;
+        for (size_t i = 0; i < num_sources; ++i) {
+            sources.push_back(new Exchange::RecvTimeClientRequestLFQueue(Exchange::ME_MAX_PENDING_REQUESTS));
+            fifo_sequencer.addSource(sources.back());
+        }
+
+        std::vector<OrderId> next_order_ids(num_sources, 0), next_exp_order_ids(num_sources, 0);
+        Nanos now = 1;
+        fillSources(&fifo_sequencer, sources, num_sources * Exchange::ME_MAX_PENDING_REQUESTS * 4, &now,
+                    &next_order_ids);
+        size_t num_pending = 0;
+        for (auto source : sources)
+            num_pending += source->size();
+
+        size_t num_calls = 0, max_published = 0, num_published = 0;
+        auto ordered = true;
+        for (size_t n = 1; n; ++num_calls) {
+            n = fifo_sequencer.sequenceAndPublish([](const Exchange::RecvTimeClientRequest&) { return true; });
+            max_published = std::max(max_published, n);
+            num_published += n;
+            ordered = drain(&client_requests, &next_exp_order_ids) && ordered;
+        }
+        printf("burst       sources:%-3zu %9zu requests %zu calls, at most %zu published per call, all published:%d "
+               "ordered:%d\n",
+               num_sources, num_pending, num_calls, max_published, num_published == num_pending, ordered);
+
+        for (auto source : sources)
+            delete source;
+    }
+
+    // A fairness window holds back the recent requests while an active source has none pending.
+    {
+        const Nanos window = 2 * NANOS_TO_MILLIS;
+        Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+        Exchange::FIFOSequencer fifo_sequencer(&client_requests, window, &logger);
+        Exchange::RecvTimeClientRequestLFQueue busy(Exchange::ME_MAX_PENDING_REQUESTS),
+            idle(Exchange::ME_MAX_PENDING_REQUESTS);
+        fifo_sequencer.addSource(&busy);
+        fifo_sequencer.addSource(&idle);
+        fifo_sequencer.setSourceActive(0, true);
+        fifo_sequencer.setSourceActive(1, true);
+
+        const Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW, 0, 0, 0, Side::BUY, 100, 10};
+        const auto receive = [&]() {
+            *busy.getNextToWriteTo() = Exchange::RecvTimeClientRequest{Common::getCurrentNanos(), request, false};
+            busy.updateWriteIndex();
+            fifo_sequencer.sourceReady(0);
+        };
+        const auto publish = [](const Exchange::RecvTimeClientRequest&) { return true; };
+        receive();
+        const auto held = fifo_sequencer.sequenceAndPublish(publish);
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(3ms);
+        const auto released = fifo_sequencer.sequenceAndPublish(publish);
+
+        // The idle source's client is gone, nothing can arrive from it.
+        fifo_sequencer.setSourceActive(1, false);
+        receive();
+        const auto inactive = fifo_sequencer.sequenceAndPublish(publish);
+        printf("window %ld ns: published %zu within the window, %zu after it, %zu with the idle source inactive\n",
+               window, held, released, inactive);
+    }
+
+    exit(EXIT_SUCCESS);
+}
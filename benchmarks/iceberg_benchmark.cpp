@@ -0,0 +1,71 @@
+#include <cstdio>
+
+#include "bench_utils.h"
+
+/**
+ * 对比挂一个大单的两种方式：拆成很多个小的子订单，以及一个只显示一部分的冰山单
+ * 两种方式都在每个 ticker 上挂 TOTAL_QTY 的卖单，每次显示 / 每个子订单 DISPLAY_QTY，然后用小的 IOC 买单把它全部吃掉
+ * 记录撮合引擎挂单和被吃掉的耗时，订单簿里的订单数量，以及产生的回报 / 逐笔行情 / 价位行情的数量
+ */
+
+/// ./iceberg_benchmark [TOTAL_QTY] [DISPLAY_QTY] [TAKE_QTY]
+int main(int argc, char** argv) {
+    const Qty total_qty = (argc > 1 ? std::atol(argv[1]) : 100000);
+    const Qty display_qty = (argc > 2 ? std::atol(argv[2]) : 100);
+    const Qty take_qty = (argc > 3 ? std::atol(argv[3]) : 30);
+    const ClientId maker = 1, taker = 2;
+    const Price price = 100;
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+
+    for (const auto iceberg : {false, true}) {
+        auto matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                            &level_updates, nullptr);
+
+        OrderId maker_order_id = 0, taker_order_id = 0;
+        Benchmarks::Counts rest_counts, take_counts;
+        const auto rest_nanos = Benchmarks::timeNanos([&]() {
+            for (TickerId ticker_id = 0; ticker_id < ME_MAX_TICKERS; ++ticker_id) {
+                for (Qty qty = 0; qty < total_qty; qty += (iceberg ? total_qty : display_qty)) {
+                    Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW,
+                                                      maker,
+                                                      ticker_id,
+                                                      maker_order_id++,
+                                                      Side::SELL,
+                                                      price,
+                                                      (iceberg ? total_qty : std::min(display_qty, total_qty - qty))};
+                    request.display_qty_ = (iceberg ? display_qty : Qty_INVALID);
+                    matching_engine->processClientRequest(&request);
+                }
+            }
+        });
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, nullptr, &rest_counts);
+
+        Nanos take_nanos = 0;
+        for (TickerId ticker_id = 0; ticker_id < ME_MAX_TICKERS; ++ticker_id) {
+            for (Qty qty = 0; qty < total_qty; qty += take_qty) {
+                Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW,
+                                                  taker,
+                                                  ticker_id,
+                                                  taker_order_id++,
+                                                  Side::BUY,
+                                                  price,
+                                                  take_qty};
+                request.tif_ = Exchange::TimeInForce::IOC;
+                take_nanos += Benchmarks::timeNanos([&]() { matching_engine->processClientRequest(&request); });
+                Benchmarks::drain(&client_responses, &market_updates, &level_updates, nullptr, &take_counts);
+            }
+        }
+
+        printf("%s book orders:%-6zu rest %9.1f us responses:%-6zu market updates:%-6zu | take %9.1f us "
+               "responses:%-7zu market updates:%-7zu level updates:%zu\n",
+               (iceberg ? "iceberg     " : "child orders"), static_cast<size_t>(maker_order_id), rest_nanos / 1000.0,
+               rest_counts.responses_, rest_counts.market_updates_, take_nanos / 1000.0, take_counts.responses_,
+               take_counts.market_updates_, take_counts.level_updates_);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "bench_utils.h"
+
+/**
+ * 测量 ME write-ahead journal 的开销和重启恢复的耗时：
+ * - 每种 JournalSyncPolicy 下写 journal 的吞吐
+ * - 打开 journal 处理一段随机订单流，然后用一个新的撮合引擎从 journal 完整重放，记录每秒重放的消息数
+ * - 重放之后写 checkpoint，再用一个新的撮合引擎从 checkpoint 恢复，对比两种方式的重启耗时
+ * 恢复出来的订单簿都和原来的订单簿逐字节比较 checkpoint，保证重放是确定性的
+ */
+
+namespace
+{
+const std::string prefix = "journal_benchmark";
+
+auto removeFiles() {
+    std::remove((prefix + ".journal").c_str());
+    std::remove((prefix + ".checkpoint").c_str());
+}
+
+auto readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+/// Drain the responses and market updates published by the matching engine.
+auto drain(Exchange::ClientResponseLFQueue* client_responses, Exchange::MEMarketUpdateLFQueue* market_updates) {
+    for (; client_responses->getNextToRead(); client_responses->updateReadIndex())
+        ;
+    for (; market_updates->getNextToRead(); market_updates->updateReadIndex())
+        ;
+}
+} // namespace
+
+/// ./journal_benchmark [NUM_ORDERS] [JOURNAL_CAPACITY]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 50000);
+    const size_t capacity = (argc > 2 ? std::atol(argv[2]) : 1024 * 1024);
+
+    const auto requests = Benchmarks::makeRandomRequests(num_orders, 8, 1);
+    printf("session: %zu requests, journal capacity:%zu records (%zu bytes each)\n", requests.size(), capacity,
+           sizeof(Exchange::MEJournalRecord));
+
+    Common::Logger logger("journal_benchmark.log");
+    for (const auto sync_policy : {Exchange::JournalSyncPolicy::NONE, Exchange::JournalSyncPolicy::BATCH,
+                                   Exchange::JournalSyncPolicy::EVERY_REQUEST}) {
+        removeFiles();
+        // Syncing every request is orders of magnitude slower, only a prefix of the session is appended.
+        const auto num_appends = (sync_policy == Exchange::JournalSyncPolicy::EVERY_REQUEST
+                                      ? std::min<size_t>(requests.size(), 10000)
+                                      : std::min(requests.size(), capacity));
+        Exchange::MEJournal journal(prefix + ".journal", capacity, sync_policy, &logger);
+        journal.replay(0, [](const Exchange::MEClientRequest*) {});
+
+        const auto nanos = Benchmarks::timeNanos([&]() {
+            for (size_t i = 0; i < num_appends; ++i) {
+                journal.append(&requests[i]);
+                if (i % 64 == 63) // the matching engine ran out of requests.
+                    journal.flush();
+            }
+            journal.flush();
+        });
+        printf("append sync:%-13s %8zu records %9.1f ns/record %12.0f records/s\n",
+               Exchange::journalSyncPolicyToString(sync_policy).c_str(), num_appends,
+               static_cast<double>(nanos) / num_appends, num_appends * 1e9 / nanos);
+    }
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    auto makeMatchingEngine = [&]() {
+        return new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates, nullptr, nullptr);
+    };
+
+    // The live session, every request is journaled before it is processed.
+    removeFiles();
+    auto matching_engine = makeMatchingEngine();
+    matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    const auto live_nanos = Benchmarks::timeNanos([&]() {
+        for (const auto& request : requests) {
+            matching_engine->onClientRequest(&request);
+            drain(&client_responses, &market_updates);
+        }
+    });
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_expected.checkpoint"), "Unable to write checkpoint.");
+    delete matching_engine;
+    printf("live    %8zu requests %9.1f ms %12.0f requests/s\n", requests.size(), live_nanos / 1e6,
+           requests.size() * 1e9 / live_nanos);
+    const auto expected = readFile(prefix + "_expected.checkpoint");
+
+    // Restart without a checkpoint, the whole journal is replayed.
+    matching_engine = makeMatchingEngine();
+    size_t num_replayed = 0;
+    const auto replay_nanos = Benchmarks::timeNanos([&]() {
+        num_replayed = matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    });
+    drain(&client_responses, &market_updates); // the resent responses, a checkpoint keeps the unread ones.
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_replayed.checkpoint"), "Unable to write checkpoint.");
+    printf("replay  %8zu requests %9.1f ms %12.0f requests/s identical:%d\n", num_replayed, replay_nanos / 1e6,
+           num_replayed * 1e9 / replay_nanos, readFile(prefix + "_replayed.checkpoint") == expected);
+
+    // Checkpoint the recovered order books and restart from the checkpoint, nothing is left to replay.
+    const auto checkpoint_nanos = Benchmarks::timeNanos([&]() { matching_engine->checkpoint(); });
+    delete matching_engine;
+    printf("checkpoint %zu bytes %9.1f ms\n", readFile(prefix + ".checkpoint").size(), checkpoint_nanos / 1e6);
+
+    matching_engine = makeMatchingEngine();
+    const auto restore_nanos = Benchmarks::timeNanos([&]() {
+        num_replayed = matching_engine->enableJournal(prefix, capacity, Exchange::JournalSyncPolicy::NONE, 0);
+    });
+    drain(&client_responses, &market_updates); // the resent responses, a checkpoint keeps the unread ones.
+    ASSERT(matching_engine->writeCheckpoint(prefix + "_restored.checkpoint"), "Unable to write checkpoint.");
+    printf("restore %8zu requests %9.1f ms identical:%d\n", num_replayed, restore_nanos / 1e6,
+           readFile(prefix + "_restored.checkpoint") == expected);
+    delete matching_engine;
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,90 @@
+#include <cstdio>
+
+#include "bench_utils.h"
+
+/**
+ * 对比撤掉一个客户的所有挂单的两种方式：一个订单一个 CANCEL，以及一个 MASS_CANCEL
+ * 被撤的客户在所有 ticker 的两边都挂了 NUM_ORDERS 个不会成交的订单，另外一个客户挂了同样多的订单当背景
+ * 记录撮合引擎处理的耗时，以及产生的回报 / 逐笔行情 / 价位行情 / BBO 的数量
+ */
+
+/// ./mass_cancel_benchmark [NUM_ORDERS] [ITERATIONS]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 10000);
+    const size_t iterations = (argc > 2 ? std::atol(argv[2]) : 5);
+    const ClientId canceled_client = 1, other_client = 2;
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MEBBOUpdateLFQueue bbo_updates(ME_MAX_MARKET_UPDATES);
+    auto matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                        &level_updates, &bbo_updates);
+
+    OrderId next_order_id = 0;
+    auto restOrders = [&](ClientId client_id) {
+        for (size_t i = 0; i < num_orders; ++i) {
+            const auto side = (i % 2 ? Side::BUY : Side::SELL);
+            const Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW,
+                                                    client_id,
+                                                    static_cast<TickerId>(i % ME_MAX_TICKERS),
+                                                    next_order_id++,
+                                                    side,
+                                                    (side == Side::BUY ? 99 - static_cast<Price>(i % 50)
+                                                                       : 101 + static_cast<Price>(i % 50)),
+                                                    static_cast<Qty>(1 + i % 100)};
+            matching_engine->processClientRequest(&request);
+        }
+    };
+
+    Benchmarks::Counts discard;
+    restOrders(other_client);
+    Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &discard);
+
+    Nanos cancel_nanos = 0, mass_cancel_nanos = 0;
+    Benchmarks::Counts cancel_counts, mass_cancel_counts;
+    for (size_t i = 0; i < iterations; ++i) {
+        const auto first_order_id = next_order_id;
+        restOrders(canceled_client);
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &discard);
+        cancel_nanos += Benchmarks::timeNanos([&]() {
+            for (auto order_id = first_order_id; order_id < next_order_id; ++order_id) {
+                const Exchange::MEClientRequest request{Exchange::ClientRequestType::CANCEL,
+                                                        canceled_client,
+                                                        static_cast<TickerId>((order_id - first_order_id) %
+                                                                              ME_MAX_TICKERS),
+                                                        order_id,
+                                                        Side::INVALID,
+                                                        Price_INVALID,
+                                                        Qty_INVALID};
+                matching_engine->processClientRequest(&request);
+            }
+        });
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &cancel_counts);
+
+        restOrders(canceled_client);
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &discard);
+        mass_cancel_nanos += Benchmarks::timeNanos([&]() {
+            const Exchange::MEClientRequest request{Exchange::ClientRequestType::MASS_CANCEL,
+                                                    canceled_client,
+                                                    TickerId_INVALID,
+                                                    OrderId_INVALID,
+                                                    Side::INVALID,
+                                                    Price_INVALID,
+                                                    Qty_INVALID};
+            matching_engine->processClientRequest(&request);
+        });
+        Benchmarks::drain(&client_responses, &market_updates, &level_updates, &bbo_updates, &mass_cancel_counts);
+    }
+
+    for (const auto& [name, nanos, counts] : {std::tuple{"CANCEL x N ", cancel_nanos, cancel_counts},
+                                             std::tuple{"MASS_CANCEL", mass_cancel_nanos, mass_cancel_counts}}) {
+        printf("%s %zu orders: %10.1f us  responses:%zu market updates:%zu level updates:%zu bbo updates:%zu\n", name,
+               num_orders, nanos / 1000.0 / iterations, counts.responses_ / iterations,
+               counts.market_updates_ / iterations, counts.level_updates_ / iterations,
+               counts.bbo_updates_ / iterations);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,86 @@
+#include <cstdio>
+
+#include "exchange/market_data/md_codec.h"
+
+#include "bench_utils.h"
+
+/**
+ * 对比 MDPMarketUpdate 原始结构和紧凑编码的线上字节数，并测量编码 / 解码的吞吐
+ * 发布端每个循环会把当前 frame 发送出去，所以 frame 里的 update 数量取决于负载，这里分别测几种 batch 大小
+ */
+
+/// Encode the updates with at most batch_size updates per frame into frames, returns the total encoded size.
+static auto encodeAll(const std::vector<Exchange::MEMarketUpdate>& updates, size_t batch_size, std::vector<char>* out) {
+    Exchange::MDPEncoder encoder;
+    std::array<char, Exchange::MD_MAX_FRAME_SIZE> frame;
+    size_t frame_updates = 0;
+
+    out->clear();
+    for (size_t i = 0; i < updates.size(); ++i) {
+        if (encoder.full() || frame_updates == batch_size) {
+            const auto frame_size = encoder.finish(frame.data());
+            out->insert(out->end(), frame.data(), frame.data() + frame_size);
+            frame_updates = 0;
+        }
+        encoder.add(i + 1, &updates[i]);
+        ++frame_updates;
+    }
+    const auto frame_size = encoder.finish(frame.data());
+    out->insert(out->end(), frame.data(), frame.data() + frame_size);
+
+    return out->size();
+}
+
+/// ./md_codec_benchmark [NUM_ORDERS] [ITERATIONS]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 200000);
+    const size_t iterations = (argc > 2 ? std::atol(argv[2]) : 10);
+
+    const auto requests = Benchmarks::makeRandomRequests(num_orders, 8, 1);
+    const auto updates = Benchmarks::recordMarketUpdates(requests);
+    const auto raw_size = updates.size() * sizeof(Exchange::MDPMarketUpdate);
+    printf("session: %zu requests -> %zu market updates, raw MDPMarketUpdate %zu bytes (%zu bytes/update)\n",
+           requests.size(), updates.size(), raw_size, sizeof(Exchange::MDPMarketUpdate));
+
+    std::vector<char> encoded;
+    encoded.reserve(raw_size);
+    for (const size_t batch_size : {size_t{1}, size_t{16}, updates.size()}) {
+        const auto encoded_size = encodeAll(updates, batch_size, &encoded);
+
+        // Verify the round trip before timing anything.
+        size_t num_decoded = 0, num_mismatched = 0;
+        const auto consumed = Exchange::decodeMDPFrames(
+            encoded.data(), encoded.size(), [&](const Exchange::MDPMarketUpdate* update) {
+                const auto& expected = updates[num_decoded];
+                const auto& decoded = update->me_market_update_;
+                num_mismatched += (update->seq_num_ != num_decoded + 1 || decoded.type_ != expected.type_ ||
+                                   decoded.order_id_ != expected.order_id_ ||
+                                   decoded.ticker_id_ != expected.ticker_id_ || decoded.side_ != expected.side_ ||
+                                   decoded.price_ != expected.price_ || decoded.qty_ != expected.qty_ ||
+                                   decoded.priority_ != expected.priority_);
+                ++num_decoded;
+            });
+        if (consumed != encoded.size() || num_decoded != updates.size() || num_mismatched)
+            FATAL("Round trip failed batch:" + std::to_string(batch_size) + " decoded:" + std::to_string(num_decoded) +
+                  " mismatched:" + std::to_string(num_mismatched));
+
+        Nanos encode_nanos = 0, decode_nanos = 0;
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            encode_nanos += Benchmarks::timeNanos([&]() { encodeAll(updates, batch_size, &encoded); });
+            decode_nanos += Benchmarks::timeNanos([&]() {
+                Exchange::decodeMDPFrames(encoded.data(), encoded.size(), [&](const Exchange::MDPMarketUpdate* update) {
+                    checksum += update->seq_num_;
+                });
+            });
+        }
+
+        const auto total_updates = static_cast<double>(updates.size() * iterations);
+        printf("batch:%-7zu compact %9zu bytes (%5.2f bytes/update, %5.1f%% of raw) encode %6.2f ns/update "
+               "decode %6.2f ns/update checksum:%zu\n",
+               std::min(batch_size, updates.size()), encoded_size, static_cast<double>(encoded_size) / updates.size(),
+               100.0 * encoded_size / raw_size, encode_nanos / total_updates, decode_nanos / total_updates, checksum);
+    }
+
+    exit(EXIT_SUCCESS);
+}
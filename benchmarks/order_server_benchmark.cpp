@@ -0,0 +1,185 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench_utils.h"
+
+#include "exchange/order_server/order_server.h"
+
+/**
+ * 测量 order server 在不同网络线程数下的吞吐：
+ * - 一个回显线程代替撮合引擎，对每个请求回一个 ACCEPTED，只测量 order server 本身
+ * - NUM_CLIENTS 个客户各自一个 TCP 连接，每个客户最多同时有 WINDOW 个请求没有收到回报
+ * - 每种网络线程数跑 SECONDS 秒，记录每秒完成的请求数，并检查每个客户收到的回报序号连续、ClientId 正确
+ * - THROTTLE 大于 0 时每个客户每秒最多 THROTTLE 个请求（可以连续发 WINDOW 个），记录被拒绝的请求数
+ * - BACKEND 是 io_uring 时 order server 用 io_uring 收发，否则用 epoll
+ * 网络线程多于 1 个时还有一个 sequencer 线程，所以核数不够的机器上看不到扩展性
+ */
+
+namespace
+{
+/// A client session, a non-blocking loopback TCP connection to the order server.
+struct Client {
+    ClientId client_id_ = ClientId_INVALID;
+    int fd_ = -1;
+    size_t next_seq_num_ = 1;
+    size_t next_exp_seq_num_ = 1;
+    size_t num_outstanding_ = 0;
+    size_t num_bad_responses_ = 0;
+    size_t num_rejected_ = 0;
+
+    std::vector<char> inbound_data_ = std::vector<char>(1024 * 1024);
+    size_t next_rcv_valid_index_ = 0;
+};
+
+auto connectClient(Client* client, int port) {
+    client->fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT(client->fd_ >= 0, "socket() failed. error:" + std::string(std::strerror(errno)));
+    const sockaddr_in addr{AF_INET, htons(port), {htonl(INADDR_LOOPBACK)}, {}};
+    ASSERT(connect(client->fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0,
+           "connect() failed. error:" + std::string(std::strerror(errno)));
+    ASSERT(Common::setNonBlocking(client->fd_) && Common::disableNagle(client->fd_),
+           "Failed to set non-blocking or no-delay on client socket.");
+}
+
+/// Fill the client's window with NEW requests.
+auto sendRequests(Client* client, size_t window) {
+    std::array<Exchange::OMClientRequest, 64> requests;
+    size_t num_requests = 0;
+    for (; client->num_outstanding_ + num_requests < window && num_requests < requests.size(); ++num_requests) {
+        auto& request = requests[num_requests];
+        request.seq_num_ = client->next_seq_num_ + num_requests;
+        request.me_client_request_ = {Exchange::ClientRequestType::NEW, client->client_id_, 0,
+                                      client->next_seq_num_ + num_requests, Side::BUY, 100, 10};
+    }
+    if (!num_requests)
+        return;
+
+    const auto n = ::send(client->fd_, requests.data(), num_requests * sizeof(Exchange::OMClientRequest),
+                          MSG_DONTWAIT | MSG_NOSIGNAL);
+    // Only whole requests are ever written, a partial write would need the rest to be kept around.
+    ASSERT(n < 0 || static_cast<size_t>(n) == num_requests * sizeof(Exchange::OMClientRequest),
+           "Partial write of client requests:" + std::to_string(n));
+    if (n > 0) {
+        client->next_seq_num_ += num_requests;
+        client->num_outstanding_ += num_requests;
+    }
+}
+
+/// Read the responses available to the client, returns the number of responses read.
+auto recvResponses(Client* client) {
+    const auto n = recv(client->fd_, client->inbound_data_.data() + client->next_rcv_valid_index_,
+                        client->inbound_data_.size() - client->next_rcv_valid_index_, MSG_DONTWAIT);
+    if (n <= 0)
+        return size_t{0};
+    client->next_rcv_valid_index_ += n;
+
+    size_t i = 0, num_responses = 0;
+    for (; i + sizeof(Exchange::OMClientResponse) <= client->next_rcv_valid_index_;
+         i += sizeof(Exchange::OMClientResponse), ++num_responses) {
+        auto response = reinterpret_cast<const Exchange::OMClientResponse*>(client->inbound_data_.data() + i);
+        if (response->seq_num_ != client->next_exp_seq_num_ ||
+            response->me_client_response_.client_id_ != client->client_id_)
+            ++client->num_bad_responses_;
+        if (response->me_client_response_.type_ == Exchange::ClientResponseType::REJECTED)
+            ++client->num_rejected_;
+        ++client->next_exp_seq_num_;
+    }
+    memmove(client->inbound_data_.data(), client->inbound_data_.data() + i, client->next_rcv_valid_index_ - i);
+    client->next_rcv_valid_index_ -= i;
+    client->num_outstanding_ -= num_responses;
+
+    return num_responses;
+}
+} // namespace
+
+/// ./order_server_benchmark [NUM_CLIENTS] [SECONDS] [WINDOW] [THROTTLE] [BACKEND]
+int main(int argc, char** argv) {
+    const size_t num_clients = (argc > 1 ? std::atol(argv[1]) : 8);
+    const double seconds = (argc > 2 ? std::atof(argv[2]) : 2);
+    const size_t window = (argc > 3 ? std::atol(argv[3]) : 64);
+    const size_t throttle = (argc > 4 ? std::atol(argv[4]) : 0);
+    const auto tcp_backend = (argc > 5 && std::string(argv[5]) == "io_uring" ? Common::TCPBackend::IO_URING
+                                                                              : Common::TCPBackend::EPOLL);
+    ASSERT(num_clients >= 1 && num_clients <= ME_MAX_NUM_CLIENTS, "Invalid number of clients.");
+
+    printf("%zu clients, %zu outstanding requests each, %.1f s per run, throttle:%zu requests/s, backend:%s, "
+           "%u cores\n",
+           num_clients, window, seconds, throttle, Common::tcpBackendToString(tcp_backend).c_str(),
+           std::thread::hardware_concurrency());
+
+    const int base_port = 12400;
+    for (const size_t num_network_threads : {1, 2, 4}) {
+        Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+        Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+
+        // Stands in for the matching engine, every request is accepted.
+        std::atomic<bool> echo_running{true};
+        std::thread echo([&]() {
+            while (echo_running) {
+                for (auto request = client_requests.getNextToRead(); request;
+                     request = client_requests.getNextToRead()) {
+                    *client_responses.getNextToWriteTo() = {Exchange::ClientResponseType::ACCEPTED,
+                                                            request->client_id_,
+                                                            request->ticker_id_,
+                                                            request->order_id_,
+                                                            request->order_id_,
+                                                            request->side_,
+                                                            request->price_,
+                                                            0,
+                                                            request->qty_};
+                    client_responses.updateWriteIndex();
+                    client_requests.updateReadIndex();
+                }
+            }
+        });
+
+        // A new port for every run, the listeners of the previous order server are never closed.
+        const int port = base_port + static_cast<int>(num_network_threads);
+        auto order_server = new Exchange::OrderServer(&client_requests, &client_responses, "lo", port,
+                                                      num_network_threads, 0, {throttle, window}, true, tcp_backend);
+        order_server->start();
+
+        std::vector<Client> clients(num_clients);
+        for (size_t i = 0; i < num_clients; ++i) {
+            clients[i].client_id_ = static_cast<ClientId>(i);
+            connectClient(&clients[i], port);
+        }
+
+        size_t num_responses = 0;
+        const auto nanos = Benchmarks::timeNanos([&]() {
+            const auto end = Common::getCurrentNanos() + static_cast<Nanos>(seconds * 1e9);
+            while (Common::getCurrentNanos() < end) {
+                for (auto& client : clients) {
+                    sendRequests(&client, window);
+                    num_responses += recvResponses(&client);
+                }
+            }
+        });
+
+        size_t num_bad_responses = 0, num_rejected = 0, num_throttled = 0;
+        for (auto& client : clients) {
+            num_bad_responses += client.num_bad_responses_;
+            num_rejected += client.num_rejected_;
+            num_throttled += order_server->throttleStats(client.client_id_).num_throttled_;
+            close(client.fd_);
+        }
+        // Let the order server close the sessions and free their buffers before it is stopped.
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(500ms);
+        printf("network threads:%zu %10zu requests %12.0f requests/s bad responses:%zu rejected:%zu throttled:%zu\n",
+               num_network_threads, num_responses, num_responses * 1e9 / nanos, num_bad_responses, num_rejected,
+               num_throttled);
+
+        delete order_server;
+        echo_running = false;
+        echo.join();
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,72 @@
+#include <cstdio>
+
+#include "bench_utils.h"
+
+/**
+ * 测量挂着的停止单对撮合的开销：同一段随机订单流，分别在没有停止单和挂着 NUM_STOPS 个不会被触发的停止单的情况下处理
+ * 停止单在触发索引（堆）里，没有被触发之前每个请求只看两边的堆顶，所以两者的耗时应该一样
+ * 另外记录挂单（入堆）和撤掉所有停止单的耗时
+ */
+
+/// ./stop_order_benchmark [NUM_ORDERS] [NUM_STOPS]
+int main(int argc, char** argv) {
+    const size_t num_orders = (argc > 1 ? std::atol(argv[1]) : 50000);
+    const size_t num_stops = (argc > 2 ? std::atol(argv[2]) : 60000);
+    const ClientId stop_client = 100;
+
+    const auto requests = Benchmarks::makeRandomRequests(num_orders, 8, 1);
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+
+    Benchmarks::Counts discard;
+    for (const auto with_stops : {false, true}) {
+        auto matching_engine =
+            new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates, nullptr, nullptr);
+
+        // Buy stops far above and sell stops far below every price in the session, spread over every ticker.
+        Nanos park_nanos = 0;
+        if (with_stops) {
+            for (size_t i = 0; i < num_stops; ++i) {
+                const auto side = (i % 2 ? Side::BUY : Side::SELL);
+                const Exchange::MEClientRequest request{Exchange::ClientRequestType::NEW,
+                                                        stop_client,
+                                                        static_cast<TickerId>(i % ME_MAX_TICKERS),
+                                                        i,
+                                                        side,
+                                                        Price_INVALID,
+                                                        1,
+                                                        Exchange::TimeInForce::DAY,
+                                                        Exchange::OrderType::STOP,
+                                                        (side == Side::BUY ? 10000 + static_cast<Price>(i)
+                                                                           : 50 - static_cast<Price>(i % 50))};
+                park_nanos += Benchmarks::timeNanos([&]() { matching_engine->processClientRequest(&request); });
+                Benchmarks::drain(&client_responses, &market_updates, nullptr, nullptr, &discard);
+            }
+        }
+
+        Nanos session_nanos = 0;
+        for (const auto& request : requests) {
+            session_nanos += Benchmarks::timeNanos([&]() { matching_engine->processClientRequest(&request); });
+            Benchmarks::drain(&client_responses, &market_updates, nullptr, nullptr, &discard);
+        }
+
+        const Exchange::MEClientRequest mass_cancel{Exchange::ClientRequestType::MASS_CANCEL,
+                                                    stop_client,
+                                                    TickerId_INVALID,
+                                                    OrderId_INVALID,
+                                                    Side::INVALID,
+                                                    Price_INVALID,
+                                                    Qty_INVALID};
+        const auto cancel_nanos =
+            Benchmarks::timeNanos([&]() { matching_engine->processClientRequest(&mass_cancel); });
+        Benchmarks::drain(&client_responses, &market_updates, nullptr, nullptr, &discard);
+
+        printf("parked stops:%-6zu session %zu requests %8.1f ns/request  park %8.1f ns/stop  mass cancel %9.1f us\n",
+               (with_stops ? num_stops : 0), requests.size(), static_cast<double>(session_nanos) / requests.size(),
+               (with_stops ? static_cast<double>(park_nanos) / num_stops : 0.0), cancel_nanos / 1000.0);
+    }
+
+    exit(EXIT_SUCCESS);
+}
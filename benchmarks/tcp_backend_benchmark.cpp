@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "bench_utils.h"
+
+#include "common/tcp_server.h"
+#include "exchange/order_server/client_request.h"
+
+/**
+ * 比较 TCPServer / TCPSocket 的 epoll 和 io_uring 两种实现，服务端、客户端都在同一个线程里轮询，没有线程切换：
+ * - ping-pong：一个客户每次发一个请求大小的消息，服务端原样发回，记录往返时间的分位数和每条消息的系统调用数
+ * - fan-in：NUM_CLIENTS 个客户，每个客户最多同时有 WINDOW 条消息没有收到回复，记录吞吐和每条消息的系统调用数
+ * epoll 实现每一轮每个连接至少一次 recvmsg()；io_uring 实现每一轮所有连接最多一次 io_uring_enter()
+ */
+
+namespace
+{
+using Message = Exchange::OMClientRequest;
+
+/// A client connection of the benchmark, the send time of every message travels in its seq_num_.
+struct Client {
+    explicit Client(Common::Logger& logger, Common::TCPBackend backend) : socket_(logger, backend) {
+    }
+
+    Common::TCPSocket socket_;
+    size_t num_outstanding_ = 0;
+    size_t num_received_ = 0;
+    std::vector<Nanos> round_trips_;
+};
+
+/// Call back with every complete message in the socket's receive buffer and drop them.
+template<typename F>
+auto forEachMessage(Common::TCPSocket* socket, F&& fn) {
+    size_t i = 0;
+    for (; i + sizeof(Message) <= socket->next_rcv_valid_index_; i += sizeof(Message))
+        fn(reinterpret_cast<const Message*>(socket->inbound_data_.data() + i));
+    memmove(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+    socket->next_rcv_valid_index_ -= i;
+}
+
+auto sendMessage(Client* client) {
+    Message message{};
+    message.seq_num_ = static_cast<size_t>(Common::getCurrentNanos());
+    client->socket_.send(&message, sizeof(message));
+    ++client->num_outstanding_;
+}
+
+auto percentile(std::vector<Nanos>& round_trips, double p) {
+    std::sort(round_trips.begin(), round_trips.end());
+    return round_trips[static_cast<size_t>(p * (round_trips.size() - 1))];
+}
+} // namespace
+
+/// ./tcp_backend_benchmark [NUM_MESSAGES] [NUM_CLIENTS] [WINDOW]
+int main(int argc, char** argv) {
+    const size_t num_messages = (argc > 1 ? std::atol(argv[1]) : 100000);
+    const size_t num_clients = (argc > 2 ? std::atol(argv[2]) : 8);
+    const size_t window = (argc > 3 ? std::atol(argv[3]) : 8);
+
+    printf("%zu messages of %zu bytes, fan-in of %zu clients with %zu outstanding messages each\n", num_messages,
+           sizeof(Message), num_clients, window);
+
+    int port = 12600;
+    for (const auto backend : {Common::TCPBackend::EPOLL, Common::TCPBackend::IO_URING}) {
+        const auto backend_str = Common::tcpBackendToString(backend);
+        Common::Logger logger("tcp_backend_benchmark_" + backend_str + ".log");
+
+        // Echoes every message back to its sender.
+        Common::TCPServer server(logger, backend);
+        server.recv_callback_ = [](auto socket, auto) {
+            forEachMessage(socket, [socket](const Message* message) { socket->send(message, sizeof(*message)); });
+        };
+        server.recv_finished_callback_ = []() {};
+        size_t num_disconnected = 0;
+        server.disconnect_callback_ = [&num_disconnected](auto) { ++num_disconnected; };
+        server.listen("lo", ++port);
+
+        std::vector<Client*> clients;
+        for (size_t i = 0; i < num_clients; ++i) {
+            auto client = new Client(logger, backend);
+            client->round_trips_.reserve(num_messages);
+            client->socket_.recv_callback_ = [client](auto socket, auto) {
+                const auto now = Common::getCurrentNanos();
+                forEachMessage(socket, [client, now](const Message* message) {
+                    client->round_trips_.push_back(now - static_cast<Nanos>(message->seq_num_));
+                    --client->num_outstanding_;
+                    ++client->num_received_;
+                });
+            };
+            ASSERT(client->socket_.connect("127.0.0.1", "lo", port, false) >= 0,
+                   "Client failed to connect. error:" + std::string(std::strerror(errno)));
+            clients.push_back(client);
+        }
+
+        const auto poll = [&]() {
+            server.poll();
+            server.sendAndRecv();
+            for (auto client : clients)
+                client->socket_.sendAndRecv();
+        };
+        const auto numSyscalls = [&]() {
+            size_t num_server = server.numSyscalls(), num_client = 0;
+            for (auto client : clients)
+                num_client += client->socket_.numSyscalls();
+            return std::make_pair(num_server, num_client);
+        };
+
+        // Every connection is accepted and has seen a round trip before measuring.
+        for (auto client : clients) {
+            sendMessage(client);
+            while (client->num_outstanding_)
+                poll();
+            client->round_trips_.clear();
+        }
+
+        // A single connection, one message at a time.
+        {
+            auto client = clients.front();
+            const auto [server_start, client_start] = numSyscalls();
+            for (size_t i = 0; i < num_messages; ++i) {
+                sendMessage(client);
+                while (client->num_outstanding_)
+                    poll();
+            }
+            const auto [server_end, client_end] = numSyscalls();
+            printf("%-8s ping-pong p50:%6ld ns p99:%6ld ns p99.9:%7ld ns syscalls/message server:%5.2f client:%5.2f\n",
+                   backend_str.c_str(), percentile(client->round_trips_, 0.5), percentile(client->round_trips_, 0.99),
+                   percentile(client->round_trips_, 0.999),
+                   static_cast<double>(server_end - server_start) / num_messages,
+                   static_cast<double>(client_end - client_start) / num_messages);
+        }
+
+        // Every connection keeps its window full.
+        {
+            for (auto client : clients)
+                client->num_received_ = 0;
+            const auto [server_start, client_start] = numSyscalls();
+            size_t num_sent = 0, num_received = 0;
+            const auto nanos = Benchmarks::timeNanos([&]() {
+                while (num_received < num_messages) {
+                    num_received = 0;
+                    for (auto client : clients) {
+                        while (client->num_outstanding_ < window && num_sent < num_messages) {
+                            sendMessage(client);
+                            ++num_sent;
+                        }
+                        num_received += client->num_received_;
+                    }
+                    poll();
+                }
+            });
+            const auto [server_end, client_end] = numSyscalls();
+            printf("%-8s fan-in %10.0f messages/s syscalls/message server:%5.2f client:%5.2f\n", backend_str.c_str(),
+                   num_received * 1e9 / nanos, static_cast<double>(server_end - server_start) / num_received,
+                   static_cast<double>(client_end - client_start) / num_received);
+        }
+
+        // Every TCPSocket holds 128MB of buffers, the server's are only freed once it saw the connections close.
+        for (auto client : clients) {
+            client->socket_.close();
+            delete client;
+        }
+        while (num_disconnected < num_clients) {
+            server.poll();
+            server.sendAndRecv();
+        }
+    }
+
+    exit(EXIT_SUCCESS);
+}
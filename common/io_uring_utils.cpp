@@ -0,0 +1,95 @@
+#include "io_uring_utils.h"
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Common
+{
+/// Set up a ring with sq_entries submission queue entries and four times as many completion queue entries.
+IoUring::IoUring(unsigned sq_entries) {
+    /* SUBMIT_ALL：一个 SQE 出错也继续提交后面的，错误只出现在各自的 CQE 里 */
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = sq_entries * 4;
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, sq_entries, &params));
+    ASSERT(ring_fd_ >= 0, "io_uring_setup() failed error:" + std::string(std::strerror(errno)));
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    ASSERT(sq_ring_ != MAP_FAILED, "mmap() of the submission queue failed error:" + std::string(std::strerror(errno)));
+    cq_ring_ = (single_mmap ? sq_ring_
+                            : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                   ring_fd_, IORING_OFF_CQ_RING));
+    ASSERT(cq_ring_ != MAP_FAILED, "mmap() of the completion queue failed error:" + std::string(std::strerror(errno)));
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(
+        mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    ASSERT(sqes_ != MAP_FAILED, "mmap() of the submission queue entries failed error:" +
+                                    std::string(std::strerror(errno)));
+
+    auto sq_ring = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+    sq_flags_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.flags);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = sqe_submitted_ = *sq_tail_;
+    /* 提交队列的第 i 个位置永远是第 i 个 SQE，只需要移动 tail */
+    auto sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i)
+        sq_array[i] = i;
+
+    auto cq_ring = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+}
+
+/// Submit all the queued submission queue entries with a single io_uring_enter() and wait for min_complete
+/// completions, returns the number of entries submitted or -errno. Makes no system call if there is nothing to submit,
+/// wait for or flush from an overflown completion queue.
+auto IoUring::submit(unsigned min_complete) noexcept -> int {
+    const auto num_sqes = sqe_tail_ - sqe_submitted_;
+    /* 完成队列满了之后内核把 CQE 暂存起来，要进入一次内核才会写回完成队列 */
+    const auto cq_overflow = (std::atomic_ref<unsigned>(*sq_flags_).load(std::memory_order_relaxed) &
+                              IORING_SQ_CQ_OVERFLOW);
+    if (LIKELY(!num_sqes && !min_complete && !cq_overflow))
+        return 0;
+
+    std::atomic_ref<unsigned>(*sq_tail_).store(sqe_tail_, std::memory_order_release);
+    ++num_syscalls_;
+    const auto n =
+        static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, num_sqes, min_complete,
+                                 ((min_complete || cq_overflow) ? IORING_ENTER_GETEVENTS : 0), nullptr, 0));
+    if (n < 0)
+        return -errno;
+
+    sqe_submitted_ += static_cast<unsigned>(n);
+    return n;
+}
+
+/// io_uring_register() for the ring, returns its result or -errno.
+auto IoUring::registerOp(unsigned opcode, const void* arg, unsigned nr_args) noexcept -> int {
+    ++num_syscalls_;
+    const auto n = static_cast<int>(syscall(__NR_io_uring_register, ring_fd_, opcode, arg, nr_args));
+    return (n < 0 ? -errno : n);
+}
+} // namespace Common
@@ -0,0 +1,102 @@
+#pragma once
+
+/**
+ * io_uring 的一层很薄的封装，直接用系统调用和内核的 uapi 头文件，不依赖 liburing
+ * - 提交队列和完成队列都 mmap 到用户态，准备 SQE、读取 CQE 都不需要系统调用
+ * - submit() 用一次 io_uring_enter() 提交所有准备好的 SQE
+ * - 不用 COOP_TASKRUN / DEFER_TASKRUN：内核在线程回到用户态时就把完成事件写进 CQ，忙轮询的线程不进入内核也能看到 CQE
+ * - 不用 SINGLE_ISSUER：ring 可以在一个线程里创建、在另一个线程里使用
+ */
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include <linux/io_uring.h>
+
+#include "macros.h"
+
+namespace Common
+{
+class IoUring {
+public:
+    /// Set up a ring with sq_entries submission queue entries and four times as many completion queue entries.
+    explicit IoUring(unsigned sq_entries);
+
+    ~IoUring();
+
+    /// The next free submission queue entry, zeroed. The queued entries are submitted first if the queue is full.
+    auto getSqe() noexcept -> io_uring_sqe* {
+        if (UNLIKELY(sqe_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) >= sq_entries_))
+            submit();
+
+        auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /// Submit all the queued submission queue entries with a single io_uring_enter() and wait for min_complete
+    /// completions, returns the number of entries submitted or -errno. Makes no system call if there is nothing to
+    /// submit, wait for or flush from an overflown completion queue.
+    auto submit(unsigned min_complete = 0) noexcept -> int;
+
+    /// Call fn(const io_uring_cqe&) for every completion queue entry available and mark them consumed, returns how
+    /// many there were. fn may queue new submission queue entries.
+    template<typename F>
+    auto forEachCqe(F&& fn) noexcept -> unsigned {
+        auto head = *cq_head_;
+        const auto tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+        const auto num_cqes = tail - head;
+        for (; head != tail; ++head)
+            fn(cqes_[head & cq_mask_]);
+
+        std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+        return num_cqes;
+    }
+
+    /// io_uring_register() for the ring, returns its result or -errno.
+    auto registerOp(unsigned opcode, const void* arg, unsigned nr_args) noexcept -> int;
+
+    /// Number of system calls made on the ring, io_uring_enter() and io_uring_register().
+    auto numSyscalls() const noexcept {
+        return num_syscalls_;
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    IoUring() = delete;
+    IoUring(const IoUring&) = delete;
+    IoUring(const IoUring&&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&&) = delete;
+
+private:
+    int ring_fd_ = -1;
+
+    /// Mappings of the submission queue ring, the completion queue ring (the same one with IORING_FEAT_SINGLE_MMAP)
+    /// and the submission queue entries.
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    /// Submission queue, sqe_tail_ counts the entries handed out by getSqe() and sqe_submitted_ the ones submitted.
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_flags_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;
+    unsigned sqe_submitted_ = 0;
+
+    /// Completion queue.
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    size_t num_syscalls_ = 0;
+};
+} // namespace Common
@@ -37,6 +37,21 @@ public:
         return num_elements_.load();
     }
 
+    /// Maximum number of elements, writing to a full queue overwrites the oldest element.
+    auto capacity() const noexcept {
+        return store_.size();
+    }
+
+    /// Call fn(const T&) for every element written and not read yet in FIFO order, only safe from the writing thread.
+    /// The reader may consume them meanwhile, so the first ones may already have been read.
+    template<typename F>
+    auto forEachUnread(F&& fn) const noexcept {
+        const auto num_unread = num_elements_.load();
+        const auto first_index = next_write_index_ + store_.size() - num_unread;
+        for (size_t i = 0; i < num_unread; ++i)
+            fn(store_[(first_index + i) % store_.size()]);
+    }
+
     /// Deleted default, copy & move constructors and assignment-operators.
     LFQueue() = delete;
     LFQueue(const LFQueue&) = delete;
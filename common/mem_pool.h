@@ -21,7 +21,8 @@ public:
     template <typename... Args>
     T* allocate(Args... args) noexcept {
         auto obj_block = &(store_[next_free_index_]);
-        ASSERT(obj_block->is_free_, "Expected free ObjectBlock at index:" + std::to_string(next_free_index_));
+        if (UNLIKELY(!obj_block->is_free_)) // message only built on failure, this is on every allocation.
+            FATAL("Expected free ObjectBlock at index:" + std::to_string(next_free_index_));
         T* ret = &(obj_block->object_);
         ret = new (ret) T(args...); // placement new.
         obj_block->is_free_ = false;
@@ -35,9 +36,10 @@ public:
     /// Destructor is not called for the object.
     auto deallocate(const T* elem) noexcept {
         const auto elem_index = (reinterpret_cast<const ObjectBlock*>(elem) - &store_[0]);
-        ASSERT(elem_index >= 0 && static_cast<size_t>(elem_index) < store_.size(),
-               "Element being deallocated does not belong to this Memory pool.");
-        ASSERT(!store_[elem_index].is_free_, "Expected in-use ObjectBlock at index:" + std::to_string(elem_index));
+        if (UNLIKELY(elem_index < 0 || static_cast<size_t>(elem_index) >= store_.size()))
+            FATAL("Element being deallocated does not belong to this Memory pool.");
+        if (UNLIKELY(store_[elem_index].is_free_))
+            FATAL("Expected in-use ObjectBlock at index:" + std::to_string(elem_index));
         store_[elem_index].is_free_ = true;
     }
 
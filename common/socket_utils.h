@@ -28,11 +28,13 @@ struct SocketCfg {
     bool is_udp_ = false;
     bool is_listening_ = false;
     bool needs_so_timestamp_ = false;
+    bool reuse_port_ = false; ///< listening sockets only, several sockets can listen on the same port.
 
     auto toString() const {
         std::stringstream ss;
         ss << "SocketCfg[ip:" << ip_ << " iface:" << iface_ << " port:" << port_ << " is_udp:" << is_udp_
-           << " is_listening:" << is_listening_ << " needs_SO_timestamp:" << needs_so_timestamp_ << "]";
+           << " is_listening:" << is_listening_ << " needs_SO_timestamp:" << needs_so_timestamp_
+           << " reuse_port:" << reuse_port_ << "]";
 
         return ss.str();
     }
@@ -69,6 +71,13 @@ inline auto setNonBlocking(int fd) -> bool {
     return (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1);
 }
 
+/// Configure a socket to be blocking, io_uring waits for data / connections on it without a busy loop.
+inline auto setBlocking(int fd) -> bool {
+    const auto flags = fcntl(fd, F_GETFL, 0);
+    if (!(flags & O_NONBLOCK)) return true;
+    return (fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) != -1);
+}
+
 /// Disable Nagle's algorithm and associated delays.
 inline auto disableNagle(int fd) -> bool {
     int one = 1;
@@ -139,6 +148,13 @@ inline auto join(int fd, const std::string& ip) -> bool {
                    "setsockopt() SO_REUSEADDR failed. errno:" + std::string(strerror(errno)));
         }
 
+        /* 内核按连接的四元组把新连接分给监听同一个端口的各个 socket */
+        if (socket_cfg.is_listening_ && socket_cfg.reuse_port_) { // allow several sockets to listen on the port.
+            ASSERT(setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&one), sizeof(one)) ==
+                       0,
+                   "setsockopt() SO_REUSEPORT failed. errno:" + std::string(strerror(errno)));
+        }
+
         if (socket_cfg.is_listening_) {
             // bind to the specified port number.
             const sockaddr_in addr{AF_INET, htons(socket_cfg.port_), {htonl(INADDR_ANY)}, {}};
@@ -0,0 +1,371 @@
+#include "tcp_ring.h"
+
+#include <algorithm>
+
+#include <sys/mman.h>
+
+namespace Common
+{
+static_assert(alignof(TCPSocket) > 3, "The low bits of a TCPSocket* carry the request of a completion.");
+
+TCPRing::TCPRing(Logger& logger) : ring_(TCPRingEntries), logger_(logger) {
+    /* 注册一张空的 fd 表，每个连接占一个位置 */
+    io_uring_rsrc_register sparse{};
+    sparse.nr = TCPRingMaxSockets;
+    sparse.flags = IORING_RSRC_REGISTER_SPARSE;
+    auto rc = ring_.registerOp(IORING_REGISTER_FILES2, &sparse, sizeof(sparse));
+    ASSERT(rc >= 0, "Unable to register files. error:" + std::string(std::strerror(-rc)));
+
+    buffers_.resize(TCPRingNumBuffers * TCPRingBufferSize);
+    const auto buffer_ring_size = TCPRingNumBuffers * sizeof(io_uring_buf);
+    auto buffer_ring = mmap(nullptr, buffer_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    ASSERT(buffer_ring != MAP_FAILED, "mmap() of the buffer ring failed error:" + std::string(std::strerror(errno)));
+    buffer_ring_ = static_cast<io_uring_buf_ring*>(buffer_ring);
+    io_uring_buf_reg buffer_reg{};
+    buffer_reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+    buffer_reg.ring_entries = TCPRingNumBuffers;
+    buffer_reg.bgid = 0;
+    rc = ring_.registerOp(IORING_REGISTER_PBUF_RING, &buffer_reg, 1);
+    ASSERT(rc >= 0, "Unable to register the buffer ring. error:" + std::string(std::strerror(-rc)));
+    for (unsigned buffer_id = 0; buffer_id < TCPRingNumBuffers; ++buffer_id)
+        recycleBuffer(buffer_id);
+
+    for (int slot = TCPRingMaxSockets - 1; slot >= 0; --slot)
+        free_slots_.push_back(slot);
+    sockets_.reserve(TCPRingMaxSockets);
+    closing_sockets_.reserve(TCPRingMaxSockets);
+    ready_sockets_.reserve(TCPRingMaxSockets);
+}
+
+/// Cancels every request in flight and waits for them to complete, so the kernel no longer touches any buffer.
+TCPRing::~TCPRing() {
+    destroying_ = true;
+    accept_callback_ = nullptr;
+    lost_callback_ = nullptr;
+    if (num_ops_) {
+        auto sqe = ring_.getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = userData(nullptr, Op::CANCEL);
+        while (num_ops_) {
+            ring_.submit(1);
+            reap();
+        }
+    }
+    munmap(buffer_ring_, TCPRingNumBuffers * sizeof(io_uring_buf));
+}
+
+/// Accept connections on the listening socket, calling accept_callback_ with each new file descriptor.
+auto TCPRing::listen(TCPSocket* listener) -> void {
+    /* 非阻塞的 fd 上 io_uring 会直接返回 EAGAIN，而不是等到有数据 / 新连接 */
+    ASSERT(setBlocking(listener->socket_fd_), "setBlocking() failed. errno:" + std::string(std::strerror(errno)));
+    armAccept(listener);
+}
+
+/// Receive and send the data of a connected socket through the ring.
+auto TCPRing::add(TCPSocket* socket) -> void {
+    ASSERT(!free_slots_.empty(), "Too many connections in TCPRing:" + std::to_string(sockets_.size()));
+    ASSERT(setBlocking(socket->socket_fd_), "setBlocking() failed. errno:" + std::string(std::strerror(errno)));
+
+    auto& state = socket->ring_state_;
+    state = TCPRingState{};
+    state.slot_ = free_slots_.back();
+    free_slots_.pop_back();
+    updateSlot(state.slot_, socket->socket_fd_);
+    logger_.log("%:% %() % socket:% slot:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, state.slot_);
+
+    /* 不要来源地址，只要内核接收时间戳的控制消息 */
+    state.recv_msg_.msg_controllen = CMSG_SPACE(sizeof(timeval));
+
+    sockets_.push_back(socket);
+    armRecv(socket);
+}
+
+/// Stop driving the socket, which is closed and deleted once none of its requests is in flight any more.
+auto TCPRing::remove(TCPSocket* socket) noexcept -> void {
+    auto& state = socket->ring_state_;
+    state.removed_ = true;
+    sockets_.erase(std::remove(sockets_.begin(), sockets_.end(), socket), sockets_.end());
+    if (state.ready_)
+        ready_sockets_.erase(std::remove(ready_sockets_.begin(), ready_sockets_.end(), socket), ready_sockets_.end());
+
+    if (state.num_ops_) {
+        auto sqe = ring_.getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = state.slot_;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_FD_FIXED | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = userData(socket, Op::CANCEL);
+    }
+    closing_sockets_.push_back(socket);
+}
+
+/// Process the completions: accept new connections, append received data to inbound_data_, drop the data sent from
+/// outbound_data_ and set connection_lost_ on the lost connections. Makes no system call.
+auto TCPRing::reap() noexcept -> void {
+    ring_.forEachCqe([this](const io_uring_cqe& cqe) {
+        auto socket = reinterpret_cast<TCPSocket*>(cqe.user_data & ~OpMask);
+        switch (static_cast<Op>(cqe.user_data & OpMask)) {
+        case Op::ACCEPT:
+            onAccept(socket, cqe);
+            break;
+        case Op::RECV:
+            onRecv(socket, cqe);
+            break;
+        case Op::SEND:
+            onSend(socket, cqe);
+            break;
+        case Op::CANCEL:
+            break;
+        }
+    });
+
+    if (UNLIKELY(!closing_sockets_.empty()))
+        deleteClosedSockets();
+}
+
+/// Call recv_callback_ for every socket which received data since the last call, returns true if there was any.
+auto TCPRing::dispatch() noexcept -> bool {
+    if (ready_sockets_.empty())
+        return false;
+
+    for (auto socket : ready_sockets_) {
+        socket->ring_state_.ready_ = false;
+        socket->recv_callback_(socket, socket->ring_state_.rx_time_);
+    }
+    ready_sockets_.clear();
+
+    return true;
+}
+
+/// Send the pending outgoing data of every socket, resume receiving where needed and submit it all at once.
+auto TCPRing::flush() noexcept -> void {
+    for (auto socket : sockets_) {
+        auto& state = socket->ring_state_;
+        if (UNLIKELY(socket->connection_lost_))
+            continue;
+
+        /* 内核结束了 multishot recvmsg（比如 buffer 用完了），或者暂停之后 inbound_data_ 又有空间了 */
+        if (UNLIKELY(!state.recv_armed_) &&
+            (!state.recv_paused_ || TCPBufferSize - socket->next_rcv_valid_index_ >= TCPRingRecvReserve)) {
+            state.recv_paused_ = false;
+            armRecv(socket);
+        }
+
+        if (socket->next_send_valid_index_ && !state.send_in_flight_)
+            queueSend(socket);
+    }
+
+    ring_.submit();
+}
+
+auto TCPRing::armAccept(TCPSocket* listener) noexcept -> void {
+    auto sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener->socket_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData(listener, Op::ACCEPT);
+    ++listener->ring_state_.num_ops_;
+    ++num_ops_;
+}
+
+auto TCPRing::armRecv(TCPSocket* socket) noexcept -> void {
+    auto& state = socket->ring_state_;
+    auto sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = state.slot_;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->addr = reinterpret_cast<uint64_t>(&state.recv_msg_);
+    sqe->len = 1;
+    sqe->buf_group = 0;
+    sqe->user_data = userData(socket, Op::RECV);
+    state.recv_armed_ = true;
+    ++state.num_ops_;
+    ++num_ops_;
+}
+
+/* 停止接收之后对端很快会被 TCP 的窗口挡住，和 epoll 实现里 inbound_data_ 满了之后不再读是一样的效果 */
+auto TCPRing::pauseRecv(TCPSocket* socket) noexcept -> void {
+    logger_.log("%:% %() % socket:% pausing receive, inbound data:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, socket->next_rcv_valid_index_);
+    socket->ring_state_.recv_paused_ = true;
+    auto sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = userData(socket, Op::RECV);
+    sqe->user_data = userData(socket, Op::CANCEL);
+}
+
+auto TCPRing::queueSend(TCPSocket* socket) noexcept -> void {
+    auto& state = socket->ring_state_;
+    auto sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = state.slot_;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = reinterpret_cast<uint64_t>(socket->outbound_data_.data());
+    sqe->len = static_cast<uint32_t>(socket->next_send_valid_index_);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData(socket, Op::SEND);
+    state.send_in_flight_ = socket->next_send_valid_index_;
+    ++state.num_ops_;
+    ++num_ops_;
+}
+
+auto TCPRing::onAccept(TCPSocket* listener, const io_uring_cqe& cqe) noexcept -> void {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        --listener->ring_state_.num_ops_;
+        --num_ops_;
+        if (!destroying_)
+            armAccept(listener);
+    }
+
+    if (cqe.res < 0) {
+        if (cqe.res != -ECANCELED)
+            logger_.log("%:% %() % accept on socket:% failed error:%\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), listener->socket_fd_, std::strerror(-cqe.res));
+        return;
+    }
+
+    if (accept_callback_)
+        accept_callback_(cqe.res);
+    else
+        close(cqe.res);
+}
+
+auto TCPRing::onRecv(TCPSocket* socket, const io_uring_cqe& cqe) noexcept -> void {
+    auto& state = socket->ring_state_;
+    auto peer_closed = false;
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        const auto buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe.res > 0 && !state.removed_)
+            peer_closed = !copyReceived(socket, buffers_.data() + buffer_id * TCPRingBufferSize);
+        recycleBuffer(buffer_id);
+    }
+    if (cqe.flags & IORING_CQE_F_MORE)
+        return;
+
+    --state.num_ops_;
+    --num_ops_;
+    state.recv_armed_ = false;
+    if (state.removed_ || state.recv_paused_ || socket->connection_lost_)
+        return;
+
+    /* buffer 用完了（ENOBUFS）或者内核因为别的原因结束了 multishot：flush() 重新提交，其他情况是断线 */
+    if (cqe.res == -ENOBUFS || (cqe.res > 0 && !peer_closed))
+        return;
+    connectionLost(socket, (cqe.res < 0 ? -cqe.res : 0));
+}
+
+auto TCPRing::onSend(TCPSocket* socket, const io_uring_cqe& cqe) noexcept -> void {
+    auto& state = socket->ring_state_;
+    --state.num_ops_;
+    --num_ops_;
+    state.send_in_flight_ = 0;
+    if (state.removed_)
+        return;
+
+    logger_.log("%:% %() % send socket:% len:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, cqe.res);
+
+    /* 在途的时候 send() 追加在后面的数据往前挪，下一轮再发；连接断了就丢掉 */
+    if (cqe.res > 0) {
+        const auto n = static_cast<size_t>(cqe.res);
+        memmove(socket->outbound_data_.data(), socket->outbound_data_.data() + n, socket->next_send_valid_index_ - n);
+        socket->next_send_valid_index_ -= n;
+    } else if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR) {
+        socket->next_send_valid_index_ = 0;
+        connectionLost(socket, -cqe.res);
+    }
+}
+
+/// Append the data of a recvmsg completion to inbound_data_, returns false if the peer closed the connection.
+auto TCPRing::copyReceived(TCPSocket* socket, const char* buffer) noexcept -> bool {
+    auto& state = socket->ring_state_;
+    /* buffer 里依次是 io_uring_recvmsg_out、来源地址、控制消息、数据，地址和控制消息的长度是 recv_msg_ 里给的 */
+    const auto recvmsg_out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+    if (!recvmsg_out->payloadlen)
+        return false;
+
+    const auto control = buffer + sizeof(io_uring_recvmsg_out) + state.recv_msg_.msg_namelen;
+    const auto payload = control + state.recv_msg_.msg_controllen;
+
+    Nanos kernel_time = 0;
+    timeval time_kernel;
+    const auto cmsg = reinterpret_cast<const cmsghdr*>(control);
+    if (recvmsg_out->controllen >= CMSG_LEN(sizeof(time_kernel)) && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_TIMESTAMP && cmsg->cmsg_len == CMSG_LEN(sizeof(time_kernel))) {
+        memcpy(&time_kernel, CMSG_DATA(cmsg), sizeof(time_kernel));
+        kernel_time = time_kernel.tv_sec * NANOS_TO_SECS +
+                      time_kernel.tv_usec * NANOS_TO_MICROS; // convert timestamp to nanoseconds.
+    }
+
+    if (UNLIKELY(recvmsg_out->payloadlen > TCPBufferSize - socket->next_rcv_valid_index_))
+        FATAL("Receive buffer of socket:" + std::to_string(socket->socket_fd_) + " overflown by:" +
+              std::to_string(recvmsg_out->payloadlen));
+    memcpy(socket->inbound_data_.data() + socket->next_rcv_valid_index_, payload, recvmsg_out->payloadlen);
+    socket->next_rcv_valid_index_ += recvmsg_out->payloadlen;
+
+    const auto user_time = getCurrentNanos();
+    logger_.log("%:% %() % read socket:% len:% utime:% ktime:% diff:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, socket->next_rcv_valid_index_, user_time,
+                kernel_time, (user_time - kernel_time));
+
+    state.rx_time_ = kernel_time;
+    if (!state.ready_) {
+        state.ready_ = true;
+        ready_sockets_.push_back(socket);
+    }
+
+    if (UNLIKELY(TCPBufferSize - socket->next_rcv_valid_index_ < TCPRingRecvReserve && !state.recv_paused_))
+        pauseRecv(socket);
+
+    return true;
+}
+
+/// Give a buffer back to the kernel to receive into.
+auto TCPRing::recycleBuffer(unsigned buffer_id) noexcept -> void {
+    /* 不能用 buffer_ring_->bufs：C++ 里 __DECLARE_FLEX_ARRAY 的空结构体占 1 个字节，bufs 会错开 8 个字节 */
+    auto& buffer = reinterpret_cast<io_uring_buf*>(buffer_ring_)[buffer_ring_tail_ & (TCPRingNumBuffers - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(buffers_.data() + buffer_id * TCPRingBufferSize);
+    buffer.len = TCPRingBufferSize;
+    buffer.bid = static_cast<uint16_t>(buffer_id);
+    std::atomic_ref<uint16_t>(buffer_ring_->tail).store(++buffer_ring_tail_, std::memory_order_release);
+}
+
+auto TCPRing::connectionLost(TCPSocket* socket, int error) noexcept -> void {
+    if (socket->connection_lost_ || destroying_)
+        return;
+    logger_.log("%:% %() % socket:% connection lost error:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, (error ? std::strerror(error) : "EOF"));
+    socket->connection_lost_ = true;
+    if (lost_callback_)
+        lost_callback_(socket);
+}
+
+/// Put a file descriptor in the ring's registered files at the slot, -1 clears the slot.
+auto TCPRing::updateSlot(int slot, int fd) noexcept -> void {
+    io_uring_rsrc_update2 update{};
+    update.offset = static_cast<uint32_t>(slot);
+    update.data = reinterpret_cast<uint64_t>(&fd);
+    update.nr = 1;
+    const auto rc = ring_.registerOp(IORING_REGISTER_FILES_UPDATE2, &update, sizeof(update));
+    ASSERT(rc == 1, "Unable to register file:" + std::to_string(fd) + " error:" + std::string(std::strerror(-rc)));
+}
+
+auto TCPRing::deleteClosedSockets() noexcept -> void {
+    for (size_t i = 0; i < closing_sockets_.size();) {
+        auto socket = closing_sockets_[i];
+        if (socket->ring_state_.num_ops_) {
+            ++i;
+            continue;
+        }
+
+        updateSlot(socket->ring_state_.slot_, -1);
+        free_slots_.push_back(socket->ring_state_.slot_);
+        close(socket->socket_fd_);
+        delete socket;
+        closing_sockets_[i] = closing_sockets_.back();
+        closing_sockets_.pop_back();
+    }
+}
+} // namespace Common
@@ -0,0 +1,140 @@
+#pragma once
+
+/**
+ * 用 io_uring 驱动一组 TCPSocket，对外和 epoll 的实现一样：收到的数据写进 inbound_data_ 之后调用 recv_callback_，
+ * send() 只是写进 outbound_data_
+ *
+ * - 新连接：listening socket 上一个 multishot accept，一直有效，每个新连接一个 CQE
+ * - 接收：每个连接一个 multishot recvmsg，内核从所有连接共享的一组 provided buffer 里挑一个写进去，
+ *   控制消息里带着和 epoll 实现一样的内核接收时间戳，复制到 inbound_data_ 之后马上还给内核
+ * - 每个连接的 fd 注册在 ring 里（registered file），收发时内核不需要每次查 fd 表、增减引用计数
+ * - 发送：每个连接同时最多一个 send 在途。outbound_data_ 没有注册成 fixed buffer：普通的 IORING_OP_SEND 不接受
+ *   fixed buffer，SEND_ZC 要等通知之后才能改缓冲区，几十个字节的回报用零拷贝反而更慢
+ * - 每一轮所有连接的 send 和重新提交的 recvmsg 用一次 io_uring_enter() 批量提交，没有要提交的就没有系统调用；
+ *   完成事件由内核直接写进 mmap 的完成队列，空转的时候一次系统调用都没有（epoll 实现每一轮每个连接至少一次 recvmsg）
+ * - 断线：连接上的请求都取消、完成之后才关闭 fd、删除 TCPSocket，内核不会再写已经释放的缓冲区
+ */
+
+#include <functional>
+#include <vector>
+
+#include "io_uring_utils.h"
+#include "tcp_socket.h"
+
+namespace Common
+{
+/// Number of submission queue entries of a TCPRing.
+constexpr unsigned TCPRingEntries = 1024;
+
+/// Maximum number of connections driven by a TCPRing at the same time.
+constexpr size_t TCPRingMaxSockets = 1024;
+
+/// Number and size of the buffers the kernel receives into, shared by all the connections of a TCPRing.
+constexpr size_t TCPRingNumBuffers = 64;
+constexpr size_t TCPRingBufferSize = 64 * 1024;
+
+/// A connection stops receiving while it has less room than this left in inbound_data_, which holds everything the
+/// kernel can still write into the buffers until the multishot recvmsg is canceled.
+constexpr size_t TCPRingRecvReserve = 2 * TCPRingNumBuffers * TCPRingBufferSize;
+
+class TCPRing {
+public:
+    explicit TCPRing(Logger& logger);
+
+    /// Cancels every request in flight and waits for them to complete, so the kernel no longer touches any buffer.
+    ~TCPRing();
+
+    /// Accept connections on the listening socket, calling accept_callback_ with each new file descriptor.
+    auto listen(TCPSocket* listener) -> void;
+
+    /// Receive and send the data of a connected socket through the ring.
+    auto add(TCPSocket* socket) -> void;
+
+    /// Stop driving the socket, which is closed and deleted once none of its requests is in flight any more.
+    auto remove(TCPSocket* socket) noexcept -> void;
+
+    /// Process the completions: accept new connections, append received data to inbound_data_, drop the data sent
+    /// from outbound_data_ and set connection_lost_ on the lost connections. Makes no system call.
+    auto reap() noexcept -> void;
+
+    /// Call recv_callback_ for every socket which received data since the last call, returns true if there was any.
+    auto dispatch() noexcept -> bool;
+
+    /// Send the pending outgoing data of every socket, resume receiving where needed and submit it all at once.
+    auto flush() noexcept -> void;
+
+    /// reap(), dispatch() and flush() for a ring driving a single connecting socket.
+    auto sendAndRecv() noexcept -> bool {
+        reap();
+        const auto recv = dispatch();
+        flush();
+        return recv;
+    }
+
+    auto numSyscalls() const noexcept {
+        return ring_.numSyscalls();
+    }
+
+    /// Called with the file descriptor of every new connection accepted by reap().
+    std::function<void(int fd)> accept_callback_ = nullptr;
+    /// Called by reap() when a connection was closed by the peer or failed, after connection_lost_ was set.
+    std::function<void(TCPSocket* s)> lost_callback_ = nullptr;
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    TCPRing() = delete;
+    TCPRing(const TCPRing&) = delete;
+    TCPRing(const TCPRing&&) = delete;
+    TCPRing& operator=(const TCPRing&) = delete;
+    TCPRing& operator=(const TCPRing&&) = delete;
+
+private:
+    /// The request a completion belongs to is encoded in the low bits of its user_data, next to the TCPSocket.
+    enum class Op : uint64_t { ACCEPT = 0, RECV = 1, SEND = 2, CANCEL = 3 };
+    static constexpr uint64_t OpMask = 3;
+
+    static auto userData(TCPSocket* socket, Op op) noexcept {
+        return (reinterpret_cast<uint64_t>(socket) | static_cast<uint64_t>(op));
+    }
+
+    auto armAccept(TCPSocket* listener) noexcept -> void;
+    auto armRecv(TCPSocket* socket) noexcept -> void;
+    auto pauseRecv(TCPSocket* socket) noexcept -> void;
+    auto queueSend(TCPSocket* socket) noexcept -> void;
+
+    auto onAccept(TCPSocket* listener, const io_uring_cqe& cqe) noexcept -> void;
+    auto onRecv(TCPSocket* socket, const io_uring_cqe& cqe) noexcept -> void;
+    auto onSend(TCPSocket* socket, const io_uring_cqe& cqe) noexcept -> void;
+
+    /// Append the data of a recvmsg completion to inbound_data_, returns false if the peer closed the connection.
+    auto copyReceived(TCPSocket* socket, const char* buffer) noexcept -> bool;
+
+    /// Give a buffer back to the kernel to receive into.
+    auto recycleBuffer(unsigned buffer_id) noexcept -> void;
+
+    auto connectionLost(TCPSocket* socket, int error) noexcept -> void;
+
+    /// Put a file descriptor in the ring's registered files at the slot, -1 clears the slot.
+    auto updateSlot(int slot, int fd) noexcept -> void;
+
+    auto deleteClosedSockets() noexcept -> void;
+
+    IoUring ring_;
+
+    /// The buffers the kernel receives into and the ring through which they are given to the kernel.
+    std::vector<char> buffers_;
+    io_uring_buf_ring* buffer_ring_ = nullptr;
+    uint16_t buffer_ring_tail_ = 0;
+
+    /// Connections driven by the ring, the removed ones waiting for their requests to complete and the ones with
+    /// received data waiting for recv_callback_.
+    std::vector<TCPSocket*> sockets_, closing_sockets_, ready_sockets_;
+    std::vector<int> free_slots_;
+
+    /// Requests in flight across all the sockets.
+    size_t num_ops_ = 0;
+    bool destroying_ = false;
+
+    std::string time_str_;
+    Logger& logger_;
+};
+} // namespace Common
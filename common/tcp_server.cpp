@@ -5,25 +5,71 @@ namespace Common
 /// Add and remove socket file descriptors to and from the EPOLL list.
 auto TCPServer::addToEpollList(TCPSocket* socket) -> bool{
     // EPOLLET： 只有“状态由无数据→有数据”这一次变化时才通知
-    epoll_event ev{EPOLLET | EPOLLIN, {reinterpret_cast<void*>(socket)}};
+    // EPOLLRDHUP：对端关闭连接时也通知，不用等到下一次 send 失败
+    epoll_event ev{EPOLLET | EPOLLIN | EPOLLRDHUP, {reinterpret_cast<void*>(socket)}};
     // 成功返回 0，失败返回 -1
     return !epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket->socket_fd_, &ev);
 }
 
-/// Start listening for connections on the provided interface and port.
-auto TCPServer::listen(const std::string& iface, int port) -> void {
+/// Start listening for connections on the provided interface and port. With reuse_port several servers can listen on
+/// the same port, each is handed a share of the new connections by the kernel.
+auto TCPServer::listen(const std::string& iface, int port, bool reuse_port) -> void {
+    if (backend_ == TCPBackend::IO_URING) {
+        listenRing(iface, port, reuse_port);
+        return;
+    }
+
     epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
     ASSERT(epoll_fd_ >= 0, "epoll_create() failed error:" + std::string(std::strerror(errno)));
 
-    ASSERT(listener_socket_.connect("", iface, port, true) >= 0, "Listener socket failed to connect. iface:" + iface +
-                                                                     " port:" + std::to_string(port) +
-                                                                     " error:" + std::string(std::strerror(errno)));
+    ASSERT(listener_socket_.connect("", iface, port, true, reuse_port) >= 0,
+           "Listener socket failed to connect. iface:" + iface + " port:" + std::to_string(port) +
+               " error:" + std::string(std::strerror(errno)));
 
     ASSERT(addToEpollList(&listener_socket_), "epoll_ctl() failed. error:" + std::string(std::strerror(errno)));
 }
 
+/* io_uring：新连接和断线都在 ring_->reap() 里通过回调报告，不需要 epoll */
+/// Start listening with the io_uring backend, every connection accepted is added to the ring.
+auto TCPServer::listenRing(const std::string& iface, int port, bool reuse_port) -> void {
+    ASSERT(listener_socket_.connect("", iface, port, true, reuse_port) >= 0,
+           "Listener socket failed to connect. iface:" + iface + " port:" + std::to_string(port) +
+               " error:" + std::string(std::strerror(errno)));
+
+    ring_ = std::make_unique<TCPRing>(logger_);
+    ring_->accept_callback_ = [this](int fd) {
+        ASSERT(disableNagle(fd), "Failed to set no-delay on socket:" + std::to_string(fd));
+        num_syscalls_ += 3; // setsockopt() and fcntl() twice in TCPRing::add().
+        logger_.log("%:% %() % accepted socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), fd);
+
+        auto socket = new TCPSocket(logger_, TCPBackend::IO_URING);
+        socket->socket_fd_ = fd;
+        socket->recv_callback_ = recv_callback_;
+        ring_->add(socket);
+    };
+    ring_->lost_callback_ = [this](TCPSocket* socket) {
+        if (!socket->disconnected_) {
+            socket->disconnected_ = true;
+            disconnected_sockets_.push_back(socket);
+        }
+    };
+    ring_->listen(&listener_socket_);
+    ring_->flush();
+}
+
 /// Publish outgoing data from the send buffer and read incoming data from the receive buffer.
 auto TCPServer::sendAndRecv() noexcept -> void {
+    if (ring_) {
+        /* 数据已经在 poll() 的 reap() 里收进 inbound_data_ 了，这里只回调，最后一次 io_uring_enter() 提交所有发送 */
+        if (ring_->dispatch())
+            recv_finished_callback_();
+        if (UNLIKELY(!disconnected_sockets_.empty()))
+            closeDisconnectedSockets();
+        ring_->flush();
+        return;
+    }
+
     auto recv = false;
 
     std::for_each(receive_sockets_.begin(), receive_sockets_.end(),
@@ -33,13 +79,50 @@ auto TCPServer::sendAndRecv() noexcept -> void {
         recv_finished_callback_();
 
     std::for_each(send_sockets_.begin(), send_sockets_.end(), [](auto socket) { socket->sendAndRecv(); });
+
+    if (UNLIKELY(!disconnected_sockets_.empty()))
+        closeDisconnectedSockets();
+}
+
+/// Close the connections reported dead by poll(), after the data they still had was read and dispatched.
+auto TCPServer::closeDisconnectedSockets() noexcept -> void {
+    for (auto socket : disconnected_sockets_) {
+        logger_.log("%:% %() % closing socket:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), socket->socket_fd_);
+        if (disconnect_callback_)
+            disconnect_callback_(socket);
+
+        if (ring_) { // the ring closes and deletes the socket once its requests are done.
+            ring_->remove(socket);
+            continue;
+        }
+
+        num_syscalls_ += socket->numSyscalls() + 2; // epoll_ctl() and close().
+        if (socket->in_receive_sockets_)
+            receive_sockets_.erase(std::remove(receive_sockets_.begin(), receive_sockets_.end(), socket),
+                                   receive_sockets_.end());
+        if (socket->in_send_sockets_)
+            send_sockets_.erase(std::remove(send_sockets_.begin(), send_sockets_.end(), socket), send_sockets_.end());
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket->socket_fd_, nullptr);
+        close(socket->socket_fd_);
+        delete socket;
+    }
+    disconnected_sockets_.clear();
 }
 
 /// Check for new connections or dead connections and update containers that track the sockets.
 auto TCPServer::poll() noexcept -> void {
-    const int max_events = 1 + send_sockets_.size() + receive_sockets_.size();
+    if (ring_) {
+        ring_->reap();
+        return;
+    }
+
+    /* 连接多于 events_ 的时候剩下的事件留给下一次 poll() */
+    const auto max_events = static_cast<int>(
+        std::min(1 + send_sockets_.size() + receive_sockets_.size(), std::size(events_)));
 
     const int n = epoll_wait(epoll_fd_, events_, max_events, 0);
+    ++num_syscalls_;
     bool have_new_connection = false;
     for (int i = 0; i < n; ++i) {
         const auto& event = events_[i];
@@ -55,24 +138,27 @@ auto TCPServer::poll() noexcept -> void {
             }
             logger_.log("%:% %() % EPOLLIN socket:%\n", __FILE__, __LINE__, __FUNCTION__,
                         Common::getCurrentTimeStr(&time_str_), socket->socket_fd_);
-            if (std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end())
-                /* 没找到就加进去 */
-                receive_sockets_.push_back(socket);
+            addToReceiveSockets(socket);
         }
 
         if (event.events & EPOLLOUT) {
             logger_.log("%:% %() % EPOLLOUT socket:%\n", __FILE__, __LINE__, __FUNCTION__,
                         Common::getCurrentTimeStr(&time_str_), socket->socket_fd_);
-            if (std::find(send_sockets_.begin(), send_sockets_.end(), socket) == send_sockets_.end())
-                /* 放到 receive_sockets_，等待后续 recv() 把它识别为关闭 */
+            if (!socket->in_send_sockets_) {
+                socket->in_send_sockets_ = true;
                 send_sockets_.push_back(socket);
+            }
         }
 
-        if (event.events & (EPOLLERR | EPOLLHUP)) {
+        if (event.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
             logger_.log("%:% %() % EPOLLERR socket:%\n", __FILE__, __LINE__, __FUNCTION__,
                         Common::getCurrentTimeStr(&time_str_), socket->socket_fd_);
-            if (std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end())
-                receive_sockets_.push_back(socket);
+            /* 放到 receive_sockets_，先把还没读的数据读完再关闭，见 sendAndRecv() */
+            addToReceiveSockets(socket);
+            if (socket != &listener_socket_ && !socket->disconnected_) {
+                socket->disconnected_ = true;
+                disconnected_sockets_.push_back(socket);
+            }
         }
     }
 
@@ -83,6 +169,7 @@ auto TCPServer::poll() noexcept -> void {
         sockaddr_storage addr;
         socklen_t addr_len = sizeof(addr);
         int fd = accept(listener_socket_.socket_fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+        ++num_syscalls_;
         if (fd == -1) break;
 
         ASSERT(setNonBlocking(fd) && disableNagle(fd),
@@ -95,9 +182,20 @@ auto TCPServer::poll() noexcept -> void {
         socket->socket_fd_ = fd;
         socket->recv_callback_ = recv_callback_;
         ASSERT(addToEpollList(socket), "Unable to add socket. error:" + std::string(std::strerror(errno)));
+        num_syscalls_ += 4; // fcntl() twice, setsockopt() and epoll_ctl().
 
-        if (std::find(receive_sockets_.begin(), receive_sockets_.end(), socket) == receive_sockets_.end())
-            receive_sockets_.push_back(socket);
+        addToReceiveSockets(socket);
     }
 }
+
+/// Number of system calls made to accept, send and receive data, across all the connections.
+auto TCPServer::numSyscalls() const noexcept -> size_t {
+    if (ring_)
+        return num_syscalls_ + ring_->numSyscalls();
+
+    auto num_syscalls = num_syscalls_;
+    for (auto socket : receive_sockets_)
+        num_syscalls += socket->numSyscalls();
+    return num_syscalls;
+}
 } // namespace Common
@@ -1,15 +1,20 @@
 #pragma once
 
+#include <memory>
+
+#include "tcp_ring.h"
 #include "tcp_socket.h"
 
 namespace Common
 {
 struct TCPServer {
-    explicit TCPServer(Logger& logger) : listener_socket_(logger), logger_(logger) {
+    explicit TCPServer(Logger& logger, TCPBackend backend = TCPBackend::EPOLL)
+        : backend_(backend), listener_socket_(logger), logger_(logger) {
     }
 
-    /// Start listening for connections on the provided interface and port.
-    auto listen(const std::string& iface, int port) -> void;
+    /// Start listening for connections on the provided interface and port. With reuse_port several servers can listen
+    /// on the same port, each is handed a share of the new connections by the kernel.
+    auto listen(const std::string& iface, int port, bool reuse_port = false) -> void;
 
     /// Check for new connections or dead connections and update containers that track the sockets.
     auto poll() noexcept -> void;
@@ -17,11 +22,30 @@ struct TCPServer {
     /// Publish outgoing data from the send buffer and read incoming data from the receive buffer.
     auto sendAndRecv() noexcept -> void;
 
+    /// Number of system calls made to accept, send and receive data, across all the connections.
+    auto numSyscalls() const noexcept -> size_t;
+
 private:
+    /// Start listening with the io_uring backend, every connection accepted is added to the ring.
+    auto listenRing(const std::string& iface, int port, bool reuse_port) -> void;
+
     /// Add and remove socket file descriptors to and from the EPOLL list.
     auto addToEpollList(TCPSocket* socket) -> bool;
 
+    /// Add the socket to receive_sockets_ unless it is already there.
+    auto addToReceiveSockets(TCPSocket* socket) noexcept {
+        if (!socket->in_receive_sockets_) {
+            socket->in_receive_sockets_ = true;
+            receive_sockets_.push_back(socket);
+        }
+    }
+
+    /// Close the connections reported dead by poll(), after the data they still had was read and dispatched.
+    auto closeDisconnectedSockets() noexcept -> void;
+
 public:
+    const TCPBackend backend_ = TCPBackend::EPOLL;
+
     /// Socket on which this server is listening for new connections on.
     int epoll_fd_ = -1;
     TCPSocket listener_socket_;
@@ -29,12 +53,21 @@ public:
     epoll_event events_[1024];
 
     /// Collection of all sockets, sockets for incoming data, sockets for outgoing data and dead connections.
-    std::vector<TCPSocket*> receive_sockets_, send_sockets_;
+    /// Membership is tracked by flags on each TCPSocket instead of searching the containers on every event.
+    std::vector<TCPSocket*> receive_sockets_, send_sockets_, disconnected_sockets_;
+
+    /// With the io_uring backend, the ring driving the listener and all the connections instead of epoll.
+    std::unique_ptr<TCPRing> ring_;
+
+    /// System calls made by poll() and by the connections already closed.
+    size_t num_syscalls_ = 0;
 
     /// Function wrapper to call back when data is available.
     std::function<void(TCPSocket* s, Nanos rx_time)> recv_callback_ = nullptr;
     /// Function wrapper to call back when all data across all TCPSockets has been read and dispatched this round.
     std::function<void()> recv_finished_callback_ = nullptr;
+    /// Function wrapper to call back when a connection was closed or failed, right before the TCPSocket is destroyed.
+    std::function<void(TCPSocket* s)> disconnect_callback_ = nullptr;
 
     std::string time_str_;
     Logger& logger_;
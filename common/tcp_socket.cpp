@@ -1,18 +1,32 @@
 #include "tcp_socket.h"
 
+#include "tcp_ring.h"
+
 namespace Common
 {
+/* TCPRing 在这里是完整类型，unique_ptr 才能析构它 */
+TCPSocket::~TCPSocket() {
+}
+
 /* iface 就是网络接口名，比如 eth0 */
-/// Create TCPSocket with provided attributes to either listen-on / connect-to.
-auto TCPSocket::connect(const std::string& ip, const std::string& iface, int port, bool is_listening) -> int {
+/// Create TCPSocket with provided attributes to either listen-on / connect-to. reuse_port lets several listening
+/// sockets share the port, the kernel spreads the new connections across them.
+auto TCPSocket::connect(const std::string& ip, const std::string& iface, int port, bool is_listening,
+                        bool reuse_port) -> int {
     // Note that needs_so_timestamp=true for FIFOSequencer.
-    const SocketCfg socket_cfg{ip, iface, port, false, is_listening, true};
+    const SocketCfg socket_cfg{ip, iface, port, false, is_listening, true, reuse_port};
     socket_fd_ = createSocket(logger_, socket_cfg);
 
     socket_attrib_.sin_addr.s_addr = INADDR_ANY;
     socket_attrib_.sin_port = htons(port);
     socket_attrib_.sin_family = AF_INET;
 
+    /* 监听 socket 的 ring 属于 TCPServer；连接出去的 socket 自己有一个 ring */
+    if (backend_ == TCPBackend::IO_URING && !is_listening) {
+        own_ring_ = std::make_unique<TCPRing>(logger_);
+        own_ring_->add(this);
+    }
+
     return socket_fd_;
 }
 
@@ -25,6 +39,9 @@ auto TCPSocket::connect(const std::string& ip, const std::string& iface, int por
 /// Called to publish outgoing data from the buffers as well as check for and callback if data is available in the read
 /// buffers.
 auto TCPSocket::sendAndRecv() noexcept -> bool {
+    if (own_ring_)
+        return own_ring_->sendAndRecv();
+
     /* CMSG_SPACE 宏是计算存储一个 struct timeval 控制消息所需的总空间（包括头部 + 对齐 padding） */
     /* ctrl[]：为内核控制信息准备的缓冲区（这里用来接收“时间戳”） */
     char ctrl[CMSG_SPACE(sizeof(struct timeval))];
@@ -51,6 +68,11 @@ auto TCPSocket::sendAndRecv() noexcept -> bool {
     
     // Non-blocking call to read available data.
     const auto read_size = recvmsg(socket_fd_, &msg, MSG_DONTWAIT);
+    ++num_syscalls_;
+    /* 读到 0 表示对端关闭了连接（缓冲区满的时候也会读到 0，不算断线） */
+    if (UNLIKELY((read_size == 0 && iov.iov_len) ||
+                 (read_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)))
+        connection_lost_ = true;
     if (read_size > 0) {
         next_rcv_valid_index_ += read_size;
 
@@ -74,14 +96,42 @@ auto TCPSocket::sendAndRecv() noexcept -> bool {
     if (next_send_valid_index_ > 0) {
         // Non-blocking call to send data.
         const auto n = ::send(socket_fd_, outbound_data_.data(), next_send_valid_index_, MSG_DONTWAIT | MSG_NOSIGNAL);
+        const auto send_errno = errno;
+        ++num_syscalls_;
         logger_.log("%:% %() % send socket:% len:%\n", __FILE__, __LINE__, __FUNCTION__,
                     Common::getCurrentTimeStr(&time_str_), socket_fd_, n);
+
+        /* 内核的发送缓冲区满了（或者还在连接中）的时候没发出去的数据留到下一次，连接断了才丢掉 */
+        if (n > 0 && static_cast<size_t>(n) < next_send_valid_index_) {
+            memmove(outbound_data_.data(), outbound_data_.data() + n, next_send_valid_index_ - n);
+            next_send_valid_index_ -= n;
+        } else if (n >= 0 || (send_errno != EAGAIN && send_errno != EWOULDBLOCK && send_errno != EINTR)) {
+            connection_lost_ = connection_lost_ || (n < 0);
+            next_send_valid_index_ = 0;
+        }
     }
-    next_send_valid_index_ = 0;
 
     return (read_size > 0);
 }
 
+/// Close the connection and drop the data left in the buffers, the socket can connect() again afterwards.
+auto TCPSocket::close() noexcept -> void {
+    /* 先等 ring 上的请求都结束，内核不再用这个 fd 和缓冲区 */
+    own_ring_.reset();
+    ring_state_ = {};
+    if (socket_fd_ >= 0)
+        ::close(socket_fd_);
+    socket_fd_ = -1;
+    next_send_valid_index_ = 0;
+    next_rcv_valid_index_ = 0;
+    connection_lost_ = false;
+}
+
+/// Number of system calls made to send and receive data, including the ones of its own TCPRing.
+auto TCPSocket::numSyscalls() const noexcept -> size_t {
+    return num_syscalls_ + (own_ring_ ? own_ring_->numSyscalls() : 0);
+}
+
 /* 只是发送到 outbound_data_ 缓存中 */
 /// Write outgoing data to the send buffers.
 auto TCPSocket::send(const void* data, size_t len) noexcept -> void {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include "logging.h"
 #include "socket_utils.h"
@@ -10,22 +11,73 @@ namespace Common
 /// Size of our send and receive buffers in bytes.
 constexpr size_t TCPBufferSize = 64 * 1024 * 1024;
 
+/// How TCPServer and TCPSocket move data between the kernel and their buffers.
+enum class TCPBackend : uint8_t {
+    EPOLL = 0,   // epoll 通知新连接 / 断线，每个 socket 每一轮一次 recvmsg() 和一次 send()
+    IO_URING = 1 // io_uring：multishot 接收、注册过的 fd，每一轮最多一次 io_uring_enter()，见 tcp_ring.h
+};
+
+inline auto tcpBackendToString(TCPBackend backend) -> std::string {
+    switch (backend) {
+    case TCPBackend::EPOLL:
+        return "EPOLL";
+    case TCPBackend::IO_URING:
+        return "IO_URING";
+    }
+    return "UNKNOWN";
+}
+
+class TCPRing;
+
+/// State of a TCPSocket driven by a TCPRing, only used by the TCPRing.
+struct TCPRingState {
+    /// Index of the socket in the ring's registered files.
+    int slot_ = -1;
+
+    /// A multishot recvmsg is in flight, recv_paused_ while it was canceled because inbound_data_ is nearly full.
+    bool recv_armed_ = false;
+    bool recv_paused_ = false;
+    msghdr recv_msg_{};
+
+    /// Bytes at the front of outbound_data_ being sent.
+    size_t send_in_flight_ = 0;
+
+    /// Requests in flight, a socket removed from the ring is deleted once it has none left.
+    size_t num_ops_ = 0;
+    bool removed_ = false;
+
+    /// Received data waiting for recv_callback_, with the kernel receive time of the latest data.
+    bool ready_ = false;
+    Nanos rx_time_ = 0;
+};
+
 struct TCPSocket {
-    explicit TCPSocket(Logger& logger) : logger_(logger) {
+    /// The backend only matters for connecting sockets, the sockets accepted by a TCPServer use the server's.
+    explicit TCPSocket(Logger& logger, TCPBackend backend = TCPBackend::EPOLL) : backend_(backend), logger_(logger) {
         outbound_data_.resize(TCPBufferSize);
         inbound_data_.resize(TCPBufferSize);
     }
 
-    /// Create TCPSocket with provided attributes to either listen-on / connect-to.
-    auto connect(const std::string& ip, const std::string& iface, int port, bool is_listening) -> int;
+    ~TCPSocket();
+
+    /// Create TCPSocket with provided attributes to either listen-on / connect-to. reuse_port lets several listening
+    /// sockets share the port, the kernel spreads the new connections across them.
+    auto connect(const std::string& ip, const std::string& iface, int port, bool is_listening,
+                 bool reuse_port = false) -> int;
 
     /// Called to publish outgoing data from the buffers as well as check for and callback if data is available in the
-    /// read buffers.
+    /// read buffers. Sets connection_lost_ once the peer closed the connection or it failed.
     auto sendAndRecv() noexcept -> bool;
 
+    /// Close the connection and drop the data left in the buffers, the socket can connect() again afterwards.
+    auto close() noexcept -> void;
+
     /// Write outgoing data to the send buffers.
     auto send(const void* data, size_t len) noexcept -> void;
 
+    /// Number of system calls made to send and receive data, including the ones of its own TCPRing.
+    auto numSyscalls() const noexcept -> size_t;
+
     /// Deleted default, copy & move constructors and assignment-operators.
     TCPSocket() = delete;
     TCPSocket(const TCPSocket&) = delete;
@@ -33,6 +85,8 @@ struct TCPSocket {
     TCPSocket& operator=(const TCPSocket&) = delete;
     TCPSocket& operator=(const TCPSocket&&) = delete;
 
+    const TCPBackend backend_ = TCPBackend::EPOLL;
+
     /// File descriptor for the socket.
     int socket_fd_ = -1;
 
@@ -45,6 +99,21 @@ struct TCPSocket {
     /// Socket attributes.
     struct sockaddr_in socket_attrib_{};
 
+    /// Membership of the containers of the TCPServer which accepted this socket, so they are never searched.
+    bool in_receive_sockets_ = false;
+    bool in_send_sockets_ = false;
+    bool disconnected_ = false;
+
+    /// The peer closed the connection or it failed, seen by sendAndRecv().
+    bool connection_lost_ = false;
+
+    /// System calls made by sendAndRecv() with the epoll backend.
+    size_t num_syscalls_ = 0;
+
+    /// With the io_uring backend, the ring driving the socket: its own once connected, or the TCPServer's.
+    TCPRingState ring_state_;
+    std::unique_ptr<TCPRing> own_ring_;
+
     /// Function wrapper to callback when there is data to be processed.
     std::function<void(TCPSocket* s, Nanos rx_time)> recv_callback_ = nullptr;
 
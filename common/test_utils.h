@@ -0,0 +1,42 @@
+#pragma once
+
+/**
+ * 单元测试共用的检查，ctest 运行的测试程序使用
+ * CHECK 失败时打印位置和表达式，继续执行剩下的检查；main() 返回 testResult()，有失败的检查时测试程序返回非 0
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "macros.h"
+
+namespace Common
+{
+/// Number of failed checks in this test program.
+inline size_t test_failures = 0;
+
+/// Report a failed check at file:line, returns cond.
+inline auto testCheck(bool cond, const char* expr, const char* file, int line) noexcept {
+    if (UNLIKELY(!cond)) {
+        std::cerr << file << ":" << line << " CHECK failed: " << expr << std::endl;
+        ++test_failures;
+    }
+    return cond;
+}
+
+/// Run a test case and report whether all of its checks passed.
+template<typename F>
+inline auto runTest(const char* name, F&& fn) {
+    const auto failures = test_failures;
+    fn();
+    std::cout << (test_failures == failures ? "PASS " : "FAIL ") << name << std::endl;
+}
+
+/// Exit status of the test program.
+inline auto testResult() noexcept {
+    return (test_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace Common
+
+#define CHECK(cond) Common::testCheck((cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) Common::testCheck((a) == (b), #a " == " #b, __FILE__, __LINE__)
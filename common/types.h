@@ -27,6 +27,9 @@ constexpr size_t ME_MAX_ORDER_IDS = 1024 * 1024;
 /// Maximum price level depth in the order books.
 constexpr size_t ME_MAX_PRICE_LEVELS = 256;
 
+/// Maximum parked stop orders per side of an order book.
+constexpr size_t ME_MAX_STOP_ORDERS = 64 * 1024;
+
 typedef uint64_t OrderId;
 constexpr auto OrderId_INVALID = std::numeric_limits<OrderId>::max();
 
@@ -3,6 +3,10 @@
  *      ME
  *      MDP 这里面又创建了 snapshot synthesizer
  *      Order Server
+ *
+ * ./exchange_main [standby]
+ * standby 作为同一台机器上主 exchange 的热备启动：跟着主 ME 的 journal 撮合但不发布任何东西，主 exchange 退出后接管，
+ * 接管之后的 order server 从主 exchange 的会话文件恢复每个客户的序号和回报历史，再开始接受 LOGON
  */
 
 #include <csignal>
@@ -22,6 +26,11 @@ void signal_handler(int) {
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(10s);
 
+    matching_engine->stop();
+    std::this_thread::sleep_for(1s);
+    matching_engine->snapshotOrderBooks("exchange_order_book");
+    matching_engine->checkpoint();
+
     delete logger;
     logger = nullptr;
     delete matching_engine;
@@ -36,7 +45,7 @@ void signal_handler(int) {
     exit(EXIT_SUCCESS);
 }
 
-int main(int, char**) {
+int main(int argc, char** argv) {
     logger = new Common::Logger("exchange_main.log");
 
     std::signal(SIGINT, signal_handler);
@@ -48,36 +57,110 @@ int main(int, char**) {
     Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
     Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
     Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MEBBOUpdateLFQueue bbo_updates(ME_MAX_MARKET_UPDATES);
 
     std::string time_str;
 
-    logger->log("%:% %() % Starting Matching Engine...\n", __FILE__, __LINE__, __FUNCTION__,
-                Common::getCurrentTimeStr(&time_str));
-    matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates);
-    matching_engine->start();
-
     const std::string mkt_pub_iface = "lo";
-    const std::string snap_pub_ip = "233.252.14.1", inc_pub_ip = "233.252.14.3";
+    const std::string md_ip_prefix = "233.252.14.";
+    const int snap_pub_ip_suffix = 1, inc_pub_ip_suffix = 3;
     const int snap_pub_port = 20000, inc_pub_port = 20001;
 
-    logger->log("%:% %() % Starting Market Data Publisher...\n", __FILE__, __LINE__, __FUNCTION__,
+    /* 行情按 ticker 分片到多个 channel，channel i 使用 233.252.14.(1+4i) / 233.252.14.(3+4i) 以及端口 20000+2i / 20001+2i */
+    const size_t num_md_channels = 2;
+    auto md_channels_cfg = Exchange::makeMDChannelsCfg(num_md_channels, md_ip_prefix, snap_pub_ip_suffix,
+                                                       snap_pub_port, inc_pub_ip_suffix, inc_pub_port);
+
+    /* 可选的 L2 聚合价位行情，channel i 使用 233.252.14.(2+4i) / 233.252.14.(4+4i) 以及端口 20100+2i / 20101+2i */
+    const bool publish_level_feed = true;
+    const int level_snap_pub_ip_suffix = 2, level_inc_pub_ip_suffix = 4;
+    const int level_snap_pub_port = 20100, level_inc_pub_port = 20101;
+    if (publish_level_feed)
+        Exchange::addMDLevelFeed(&md_channels_cfg, md_ip_prefix, level_snap_pub_ip_suffix, level_snap_pub_port,
+                                 level_inc_pub_ip_suffix, level_inc_pub_port);
+
+    /* 可选的合并 BBO 行情，channel i 使用 233.252.14.(101+i) 以及端口 20200+i，间隔为 0 表示每批撮合事件每个 ticker 最多一条 */
+    const bool publish_bbo_feed = true;
+    const int bbo_pub_ip_suffix = 101;
+    const int bbo_pub_port = 20200;
+    const Nanos bbo_pub_interval = 0;
+    if (publish_bbo_feed)
+        Exchange::addMDBBOFeed(&md_channels_cfg, md_ip_prefix, bbo_pub_ip_suffix, bbo_pub_port, bbo_pub_interval);
+
+    /* 每 N 个请求检查一次订单簿被改动的价位（0 表示不检查），完整的订单簿只在退出时写到文件里 */
+    const size_t book_validation_sample = 0;
+
+    /* 主动单一次吃掉多个被动订单时，主动方的成交回报和 TRADE 行情按价位合并，每个价位一条 */
+    const bool aggregate_fills = true;
+
+    /* 同一个客户的主动单碰到自己的挂单时撤掉主动单剩下的数量，避免无意义的自成交 */
+    const auto self_trade_prevention = Exchange::SelfTradePrevention::CANCEL_NEWEST;
+
+    /* 每个请求撮合之前先写入 journal，每 checkpoint_every 个请求写一次订单簿 checkpoint，
+       重启时先恢复 checkpoint 再重放之后的 journal；BATCH 在没有请求可处理时把这一批 journal 刷到磁盘 */
+    const std::string journal_prefix = "exchange_matching_engine";
+    const size_t journal_capacity = 1024 * 1024;
+    const auto journal_sync_policy = Exchange::JournalSyncPolicy::BATCH;
+    const size_t checkpoint_every = 256 * 1024;
+    const bool standby = (argc > 1 && std::string(argv[1]) == "standby");
+
+    logger->log("%:% %() % Starting Matching Engine...\n", __FILE__, __LINE__, __FUNCTION__,
                 Common::getCurrentTimeStr(&time_str));
-    /**
-     * MarketDataPublisher::MarketDataPublisher(MEMarketUpdateLFQueue* market_updates, const std::string& iface,
-                                                const std::string& snapshot_ip, int snapshot_port,
-                                                const std::string& incremental_ip, int incremental_port)
-     */
-    market_data_publisher = new Exchange::MarketDataPublisher(&market_updates, mkt_pub_iface, 
-                                                              snap_pub_ip, snap_pub_port, 
-                                                              inc_pub_ip, inc_pub_port);
+    matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                   (publish_level_feed ? &level_updates : nullptr),
+                                                   (publish_bbo_feed ? &bbo_updates : nullptr));
+    matching_engine->setBookValidation(book_validation_sample);
+    matching_engine->setAggregateFills(aggregate_fills);
+    matching_engine->setSelfTradePrevention(self_trade_prevention);
+    if (standby) {
+        logger->log("%:% %() % Following the primary Matching Engine...\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str));
+        const auto last_seq_num =
+            matching_engine->runStandby(journal_prefix, journal_capacity, journal_sync_policy, checkpoint_every);
+        logger->log("%:% %() % Took over from the primary at seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), last_seq_num);
+    } else {
+        const auto num_replayed =
+            matching_engine->enableJournal(journal_prefix, journal_capacity, journal_sync_policy, checkpoint_every);
+        logger->log("%:% %() % Replayed % journaled requests\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), num_replayed);
+    }
+    matching_engine->start();
+
+    logger->log("%:% %() % Starting Market Data Publisher... %\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str), md_channels_cfg.toString());
+    market_data_publisher = new Exchange::MarketDataPublisher(&market_updates, &level_updates, &bbo_updates,
+                                                              mkt_pub_iface, md_channels_cfg);
+    /* 恢复出来的订单簿通过 checkpoint 镜像直接初始化 snapshot，ME 不再把每个订单重新发一遍 */
+    if (market_data_publisher->seedFromCheckpoint(journal_prefix + ".checkpoint"))
+        logger->log("%:% %() % Seeded Market Data Publisher from %.checkpoint\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), journal_prefix);
     market_data_publisher->start();
 
     const std::string order_gw_iface = "lo";
     const int order_gw_port = 12345;
 
+    /* 大于 1 时每个网络线程用 SO_REUSEPORT 监听同一个端口，各自收发分到的客户连接，另有一个 sequencer 线程排序和路由回报 */
+    const size_t order_server_network_threads = 1;
+    /* 大于 0 时，有客户没有待处理请求的情况下只发布这么久以前收到的请求，等其他网络线程把更早收到的请求送过来 */
+    const Nanos order_server_sequencer_window = 0;
+    /* 每个客户每秒最多 100k 个请求，空闲之后可以连续发 1000 个，超过的请求直接回 REJECTED，不会到达 ME */
+    const Exchange::ClientThrottleCfg order_server_throttle_cfg{100000, 1000};
+    /* 断线不撤单：订单留在订单簿里，客户重连 LOGON 之后补发断线期间的回报，接着之前的会话继续 */
+    const bool order_server_cancel_on_disconnect = false;
+    /* IO_URING：multishot 接收 + 注册过的 fd（发送缓冲区没有注册），每一轮所有连接最多一次 io_uring_enter()，需要 6.0 以上的内核 */
+    const auto order_server_tcp_backend = Common::TCPBackend::EPOLL;
+    /* 会话的序号和回报历史写在共享映射的文件里，重启之后客户 LOGON 接着之前的序号，不会把 ME 已经执行过的请求再发一遍 */
+    const std::string order_server_sessions_path = "exchange_order_server.sessions";
+
     logger->log("%:% %() % Starting Order Server...\n", __FILE__, __LINE__, __FUNCTION__,
                 Common::getCurrentTimeStr(&time_str));
-    order_server = new Exchange::OrderServer(&client_requests, &client_responses, order_gw_iface, order_gw_port);
+    order_server = new Exchange::OrderServer(&client_requests, &client_responses, order_gw_iface, order_gw_port,
+                                             order_server_network_threads, order_server_sequencer_window,
+                                             order_server_throttle_cfg, order_server_cancel_on_disconnect,
+                                             order_server_tcp_backend);
+    order_server->persistSessions(order_server_sessions_path);
     order_server->start();
 
     while (true) {
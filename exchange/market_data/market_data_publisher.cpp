@@ -2,34 +2,90 @@
 
 /**
  * 这个是 Market Data Publisher 的主文件
- * 从这里面创建了 SnapshotSynthesizer 和 McastSocket
+ * 从这里面创建了 SnapshotSynthesizer 和每个 channel 的 McastSocket
  */
 
 /**
  * 调用链：
  * run() ->
  *  for 循环获取 LFQueue outgoing_md_updates_ 的数据
- *      封装并发送到 incremental_socket_ ->
+ *      按 ticker 找到 channel，编码进该 channel 当前的 frame（每个 channel 独立的序号），frame 满了就发送 ->
  *      将数据转发到 snapshot_synthesizer_
- *  调用 incremental_socket_.sendAndRecv() 发送数据到组播地址
+ *  if (开启了 L2 行情) for 循环获取 LFQueue outgoing_level_updates_ 的数据
+ *      同样按 ticker 找到 channel，发送到该 channel 的 level incremental socket（独立的序号） ->
+ *      将数据转发到 snapshot_synthesizer_
+ *  if (开启了 BBO 行情) for 循环获取 LFQueue outgoing_bbo_updates_ 的数据，按 ticker 覆盖最新盘口 ->
+ *      publishBBO() 发布有变化且已过了合并间隔的 ticker 的最新盘口
+ *  把每个 channel 还没发送的 frame 发送出去，调用 level incremental / bbo socket 的 sendAndRecv() 发送数据到组播地址
  */
 
 namespace Exchange
 {
-MarketDataPublisher::MarketDataPublisher(MEMarketUpdateLFQueue* market_updates, const std::string& iface,
-                                         const std::string& snapshot_ip, int snapshot_port,
-                                         const std::string& incremental_ip, int incremental_port)
-    : outgoing_md_updates_(market_updates), snapshot_md_updates_(ME_MAX_MARKET_UPDATES), run_(false),
-      logger_("exchange_market_data_publisher.log"), incremental_socket_(logger_) {
-        /* 下面这句话是创建 UDP 组播 socket 的 */
-    ASSERT(incremental_socket_.init(incremental_ip, iface, incremental_port, /* is_listening */ false) >= 0, 
-           "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
-           /* 创建 SnapshotSynthesizer */
-    snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_/* LFQueue */, iface, snapshot_ip, snapshot_port);
+MarketDataPublisher::MarketDataPublisher(MEMarketUpdateLFQueue* market_updates, MELevelUpdateLFQueue* level_updates,
+                                         MEBBOUpdateLFQueue* bbo_updates, const std::string& iface,
+                                         const MDChannelsCfg& channels_cfg)
+    : channels_cfg_(channels_cfg), outgoing_md_updates_(market_updates), snapshot_md_updates_(ME_MAX_MARKET_UPDATES),
+      outgoing_level_updates_(level_updates), snapshot_level_updates_(ME_MAX_MARKET_UPDATES),
+      outgoing_bbo_updates_(bbo_updates), run_(false),
+      logger_("exchange_market_data_publisher.log") {
+    ASSERT(!channels_cfg_.level_feed_ || outgoing_level_updates_, "Price level feed enabled without a level queue.");
+    ASSERT(!channels_cfg_.bbo_feed_ || outgoing_bbo_updates_, "BBO feed enabled without a BBO queue.");
+
+    next_inc_seq_num_.fill(1);
+    next_level_inc_seq_num_.fill(1);
+    next_bbo_seq_num_.fill(1);
+    incremental_sockets_.fill(nullptr);
+    level_incremental_sockets_.fill(nullptr);
+    bbo_sockets_.fill(nullptr);
+
+    /* 每个 channel 各创建一个 UDP 组播 socket */
+    for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+        const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+        logger_.log("%:% %() % channel:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    channel, channel_cfg.toString());
+
+        incremental_sockets_[channel] = new Common::McastSocket(logger_);
+        ASSERT(incremental_sockets_[channel]->init(channel_cfg.incremental_ip_, iface, channel_cfg.incremental_port_,
+                                                   /* is_listening */ false) >= 0,
+               "Unable to create incremental mcast socket. error:" + std::string(std::strerror(errno)));
+
+        if (channels_cfg_.level_feed_) {
+            level_incremental_sockets_[channel] = new Common::McastSocket(logger_);
+            ASSERT(level_incremental_sockets_[channel]->init(channel_cfg.level_incremental_ip_, iface,
+                                                             channel_cfg.level_incremental_port_,
+                                                             /* is_listening */ false) >= 0,
+                   "Unable to create level incremental mcast socket. error:" + std::string(std::strerror(errno)));
+        }
+
+        if (channels_cfg_.bbo_feed_) {
+            bbo_sockets_[channel] = new Common::McastSocket(logger_);
+            ASSERT(bbo_sockets_[channel]->init(channel_cfg.bbo_ip_, iface, channel_cfg.bbo_port_,
+                                               /* is_listening */ false) >= 0,
+                   "Unable to create BBO mcast socket. error:" + std::string(std::strerror(errno)));
+        }
+    }
+    /* 创建 SnapshotSynthesizer */
+    snapshot_synthesizer_ = new SnapshotSynthesizer(&snapshot_md_updates_/* LFQueue */, &snapshot_level_updates_,
+                                                    iface, channels_cfg_);
+}
+
+/// Seed the snapshot synthesizer with the order books in the checkpoint image at path, returns false if there is no
+/// checkpoint at path.
+/* 增量行情从 MD_SEED_SEQ_NUM + 1 开始，消费端（包括重启前就在的）都会发现缺口，转去从 snapshot 恢复 */
+auto MarketDataPublisher::seedFromCheckpoint(const std::string& path) -> bool {
+    if (!snapshot_synthesizer_->seedFromCheckpoint(path))
+        return false;
+
+    next_inc_seq_num_.fill(MD_SEED_SEQ_NUM + 1);
+    next_level_inc_seq_num_.fill(MD_SEED_SEQ_NUM + 1);
+    logger_.log("%:% %() % Seeded from checkpoint:% incremental seq starts at:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), path, MD_SEED_SEQ_NUM + 1);
+
+    return true;
 }
 
 /// Main run loop for this thread - consumes market updates from the lock free queue from the matching engine, publishes
-/// them on the incremental multicast stream and forwards them to the snapshot synthesizer.
+/// them on the incremental multicast stream of the ticker's channel and forwards them to the snapshot synthesizer.
 auto MarketDataPublisher::run() noexcept -> void {
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
     while (run_) {
@@ -39,15 +95,19 @@ auto MarketDataPublisher::run() noexcept -> void {
 #ifdef PERF
             TTT_MEASURE(T5_MarketDataPublisher_LFQueue_read, logger_);
 #endif
-            logger_.log("%:% %() % Sending seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
-                        Common::getCurrentTimeStr(&time_str_), next_inc_seq_num_, market_update->toString().c_str());
+            const auto channel = channels_cfg_.channelForTicker(market_update->ticker_id_);
+            auto& next_inc_seq_num = next_inc_seq_num_[channel];
+            logger_.log("%:% %() % Sending channel:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), channel, next_inc_seq_num,
+                        market_update->toString().c_str());
 
 #ifdef PERF
             START_MEASURE(Exchange_McastSocket_send);
 #endif
-            /* 这里就直接分两次发 相当于是构造了 MDP 的结构了 */
-            incremental_socket_.send(&next_inc_seq_num_, sizeof(next_inc_seq_num_));
-            incremental_socket_.send(market_update, sizeof(MEMarketUpdate));
+            /* 编码成紧凑格式，一个 frame 对应一个 datagram */
+            if (encoders_[channel].full())
+                sendFrame(channel);
+            encoders_[channel].add(next_inc_seq_num, market_update);
 #ifdef PERF
             END_MEASURE(Exchange_McastSocket_send, logger_);
 #endif
@@ -63,15 +123,93 @@ auto MarketDataPublisher::run() noexcept -> void {
              */
             // Forward this incremental market data update the snapshot synthesizer.
             auto next_write = snapshot_md_updates_.getNextToWriteTo();
-            next_write->seq_num_ = next_inc_seq_num_;
+            next_write->seq_num_ = next_inc_seq_num;
             next_write->me_market_update_ = *market_update;
             snapshot_md_updates_.updateWriteIndex();
 
-            ++next_inc_seq_num_;
+            ++next_inc_seq_num;
+        }
+
+        /* L2 聚合价位行情，流程和上面一样，只是走另一组 socket 和序号 */
+        if (channels_cfg_.level_feed_) {
+            for (auto level_update = outgoing_level_updates_->getNextToRead();
+                 outgoing_level_updates_->size() && level_update;
+                 level_update = outgoing_level_updates_->getNextToRead()) {
+                const auto channel = channels_cfg_.channelForTicker(level_update->ticker_id_);
+                auto& next_level_inc_seq_num = next_level_inc_seq_num_[channel];
+                logger_.log("%:% %() % Sending channel:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                            Common::getCurrentTimeStr(&time_str_), channel, next_level_inc_seq_num,
+                            level_update->toString().c_str());
+
+                level_incremental_sockets_[channel]->send(&next_level_inc_seq_num, sizeof(next_level_inc_seq_num));
+                level_incremental_sockets_[channel]->send(level_update, sizeof(MELevelUpdate));
+
+                outgoing_level_updates_->updateReadIndex();
+
+                // Forward this incremental price level update the snapshot synthesizer.
+                auto next_write = snapshot_level_updates_.getNextToWriteTo();
+                next_write->seq_num_ = next_level_inc_seq_num;
+                next_write->me_level_update_ = *level_update;
+                snapshot_level_updates_.updateWriteIndex();
+
+                ++next_level_inc_seq_num;
+            }
+        }
+
+        /* 合并的 BBO 行情，把这一批盘口更新按 ticker 覆盖掉，然后再决定发布哪些 */
+        if (channels_cfg_.bbo_feed_) {
+            for (auto bbo_update = outgoing_bbo_updates_->getNextToRead(); outgoing_bbo_updates_->size() && bbo_update;
+                 bbo_update = outgoing_bbo_updates_->getNextToRead()) {
+                ticker_bbo_[bbo_update->ticker_id_] = *bbo_update;
+                ticker_bbo_dirty_[bbo_update->ticker_id_] = true;
+
+                outgoing_bbo_updates_->updateReadIndex();
+            }
+
+            publishBBO();
+        }
+
+        // Publish to the multicast streams.
+        for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+            if (!encoders_[channel].empty())
+                sendFrame(channel);
+            if (level_incremental_sockets_[channel])
+                level_incremental_sockets_[channel]->sendAndRecv();
+            if (bbo_sockets_[channel])
+                bbo_sockets_[channel]->sendAndRecv();
         }
+    }
+}
+
+/// Publish the latest top of book of every ticker which changed and whose conflation interval elapsed, and of every
+/// known ticker once every MD_BBO_REFRESH_INTERVAL.
+auto MarketDataPublisher::publishBBO() noexcept -> void {
+    const auto now = getCurrentNanos();
+    const auto refresh = (now - last_bbo_refresh_time_ >= MD_BBO_REFRESH_INTERVAL);
+    if (refresh)
+        last_bbo_refresh_time_ = now;
+
+    for (size_t ticker_id = 0; ticker_id < ticker_bbo_.size(); ++ticker_id) {
+        const auto& bbo = ticker_bbo_[ticker_id];
+        if (bbo.ticker_id_ == TickerId_INVALID) // never had a top of book update.
+            continue;
+
+        const auto due = (ticker_bbo_dirty_[ticker_id] && now - ticker_bbo_send_time_[ticker_id] >=
+                                                               channels_cfg_.bbo_interval_);
+        if (!due && !refresh)
+            continue;
+
+        const auto channel = channels_cfg_.channelForTicker(ticker_id);
+        auto& next_bbo_seq_num = next_bbo_seq_num_[channel];
+        logger_.log("%:% %() % Sending channel:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), channel, next_bbo_seq_num, bbo.toString().c_str());
+
+        bbo_sockets_[channel]->send(&next_bbo_seq_num, sizeof(next_bbo_seq_num));
+        bbo_sockets_[channel]->send(&bbo, sizeof(MEBBOUpdate));
+        ++next_bbo_seq_num;
 
-        // Publish to the multicast stream.
-        incremental_socket_.sendAndRecv();
+        ticker_bbo_dirty_[ticker_id] = false;
+        ticker_bbo_send_time_[ticker_id] = now;
     }
 }
 } // namespace Exchange
@@ -4,21 +4,29 @@
  * 这个是 Market Data Publisher 的主文件
  * 从这里面创建了 snapshot_synthesizer
  * 并控制 snapshot_synthesizer 的开始与结束
+ * 若开启了 BBO 行情，还负责按 ticker 合并盘口更新并限频发布
  */
 
 #include <functional>
 
 #include "market_data/snapshot_synthesizer.h"
+#include "market_data/md_codec.h"
 #ifdef PERF
 #include "common/perf_utils.h"
 #endif
 
 namespace Exchange
 {
+/// Interval at which the latest top of book of every ticker is re-published on the conflated BBO feed even if it did
+/// not change, so that consumers which lost the last update of a quiet ticker do not stay stale.
+constexpr Nanos MD_BBO_REFRESH_INTERVAL = NANOS_TO_SECS;
+
 class MarketDataPublisher {
 public:
-    MarketDataPublisher(MEMarketUpdateLFQueue* market_updates, const std::string& iface, const std::string& snapshot_ip,
-                        int snapshot_port, const std::string& incremental_ip, int incremental_port);
+    /// level_updates and bbo_updates are only consumed if the aggregated price level feed and the conflated top of
+    /// book feed respectively are enabled in channels_cfg.
+    MarketDataPublisher(MEMarketUpdateLFQueue* market_updates, MELevelUpdateLFQueue* level_updates,
+                        MEBBOUpdateLFQueue* bbo_updates, const std::string& iface, const MDChannelsCfg& channels_cfg);
 
     ~MarketDataPublisher() {
         stop();
@@ -28,6 +36,19 @@ public:
 
         delete snapshot_synthesizer_;
         snapshot_synthesizer_ = nullptr;
+
+        for (auto& socket : incremental_sockets_) {
+            delete socket;
+            socket = nullptr;
+        }
+        for (auto& socket : level_incremental_sockets_) {
+            delete socket;
+            socket = nullptr;
+        }
+        for (auto& socket : bbo_sockets_) {
+            delete socket;
+            socket = nullptr;
+        }
     }
 
     /// Start and stop the market data publisher main thread, as well as the internal snapshot synthesizer thread.
@@ -46,8 +67,15 @@ public:
         snapshot_synthesizer_->stop();
     }
 
-    /// Main run loop for this thread - consumes market updates from the lock free queue from the matching engine,
-    /// publishes them on the incremental multicast stream and forwards them to the snapshot synthesizer.
+    /// Seed the snapshot synthesizer with the order books recovered by the matching engine from the checkpoint image at
+    /// path instead of the matching engine publishing every recovered order. The image stands for incremental sequence
+    /// number MD_SEED_SEQ_NUM on every channel, so consumers find the gap and recover from the snapshot stream. Returns
+    /// false if there is no checkpoint at path. Must be called before start().
+    auto seedFromCheckpoint(const std::string& path) -> bool;
+
+    /// Main run loop for this thread - consumes market updates and price level updates from the lock free queues from
+    /// the matching engine, publishes them on the incremental multicast streams of the ticker's channel and forwards
+    /// them to the snapshot synthesizer. Top of book updates are conflated per ticker and published by publishBBO().
     auto run() noexcept -> void;
 
     // Deleted default, copy & move constructors and assignment-operators.
@@ -58,8 +86,14 @@ public:
     MarketDataPublisher& operator=(const MarketDataPublisher&&) = delete;
 
 private:
-    /// Sequencer number tracker on the incremental market data stream.
-    size_t next_inc_seq_num_ = 1;
+    /// Market data channels and the TickerId -> channel mapping.
+    const MDChannelsCfg channels_cfg_;
+
+    /// Hash map from channel index -> sequence number tracker on the incremental market data stream of that channel.
+    std::array<size_t, ME_MAX_MD_CHANNELS> next_inc_seq_num_;
+
+    /// Hash map from channel index -> sequence number tracker on the incremental price level stream of that channel.
+    std::array<size_t, ME_MAX_MD_CHANNELS> next_level_inc_seq_num_;
 
     /// Lock free queue from which we consume market data updates sent by the matching engine.
     MEMarketUpdateLFQueue* outgoing_md_updates_ = nullptr;
@@ -67,16 +101,63 @@ private:
     /// Lock free queue on which we forward the incremental market data updates to send to the snapshot synthesizer.
     MDPMarketUpdateLFQueue snapshot_md_updates_;
 
+    /// Same as above for the aggregated price level feed, only used if the price level feed is enabled.
+    MELevelUpdateLFQueue* outgoing_level_updates_ = nullptr;
+    MDPLevelUpdateLFQueue snapshot_level_updates_;
+
+    /// Lock free queue from which we consume top of book updates sent by the matching engine, only used if the
+    /// conflated top of book feed is enabled.
+    MEBBOUpdateLFQueue* outgoing_bbo_updates_ = nullptr;
+
+    /* 同一个 ticker 在两次发布之间的盘口更新直接覆盖，只发布最新的状态，消费端慢了也不会积压 */
+    /// Hash map from TickerId -> latest top of book, whether it changed since it was last published and when it was
+    /// last published.
+    std::array<MEBBOUpdate, ME_MAX_TICKERS> ticker_bbo_;
+    std::array<bool, ME_MAX_TICKERS> ticker_bbo_dirty_{};
+    std::array<Nanos, ME_MAX_TICKERS> ticker_bbo_send_time_{};
+
+    /// Last time every ticker's top of book was re-published.
+    Nanos last_bbo_refresh_time_ = 0;
+
+    /// Hash map from channel index -> sequence number tracker on the top of book stream of that channel.
+    std::array<size_t, ME_MAX_MD_CHANNELS> next_bbo_seq_num_;
+
     volatile bool run_ = false;
 
     std::string time_str_;
     Logger logger_;
 
-    /// Multicast socket to represent the incremental market data stream.
-    Common::McastSocket incremental_socket_;
+    /// Hash map from channel index -> multicast socket to represent the incremental market data stream of that
+    /// channel, only the first channels_cfg_.num_channels_ entries are created.
+    std::array<Common::McastSocket*, ME_MAX_MD_CHANNELS> incremental_sockets_;
+
+    /// Hash map from channel index -> encoder building the current frame of the incremental market data stream of that
+    /// channel, and the buffer frames are written to before being sent.
+    std::array<MDPEncoder, ME_MAX_MD_CHANNELS> encoders_;
+    std::array<char, MD_MAX_FRAME_SIZE> frame_;
+
+    /// Hash map from channel index -> multicast socket for the incremental price level stream of that channel, only
+    /// created if the price level feed is enabled.
+    std::array<Common::McastSocket*, ME_MAX_MD_CHANNELS> level_incremental_sockets_;
+
+    /// Hash map from channel index -> multicast socket for the conflated top of book stream of that channel, only
+    /// created if the top of book feed is enabled.
+    std::array<Common::McastSocket*, ME_MAX_MD_CHANNELS> bbo_sockets_;
 
     /// Snapshot synthesizer which synthesizes and publishes limit order book snapshots on the snapshot multicast
     /// stream.
     SnapshotSynthesizer* snapshot_synthesizer_ = nullptr;
+
+private:
+    /// Send the current frame of the channel's encoder as a single datagram on its incremental multicast stream.
+    auto sendFrame(size_t channel) noexcept {
+        const auto frame_size = encoders_[channel].finish(frame_.data());
+        incremental_sockets_[channel]->send(frame_.data(), frame_size);
+        incremental_sockets_[channel]->sendAndRecv();
+    }
+
+    /// Publish the latest top of book of every ticker which changed and whose conflation interval elapsed, and of
+    /// every known ticker once every MD_BBO_REFRESH_INTERVAL.
+    auto publishBBO() noexcept -> void;
 };
 } // namespace Exchange
@@ -13,7 +13,7 @@ namespace Exchange
 enum class MarketUpdateType : uint8_t {
     INVALID = 0,
     CLEAR = 1,
-    ADD = 2,    // 插入一个新订单
+    ADD = 2,    // 插入一个新订单；order_id 已存在时表示改单后重新排队，替换原来的订单
     MODIFY = 3,
     CANCEL = 4,
     TRADE = 5,
@@ -43,6 +43,38 @@ inline std::string marketUpdateTypeToString(MarketUpdateType type) {
     return "UNKNOWN";
 }
 
+/// Represents the type / action in the aggregated price level update message.
+/// Level updates carry the total state of the price level, not the change, so applying one twice is harmless.
+enum class LevelUpdateType : uint8_t {
+    INVALID = 0,
+    CLEAR = 1,
+    ADD = 2,    // 新出现的价位
+    UPDATE = 3, // 价位上的总数量或订单数发生变化
+    DELETE = 4, // 价位上已经没有订单
+    SNAPSHOT_START = 5,
+    SNAPSHOT_END = 6
+};
+
+inline std::string levelUpdateTypeToString(LevelUpdateType type) {
+    switch (type) {
+    case LevelUpdateType::CLEAR:
+        return "CLEAR";
+    case LevelUpdateType::ADD:
+        return "ADD";
+    case LevelUpdateType::UPDATE:
+        return "UPDATE";
+    case LevelUpdateType::DELETE:
+        return "DELETE";
+    case LevelUpdateType::SNAPSHOT_START:
+        return "SNAPSHOT_START";
+    case LevelUpdateType::SNAPSHOT_END:
+        return "SNAPSHOT_END";
+    case LevelUpdateType::INVALID:
+        return "INVALID";
+    }
+    return "UNKNOWN";
+}
+
 /// These structures go over the wire / network, so the binary structures are packed to remove system dependent extra padding.
 #pragma pack(push, 1)
 
@@ -83,10 +115,88 @@ struct MDPMarketUpdate {
     }
 };
 
+/** 聚合后的 L2 价位行情，一次撮合事件中每个被改动的价位只会发布一条 */
+/// Aggregated price level update structure used internally by the matching engine, carries the total quantity and
+/// number of orders resting at the price level after the matching event.
+/// For SNAPSHOT_START / SNAPSHOT_END messages price_ contains the last sequence number from the incremental price level
+/// stream used to build the snapshot.
+struct MELevelUpdate {
+    LevelUpdateType type_ = LevelUpdateType::INVALID;
+
+    TickerId ticker_id_ = TickerId_INVALID;
+    Side side_ = Side::INVALID;
+    Price price_ = Price_INVALID;
+    Qty qty_ = Qty_INVALID;
+    uint32_t num_orders_ = 0;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MELevelUpdate"
+           << " ["
+           << " type:" << levelUpdateTypeToString(type_) << " ticker:" << tickerIdToString(ticker_id_)
+           << " side:" << sideToString(side_) << " price:" << priceToString(price_) << " qty:" << qtyToString(qty_)
+           << " orders:" << num_orders_ << "]";
+        return ss.str();
+    }
+};
+
+/// Price level update structure published over the network by the market data publisher.
+struct MDPLevelUpdate {
+    size_t seq_num_ = 0;
+    MELevelUpdate me_level_update_;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MDPLevelUpdate"
+           << " ["
+           << " seq:" << seq_num_ << " " << me_level_update_.toString() << "]";
+        return ss.str();
+    }
+};
+
+/** 合并后的盘口（BBO）行情，每条都是某个 ticker 最新的完整盘口状态，丢包后下一条就能自动纠正 */
+/// Top of book update structure used internally by the matching engine, carries the best bid and ask prices and the
+/// total quantity at those prices after the matching event.
+struct MEBBOUpdate {
+    TickerId ticker_id_ = TickerId_INVALID;
+    Price bid_price_ = Price_INVALID, ask_price_ = Price_INVALID;
+    Qty bid_qty_ = Qty_INVALID, ask_qty_ = Qty_INVALID;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MEBBOUpdate"
+           << " ["
+           << " ticker:" << tickerIdToString(ticker_id_) << " " << qtyToString(bid_qty_) << "@"
+           << priceToString(bid_price_) << "X" << priceToString(ask_price_) << "@" << qtyToString(ask_qty_) << "]";
+        return ss.str();
+    }
+};
+
+/// Conflated top of book update structure published over the network by the market data publisher.
+struct MDPBBOUpdate {
+    size_t seq_num_ = 0;
+    MEBBOUpdate me_bbo_update_;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MDPBBOUpdate"
+           << " ["
+           << " seq:" << seq_num_ << " " << me_bbo_update_.toString() << "]";
+        return ss.str();
+    }
+};
+
 #pragma pack(pop) // Undo the packed binary structure directive moving forward.
 
 /// Lock free queues of matching engine market update messages and market data publisher market updates messages
 /// respectively.
 typedef Common::LFQueue<Exchange::MEMarketUpdate> MEMarketUpdateLFQueue;
 typedef Common::LFQueue<Exchange::MDPMarketUpdate> MDPMarketUpdateLFQueue;
+
+/// Lock free queues of matching engine price level updates and market data publisher price level updates respectively.
+typedef Common::LFQueue<Exchange::MELevelUpdate> MELevelUpdateLFQueue;
+typedef Common::LFQueue<Exchange::MDPLevelUpdate> MDPLevelUpdateLFQueue;
+
+/// Lock free queue of top of book updates.
+typedef Common::LFQueue<Exchange::MEBBOUpdate> MEBBOUpdateLFQueue;
 } // namespace Exchange
@@ -0,0 +1,145 @@
+#pragma once
+
+/**
+ * 行情按 ticker 分片到多个组播 channel
+ * 每个 channel 都有自己的 incremental 组播组和 snapshot 组播组，序号和快照周期互相独立
+ * consumer 只需要加入自己关心的 ticker 所在的 channel
+ * 可选的 L2 聚合价位行情也按同样的 channel 划分，使用另一对 incremental / snapshot 组播组
+ * 可选的合并 BBO 行情每个 channel 只有一个组播组，每条消息都是完整的盘口状态，所以不需要 snapshot
+ */
+
+#include <array>
+#include <sstream>
+#include <string>
+
+#include "common/types.h"
+#include "common/time_utils.h"
+
+using namespace Common;
+
+namespace Exchange
+{
+/// Maximum number of market data channels, each channel is a pair of incremental and snapshot multicast streams.
+constexpr size_t ME_MAX_MD_CHANNELS = ME_MAX_TICKERS;
+
+/// Multicast stream information for a single market data channel.
+struct MDChannelCfg {
+    std::string snapshot_ip_;
+    int snapshot_port_ = -1;
+    std::string incremental_ip_;
+    int incremental_port_ = -1;
+
+    /// Multicast streams for the aggregated price level feed of this channel, only used if the level feed is enabled.
+    std::string level_snapshot_ip_;
+    int level_snapshot_port_ = -1;
+    std::string level_incremental_ip_;
+    int level_incremental_port_ = -1;
+
+    /// Multicast stream for the conflated top of book feed of this channel, only used if the BBO feed is enabled.
+    std::string bbo_ip_;
+    int bbo_port_ = -1;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MDChannelCfg{"
+           << "snapshot:" << snapshot_ip_ << ":" << snapshot_port_ << " "
+           << "incremental:" << incremental_ip_ << ":" << incremental_port_ << " "
+           << "level_snapshot:" << level_snapshot_ip_ << ":" << level_snapshot_port_ << " "
+           << "level_incremental:" << level_incremental_ip_ << ":" << level_incremental_port_ << " "
+           << "bbo:" << bbo_ip_ << ":" << bbo_port_ << "}";
+
+        return ss.str();
+    }
+};
+
+/// Configuration of all market data channels and the TickerId -> channel mapping, shared by the exchange side
+/// publisher and the trading side consumers.
+struct MDChannelsCfg {
+    size_t num_channels_ = 1;
+
+    /// True if the aggregated price level feed is published alongside the order by order feed.
+    bool level_feed_ = false;
+
+    /// True if the conflated top of book feed is published, at most one update per ticker is sent every
+    /// bbo_interval_ nanoseconds, 0 means at most one update per ticker for every batch of matching events.
+    bool bbo_feed_ = false;
+    Nanos bbo_interval_ = 0;
+
+    /// Hash map from channel index -> MDChannelCfg, only the first num_channels_ entries are used.
+    std::array<MDChannelCfg, ME_MAX_MD_CHANNELS> channels_;
+
+    /// Hash map from TickerId -> channel index.
+    std::array<size_t, ME_MAX_TICKERS> ticker_channel_{};
+
+    auto channelForTicker(TickerId ticker_id) const noexcept {
+        return ticker_channel_[ticker_id];
+    }
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MDChannelsCfg{"
+           << "level_feed:" << level_feed_ << " "
+           << "bbo_feed:" << bbo_feed_ << " "
+           << "bbo_interval:" << bbo_interval_ << " ";
+        for (size_t i = 0; i < num_channels_; ++i)
+            ss << "[" << i << "]:" << channels_[i].toString() << " ";
+        ss << "tickers:[";
+        for (size_t i = 0; i < ticker_channel_.size(); ++i)
+            ss << i << "->" << ticker_channel_[i] << " ";
+        ss << "]}";
+
+        return ss.str();
+    }
+};
+
+/// Build a channel configuration with num_channels channels, each one on its own pair of multicast groups and ports,
+/// with tickers assigned to channels round robin. Channel 0 uses the base addresses and ports.
+inline auto makeMDChannelsCfg(size_t num_channels, const std::string& ip_prefix, int snapshot_ip_suffix,
+                              int snapshot_port, int incremental_ip_suffix, int incremental_port) -> MDChannelsCfg {
+    ASSERT(num_channels && num_channels <= ME_MAX_MD_CHANNELS,
+           "Invalid number of market data channels:" + std::to_string(num_channels));
+
+    MDChannelsCfg cfg;
+    cfg.num_channels_ = num_channels;
+    for (size_t i = 0; i < num_channels; ++i) {
+        const auto offset = static_cast<int>(i) * 4;
+        auto& channel_cfg = cfg.channels_[i];
+        channel_cfg.snapshot_ip_ = ip_prefix + std::to_string(snapshot_ip_suffix + offset);
+        channel_cfg.snapshot_port_ = snapshot_port + static_cast<int>(i) * 2;
+        channel_cfg.incremental_ip_ = ip_prefix + std::to_string(incremental_ip_suffix + offset);
+        channel_cfg.incremental_port_ = incremental_port + static_cast<int>(i) * 2;
+    }
+    for (size_t ticker_id = 0; ticker_id < cfg.ticker_channel_.size(); ++ticker_id)
+        cfg.ticker_channel_[ticker_id] = ticker_id % num_channels;
+
+    return cfg;
+}
+
+/// Enable the aggregated price level feed on every channel of cfg, laid out the same way as the order by order feed
+/// in makeMDChannelsCfg(), the ports must not overlap with the ports of the order by order feed.
+inline auto addMDLevelFeed(MDChannelsCfg* cfg, const std::string& ip_prefix, int snapshot_ip_suffix,
+                           int snapshot_port, int incremental_ip_suffix, int incremental_port) -> void {
+    cfg->level_feed_ = true;
+    for (size_t i = 0; i < cfg->num_channels_; ++i) {
+        const auto offset = static_cast<int>(i) * 4;
+        auto& channel_cfg = cfg->channels_[i];
+        channel_cfg.level_snapshot_ip_ = ip_prefix + std::to_string(snapshot_ip_suffix + offset);
+        channel_cfg.level_snapshot_port_ = snapshot_port + static_cast<int>(i) * 2;
+        channel_cfg.level_incremental_ip_ = ip_prefix + std::to_string(incremental_ip_suffix + offset);
+        channel_cfg.level_incremental_port_ = incremental_port + static_cast<int>(i) * 2;
+    }
+}
+
+/// Enable the conflated top of book feed on every channel of cfg, channel i uses ip_suffix + i and port + i, the ports
+/// must not overlap with the ports of the other feeds.
+inline auto addMDBBOFeed(MDChannelsCfg* cfg, const std::string& ip_prefix, int ip_suffix, int port,
+                         Nanos interval) -> void {
+    cfg->bbo_feed_ = true;
+    cfg->bbo_interval_ = interval;
+    for (size_t i = 0; i < cfg->num_channels_; ++i) {
+        auto& channel_cfg = cfg->channels_[i];
+        channel_cfg.bbo_ip_ = ip_prefix + std::to_string(ip_suffix + static_cast<int>(i));
+        channel_cfg.bbo_port_ = port + static_cast<int>(i);
+    }
+}
+} // namespace Exchange
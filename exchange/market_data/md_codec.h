@@ -0,0 +1,250 @@
+#pragma once
+
+/**
+ * 逐笔行情（MDPMarketUpdate）的紧凑二进制编码
+ *
+ * 若干条序号连续的 update 打包成一个 frame：
+ *  frame   = [version: u8][frame_len: varint][first_seq: varint][num_updates: varint][base_order_id: varint][update...]
+ *  update  = [flags: u8][ticker + 1: varint][order_id - base: zigzag varint][price - last_price: zigzag varint]
+ *            [qty + 1: varint][priority + 1: varint]
+ *  flags   = type（低 3 位）| side 下标（2 位）| 是否带 order_id | 是否带 price
+ *
+ * - 价格相对同一个 frame 内该 ticker 的上一个价格做差分，order id 相对 frame 的 base_order_id 做差分，
+ *   每个 frame 都能单独解码，UDP 丢掉一个 datagram 不会影响后面的 frame
+ * - 值为 0 的 varint 表示 INVALID（ticker / qty / priority），order_id / price 为 INVALID 时不写
+ * - version 和 frame_len 的位置以后的版本也不能变，这样解码端可以跳过不认识的版本
+ */
+
+#include <array>
+#include <cstring>
+
+#include "common/macros.h"
+#include "common/types.h"
+
+#include "market_update.h"
+
+namespace Exchange
+{
+/// Version of the compact market data encoding written in the first byte of every frame.
+constexpr uint8_t MD_CODEC_VERSION = 1;
+
+/// Upper bound on the encoded size of a single market update and of the frame header.
+constexpr size_t MD_MAX_ENCODED_UPDATE_SIZE = 1 + 5 + 10 + 10 + 5 + 10;
+constexpr size_t MD_MAX_FRAME_HEADER_SIZE = 1 + 4 * 10;
+
+/// Maximum encoded size of the updates in a frame, kept below a typical MTU so a frame fits in a single datagram.
+constexpr size_t MD_MAX_FRAME_BODY_SIZE = 1400;
+
+/// Maximum encoded size of a frame, the size of the buffer MDPEncoder::finish() writes to.
+constexpr size_t MD_MAX_FRAME_SIZE = MD_MAX_FRAME_HEADER_SIZE + MD_MAX_FRAME_BODY_SIZE;
+
+/// Write v as a LEB128 varint to out and return the number of bytes written.
+inline auto putVarint(uint8_t* out, uint64_t v) noexcept -> size_t {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+
+    return n;
+}
+
+/// Read a LEB128 varint from [in, end) into v and return the number of bytes read, 0 if the varint is truncated.
+inline auto getVarint(const uint8_t* in, const uint8_t* end, uint64_t* v) noexcept -> size_t {
+    uint64_t result = 0;
+    for (size_t n = 0; n < 10 && in + n < end; ++n) {
+        result |= static_cast<uint64_t>(in[n] & 0x7f) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *v = result;
+            return n + 1;
+        }
+    }
+
+    return 0;
+}
+
+/// Map signed deltas to unsigned values so that small negative deltas also encode to short varints.
+inline auto zigzagEncode(int64_t v) noexcept {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline auto zigzagDecode(uint64_t v) noexcept {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+/// Map values using their type's INVALID sentinel to varints where 0 represents INVALID.
+template<typename T>
+inline auto encodeOptional(T v, T invalid) noexcept {
+    return (v == invalid ? 0 : static_cast<uint64_t>(v) + 1);
+}
+
+template<typename T>
+inline auto decodeOptional(uint64_t v, T invalid) noexcept {
+    return (v ? static_cast<T>(v - 1) : invalid);
+}
+
+/// Bits in the flags byte of an encoded market update.
+constexpr uint8_t MD_FLAG_TYPE_MASK = 0x07;
+constexpr uint8_t MD_FLAG_SIDE_SHIFT = 3;
+constexpr uint8_t MD_FLAG_SIDE_MASK = 0x03;
+constexpr uint8_t MD_FLAG_HAS_ORDER_ID = 0x20;
+constexpr uint8_t MD_FLAG_HAS_PRICE = 0x40;
+
+/// Builds frames out of market updates with consecutive sequence numbers.
+class MDPEncoder {
+public:
+    /// Append a market update to the current frame, seq_num must follow the sequence number of the previous update.
+    auto add(size_t seq_num, const MEMarketUpdate* market_update) noexcept -> void {
+        if (UNLIKELY(full()))
+            FATAL("Frame is full, finish() was not called.");
+        if (!num_updates_) {
+            first_seq_num_ = seq_num;
+            base_order_id_ = OrderId_INVALID;
+            last_price_.fill(0);
+        }
+        if (UNLIKELY(seq_num != first_seq_num_ + num_updates_))
+            FATAL("Non consecutive seq:" + std::to_string(seq_num) + " in frame starting at:" +
+                  std::to_string(first_seq_num_));
+
+        auto out = body_.data() + body_size_;
+        const auto has_order_id = (market_update->order_id_ != OrderId_INVALID);
+        const auto has_price = (market_update->price_ != Price_INVALID);
+        *out++ = static_cast<uint8_t>(static_cast<uint8_t>(market_update->type_) |
+                                      (sideToIndex(market_update->side_) << MD_FLAG_SIDE_SHIFT) |
+                                      (has_order_id ? MD_FLAG_HAS_ORDER_ID : 0) | (has_price ? MD_FLAG_HAS_PRICE : 0));
+        out += putVarint(out, encodeOptional(market_update->ticker_id_, TickerId_INVALID));
+        if (has_order_id) {
+            if (base_order_id_ == OrderId_INVALID)
+                base_order_id_ = market_update->order_id_;
+            out += putVarint(out, zigzagEncode(static_cast<int64_t>(market_update->order_id_ - base_order_id_)));
+        }
+        if (has_price) {
+            auto& last_price = lastPrice(market_update->ticker_id_);
+            out += putVarint(out, zigzagEncode(market_update->price_ - last_price));
+            last_price = market_update->price_;
+        }
+        out += putVarint(out, encodeOptional(market_update->qty_, Qty_INVALID));
+        out += putVarint(out, encodeOptional(market_update->priority_, Priority_INVALID));
+
+        body_size_ = out - body_.data();
+        ++num_updates_;
+    }
+
+    /// True if another update might not fit in the current frame.
+    auto full() const noexcept -> bool {
+        return body_size_ + MD_MAX_ENCODED_UPDATE_SIZE > body_.size();
+    }
+
+    auto empty() const noexcept {
+        return !num_updates_;
+    }
+
+    /// Write the current frame to out, which must have room for MD_MAX_FRAME_SIZE bytes, start a new frame and return
+    /// the number of bytes written.
+    auto finish(char* out) noexcept -> size_t {
+        std::array<uint8_t, MD_MAX_FRAME_HEADER_SIZE> header;
+        auto header_size = putVarint(header.data(), first_seq_num_);
+        header_size += putVarint(header.data() + header_size, num_updates_);
+        header_size += putVarint(header.data() + header_size, (base_order_id_ == OrderId_INVALID ? 0 : base_order_id_));
+
+        auto frame = reinterpret_cast<uint8_t*>(out);
+        size_t n = 0;
+        frame[n++] = MD_CODEC_VERSION;
+        n += putVarint(frame + n, header_size + body_size_);
+        std::memcpy(frame + n, header.data(), header_size);
+        n += header_size;
+        std::memcpy(frame + n, body_.data(), body_size_);
+        n += body_size_;
+
+        body_size_ = 0;
+        num_updates_ = 0;
+
+        return n;
+    }
+
+private:
+    std::array<uint8_t, MD_MAX_FRAME_BODY_SIZE> body_;
+    size_t body_size_ = 0;
+
+    size_t first_seq_num_ = 0;
+    size_t num_updates_ = 0;
+    OrderId base_order_id_ = OrderId_INVALID;
+
+    /// Hash map from TickerId -> last price encoded in the current frame, the extra entry is shared by invalid tickers.
+    std::array<Price, ME_MAX_TICKERS + 1> last_price_{};
+
+    auto lastPrice(TickerId ticker_id) noexcept -> Price& {
+        return last_price_[ticker_id < ME_MAX_TICKERS ? ticker_id : ME_MAX_TICKERS];
+    }
+};
+
+/// Decode every complete frame in [data, data + len) and call on_update(const MDPMarketUpdate*) for every market update
+/// in it. Frames with an unknown version are skipped. Returns the number of bytes consumed, any incomplete frame at the
+/// end is left in the buffer.
+template<typename F>
+inline auto decodeMDPFrames(const char* data, size_t len, F&& on_update) noexcept -> size_t {
+    const auto begin = reinterpret_cast<const uint8_t*>(data);
+    const auto end = begin + len;
+    auto in = begin;
+
+    while (in < end) {
+        uint64_t frame_len = 0;
+        const auto len_size = getVarint(in + 1, end, &frame_len);
+        if (!len_size || frame_len > static_cast<uint64_t>(end - (in + 1 + len_size))) // incomplete frame.
+            break;
+
+        const auto version = *in;
+        auto p = in + 1 + len_size;
+        const auto frame_end = p + frame_len;
+        in = frame_end;
+        if (UNLIKELY(version != MD_CODEC_VERSION))
+            continue;
+
+        uint64_t first_seq_num = 0, num_updates = 0, base_order_id = 0;
+        p += getVarint(p, frame_end, &first_seq_num);
+        p += getVarint(p, frame_end, &num_updates);
+        p += getVarint(p, frame_end, &base_order_id);
+
+        std::array<Price, ME_MAX_TICKERS + 1> last_price{};
+        MDPMarketUpdate update;
+        for (uint64_t i = 0; i < num_updates && p < frame_end; ++i) {
+            auto& market_update = update.me_market_update_;
+            const auto flags = *p++;
+            uint64_t v = 0;
+
+            market_update.type_ = static_cast<MarketUpdateType>(flags & MD_FLAG_TYPE_MASK);
+            market_update.side_ =
+                static_cast<Side>(static_cast<int>((flags >> MD_FLAG_SIDE_SHIFT) & MD_FLAG_SIDE_MASK) - 1);
+
+            p += getVarint(p, frame_end, &v);
+            market_update.ticker_id_ = decodeOptional(v, TickerId_INVALID);
+
+            market_update.order_id_ = OrderId_INVALID;
+            if (flags & MD_FLAG_HAS_ORDER_ID) {
+                p += getVarint(p, frame_end, &v);
+                market_update.order_id_ = base_order_id + zigzagDecode(v);
+            }
+
+            market_update.price_ = Price_INVALID;
+            if (flags & MD_FLAG_HAS_PRICE) {
+                auto& last = last_price[market_update.ticker_id_ < ME_MAX_TICKERS ? market_update.ticker_id_
+                                                                                   : ME_MAX_TICKERS];
+                p += getVarint(p, frame_end, &v);
+                market_update.price_ = last + zigzagDecode(v);
+                last = market_update.price_;
+            }
+
+            p += getVarint(p, frame_end, &v);
+            market_update.qty_ = decodeOptional(v, Qty_INVALID);
+            p += getVarint(p, frame_end, &v);
+            market_update.priority_ = decodeOptional(v, Priority_INVALID);
+
+            update.seq_num_ = first_seq_num + i;
+            on_update(&update);
+        }
+    }
+
+    return in - begin;
+}
+} // namespace Exchange
@@ -0,0 +1,138 @@
+#include <vector>
+
+#include "common/test_utils.h"
+
+#include "market_data/md_codec.h"
+
+/**
+ * 逐笔行情紧凑编码的测试：编码再解码得到同样的 update，跳过不认识的版本，不完整的 frame 留在缓冲区里
+ */
+
+namespace
+{
+using namespace Exchange;
+
+/// Updates exercising every field: every type, INVALID values, prices moving both ways on interleaved tickers and order
+/// ids below the first one in the frame.
+auto makeUpdates() {
+    return std::vector<MEMarketUpdate>{
+        {MarketUpdateType::ADD, 1000, 0, Side::BUY, 100, 10, 1},
+        {MarketUpdateType::ADD, 1001, 1, Side::SELL, 5000, 20, 1},
+        {MarketUpdateType::MODIFY, 1000, 0, Side::BUY, 100, 5, 1},
+        {MarketUpdateType::ADD, 998, 0, Side::SELL, 99, 7, 2},
+        {MarketUpdateType::TRADE, OrderId_INVALID, 1, Side::SELL, 4990, 3, Priority_INVALID},
+        {MarketUpdateType::CANCEL, 1001, 1, Side::SELL, 5000, 0, 1},
+        {MarketUpdateType::TRADE, OrderId_INVALID, 0, Side::INVALID, 101, 12, Priority_INVALID},
+        {MarketUpdateType::CLEAR, OrderId_INVALID, TickerId_INVALID, Side::INVALID, Price_INVALID, Qty_INVALID,
+         Priority_INVALID},
+        {MarketUpdateType::ADD, 1ul << 40, ME_MAX_TICKERS - 1, Side::BUY, 1, 1u << 30, 1ul << 35},
+    };
+}
+
+auto sameUpdate(const MEMarketUpdate& a, const MEMarketUpdate& b) {
+    return a.type_ == b.type_ && a.order_id_ == b.order_id_ && a.ticker_id_ == b.ticker_id_ && a.side_ == b.side_ &&
+           a.price_ == b.price_ && a.qty_ == b.qty_ && a.priority_ == b.priority_;
+}
+
+/// Encode the updates as a single frame starting at first_seq_num.
+auto encodeFrame(const std::vector<MEMarketUpdate>& updates, size_t first_seq_num) {
+    MDPEncoder encoder;
+    for (size_t i = 0; i < updates.size(); ++i)
+        encoder.add(first_seq_num + i, &updates[i]);
+    std::vector<char> frame(MD_MAX_FRAME_SIZE);
+    frame.resize(encoder.finish(frame.data()));
+    return frame;
+}
+
+/// Decode the frames in data, returns the bytes consumed.
+auto decode(const std::vector<char>& data, std::vector<MDPMarketUpdate>* decoded) {
+    decoded->clear();
+    return decodeMDPFrames(data.data(), data.size(),
+                           [decoded](const MDPMarketUpdate* update) { decoded->push_back(*update); });
+}
+
+auto testRoundTrip() {
+    const auto updates = makeUpdates();
+    const auto frame = encodeFrame(updates, 42);
+    CHECK(frame.size() < updates.size() * sizeof(MDPMarketUpdate));
+
+    std::vector<MDPMarketUpdate> decoded;
+    CHECK_EQ(decode(frame, &decoded), frame.size());
+    CHECK_EQ(decoded.size(), updates.size());
+    for (size_t i = 0; i < std::min(decoded.size(), updates.size()); ++i) {
+        CHECK_EQ(decoded[i].seq_num_, 42 + i);
+        CHECK(sameUpdate(decoded[i].me_market_update_, updates[i]));
+    }
+}
+
+auto testFramesDecodeIndependently() {
+    // The second frame starts over from its own base order id and prices.
+    const auto updates = makeUpdates();
+    auto data = encodeFrame({updates.begin(), updates.begin() + 4}, 1);
+    const auto second = encodeFrame({updates.begin() + 4, updates.end()}, 5);
+    data.insert(data.end(), second.begin(), second.end());
+
+    std::vector<MDPMarketUpdate> decoded;
+    CHECK_EQ(decode(second, &decoded), second.size());
+    CHECK(!decoded.empty() && decoded[0].seq_num_ == 5 && sameUpdate(decoded[0].me_market_update_, updates[4]));
+
+    CHECK_EQ(decode(data, &decoded), data.size());
+    CHECK_EQ(decoded.size(), updates.size());
+    for (size_t i = 0; i < std::min(decoded.size(), updates.size()); ++i)
+        CHECK(decoded[i].seq_num_ == 1 + i && sameUpdate(decoded[i].me_market_update_, updates[i]));
+}
+
+auto testUnknownVersionSkipped() {
+    const auto updates = makeUpdates();
+    auto data = encodeFrame({updates.begin(), updates.begin() + 3}, 1);
+    data[0] = static_cast<char>(MD_CODEC_VERSION + 1);
+    const auto known = encodeFrame({updates.begin() + 3, updates.end()}, 4);
+    data.insert(data.end(), known.begin(), known.end());
+
+    std::vector<MDPMarketUpdate> decoded;
+    CHECK_EQ(decode(data, &decoded), data.size());
+    CHECK(decoded.size() == updates.size() - 3 && decoded[0].seq_num_ == 4);
+}
+
+auto testTruncatedFrameLeftInBuffer() {
+    const auto updates = makeUpdates();
+    const auto first = encodeFrame({updates.begin(), updates.begin() + 4}, 1);
+    const auto second = encodeFrame({updates.begin() + 4, updates.end()}, 5);
+
+    // Every prefix of the second frame is left for the next datagram / read.
+    std::vector<MDPMarketUpdate> decoded;
+    for (size_t len = 0; len < second.size(); ++len) {
+        auto data = first;
+        data.insert(data.end(), second.begin(), second.begin() + len);
+        CHECK_EQ(decode(data, &decoded), first.size());
+        CHECK_EQ(decoded.size(), 4u);
+    }
+}
+
+auto testFullFrameFits() {
+    // Worst case updates until the encoder reports full, the frame still fits in MD_MAX_FRAME_SIZE.
+    MDPEncoder encoder;
+    const MEMarketUpdate update{MarketUpdateType::ADD, OrderId_INVALID - 1, ME_MAX_TICKERS - 1,  Side::SELL,
+                                Price_INVALID - 1,     Qty_INVALID - 1,     Priority_INVALID - 1};
+    size_t num_updates = 0;
+    for (; !encoder.full(); ++num_updates)
+        encoder.add(num_updates, &update);
+    std::vector<char> frame(MD_MAX_FRAME_SIZE);
+    frame.resize(encoder.finish(frame.data()));
+    CHECK(frame.size() <= MD_MAX_FRAME_SIZE);
+
+    std::vector<MDPMarketUpdate> decoded;
+    CHECK_EQ(decode(frame, &decoded), frame.size());
+    CHECK(decoded.size() == num_updates && sameUpdate(decoded.back().me_market_update_, update));
+}
+} // namespace
+
+int main(int, char**) {
+    Common::runTest("round trip", testRoundTrip);
+    Common::runTest("frames decode independently", testFramesDecodeIndependently);
+    Common::runTest("unknown version skipped", testUnknownVersionSkipped);
+    Common::runTest("truncated frame left in buffer", testTruncatedFrameLeftInBuffer);
+    Common::runTest("full frame fits", testFullFrameFits);
+
+    return Common::testResult();
+}
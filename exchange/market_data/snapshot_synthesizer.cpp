@@ -5,20 +5,52 @@
 
 #include "snapshot_synthesizer.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace Exchange
 {
-SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateLFQueue* market_updates, const std::string& iface,
-                                         const std::string& snapshot_ip, int snapshot_port)
-    : snapshot_md_updates_(market_updates), logger_("exchange_snapshot_synthesizer.log"), snapshot_socket_(logger_),
-      order_pool_(ME_MAX_ORDER_IDS) {
-    ASSERT(snapshot_socket_.init(snapshot_ip, iface, snapshot_port, /*is_listening*/ false) >= 0,
-           "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+SnapshotSynthesizer::SnapshotSynthesizer(MDPMarketUpdateLFQueue* market_updates, MDPLevelUpdateLFQueue* level_updates,
+                                         const std::string& iface, const MDChannelsCfg& channels_cfg)
+    : snapshot_md_updates_(market_updates), snapshot_level_updates_(level_updates),
+      logger_("exchange_snapshot_synthesizer.log"), channels_cfg_(channels_cfg), order_pool_(ME_MAX_ORDER_IDS) {
+    snapshot_sockets_.fill(nullptr);
+    level_snapshot_sockets_.fill(nullptr);
+    for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+        const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+        snapshot_sockets_[channel] = new McastSocket(logger_);
+        ASSERT(snapshot_sockets_[channel]->init(channel_cfg.snapshot_ip_, iface, channel_cfg.snapshot_port_,
+                                                /*is_listening*/ false) >= 0,
+               "Unable to create snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+
+        if (channels_cfg_.level_feed_) {
+            level_snapshot_sockets_[channel] = new McastSocket(logger_);
+            ASSERT(level_snapshot_sockets_[channel]->init(channel_cfg.level_snapshot_ip_, iface,
+                                                          channel_cfg.level_snapshot_port_,
+                                                          /*is_listening*/ false) >= 0,
+                   "Unable to create level snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+        }
+    }
     for (auto& orders : ticker_orders_)
         orders.fill(nullptr);
+    last_inc_seq_num_.fill(0);
+    last_level_inc_seq_num_.fill(0);
+    last_snapshot_time_.fill(0);
 }
 
 SnapshotSynthesizer::~SnapshotSynthesizer() {
     stop();
+
+    for (auto& socket : snapshot_sockets_) {
+        delete socket;
+        socket = nullptr;
+    }
+    for (auto& socket : level_snapshot_sockets_) {
+        delete socket;
+        socket = nullptr;
+    }
 }
 
 /// Start and stop the snapshot synthesizer thread.
@@ -32,6 +64,70 @@ void SnapshotSynthesizer::stop() {
     run_ = false;
 }
 
+/// Seed the empty snapshots with the resting orders and price levels of the checkpoint image at path, returns false if
+/// there is no checkpoint at path.
+/* 镜像是按列存放的，这里只读挂着的订单需要的几列，不需要 ME 把每个订单再发一遍增量行情 */
+auto SnapshotSynthesizer::seedFromCheckpoint(const std::string& path) -> bool {
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    ASSERT(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(MECheckpointHeader),
+           "Checkpoint:" + path + " is truncated.");
+    const auto size = static_cast<size_t>(st.st_size);
+    const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    ASSERT(mapping != MAP_FAILED, "Unable to mmap checkpoint:" + path + " error:" + std::string(std::strerror(errno)));
+    const auto image = static_cast<const char*>(mapping);
+
+    const auto header = reinterpret_cast<const MECheckpointHeader*>(image);
+    ASSERT(header->magic_ == ME_CHECKPOINT_MAGIC && header->version_ == ME_CHECKPOINT_VERSION &&
+               header->num_tickers_ <= ME_MAX_TICKERS,
+           "Checkpoint:" + path + " has an unexpected layout.");
+
+    size_t num_orders = 0, num_levels = 0;
+    auto offset = sizeof(MECheckpointHeader);
+    for (uint32_t book = 0; book < header->num_tickers_; ++book) {
+        MEBookCheckpointColumns columns;
+        const auto book_size = columns.read(image + offset, size - offset);
+        ASSERT(book_size, "Checkpoint:" + path + " is truncated.");
+        offset += book_size;
+
+        const auto ticker_id = columns.book_->ticker_id_;
+        auto& orders = ticker_orders_.at(ticker_id);
+        const auto num_resting_orders = columns.numRestingOrders();
+        for (uint64_t i = 0; i < num_resting_orders; ++i) {
+            if (UNLIKELY(orders.at(columns.market_order_id_[i]) != nullptr))
+                FATAL("Snapshot already has order:" + orderIdToString(columns.market_order_id_[i]));
+            orders.at(columns.market_order_id_[i]) = order_pool_.allocate(
+                MEMarketUpdate{MarketUpdateType::ADD, columns.market_order_id_[i], ticker_id, columns.side_[i],
+                               columns.price_[i], columns.qty_[i], columns.priority_[i]});
+        }
+        num_orders += num_resting_orders;
+
+        if (channels_cfg_.level_feed_) {
+            for (uint64_t i = 0; i < columns.book_->num_levels_; ++i) {
+                const auto side = columns.level_side_[i];
+                const auto price = columns.level_price_[i];
+                ticker_levels_.at(ticker_id).at(sideToIndex(side)).at(price % ME_MAX_PRICE_LEVELS) =
+                    {LevelUpdateType::ADD, ticker_id, side, price, columns.level_qty_[i], columns.level_num_orders_[i]};
+            }
+            num_levels += columns.book_->num_levels_;
+        }
+    }
+    const auto seq_num = header->seq_num_;
+    munmap(mapping, size);
+
+    last_inc_seq_num_.fill(MD_SEED_SEQ_NUM);
+    last_level_inc_seq_num_.fill(MD_SEED_SEQ_NUM);
+
+    logger_.log("%:% %() % Seeded % orders and % levels from checkpoint:% seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                getCurrentTimeStr(&time_str_), num_orders, num_levels, path, seq_num);
+
+    return true;
+}
+
 /// Process an incremental market update and update the limit order book snapshot.
 auto SnapshotSynthesizer::addToSnapshot(const MDPMarketUpdate* market_update) {
     const auto& me_market_update = market_update->me_market_update_;
@@ -39,9 +135,13 @@ auto SnapshotSynthesizer::addToSnapshot(const MDPMarketUpdate* market_update) {
     switch (me_market_update.type_) {
     case MarketUpdateType::ADD: {
         auto order = orders->at(me_market_update.order_id_);
-        ASSERT(order == nullptr, "Received:" + me_market_update.toString() +
-                                     " but order already exists:" + (order ? order->toString() : ""));
-        orders->at(me_market_update.order_id_) = order_pool_.allocate(me_market_update);
+        if (order) { // modified and re-queued, replaces the old order.
+            ASSERT(order->side_ == me_market_update.side_, "Received:" + me_market_update.toString() +
+                                                               " but order already exists:" + order->toString());
+            *order = me_market_update;
+        } else {
+            orders->at(me_market_update.order_id_) = order_pool_.allocate(me_market_update);
+        }
     } break;
     case MarketUpdateType::MODIFY: {
         auto order = orders->at(me_market_update.order_id_);
@@ -69,31 +169,65 @@ auto SnapshotSynthesizer::addToSnapshot(const MDPMarketUpdate* market_update) {
         break;
     }
 
-    /* 校验接收到的增量消息 seq_num_ 是否正好是上次记录的 next + 1，用于检测丢包或乱序 */
-    ASSERT(market_update->seq_num_ == last_inc_seq_num_ + 1, "Expected incremental seq_nums to increase.");
+    /* 每个 channel 的序号是独立的，校验接收到的增量消息 seq_num_ 是否正好是该 channel 上次记录的 next + 1，用于检测丢包或乱序 */
+    auto& last_inc_seq_num = last_inc_seq_num_[channels_cfg_.channelForTicker(me_market_update.ticker_id_)];
+    ASSERT(market_update->seq_num_ == last_inc_seq_num + 1, "Expected incremental seq_nums to increase.");
     /* 记录快照记录到哪一条增量记录了，可以给下一个函数 publishSnapshot() 使用 */
-    last_inc_seq_num_ = market_update->seq_num_;
+    last_inc_seq_num = market_update->seq_num_;
+}
+
+/// Process an incremental price level update and update the price level snapshot.
+auto SnapshotSynthesizer::addToLevelSnapshot(const MDPLevelUpdate* level_update) {
+    const auto& me_level_update = level_update->me_level_update_;
+    auto& level = ticker_levels_.at(me_level_update.ticker_id_)
+                      .at(sideToIndex(me_level_update.side_))
+                      .at(me_level_update.price_ % ME_MAX_PRICE_LEVELS);
+    switch (me_level_update.type_) {
+    case LevelUpdateType::ADD:
+    case LevelUpdateType::UPDATE: {
+        level = me_level_update;
+        level.type_ = LevelUpdateType::ADD; // published as a new level in the snapshot.
+    } break;
+    case LevelUpdateType::DELETE: {
+        ASSERT(level.type_ != LevelUpdateType::INVALID && level.price_ == me_level_update.price_,
+               "Received:" + me_level_update.toString() + " but level does not exist:" + level.toString());
+        level = {};
+    } break;
+    case LevelUpdateType::SNAPSHOT_START:
+    case LevelUpdateType::CLEAR:
+    case LevelUpdateType::SNAPSHOT_END:
+    case LevelUpdateType::INVALID:
+        break;
+    }
+
+    auto& last_level_inc_seq_num = last_level_inc_seq_num_[channels_cfg_.channelForTicker(me_level_update.ticker_id_)];
+    ASSERT(level_update->seq_num_ == last_level_inc_seq_num + 1, "Expected incremental level seq_nums to increase.");
+    last_level_inc_seq_num = level_update->seq_num_;
 }
 
-/// Publish a full snapshot cycle on the snapshot multicast stream.
-auto SnapshotSynthesizer::publishSnapshot() {
+/// Publish a full snapshot cycle for the tickers of the provided channel on that channel's snapshot multicast stream.
+auto SnapshotSynthesizer::publishSnapshot(size_t channel) {
     size_t snapshot_size = 0;
+    auto& snapshot_socket = *snapshot_sockets_[channel];
+    const auto last_inc_seq_num = last_inc_seq_num_[channel];
 
     // The snapshot cycle starts with a SNAPSHOT_START message and order_id_ contains the last sequence number from the
     // incremental market data stream used to build this snapshot.
     /**
      * ！！！
-     * 标记快照同步的起点，order_id_ 字段被复用来记录当前已消费到的增量消息序号 last_inc_seq_num_
+     * 标记快照同步的起点，order_id_ 字段被复用来记录当前 channel 已消费到的增量消息序号 last_inc_seq_num
      * 下游在收到完整快照后就知道下一条要从哪个增量序号开始继续回放。
      */
-    const MDPMarketUpdate start_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_START, last_inc_seq_num_}};
+    const MDPMarketUpdate start_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_START, last_inc_seq_num}};
     logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
                 start_market_update.toString());
-    snapshot_socket_.send(&start_market_update, sizeof(MDPMarketUpdate));
+    sendSnapshotUpdate(&snapshot_socket, &start_market_update);
 
-    /* 这里先发送每一个 Ticker 的 CLEAR 报文，然后再发送每一个 order */
-    // Publish order information for each order in the limit order book for each instrument.
+    /* 这里先发送这个 channel 上每一个 Ticker 的 CLEAR 报文，然后再发送每一个 order */
+    // Publish order information for each order in the limit order book for each instrument on this channel.
     for (size_t ticker_id = 0; ticker_id < ticker_orders_.size(); ++ticker_id) {
+        if (channels_cfg_.channelForTicker(ticker_id) != channel) continue;
+
         const auto& orders = ticker_orders_.at(ticker_id);
 
         MEMarketUpdate me_market_update;
@@ -105,7 +239,7 @@ auto SnapshotSynthesizer::publishSnapshot() {
         const MDPMarketUpdate clear_market_update{snapshot_size++, me_market_update};
         logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
                     clear_market_update.toString());
-        snapshot_socket_.send(&clear_market_update, sizeof(MDPMarketUpdate));
+        sendSnapshotUpdate(&snapshot_socket, &clear_market_update);
 
         // Publish each order.
         for (const auto order : orders) {
@@ -113,8 +247,7 @@ auto SnapshotSynthesizer::publishSnapshot() {
                 const MDPMarketUpdate market_update{snapshot_size++, *order};
                 logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
                             market_update.toString());
-                snapshot_socket_.send(&market_update, sizeof(MDPMarketUpdate));
-                snapshot_socket_.sendAndRecv();
+                sendSnapshotUpdate(&snapshot_socket, &market_update);
             }
         }
     }
@@ -122,18 +255,70 @@ auto SnapshotSynthesizer::publishSnapshot() {
     // The snapshot cycle ends with a SNAPSHOT_END message and order_id_ contains the last sequence number from the
     // incremental market data stream used to build this snapshot.
     /* 发送 END message 标记快照结束 */
-    const MDPMarketUpdate end_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_END, last_inc_seq_num_}};
+    const MDPMarketUpdate end_market_update{snapshot_size++, {MarketUpdateType::SNAPSHOT_END, last_inc_seq_num}};
     logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
                 end_market_update.toString());
-    snapshot_socket_.send(&end_market_update, sizeof(MDPMarketUpdate));
-    snapshot_socket_.sendAndRecv();
+    sendSnapshotUpdate(&snapshot_socket, &end_market_update);
+    sendFrame(&snapshot_socket);
 
-    logger_.log("%:% %() % Published snapshot of % orders.\n", __FILE__, __LINE__, __FUNCTION__,
-                getCurrentTimeStr(&time_str_), snapshot_size - 1);
+    logger_.log("%:% %() % Published snapshot of % orders on channel:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                getCurrentTimeStr(&time_str_), snapshot_size - 1, channel);
+}
+
+/// Publish a full price level snapshot cycle for the tickers of the provided channel on that channel's price level
+/// snapshot multicast stream.
+/* 和 publishSnapshot() 的格式一样：START、每个 ticker 的 CLEAR 和所有价位、END，START / END 的 price_ 是 L2 增量序号 */
+auto SnapshotSynthesizer::publishLevelSnapshot(size_t channel) {
+    size_t snapshot_size = 0;
+    auto& snapshot_socket = *level_snapshot_sockets_[channel];
+    const auto last_level_inc_seq_num = static_cast<Price>(last_level_inc_seq_num_[channel]);
+
+    const MDPLevelUpdate start_level_update{
+        snapshot_size++,
+        {LevelUpdateType::SNAPSHOT_START, TickerId_INVALID, Side::INVALID, last_level_inc_seq_num, 0, 0}};
+    logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                start_level_update.toString());
+    snapshot_socket.send(&start_level_update, sizeof(MDPLevelUpdate));
+
+    for (size_t ticker_id = 0; ticker_id < ticker_levels_.size(); ++ticker_id) {
+        if (channels_cfg_.channelForTicker(ticker_id) != channel) continue;
+
+        MELevelUpdate clear_update;
+        clear_update.type_ = LevelUpdateType::CLEAR;
+        clear_update.ticker_id_ = ticker_id;
+
+        const MDPLevelUpdate clear_level_update{snapshot_size++, clear_update};
+        logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                    clear_level_update.toString());
+        snapshot_socket.send(&clear_level_update, sizeof(MDPLevelUpdate));
+
+        for (const auto& side_levels : ticker_levels_.at(ticker_id)) {
+            for (const auto& level : side_levels) {
+                if (level.type_ == LevelUpdateType::INVALID) continue;
+
+                const MDPLevelUpdate level_update{snapshot_size++, level};
+                logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                            level_update.toString());
+                snapshot_socket.send(&level_update, sizeof(MDPLevelUpdate));
+                snapshot_socket.sendAndRecv();
+            }
+        }
+    }
+
+    const MDPLevelUpdate end_level_update{
+        snapshot_size++,
+        {LevelUpdateType::SNAPSHOT_END, TickerId_INVALID, Side::INVALID, last_level_inc_seq_num, 0, 0}};
+    logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                end_level_update.toString());
+    snapshot_socket.send(&end_level_update, sizeof(MDPLevelUpdate));
+    snapshot_socket.sendAndRecv();
+
+    logger_.log("%:% %() % Published level snapshot of % levels on channel:%.\n", __FILE__, __LINE__, __FUNCTION__,
+                getCurrentTimeStr(&time_str_), snapshot_size - 1, channel);
 }
 
 /// Main method for this thread - processes incremental updates from the market data publisher, updates the snapshot and
-/// publishes the snapshot periodically.
+/// publishes the snapshot of every channel periodically.
 void SnapshotSynthesizer::run() {
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_));
     while (run_) {
@@ -148,10 +333,27 @@ void SnapshotSynthesizer::run() {
             snapshot_md_updates_->updateReadIndex();
         }
 
-        /* 循环发布 */
-        if (getCurrentNanos() - last_snapshot_time_ > 60 * NANOS_TO_SECS) {
-            last_snapshot_time_ = getCurrentNanos();
-            publishSnapshot();
+        if (channels_cfg_.level_feed_) {
+            for (auto level_update = snapshot_level_updates_->getNextToRead();
+                 snapshot_level_updates_->size() && level_update;
+                 level_update = snapshot_level_updates_->getNextToRead()) {
+                logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__, getCurrentTimeStr(&time_str_),
+                            level_update->toString().c_str());
+
+                addToLevelSnapshot(level_update);
+
+                snapshot_level_updates_->updateReadIndex();
+            }
+        }
+
+        /* 每个 channel 各自循环发布 */
+        for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+            if (getCurrentNanos() - last_snapshot_time_[channel] > 60 * NANOS_TO_SECS) {
+                last_snapshot_time_[channel] = getCurrentNanos();
+                publishSnapshot(channel);
+                if (channels_cfg_.level_feed_)
+                    publishLevelSnapshot(channel);
+            }
         }
     }
 }
@@ -9,16 +9,24 @@
 #include "common/logging.h"
 
 #include "market_data/market_update.h"
+#include "market_data/md_channel.h"
+#include "market_data/md_codec.h"
 #include "matcher/me_order.h"
+#include "matcher/me_checkpoint.h"
 
 using namespace Common;
 
 namespace Exchange
 {
+/// Incremental sequence number on every channel which a checkpoint image seeding the snapshot synthesizer stands for,
+/// the incremental streams continue after it.
+constexpr size_t MD_SEED_SEQ_NUM = 1;
+
 class SnapshotSynthesizer {
 public:
-    SnapshotSynthesizer(MDPMarketUpdateLFQueue* market_updates, const std::string& iface,
-                        const std::string& snapshot_ip, int snapshot_port);
+    /// level_updates is only consumed if the aggregated price level feed is enabled in channels_cfg.
+    SnapshotSynthesizer(MDPMarketUpdateLFQueue* market_updates, MDPLevelUpdateLFQueue* level_updates,
+                        const std::string& iface, const MDChannelsCfg& channels_cfg);
 
     ~SnapshotSynthesizer();
 
@@ -27,14 +35,27 @@ public:
 
     auto stop() -> void;
 
+    /// Seed the empty limit order book and price level snapshots with the resting orders and price levels of the
+    /// checkpoint image at path, as of incremental sequence number MD_SEED_SEQ_NUM on every channel. Returns false if
+    /// there is no checkpoint at path. Must be called before start().
+    auto seedFromCheckpoint(const std::string& path) -> bool;
+
     /// Process an incremental market update and update the limit order book snapshot.
     auto addToSnapshot(const MDPMarketUpdate* market_update);
 
-    /// Publish a full snapshot cycle on the snapshot multicast stream.
-    auto publishSnapshot();
+    /// Process an incremental price level update and update the price level snapshot.
+    auto addToLevelSnapshot(const MDPLevelUpdate* level_update);
+
+    /// Publish a full snapshot cycle for the tickers of the provided channel on that channel's snapshot multicast
+    /// stream.
+    auto publishSnapshot(size_t channel);
+
+    /// Publish a full price level snapshot cycle for the tickers of the provided channel on that channel's price level
+    /// snapshot multicast stream.
+    auto publishLevelSnapshot(size_t channel);
 
     /// Main method for this thread - processes incremental updates from the market data publisher, updates the snapshot
-    /// and publishes the snapshot periodically.
+    /// and publishes the snapshot of every channel periodically.
     auto run() -> void;
 
     /// Deleted default, copy & move constructors and assignment-operators.
@@ -48,21 +69,62 @@ private:
     /// Lock free queue containing incremental market data updates coming in from the market data publisher.
     MDPMarketUpdateLFQueue* snapshot_md_updates_ = nullptr;
 
+    /// Lock free queue containing incremental price level updates coming in from the market data publisher.
+    MDPLevelUpdateLFQueue* snapshot_level_updates_ = nullptr;
+
     Logger logger_;
 
     volatile bool run_ = false;
 
     std::string time_str_;
 
-    /// Multicast socket for the snapshot multicast stream.
-    McastSocket snapshot_socket_;
+    /// Market data channels and the TickerId -> channel mapping.
+    const MDChannelsCfg channels_cfg_;
+
+    /// Hash map from channel index -> multicast socket for the snapshot multicast stream of that channel.
+    std::array<McastSocket*, ME_MAX_MD_CHANNELS> snapshot_sockets_;
+
+    /// Encoder for the snapshot market data stream, snapshots are published one channel at a time so one is enough,
+    /// and the buffer frames are written to before being sent.
+    MDPEncoder encoder_;
+    std::array<char, MD_MAX_FRAME_SIZE> frame_;
 
     /// Hash map from TickerId -> Full limit order book snapshot containing information for every live order.
     std::array<std::array<MEMarketUpdate*, ME_MAX_ORDER_IDS>, ME_MAX_TICKERS> ticker_orders_;
-    size_t last_inc_seq_num_ = 0;
-    Nanos last_snapshot_time_ = 0;
+
+    /// Hash map from channel index -> last incremental sequence number applied and last snapshot cycle time, each
+    /// channel has its own sequence numbers and snapshot cycle.
+    std::array<size_t, ME_MAX_MD_CHANNELS> last_inc_seq_num_;
+    std::array<Nanos, ME_MAX_MD_CHANNELS> last_snapshot_time_;
 
     /// Memory pool to manage MEMarketUpdate messages for the orders in the snapshot limit order books.
     MemPool<MEMarketUpdate> order_pool_;
+
+    /// Hash map from channel index -> multicast socket for the price level snapshot multicast stream of that channel,
+    /// only created if the price level feed is enabled.
+    std::array<McastSocket*, ME_MAX_MD_CHANNELS> level_snapshot_sockets_;
+
+    /* 价位按 price % ME_MAX_PRICE_LEVELS 存放，和撮合引擎的订单簿一致；type_ 为 INVALID 表示该价位不存在 */
+    /// Hash map from TickerId -> Side -> Price -> latest MELevelUpdate for that price level.
+    std::array<std::array<std::array<MELevelUpdate, ME_MAX_PRICE_LEVELS>, sideToIndex(Side::MAX) + 1>, ME_MAX_TICKERS>
+        ticker_levels_;
+
+    /// Hash map from channel index -> last incremental price level sequence number applied.
+    std::array<size_t, ME_MAX_MD_CHANNELS> last_level_inc_seq_num_;
+
+private:
+    /// Encode a snapshot market update, sending the current frame on the socket first if it is full.
+    auto sendSnapshotUpdate(McastSocket* socket, const MDPMarketUpdate* market_update) noexcept -> void {
+        if (encoder_.full())
+            sendFrame(socket);
+        encoder_.add(market_update->seq_num_, &market_update->me_market_update_);
+    }
+
+    /// Send the current frame as a single datagram on the socket.
+    auto sendFrame(McastSocket* socket) noexcept -> void {
+        const auto frame_size = encoder_.finish(frame_.data());
+        socket->send(frame_.data(), frame_size);
+        socket->sendAndRecv();
+    }
 };
 } // namespace Exchange
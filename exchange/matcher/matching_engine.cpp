@@ -1,11 +1,38 @@
 #include "matching_engine.h"
 
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace Exchange
 {
+namespace
+{
+/// Write a checkpoint image to the file at path, returns false if it could not be written.
+/* 先写临时文件、fsync，再 rename 覆盖，崩溃时留下的要么是旧的 checkpoint，要么是新的 */
+auto writeCheckpointImage(const std::string& path, const std::vector<char>& image) -> bool {
+    const auto tmp_path = path + ".tmp";
+    auto file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    auto ok = (std::fwrite(image.data(), image.size(), 1, file) == 1);
+    ok = ok && (std::fflush(file) == 0) && (fsync(fileno(file)) == 0);
+    ok = (std::fclose(file) == 0) && ok;
+
+    return ok && (std::rename(tmp_path.c_str(), path.c_str()) == 0);
+}
+} // namespace
+
 MatchingEngine::MatchingEngine(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses,
-                               MEMarketUpdateLFQueue* market_updates)
+                               MEMarketUpdateLFQueue* market_updates, MELevelUpdateLFQueue* level_updates,
+                               MEBBOUpdateLFQueue* bbo_updates)
     : incoming_requests_(client_requests), outgoing_ogw_responses_(client_responses),
-      outgoing_md_updates_(market_updates), logger_("exchange_matching_engine.log") {
+      outgoing_md_updates_(market_updates), outgoing_level_updates_(level_updates), outgoing_bbo_updates_(bbo_updates),
+      logger_("exchange_matching_engine.log") {
     for (size_t i = 0; i < ticker_order_book_.size(); ++i) {
         ticker_order_book_[i] = new MEOrderBook(i, &logger_, this);
     }
@@ -17,14 +44,27 @@ MatchingEngine::~MatchingEngine() {
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
 
+    if (checkpoint_writer_) {
+        finishCheckpoint(true);
+        checkpoint_writer_run_ = false;
+        checkpoint_writer_->join();
+        delete checkpoint_writer_;
+        checkpoint_writer_ = nullptr;
+    }
+
     incoming_requests_ = nullptr;
     outgoing_ogw_responses_ = nullptr;
     outgoing_md_updates_ = nullptr;
+    outgoing_level_updates_ = nullptr;
+    outgoing_bbo_updates_ = nullptr;
 
     for (auto& order_book : ticker_order_book_) {
         delete order_book;
         order_book = nullptr;
     }
+
+    delete journal_;
+    journal_ = nullptr;
 }
 
 /// Start and stop the matching engine main thread.
@@ -37,4 +77,298 @@ auto MatchingEngine::start() -> void {
 auto MatchingEngine::stop() -> void {
     run_ = false;
 }
+
+/// Journal every request before it is processed and checkpoint the order books periodically, after recovering the
+/// order books from the checkpoint and the journal left by a previous run. Returns the number of requests replayed.
+auto MatchingEngine::enableJournal(const std::string& prefix, size_t capacity, JournalSyncPolicy sync_policy,
+                                   size_t checkpoint_every) -> size_t {
+    ASSERT(!journal_, "Journal is already enabled.");
+    checkpoint_path_ = prefix + ".checkpoint";
+    checkpoint_every_ = checkpoint_every;
+    requests_since_checkpoint_ = 0;
+    startCheckpointWriter();
+
+    /* 先恢复 checkpoint，再从它之后的序号开始重放 journal */
+    const auto start = Common::getCurrentNanos();
+    size_t checkpoint_seq_num = 0;
+    const auto restored = restoreCheckpoint(checkpoint_path_, &checkpoint_seq_num);
+    const auto restored_nanos = Common::getCurrentNanos() - start;
+
+    journal_ = new MEJournal(prefix + ".journal", capacity, sync_policy, &logger_);
+    size_t num_replayed = 0;
+    replaying_ = true;
+    const auto last_seq_num =
+        journal_->replay(checkpoint_seq_num, [this, &num_replayed](const MEClientRequest* request) {
+            processClientRequest(request);
+            ++num_replayed;
+        });
+    replaying_ = false;
+    republish_books_ = (restored || num_replayed);
+    resendResponses();
+
+    // The market data publisher is seeded from the checkpoint image, which has to include the replayed requests.
+    if (num_replayed)
+        checkpoint();
+
+    logger_.log("%:% %() % Recovered checkpoint:% seq:% in %ns, replayed % requests up to seq:% in %ns\n", __FILE__,
+                __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), checkpoint_path_, checkpoint_seq_num,
+                restored_nanos, num_replayed, last_seq_num, Common::getCurrentNanos() - start - restored_nanos);
+
+    return num_replayed;
+}
+
+/// Follow the journal of the primary matching engine applying its requests until it exits, then take the journal over
+/// at the last request applied. Returns the sequence number of the last request applied.
+/* 主 ME 退出时内核释放它的 flock，备 ME 此时已经处理完了主 ME 写下的请求，接管只需要打开 journal 和写一次 checkpoint */
+auto MatchingEngine::runStandby(const std::string& prefix, size_t capacity, JournalSyncPolicy sync_policy,
+                                size_t checkpoint_every) -> size_t {
+    ASSERT(!journal_, "Journal is already enabled.");
+    checkpoint_path_ = prefix + ".checkpoint";
+    checkpoint_every_ = checkpoint_every;
+    requests_since_checkpoint_ = 0;
+    startCheckpointWriter();
+
+    size_t last_seq_num = 0;
+    restoreCheckpoint(checkpoint_path_, &last_seq_num);
+
+    size_t num_followed = 0;
+    replaying_ = true;
+    {
+        MEJournalFollower follower(prefix + ".journal", capacity, last_seq_num, &logger_);
+        for (;;) {
+            const auto num_polled =
+                follower.poll([this](const MEClientRequest* request) { processClientRequest(request); });
+            num_followed += num_polled;
+            if (!num_polled && !follower.primaryAlive())
+                break;
+        }
+        last_seq_num = follower.lastSeqNum();
+    }
+
+    /* 主 ME 退出前最后写的记录可能还没处理，也可能没写完：像重启一样从最后处理的请求之后重放，没写完的丢弃 */
+    const auto start = Common::getCurrentNanos();
+    journal_ = new MEJournal(prefix + ".journal", capacity, sync_policy, &logger_);
+    size_t num_replayed = 0;
+    last_seq_num = journal_->replay(last_seq_num, [this, &num_replayed](const MEClientRequest* request) {
+        processClientRequest(request);
+        ++num_replayed;
+    });
+    replaying_ = false;
+    republish_books_ = true;
+    resendResponses();
+
+    // The checkpoint on disk may be older than the request the journal was taken over at.
+    checkpoint();
+
+    logger_.log("%:% %() % Took over journal at seq:% after following % requests, replayed % requests in %ns\n",
+                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), last_seq_num, num_followed,
+                num_replayed, Common::getCurrentNanos() - start);
+
+    return last_seq_num;
+}
+
+/// Write the state of every order book, the sequence number of the last journaled request and the client responses
+/// still queued for the order server to the file at path, returns false if it could not be written.
+auto MatchingEngine::writeCheckpoint(const std::string& path) const -> bool {
+    std::vector<char> image;
+    serializeCheckpoint(&image);
+
+    return writeCheckpointImage(path, image);
+}
+
+/// Serialize the state of every order book, the sequence number of the last journaled request and the client responses
+/// still queued for the order server into image.
+/* 队列里的回报 order server 随时可能取走，多存下的几条重启之后会被 order server 按位置丢掉 */
+auto MatchingEngine::serializeCheckpoint(std::vector<char>* image) const -> void {
+    MECheckpointHeader header;
+    header.num_tickers_ = ticker_order_book_.size();
+    header.seq_num_ = (journal_ ? journal_->lastSeqNum() : 0);
+    header.num_responses_ = num_responses_;
+    image->resize(sizeof(header));
+    for (auto order_book : ticker_order_book_)
+        order_book->appendCheckpoint(image);
+
+    outgoing_ogw_responses_->forEachUnread([image, &header](const MEClientResponse& client_response) {
+        if (client_response.type_ == ClientResponseType::RESENT)
+            return;
+        const auto offset = image->size();
+        image->resize(offset + sizeof(client_response));
+        std::memcpy(image->data() + offset, &client_response, sizeof(client_response));
+        ++header.num_pending_responses_;
+    });
+    image->resize(checkpointAligned(image->size()));
+    std::memcpy(image->data(), &header, sizeof(header));
+}
+
+/// Restore the empty order books from the checkpoint at path and write the sequence number of the last journaled
+/// request it includes to seq_num, returns false if there is no checkpoint at path.
+/* 整个镜像 mmap 进来，每个订单簿直接在原地按列读，不需要逐条 fread */
+auto MatchingEngine::restoreCheckpoint(const std::string& path, size_t* seq_num) -> bool {
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    ASSERT(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(MECheckpointHeader),
+           "Checkpoint:" + path + " is truncated.");
+    const auto size = static_cast<size_t>(st.st_size);
+    const auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    ASSERT(mapping != MAP_FAILED, "Unable to mmap checkpoint:" + path + " error:" + std::string(std::strerror(errno)));
+    const auto image = static_cast<const char*>(mapping);
+
+    const auto header = reinterpret_cast<const MECheckpointHeader*>(image);
+    ASSERT(header->magic_ == ME_CHECKPOINT_MAGIC && header->version_ == ME_CHECKPOINT_VERSION &&
+               header->num_tickers_ == ticker_order_book_.size(),
+           "Checkpoint:" + path + " has an unexpected layout.");
+    auto offset = sizeof(MECheckpointHeader);
+    for (auto order_book : ticker_order_book_) {
+        const auto book_size = order_book->restoreCheckpoint(image + offset, size - offset);
+        ASSERT(book_size, "Checkpoint:" + path + " is truncated.");
+        offset += book_size;
+    }
+
+    const auto num_pending = header->num_pending_responses_;
+    ASSERT(offset + num_pending * sizeof(MEClientResponse) <= size && num_pending <= header->num_responses_,
+           "Checkpoint:" + path + " is truncated.");
+    num_responses_ = header->num_responses_;
+    resent_from_ = num_responses_ - num_pending;
+    for (uint64_t i = 0; i < num_pending; ++i) {
+        MEClientResponse client_response;
+        std::memcpy(&client_response, image + offset + i * sizeof(client_response), sizeof(client_response));
+        keepResentResponse(client_response, resent_from_ + i);
+    }
+    *seq_num = header->seq_num_;
+    munmap(mapping, size);
+
+    return true;
+}
+
+/// Checkpoint the order books so the journal can reuse the slots of the requests before it and wait until the
+/// checkpoint is on disk.
+auto MatchingEngine::checkpoint() -> void {
+    requests_since_checkpoint_ = 0;
+    if (UNLIKELY(!journal_))
+        return;
+
+    finishCheckpoint(true);
+    startCheckpoint();
+    finishCheckpoint(true);
+}
+
+/// Start the checkpoint writer thread if it is not running yet.
+auto MatchingEngine::startCheckpointWriter() -> void {
+    if (checkpoint_writer_)
+        return;
+
+    checkpoint_writer_run_ = true;
+    checkpoint_writer_ =
+        Common::createAndStartThread(-1, "Exchange/MatchingEngine/Checkpoint", [this]() { runCheckpointWriter(); });
+    ASSERT(checkpoint_writer_ != nullptr, "Failed to start MatchingEngine checkpoint writer thread.");
+}
+
+/// Main loop of the checkpoint writer thread, writes every PENDING image to checkpoint_path_.
+/* 写文件和 fsync 在这个线程里做，ME 线程只在把订单簿序列化进镜像的时候停下来 */
+auto MatchingEngine::runCheckpointWriter() noexcept -> void {
+    while (checkpoint_writer_run_) {
+        if (checkpoint_state_.load(std::memory_order_acquire) == CheckpointState::PENDING) {
+            const auto written = writeCheckpointImage(checkpoint_path_, checkpoint_image_);
+            checkpoint_errno_ = (written ? 0 : errno);
+            checkpoint_state_.store(written ? CheckpointState::WRITTEN : CheckpointState::FAILED,
+                                    std::memory_order_release);
+            continue;
+        }
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+/// Serialize the order books and hand the image to the checkpoint writer thread, false while the previous checkpoint
+/// is still being written.
+auto MatchingEngine::startCheckpoint() -> bool {
+    if (!finishCheckpoint(false))
+        return false;
+
+    checkpoint_start_ = Common::getCurrentNanos();
+    serializeCheckpoint(&checkpoint_image_);
+    checkpoint_seq_num_ = journal_->lastSeqNum();
+    requests_since_checkpoint_ = 0;
+    checkpoint_state_.store(CheckpointState::PENDING, std::memory_order_release);
+
+    logger_.log("%:% %() % Serialized checkpoint seq:% % bytes in %ns\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), checkpoint_seq_num_, checkpoint_image_.size(),
+                Common::getCurrentNanos() - checkpoint_start_);
+
+    return true;
+}
+
+/// Collect the checkpoint written by the checkpoint writer thread, false if it is still being written.
+auto MatchingEngine::finishCheckpoint(bool wait) noexcept -> bool {
+    auto state = checkpoint_state_.load(std::memory_order_acquire);
+    for (; wait && state == CheckpointState::PENDING; state = checkpoint_state_.load(std::memory_order_acquire))
+        std::this_thread::yield();
+
+    switch (state) {
+    case CheckpointState::IDLE:
+        return true;
+    case CheckpointState::PENDING:
+        return false;
+    case CheckpointState::FAILED:
+        FATAL("Unable to write checkpoint:" + checkpoint_path_ +
+              " error:" + std::string(std::strerror(checkpoint_errno_)));
+        break;
+    case CheckpointState::WRITTEN:
+        journal_->setCheckpointed(checkpoint_seq_num_);
+        logger_.log("%:% %() % Checkpointed seq:% to % in %ns\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), checkpoint_seq_num_, checkpoint_path_,
+                    Common::getCurrentNanos() - checkpoint_start_);
+        break;
+    }
+    checkpoint_state_.store(CheckpointState::IDLE, std::memory_order_relaxed);
+
+    return true;
+}
+
+/// Free the slots of a full journal: wait for the checkpoint being written, and checkpoint the order books if that
+/// does not free it.
+auto MatchingEngine::makeJournalRoom() -> void {
+    finishCheckpoint(true);
+    if (journal_->full())
+        checkpoint();
+}
+
+/// Keep a client response of a replayed request or of a checkpoint at position in the response stream.
+auto MatchingEngine::keepResentResponse(const MEClientResponse& client_response, size_t position) -> void {
+    if (UNLIKELY(resent_responses_.empty())) // leaves room for the RESENT response in the order server's queue.
+        resent_responses_.resize(outgoing_ogw_responses_->capacity() - 1);
+    resent_responses_[position % resent_responses_.size()] = client_response;
+}
+
+/// Write the kept client responses to the order server's queue after a RESENT response carrying the position of the
+/// first one.
+/* order server 在写 checkpoint 之前取走的回报一定已经记下了，所以从 checkpoint 里存的回报开始重新发就不会漏 */
+auto MatchingEngine::resendResponses() -> void {
+    auto first_position = resent_from_;
+    if (UNLIKELY(num_responses_ - first_position > resent_responses_.size())) {
+        logger_.log("%:% %() % Dropping % responses older than the order server's queue\n", __FILE__, __LINE__,
+                    __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    num_responses_ - first_position - resent_responses_.size());
+        first_position = num_responses_ - resent_responses_.size();
+    }
+
+    const MEClientResponse resent{ClientResponseType::RESENT, ClientId_INVALID, TickerId_INVALID, OrderId_INVALID,
+                                  first_position, Side::INVALID, Price_INVALID, Qty_INVALID, Qty_INVALID};
+    *outgoing_ogw_responses_->getNextToWriteTo() = resent;
+    outgoing_ogw_responses_->updateWriteIndex();
+    for (auto position = first_position; position < num_responses_; ++position) {
+        *outgoing_ogw_responses_->getNextToWriteTo() = resent_responses_[position % resent_responses_.size()];
+        outgoing_ogw_responses_->updateWriteIndex();
+    }
+    logger_.log("%:% %() % Resent responses from position:% to position:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), first_position, num_responses_);
+
+    resent_responses_ = {};
+    resent_from_ = num_responses_;
+}
 } // namespace Exchange
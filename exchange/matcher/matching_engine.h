@@ -15,12 +15,19 @@
  *                  MEOrderBook::sendMarketUpdate() 写入 LFQueue outgoing_md_updates_ 等待 MDP 取
  *          if (经过撮合还有剩) MEOrderBook::addOrder() 添加订单到订单簿
  *          MEOrderBook::sendMarketUpdate() 写入 LFQueue outgoing_md_updates_ 等待 MDP 取
+ *          MEOrderBook::publishLevelUpdates() 若开启了 L2 行情，每个被改动的价位写一条到 outgoing_level_updates_
+ *          MEOrderBook::publishBBOUpdate() 若开启了 BBO 行情且盘口有变化，写一条到 outgoing_bbo_updates_
  *      MEOrderBook::cancel() 取消订单
  *          MEOrderBook::removeOrder() 删除订单
  *          MEOrderBook::sendMarketUpdate() 写入 LFQueue outgoing_md_updates_ 等待 MDP 取
  *          MEOrderBook::sendClientResponse() 写入 LFQueue outgoing_ogw_responses_ 等待 order server 取
+ *      rejectClientRequest() 未知的 ticker / 不处理的请求类型 / 非管理员的管理请求回一个 REJECTED
  */
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "common/thread_utils.h"
 #include "common/lf_queue.h"
 #include "common/macros.h"
@@ -33,13 +40,17 @@
 #include "market_data/market_update.h"
 
 #include "me_order_book.h"
+#include "me_journal.h"
 
 namespace Exchange
 {
 class MatchingEngine final {
 public:
+    /// level_updates and bbo_updates can be nullptr, in which case the aggregated price level feed and the top of book
+    /// feed respectively are not published.
     MatchingEngine(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses,
-                   MEMarketUpdateLFQueue* market_updates);
+                   MEMarketUpdateLFQueue* market_updates, MELevelUpdateLFQueue* level_updates,
+                   MEBBOUpdateLFQueue* bbo_updates);
 
     ~MatchingEngine();
 
@@ -48,10 +59,102 @@ public:
 
     auto stop() -> void;
 
+    /// Validate the order books on every sample_every-th request, 0 disables validation.
+    auto setBookValidation(size_t sample_every) noexcept {
+        for (auto order_book : ticker_order_book_)
+            order_book->setValidation(sample_every);
+    }
+
+    /// Report aggressive fills and trades once per price level swept instead of once per passive order matched.
+    auto setAggregateFills(bool aggregate_fills) noexcept {
+        for (auto order_book : ticker_order_book_)
+            order_book->setAggregateFills(aggregate_fills);
+    }
+
+    /// Prevent aggressive orders from trading against resting orders of the same client, see SelfTradePrevention.
+    auto setSelfTradePrevention(SelfTradePrevention stp) noexcept {
+        for (auto order_book : ticker_order_book_)
+            order_book->setSelfTradePrevention(stp);
+    }
+
+    /// Write the full order book of every ticker to <prefix>_<ticker_id>.book, only safe once the matching engine
+    /// stopped.
+    auto snapshotOrderBooks(const std::string& prefix) const -> void {
+        for (TickerId ticker_id = 0; ticker_id < ticker_order_book_.size(); ++ticker_id)
+            ticker_order_book_[ticker_id]->snapshotToFile(prefix + "_" + std::to_string(ticker_id) + ".book");
+    }
+
+    /// Journal every request to <prefix>.journal before it is processed and checkpoint the order books to
+    /// <prefix>.checkpoint every checkpoint_every requests, 0 only checkpoints when the journal is full. The order
+    /// books are first recovered from the checkpoint and the journal left by a previous run, with the market updates
+    /// of the replayed requests suppressed, and checkpointed again if requests were replayed so the checkpoint image
+    /// can seed the market data publisher, see MarketDataPublisher::seedFromCheckpoint(). The client responses queued
+    /// in the checkpoint and those of the replayed requests are resent after a RESENT response, for the order server
+    /// to record the ones it had not recorded before the restart.
+    /// Replay is only deterministic with the same order book settings as the run which wrote the journal, so call it
+    /// after the setters above and before start(). Returns the number of requests replayed.
+    auto enableJournal(const std::string& prefix, size_t capacity, JournalSyncPolicy sync_policy,
+                       size_t checkpoint_every) -> size_t;
+
+    /// Run as a hot standby of the primary matching engine journaling to <prefix>.journal with the same settings:
+    /// recover the order books from <prefix>.checkpoint and keep applying every request the primary journals, with
+    /// nothing published, until the primary exits. Then take over its journal at the last request applied like
+    /// enableJournal(), resend the most recent client responses for the order server resuming the primary's sessions
+    /// and checkpoint the order books to seed the market data publisher. Must be started after the primary, blocks
+    /// until the takeover and returns the sequence number of the last request applied.
+    auto runStandby(const std::string& prefix, size_t capacity, JournalSyncPolicy sync_policy,
+                    size_t checkpoint_every) -> size_t;
+
+    /// Write the state of every order book, the sequence number of the last journaled request and the client responses
+    /// still queued for the order server to the file at path, returns false if it could not be written. Only safe from
+    /// the matching engine thread or once it stopped.
+    auto writeCheckpoint(const std::string& path) const -> bool;
+
+    /// Serialize the state of every order book, the sequence number of the last journaled request and the client
+    /// responses still queued for the order server into image, the contents of a checkpoint file. Only safe from the
+    /// matching engine thread or once it stopped.
+    auto serializeCheckpoint(std::vector<char>* image) const -> void;
+
+    /// Restore the empty order books from the checkpoint at path without publishing anything and write the sequence
+    /// number of the last journaled request it includes to seq_num, returns false if there is no checkpoint at path.
+    /// The client responses queued in the checkpoint are kept to be resent by enableJournal() or runStandby().
+    auto restoreCheckpoint(const std::string& path, size_t* seq_num) -> bool;
+
+    /// Checkpoint the order books so the journal can reuse the slots of the requests before it and wait until the
+    /// checkpoint is on disk. Only safe from the matching engine thread or once it stopped.
+    auto checkpoint() -> void;
+
+    /// Journal the client request if journaling is enabled and process it, starting a checkpoint of the order books
+    /// when due. The matching engine thread only serializes the order books, the checkpoint writer thread writes the
+    /// image to disk. Only a full journal waits for the checkpoint to be written.
+    /* run() 对每个请求调用这个函数，先写 journal 再撮合 */
+    auto onClientRequest(const MEClientRequest* client_request) noexcept {
+        if (journal_) {
+            if (UNLIKELY(journal_->full()))
+                makeJournalRoom();
+            journal_->append(client_request);
+        }
+
+        processClientRequest(client_request);
+
+        if (UNLIKELY(checkpoint_every_ && ++requests_since_checkpoint_ >= checkpoint_every_))
+            startCheckpoint(); // retried on the next request while the previous checkpoint is being written.
+    }
+
     /// Called to process a client request read from the lock free queue sent by the order server.
     /* rnu() 调用的第一个函数，目的是处理从 order server::LFQueue 到来的 request */
-    auto processClientRequest(const MEClientRequest* client_request) noexcept {
-        auto order_book = ticker_order_book_[client_request->ticker_id_];
+    auto processClientRequest(const MEClientRequest* client_request) noexcept -> void {
+        /* MASS_CANCEL 的 ticker 可以是 TickerId_INVALID（所有 ticker） */
+        auto order_book = (LIKELY(client_request->ticker_id_ < ticker_order_book_.size())
+                               ? ticker_order_book_[client_request->ticker_id_]
+                               : nullptr);
+        if (UNLIKELY(order_book == nullptr && (client_request->type_ == ClientRequestType::NEW ||
+                                               client_request->type_ == ClientRequestType::CANCEL ||
+                                               client_request->type_ == ClientRequestType::MODIFY))) {
+            rejectClientRequest(client_request, RejectReason::UNKNOWN_TICKER);
+            return;
+        }
+
         switch (client_request->type_) {
         case ClientRequestType::NEW: {
 #ifdef PERF
@@ -59,7 +162,9 @@ public:
 #endif
             /* 这里会调用 checkForMatch 检查是否有可以撮合的被动订单 */
             order_book->add(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
-                            client_request->side_, client_request->price_, client_request->qty_);
+                            client_request->side_, client_request->price_, client_request->qty_,
+                            client_request->tif_, client_request->ord_type_, client_request->stop_price_,
+                            client_request->display_qty_);
 #ifdef PERF            
             END_MEASURE(Exchange_MEOrderBook_add, logger_);
 #endif
@@ -75,8 +180,40 @@ public:
 #endif        
         } break;
 
+        case ClientRequestType::MODIFY: {
+#ifdef PERF
+            START_MEASURE(Exchange_MEOrderBook_modify);
+#endif
+            order_book->modify(client_request->client_id_, client_request->order_id_, client_request->ticker_id_,
+                               client_request->price_, client_request->qty_);
+#ifdef PERF
+            END_MEASURE(Exchange_MEOrderBook_modify, logger_);
+#endif
+        } break;
+
+        case ClientRequestType::MASS_CANCEL: {
+#ifdef PERF
+            START_MEASURE(Exchange_MatchingEngine_massCancel);
+#endif
+            massCancel(client_request);
+#ifdef PERF
+            END_MEASURE(Exchange_MatchingEngine_massCancel, logger_);
+#endif
+        } break;
+
+        case ClientRequestType::START_AUCTION:
+        case ClientRequestType::UNCROSS: {
+#ifdef PERF
+            START_MEASURE(Exchange_MatchingEngine_changePhase);
+#endif
+            changePhase(client_request);
+#ifdef PERF
+            END_MEASURE(Exchange_MatchingEngine_changePhase, logger_);
+#endif
+        } break;
+
         default: {
-            FATAL("Received invalid client-request-type:" + clientRequestTypeToString(client_request->type_));
+            rejectClientRequest(client_request, RejectReason::INVALID_TYPE);
         } break;
         }
     }
@@ -84,6 +221,11 @@ public:
     /* 被 match 调用 */
     /// Write client responses to the lock free queue for the order server to consume.
     auto sendClientResponse(const MEClientResponse* client_response) noexcept {
+        ++num_responses_;
+        if (UNLIKELY(replaying_)) { // the order server may not have recorded it before the restart.
+            keepResentResponse(*client_response, num_responses_ - 1);
+            return;
+        }
         logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                     client_response->toString());
         auto next_write = outgoing_ogw_responses_->getNextToWriteTo();
@@ -97,6 +239,8 @@ public:
     /* 被 match 调用 */
     /// Write market data update to the lock free queue for the market data publisher to consume.
     auto sendMarketUpdate(const MEMarketUpdate* market_update) noexcept {
+        if (UNLIKELY(replaying_)) // already sent before the restart.
+            return;
         logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                     market_update->toString());
         auto next_write = outgoing_md_updates_->getNextToWriteTo();
@@ -107,10 +251,135 @@ public:
 #endif
     }
 
+    /// Same as sendMarketUpdate() but without logging the update, for the bursts of updates generated by a single
+    /// request such as a mass cancel which is logged once as a whole.
+    auto sendMarketUpdateUnlogged(const MEMarketUpdate* market_update) noexcept {
+        if (UNLIKELY(replaying_)) // already sent before the restart.
+            return;
+        auto next_write = outgoing_md_updates_->getNextToWriteTo();
+        *next_write = *market_update;
+        outgoing_md_updates_->updateWriteIndex();
+    }
+
+    /// Cancel every order of the client on the requested ticker and side, TickerId_INVALID / Side::INVALID select every
+    /// ticker / both sides. The client gets a single MASS_CANCELED response carrying the number of orders canceled.
+    auto massCancel(const MEClientRequest* client_request) noexcept -> void {
+        size_t num_canceled = 0;
+        if (LIKELY(client_request->client_id_ < ME_MAX_NUM_CLIENTS)) {
+            for (TickerId ticker_id = 0; ticker_id < ticker_order_book_.size(); ++ticker_id) {
+                if (client_request->ticker_id_ == TickerId_INVALID || client_request->ticker_id_ == ticker_id)
+                    num_canceled += ticker_order_book_[ticker_id]->massCancel(client_request->client_id_,
+                                                                              client_request->side_);
+            }
+        }
+
+        const MEClientResponse client_response{ClientResponseType::MASS_CANCELED,
+                                               client_request->client_id_,
+                                               client_request->ticker_id_,
+                                               client_request->order_id_,
+                                               OrderId_INVALID,
+                                               client_request->side_,
+                                               Price_INVALID,
+                                               static_cast<Qty>(num_canceled),
+                                               Qty_INVALID};
+        sendClientResponse(&client_response);
+    }
+
+    /// Answer a client request the matching engine cannot process with a REJECTED response, leaving the books alone.
+    auto rejectClientRequest(const MEClientRequest* client_request, RejectReason reject_reason) noexcept -> void {
+        logger_.log("%:% %() % Rejecting % reason:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_request->toString(),
+                    rejectReasonToString(reject_reason));
+        const MEClientResponse client_response{ClientResponseType::REJECTED,
+                                               client_request->client_id_,
+                                               client_request->ticker_id_,
+                                               client_request->order_id_,
+                                               OrderId_INVALID,
+                                               client_request->side_,
+                                               client_request->price_,
+                                               Qty_INVALID,
+                                               client_request->qty_,
+                                               reject_reason};
+        sendClientResponse(&client_response);
+    }
+
+    /// Move the requested ticker, or every ticker if TickerId_INVALID, into the auction phase or uncross it. Only the
+    /// admin client may change phases, it gets an AUCTION_STARTED / UNCROSSED response per ticker with the uncross
+    /// price and quantity. Any other client gets a REJECTED response.
+    auto changePhase(const MEClientRequest* client_request) noexcept -> void {
+        if (UNLIKELY(client_request->client_id_ != ME_ADMIN_CLIENT_ID)) {
+            rejectClientRequest(client_request, RejectReason::NOT_AUTHORIZED);
+            return;
+        }
+
+        const auto start_auction = (client_request->type_ == ClientRequestType::START_AUCTION);
+        for (TickerId ticker_id = 0; ticker_id < ticker_order_book_.size(); ++ticker_id) {
+            if (client_request->ticker_id_ != TickerId_INVALID && client_request->ticker_id_ != ticker_id)
+                continue;
+
+            auto uncross_price = Price_INVALID;
+            Qty uncross_qty = 0;
+            if (start_auction)
+                ticker_order_book_[ticker_id]->startAuction();
+            else
+                uncross_qty = ticker_order_book_[ticker_id]->uncross(&uncross_price);
+
+            const MEClientResponse client_response{
+                (start_auction ? ClientResponseType::AUCTION_STARTED : ClientResponseType::UNCROSSED),
+                client_request->client_id_,
+                ticker_id,
+                client_request->order_id_,
+                OrderId_INVALID,
+                Side::INVALID,
+                uncross_price,
+                uncross_qty,
+                Qty_INVALID};
+            sendClientResponse(&client_response);
+        }
+    }
+
+    auto publishesLevelUpdates() const noexcept {
+        return outgoing_level_updates_ != nullptr;
+    }
+
+    /* 被 MEOrderBook::publishLevelUpdates 调用 */
+    /// Write aggregated price level update to the lock free queue for the market data publisher to consume.
+    auto sendLevelUpdate(const MELevelUpdate* level_update) noexcept {
+        if (UNLIKELY(replaying_)) // already sent before the restart.
+            return;
+        logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    level_update->toString());
+        auto next_write = outgoing_level_updates_->getNextToWriteTo();
+        *next_write = *level_update;
+        outgoing_level_updates_->updateWriteIndex();
+    }
+
+    auto publishesBBOUpdates() const noexcept {
+        return outgoing_bbo_updates_ != nullptr;
+    }
+
+    /* 被 MEOrderBook::publishBBOUpdate 调用 */
+    /// Write top of book update to the lock free queue for the market data publisher to conflate and publish.
+    auto sendBBOUpdate(const MEBBOUpdate* bbo_update) noexcept {
+        if (UNLIKELY(replaying_)) // already sent before the restart.
+            return;
+        logger_.log("%:% %() % Sending %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    bbo_update->toString());
+        auto next_write = outgoing_bbo_updates_->getNextToWriteTo();
+        *next_write = *bbo_update;
+        outgoing_bbo_updates_->updateWriteIndex();
+    }
+
     /// Main loop for this thread - processes incoming client requests which in turn generates client responses and
     /// market updates.
     auto run() noexcept {
         logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+        if (UNLIKELY(republish_books_)) {
+            for (auto order_book : ticker_order_book_)
+                order_book->publishTopOfBook();
+            republish_books_ = false;
+        }
+
         while (run_) {
             const auto me_client_request = incoming_requests_->getNextToRead();
             if (LIKELY(me_client_request)) {
@@ -122,11 +391,14 @@ public:
 #ifdef PERF                
                 START_MEASURE(Exchange_MatchingEngine_processClientRequest);
 #endif
-                processClientRequest(me_client_request);
+                onClientRequest(me_client_request);
 #ifdef PERF
                 END_MEASURE(Exchange_MatchingEngine_processClientRequest, logger_);
 #endif
                 incoming_requests_->updateReadIndex();
+            } else if (journal_) { // out of requests, the end of a batch.
+                journal_->flush();
+                finishCheckpoint(false);
             }
         }
     }
@@ -146,12 +418,79 @@ private:
     /// One to consume incoming client requests sent by the order server.
     /// Second to publish outgoing client responses to be consumed by the order server.
     /// Third to publish outgoing market updates to be consumed by the market data publisher.
+    /// Fourth, optional, to publish outgoing aggregated price level updates to be consumed by the market data
+    /// publisher.
+    /// Fifth, optional, to publish outgoing top of book updates to be conflated by the market data publisher.
     ClientRequestLFQueue* incoming_requests_ = nullptr;
     ClientResponseLFQueue* outgoing_ogw_responses_ = nullptr;
     MEMarketUpdateLFQueue* outgoing_md_updates_ = nullptr;
+    MELevelUpdateLFQueue* outgoing_level_updates_ = nullptr;
+    MEBBOUpdateLFQueue* outgoing_bbo_updates_ = nullptr;
 
     volatile bool run_ = false;
 
+    /// Write-ahead journal of the client requests, nullptr unless enableJournal() was called.
+    MEJournal* journal_ = nullptr;
+    std::string checkpoint_path_;
+    size_t checkpoint_every_ = 0;
+    size_t requests_since_checkpoint_ = 0;
+
+    /// A checkpoint image handed from the matching engine thread to the checkpoint writer thread: PENDING while it is
+    /// written to disk, WRITTEN or FAILED until the matching engine thread collects it, see finishCheckpoint().
+    enum class CheckpointState : uint8_t { IDLE = 0, PENDING = 1, WRITTEN = 2, FAILED = 3 };
+    std::atomic<CheckpointState> checkpoint_state_{CheckpointState::IDLE};
+
+    /// The image of the checkpoint being written and the sequence number of the last journaled request it includes,
+    /// the same buffer is serialized into for every checkpoint.
+    std::vector<char> checkpoint_image_;
+    size_t checkpoint_seq_num_ = 0;
+    Nanos checkpoint_start_ = 0;
+    int checkpoint_errno_ = 0;
+
+    /// Writes checkpoint images to disk off the matching engine thread, started with the journal.
+    volatile bool checkpoint_writer_run_ = false;
+    std::thread* checkpoint_writer_ = nullptr;
+
+    /// Start the checkpoint writer thread if it is not running yet.
+    auto startCheckpointWriter() -> void;
+
+    /// Main loop of the checkpoint writer thread, writes every PENDING image to checkpoint_path_.
+    auto runCheckpointWriter() noexcept -> void;
+
+    /// Serialize the order books and hand the image to the checkpoint writer thread, returns false without doing
+    /// anything while the previous checkpoint is still being written. Only allocates when the order books outgrew
+    /// the image.
+    auto startCheckpoint() -> bool;
+
+    /// Collect the checkpoint written by the checkpoint writer thread, so the journal can reuse the slots of the
+    /// requests it includes, waiting for it to be written if wait is true. Returns false if it is still being written.
+    auto finishCheckpoint(bool wait) noexcept -> bool;
+
+    /// Free the slots of a full journal: wait for the checkpoint being written, and checkpoint the order books if that
+    /// does not free it.
+    auto makeJournalRoom() -> void;
+
+    /// True while journaled requests are replayed, nothing is published. republish_books_ is set if order books were
+    /// recovered and their top of book is published when the matching engine thread starts.
+    bool replaying_ = false;
+    bool republish_books_ = false;
+
+    /// Number of client responses sent since the journal was created, the position in the response stream of the next
+    /// one. Counted while replaying as well, so a replayed response has the position it had before the restart.
+    size_t num_responses_ = 0;
+
+    /// The client responses from position resent_from_ to be resent once replayed, indexed by position. Holds the most
+    /// recent ones if there are more than the order server's queue holds, allocated when the first one is kept.
+    std::vector<MEClientResponse> resent_responses_;
+    size_t resent_from_ = 0;
+
+    /// Keep a client response of a replayed request or of a checkpoint at position in the response stream.
+    auto keepResentResponse(const MEClientResponse& client_response, size_t position) -> void;
+
+    /// Write the kept client responses to the order server's queue after a RESENT response carrying the position of
+    /// the first one, the order server drops the ones it recorded before the restart.
+    auto resendResponses() -> void;
+
     std::string time_str_;
     Logger logger_;
 };
@@ -0,0 +1,151 @@
+#pragma once
+
+/**
+ * 订单簿 checkpoint 的二进制镜像，限制重启时需要重放的 journal 长度，也用来初始化 snapshot synthesizer
+ *
+ *  文件 = [MECheckpointHeader][每个 ticker 一个 book][MEClientResponse * num_pending_responses_]
+ *  book = [MEBookCheckpoint][价位的各列][订单的各列][客户订单链表的各列]
+ * - 按列存放，每一列是同一个字段的连续数组，起始位置按 8 字节对齐，恢复时 mmap 文件直接在原地读，不需要逐个解析记录
+ * - 价位从好到差先写买方再写卖方；订单先是每个价位里按 FIFO 顺序挂着的订单，和价位一一对应，后面是停止单
+ * - 之后按每个客户从旧到新的顺序写一遍订单号，恢复出同样的客户订单链表，mass cancel 的行情顺序也就一样
+ * - 最后是写 checkpoint 时 order server 可能还没有记下的回报，重启之后和重放出来的回报一起重新发出，order server 按它们在
+ *   ME 回报流里的位置丢掉已经记下的
+ * - 先写到临时文件再 rename，文件要么是完整的旧 checkpoint，要么是完整的新 checkpoint
+ */
+
+#include <type_traits>
+
+#include "common/types.h"
+
+#include "order_server/client_request.h"
+#include "market_data/market_update.h"
+
+using namespace Common;
+
+namespace Exchange
+{
+/// Identifies checkpoint files and their layout, a checkpoint written with a different layout is rejected.
+constexpr uint64_t ME_CHECKPOINT_MAGIC = 0x54504b43454d; // "MECKPT"
+constexpr uint32_t ME_CHECKPOINT_VERSION = 3;
+
+/// Every section and column of the image starts at a multiple of ME_CHECKPOINT_ALIGNMENT bytes.
+constexpr size_t ME_CHECKPOINT_ALIGNMENT = 8;
+
+inline constexpr auto checkpointAligned(size_t size) noexcept {
+    return (size + ME_CHECKPOINT_ALIGNMENT - 1) & ~(ME_CHECKPOINT_ALIGNMENT - 1);
+}
+
+#pragma pack(push, 1)
+
+/// Start of a checkpoint file, seq_num_ is the sequence number of the last journaled request it includes and
+/// num_responses_ the number of client responses sent up to it. The last num_pending_responses_ of them follow the
+/// order books, they were still queued for the order server.
+struct MECheckpointHeader {
+    uint64_t magic_ = ME_CHECKPOINT_MAGIC;
+    uint32_t version_ = ME_CHECKPOINT_VERSION;
+    uint32_t num_tickers_ = 0;
+    uint64_t seq_num_ = 0;
+    uint64_t num_responses_ = 0;
+    uint64_t num_pending_responses_ = 0;
+};
+
+/// State of a single order book besides its price levels and orders, followed by their columns.
+struct MEBookCheckpoint {
+    TickerId ticker_id_ = TickerId_INVALID;
+    OrderId next_market_order_id_ = OrderId_INVALID;
+    uint8_t phase_ = 0;
+    Price last_trade_price_ = Price_INVALID;
+    Price high_trade_price_ = Price_INVALID;
+    Price low_trade_price_ = Price_INVALID;
+    MEBBOUpdate bbo_update_;
+    uint64_t num_levels_ = 0;
+    uint64_t num_orders_ = 0;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(MECheckpointHeader) % ME_CHECKPOINT_ALIGNMENT == 0, "Columns of the image would be misaligned.");
+
+/// The columns of a single order book in a checkpoint image.
+struct MEBookCheckpointColumns {
+    const MEBookCheckpoint* book_ = nullptr;
+
+    /// num_levels_ price levels, from the best to the worst bid and then from the best to the worst ask.
+    const Side* level_side_ = nullptr;
+    const Price* level_price_ = nullptr;
+    const Qty* level_qty_ = nullptr;
+    const uint32_t* level_num_orders_ = nullptr;
+    const Qty* level_reserve_qty_ = nullptr;
+
+    /// num_orders_ orders, the resting orders of each price level in FIFO order followed by the parked stop orders.
+    const ClientId* client_id_ = nullptr;
+    const OrderId* client_order_id_ = nullptr;
+    const OrderId* market_order_id_ = nullptr;
+    const Side* side_ = nullptr;
+    const Price* price_ = nullptr;
+    const Qty* qty_ = nullptr;
+    const Priority* priority_ = nullptr;
+    const Price* stop_price_ = nullptr;
+    const OrderType* ord_type_ = nullptr;
+    const TimeInForce* tif_ = nullptr;
+    const Qty* display_qty_ = nullptr;
+    const Qty* reserve_qty_ = nullptr;
+
+    /// num_orders_ orders again, every client's orders from the oldest to the most recent.
+    const ClientId* client_list_client_id_ = nullptr;
+    const OrderId* client_list_order_id_ = nullptr;
+
+    /// Call fn(column, num_rows) for every column in image order, column is a reference to the column pointer.
+    template<typename F>
+    auto forEachColumn(F&& fn) {
+        const auto num_levels = book_->num_levels_, num_orders = book_->num_orders_;
+        fn(level_side_, num_levels);
+        fn(level_price_, num_levels);
+        fn(level_qty_, num_levels);
+        fn(level_num_orders_, num_levels);
+        fn(level_reserve_qty_, num_levels);
+        fn(client_id_, num_orders);
+        fn(client_order_id_, num_orders);
+        fn(market_order_id_, num_orders);
+        fn(side_, num_orders);
+        fn(price_, num_orders);
+        fn(qty_, num_orders);
+        fn(priority_, num_orders);
+        fn(stop_price_, num_orders);
+        fn(ord_type_, num_orders);
+        fn(tif_, num_orders);
+        fn(display_qty_, num_orders);
+        fn(reserve_qty_, num_orders);
+        fn(client_list_client_id_, num_orders);
+        fn(client_list_order_id_, num_orders);
+    }
+
+    /// Point the columns at the order book starting at image, returns the size of the order book in the image or 0 if
+    /// it does not fit in size bytes.
+    auto read(const char* image, size_t size) -> size_t {
+        size_t offset = checkpointAligned(sizeof(MEBookCheckpoint));
+        if (offset > size)
+            return 0;
+        book_ = reinterpret_cast<const MEBookCheckpoint*>(image);
+
+        auto ok = true;
+        forEachColumn([image, size, &offset, &ok](auto& column, uint64_t num_rows) {
+            const auto column_size = checkpointAligned(num_rows * sizeof(*column));
+            ok = ok && (offset + column_size <= size);
+            column = reinterpret_cast<std::remove_reference_t<decltype(column)>>(image + offset);
+            offset += column_size;
+        });
+
+        return (ok ? offset : 0);
+    }
+
+    /// Number of resting orders at the front of the order columns.
+    auto numRestingOrders() const noexcept {
+        uint64_t num_resting_orders = 0;
+        for (uint64_t i = 0; i < book_->num_levels_; ++i)
+            num_resting_orders += level_num_orders_[i];
+
+        return num_resting_orders;
+    }
+};
+} // namespace Exchange
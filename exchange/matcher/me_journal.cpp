@@ -0,0 +1,218 @@
+#include "me_journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <thread>
+
+namespace Exchange
+{
+MEJournal::MEJournal(const std::string& path, size_t capacity, JournalSyncPolicy sync_policy, Logger* logger)
+    : path_(path), capacity_(capacity), sync_policy_(sync_policy), logger_(logger) {
+    ASSERT(capacity_ > 0, "Journal capacity must be positive.");
+
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mapping_size_ = page_size + capacity_ * sizeof(MEJournalRecord);
+
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+    ASSERT(fd_ >= 0, "Unable to open journal:" + path_ + " error:" + std::string(std::strerror(errno)));
+
+    /* flock 在进程退出时由内核释放，热备的 ME 靠它判断主 ME 是否还活着；header 在拿到锁之后才写 */
+    ASSERT(flock(fd_, LOCK_EX | LOCK_NB) == 0,
+           "Journal:" + path_ + " is in use by another matching engine error:" + std::string(std::strerror(errno)));
+
+    /* 一次性分配好整个文件，写记录的时候不会再有分配磁盘块的开销 */
+    const auto file_size = lseek(fd_, 0, SEEK_END);
+    const auto created = (file_size == 0);
+    if (created) {
+        ASSERT(posix_fallocate(fd_, 0, mapping_size_) == 0,
+               "Unable to allocate journal:" + path_ + " size:" + std::to_string(mapping_size_));
+    } else {
+        ASSERT(static_cast<size_t>(file_size) == mapping_size_,
+               "Journal:" + path_ + " size:" + std::to_string(file_size) +
+                   " expected:" + std::to_string(mapping_size_));
+    }
+
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+    ASSERT(mapping_ != MAP_FAILED, "Unable to mmap journal:" + path_ + " error:" + std::string(std::strerror(errno)));
+    records_ = reinterpret_cast<MEJournalRecord*>(static_cast<char*>(mapping_) + page_size);
+
+    auto header = static_cast<MEJournalHeader*>(mapping_);
+    if (created) {
+        *header = MEJournalHeader{};
+        header->record_size_ = sizeof(MEJournalRecord);
+        header->capacity_ = capacity_;
+        ASSERT(msync(mapping_, page_size, MS_SYNC) == 0,
+               "Unable to sync journal header:" + path_ + " error:" + std::string(std::strerror(errno)));
+    }
+    ASSERT(header->magic_ == ME_JOURNAL_MAGIC && header->version_ == ME_JOURNAL_VERSION &&
+               header->record_size_ == sizeof(MEJournalRecord) && header->capacity_ == capacity_,
+           "Journal:" + path_ + " has an unexpected layout version:" + std::to_string(header->version_) +
+               " record size:" + std::to_string(header->record_size_) + " capacity:" +
+               std::to_string(header->capacity_));
+
+    logger_->log("%:% %() % Opened journal:% capacity:% sync:% created:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), path_, capacity_, journalSyncPolicyToString(sync_policy_),
+                 created);
+}
+
+MEJournal::~MEJournal() {
+    if (next_seq_num_ != synced_seq_num_ && sync_policy_ != JournalSyncPolicy::NONE)
+        sync();
+
+    logger_->log("%:% %() % Closing journal:% last seq:% checkpoint seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), path_, lastSeqNum(), checkpoint_seq_num_);
+
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    records_ = nullptr;
+    close(fd_);
+    fd_ = -1;
+}
+
+/// Force the records written since the last sync to disk.
+auto MEJournal::sync() noexcept -> void {
+    const auto first_slot = synced_seq_num_ % capacity_;
+    const auto last_slot = (next_seq_num_ - 1) % capacity_;
+    if (next_seq_num_ - synced_seq_num_ >= capacity_) {
+        syncSlots(0, capacity_ - 1);
+    } else if (first_slot <= last_slot) {
+        syncSlots(first_slot, last_slot);
+    } else { // wrapped around the end of the file.
+        syncSlots(first_slot, capacity_ - 1);
+        syncSlots(0, last_slot);
+    }
+
+    synced_seq_num_ = next_seq_num_;
+}
+
+/// msync() the pages holding the records in slots [first_slot, last_slot].
+auto MEJournal::syncSlots(size_t first_slot, size_t last_slot) noexcept -> void {
+    static const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<uintptr_t>(&records_[first_slot]) & ~(page_size - 1);
+    const auto end = reinterpret_cast<uintptr_t>(&records_[last_slot + 1]);
+    if (UNLIKELY(msync(reinterpret_cast<void*>(begin), end - begin, MS_SYNC) != 0))
+        FATAL("Unable to sync journal:" + path_ + " error:" + std::string(std::strerror(errno)));
+}
+
+/// Clear every record after last_seq_num left over from before a crash, so they are not mistaken for requests
+/// appended after the restart.
+/* 掉电时后面的 page 可能比前面的先落盘，重放停下的位置后面还可能有序号更大的完整记录，它们不能在重启之后被接上 */
+auto MEJournal::discardAfter(size_t last_seq_num) noexcept -> void {
+    size_t num_discarded = 0;
+    for (size_t slot = 0; slot < capacity_; ++slot) {
+        if (records_[slot].seq_num_ > last_seq_num) {
+            records_[slot] = MEJournalRecord{};
+            ++num_discarded;
+        }
+    }
+
+    if (num_discarded) {
+        logger_->log("%:% %() % Discarded % journal records after seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str_), num_discarded, last_seq_num);
+        ASSERT(msync(records_, capacity_ * sizeof(MEJournalRecord), MS_SYNC) == 0,
+               "Unable to sync journal:" + path_ + " error:" + std::string(std::strerror(errno)));
+    }
+}
+
+/// Read the requests journaled after after_seq_num, or from the oldest request left in the journal if after_seq_num is
+/// 0, up to the first missing or incomplete record without modifying the journal at path.
+auto readJournal(const std::string& path, size_t after_seq_num, std::vector<MEClientRequest>* requests,
+                 size_t* first_seq_num) -> bool {
+    *first_seq_num = 0;
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    MEJournalHeader header;
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic_ != ME_JOURNAL_MAGIC ||
+        header.version_ != ME_JOURNAL_VERSION || header.record_size_ != sizeof(MEJournalRecord)) {
+        close(fd);
+        return false;
+    }
+
+    const auto capacity = header.capacity_;
+    const auto mapping_size = page_size + capacity * sizeof(MEJournalRecord);
+    const auto mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    const auto records = reinterpret_cast<const MEJournalRecord*>(static_cast<const char*>(mapping) + page_size);
+
+    /* 没有指定起点时从 journal 里最老的一条完整记录开始 */
+    auto seq_num = after_seq_num + 1;
+    if (!after_seq_num) {
+        seq_num = 0;
+        for (size_t slot = 0; slot < capacity; ++slot) {
+            const auto& record = records[slot];
+            if (record.seq_num_ && (!seq_num || record.seq_num_ < seq_num) &&
+                record.checksum_ == journalChecksum(record.seq_num_, &record.request_))
+                seq_num = record.seq_num_;
+        }
+    }
+
+    for (const auto first = seq_num; seq_num && seq_num < first + capacity; ++seq_num) {
+        const auto& record = records[seq_num % capacity];
+        if (record.seq_num_ != seq_num || record.checksum_ != journalChecksum(seq_num, &record.request_))
+            break;
+        if (!*first_seq_num)
+            *first_seq_num = seq_num;
+        requests->push_back(record.request_);
+    }
+    munmap(mapping, mapping_size);
+
+    return true;
+}
+
+/// Wait for the journal at path to be created and follow the requests journaled after after_seq_num.
+/* header 是主 ME 拿到 flock 之后才写的，header 有效以后再判断主 ME 是否存活才不会误判 */
+MEJournalFollower::MEJournalFollower(const std::string& path, size_t capacity, size_t after_seq_num, Logger* logger)
+    : path_(path), capacity_(capacity), last_seq_num_(after_seq_num), logger_(logger) {
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mapping_size_ = page_size + capacity_ * sizeof(MEJournalRecord);
+
+    using namespace std::literals::chrono_literals;
+    for (MEJournalHeader header;; std::this_thread::sleep_for(10ms)) {
+        if (fd_ < 0)
+            fd_ = open(path_.c_str(), O_RDONLY);
+        if (fd_ >= 0 && pread(fd_, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic_ == ME_JOURNAL_MAGIC) {
+            ASSERT(header.version_ == ME_JOURNAL_VERSION && header.record_size_ == sizeof(MEJournalRecord) &&
+                       header.capacity_ == capacity_,
+                   "Journal:" + path_ + " has an unexpected layout version:" + std::to_string(header.version_) +
+                       " record size:" + std::to_string(header.record_size_) +
+                       " capacity:" + std::to_string(header.capacity_));
+            break;
+        }
+    }
+
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    ASSERT(mapping_ != MAP_FAILED, "Unable to mmap journal:" + path_ + " error:" + std::string(std::strerror(errno)));
+    records_ = reinterpret_cast<const MEJournalRecord*>(static_cast<const char*>(mapping_) + page_size);
+
+    logger_->log("%:% %() % Following journal:% after seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), path_, last_seq_num_);
+}
+
+MEJournalFollower::~MEJournalFollower() {
+    logger_->log("%:% %() % Stopped following journal:% at seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), path_, last_seq_num_);
+
+    munmap(mapping_, mapping_size_);
+    mapping_ = nullptr;
+    records_ = nullptr;
+    close(fd_);
+    fd_ = -1;
+}
+
+/// True while the primary matching engine holds the journal.
+auto MEJournalFollower::primaryAlive() noexcept -> bool {
+    if (flock(fd_, LOCK_EX | LOCK_NB) != 0)
+        return true;
+
+    flock(fd_, LOCK_UN); // left for the MEJournal taking over.
+    return false;
+}
+} // namespace Exchange
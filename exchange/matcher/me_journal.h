@@ -0,0 +1,274 @@
+#pragma once
+
+/**
+ * ME 的 write-ahead journal
+ *
+ * 每个请求在撮合之前先按序号写入一个预先分配好、mmap 到内存里的文件，重启时从最近的 checkpoint 开始按顺序重放，
+ * 撮合是确定性的，所以重放之后订单簿和退出前完全一样
+ *
+ * 文件格式：
+ *  [MEJournalHeader，占一个 page][MEJournalRecord * capacity]
+ * - 序号为 seq 的请求写在 seq % capacity 这个槽里，整个文件是一个环，checkpoint 之前的槽可以被覆盖
+ * - 每条记录带序号和校验和，重放遇到序号不连续或者校验和不对（没写完的记录）就停止
+ * - 写入只是内存拷贝，进程崩溃时数据已经在 page cache 里了；机器掉电需要 msync，见 JournalSyncPolicy
+ * - 写 journal 的 ME 一直持有文件的 flock，热备的 ME 通过同一个文件的共享映射跟着重放，拿到 flock 说明主 ME 已经退出
+ */
+
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "common/types.h"
+#include "common/macros.h"
+#include "common/logging.h"
+
+#include "order_server/client_request.h"
+
+using namespace Common;
+
+namespace Exchange
+{
+/// When journaled requests are forced to disk.
+/// NONE leaves it to the kernel, the journal survives a crash of the process but not of the machine. BATCH syncs the
+/// records written since the last sync whenever the matching engine runs out of requests or ME_JOURNAL_SYNC_BATCH
+/// records are pending. EVERY_REQUEST syncs every record before the request is processed.
+enum class JournalSyncPolicy : uint8_t { NONE = 0, BATCH = 1, EVERY_REQUEST = 2 };
+
+inline std::string journalSyncPolicyToString(JournalSyncPolicy sync_policy) {
+    switch (sync_policy) {
+    case JournalSyncPolicy::NONE:
+        return "NONE";
+    case JournalSyncPolicy::BATCH:
+        return "BATCH";
+    case JournalSyncPolicy::EVERY_REQUEST:
+        return "EVERY_REQUEST";
+    }
+    return "UNKNOWN";
+}
+
+/// Maximum number of journaled records pending a sync with JournalSyncPolicy::BATCH.
+constexpr size_t ME_JOURNAL_SYNC_BATCH = 1024;
+
+/// Identifies journal files and their layout, a journal written with a different layout is rejected.
+constexpr uint64_t ME_JOURNAL_MAGIC = 0x4c4e524a4f454d; // "MEOJRNL"
+constexpr uint32_t ME_JOURNAL_VERSION = 1;
+
+/// First page of the journal file.
+struct MEJournalHeader {
+    uint64_t magic_ = ME_JOURNAL_MAGIC;
+    uint32_t version_ = ME_JOURNAL_VERSION;
+    uint32_t record_size_ = 0;
+    uint64_t capacity_ = 0;
+};
+
+/// A single journaled request, one cache line. seq_num_ is 0 in slots which were never written.
+struct alignas(64) MEJournalRecord {
+    uint64_t seq_num_ = 0;
+    uint32_t checksum_ = 0;
+    MEClientRequest request_;
+};
+
+static_assert(sizeof(MEJournalRecord) == 64, "MEJournalRecord should be a single cache line.");
+
+/// FNV-1a over the sequence number and the request, detects records which were not completely written.
+inline auto journalChecksum(uint64_t seq_num, const MEClientRequest* request) noexcept {
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t len) {
+        const auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < len; ++i)
+            hash = (hash ^ bytes[i]) * 16777619u;
+    };
+    mix(&seq_num, sizeof(seq_num));
+    mix(request, sizeof(*request));
+
+    return hash;
+}
+
+/// Read the requests journaled after after_seq_num, or from the oldest request left in the journal if after_seq_num is
+/// 0, up to the first missing or incomplete record without modifying the journal at path. Writes the sequence number
+/// of the first request read to first_seq_num, 0 if there is none, and returns false if path is not a journal.
+auto readJournal(const std::string& path, size_t after_seq_num, std::vector<MEClientRequest>* requests,
+                 size_t* first_seq_num) -> bool;
+
+class MEJournal final {
+public:
+    /// Open the journal file at path, creating and pre-allocating it for capacity records if it does not exist.
+    /// An existing journal must have been created with the same capacity and not be in use by another matching engine.
+    MEJournal(const std::string& path, size_t capacity, JournalSyncPolicy sync_policy, Logger* logger);
+
+    ~MEJournal();
+
+    /// Call fn(const MEClientRequest*) for every journaled request following after_seq_num in sequence order, up to
+    /// the first missing or incomplete record. Appends continue after the last request replayed, whose sequence number
+    /// is returned. Must be called once before the first append().
+    template<typename F>
+    auto replay(size_t after_seq_num, F&& fn) noexcept -> size_t {
+        auto seq_num = after_seq_num + 1;
+        for (; seq_num <= after_seq_num + capacity_; ++seq_num) {
+            const auto record = &records_[seq_num % capacity_];
+            if (record->seq_num_ != seq_num || record->checksum_ != journalChecksum(seq_num, &record->request_))
+                break;
+            fn(&record->request_);
+        }
+
+        const auto last_seq_num = seq_num - 1;
+        discardAfter(last_seq_num);
+        next_seq_num_ = synced_seq_num_ = last_seq_num + 1;
+        checkpoint_seq_num_ = after_seq_num;
+
+        return last_seq_num;
+    }
+
+    /// Write the request to the journal and return its sequence number. The slot it is written to must not hold a
+    /// request after the last checkpoint, see full().
+    auto append(const MEClientRequest* request) noexcept -> size_t {
+        if (UNLIKELY(full()))
+            FATAL("Journal is full, checkpoint at:" + std::to_string(checkpoint_seq_num_) +
+                  " next:" + std::to_string(next_seq_num_));
+
+        const auto seq_num = next_seq_num_++;
+        auto record = &records_[seq_num % capacity_];
+        record->request_ = *request;
+        record->checksum_ = journalChecksum(seq_num, request);
+        __atomic_store_n(&record->seq_num_, seq_num, __ATOMIC_RELEASE); // a following standby sees a complete record.
+
+        if (UNLIKELY(sync_policy_ == JournalSyncPolicy::EVERY_REQUEST ||
+                     (sync_policy_ == JournalSyncPolicy::BATCH &&
+                      next_seq_num_ - synced_seq_num_ >= ME_JOURNAL_SYNC_BATCH)))
+            sync();
+
+        return seq_num;
+    }
+
+    /// Sync the records written since the last sync with JournalSyncPolicy::BATCH, called when the matching engine runs
+    /// out of requests.
+    auto flush() noexcept {
+        if (sync_policy_ == JournalSyncPolicy::BATCH && next_seq_num_ != synced_seq_num_)
+            sync();
+    }
+
+    /// True if the next append() would overwrite a request which is not covered by a checkpoint yet.
+    auto full() const noexcept -> bool {
+        return next_seq_num_ > checkpoint_seq_num_ + capacity_;
+    }
+
+    /// Record that the order books were checkpointed after the request with seq_num, whose slot and the slots before it
+    /// can be reused.
+    auto setCheckpointed(size_t seq_num) noexcept {
+        checkpoint_seq_num_ = seq_num;
+    }
+
+    /// Sequence number of the last request written to the journal, 0 if none.
+    auto lastSeqNum() const noexcept {
+        return next_seq_num_ - 1;
+    }
+
+    auto capacity() const noexcept {
+        return capacity_;
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    MEJournal() = delete;
+    MEJournal(const MEJournal&) = delete;
+    MEJournal(const MEJournal&&) = delete;
+    MEJournal& operator=(const MEJournal&) = delete;
+    MEJournal& operator=(const MEJournal&&) = delete;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+
+    /// The mapped journal file, records_ starts at the page following the header.
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    MEJournalRecord* records_ = nullptr;
+    size_t capacity_ = 0;
+
+    JournalSyncPolicy sync_policy_ = JournalSyncPolicy::NONE;
+
+    /// Sequence number of the next request appended, of the first request not synced yet and of the last request
+    /// covered by a checkpoint.
+    size_t next_seq_num_ = 1;
+    size_t synced_seq_num_ = 1;
+    size_t checkpoint_seq_num_ = 0;
+
+    std::string time_str_;
+    Logger* logger_ = nullptr;
+
+    /// Force the records written since the last sync to disk.
+    auto sync() noexcept -> void;
+
+    /// msync() the pages holding the records in slots [first_slot, last_slot].
+    auto syncSlots(size_t first_slot, size_t last_slot) noexcept -> void;
+
+    /// Clear every record after last_seq_num left over from before a crash, so they are not mistaken for requests
+    /// appended after the restart.
+    auto discardAfter(size_t last_seq_num) noexcept -> void;
+};
+
+/// Follows the journal written by the primary matching engine in another process through a shared mapping of the
+/// journal file, used by a hot standby matching engine.
+class MEJournalFollower final {
+public:
+    /// Wait for the journal at path to be created and follow the requests journaled after after_seq_num.
+    MEJournalFollower(const std::string& path, size_t capacity, size_t after_seq_num, Logger* logger);
+
+    ~MEJournalFollower();
+
+    /// Call fn(const MEClientRequest*) for every request journaled by the primary since the last call and return the
+    /// number of requests. Calls FATAL if the primary overwrote requests which were not followed yet.
+    template<typename F>
+    auto poll(F&& fn) noexcept -> size_t {
+        size_t num_polled = 0;
+        for (;; ++num_polled) {
+            const auto seq_num = last_seq_num_ + 1;
+            const auto record = &records_[seq_num % capacity_];
+            const auto record_seq_num = __atomic_load_n(&record->seq_num_, __ATOMIC_ACQUIRE);
+            if (record_seq_num != seq_num) {
+                if (UNLIKELY(record_seq_num > seq_num))
+                    FATAL("Journal:" + path_ + " overwrote seq:" + std::to_string(seq_num) +
+                          " before it was followed, found seq:" + std::to_string(record_seq_num));
+                break;
+            }
+            if (UNLIKELY(record->checksum_ != journalChecksum(seq_num, &record->request_)))
+                FATAL("Journal:" + path_ + " has a corrupt record at seq:" + std::to_string(seq_num));
+
+            fn(&record->request_);
+            last_seq_num_ = seq_num;
+        }
+
+        return num_polled;
+    }
+
+    /// True while the primary matching engine holds the journal, a syscall so only call it when there is nothing to
+    /// poll.
+    auto primaryAlive() noexcept -> bool;
+
+    /// Sequence number of the last request followed.
+    auto lastSeqNum() const noexcept {
+        return last_seq_num_;
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    MEJournalFollower() = delete;
+    MEJournalFollower(const MEJournalFollower&) = delete;
+    MEJournalFollower(const MEJournalFollower&&) = delete;
+    MEJournalFollower& operator=(const MEJournalFollower&) = delete;
+    MEJournalFollower& operator=(const MEJournalFollower&&) = delete;
+
+private:
+    std::string path_;
+    int fd_ = -1;
+
+    /// The shared mapping of the journal file, records_ starts at the page following the header.
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    const MEJournalRecord* records_ = nullptr;
+    size_t capacity_ = 0;
+
+    size_t last_seq_num_ = 0;
+
+    std::string time_str_;
+    Logger* logger_ = nullptr;
+};
+} // namespace Exchange
@@ -0,0 +1,260 @@
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common/test_utils.h"
+
+#include "matcher/matching_engine.h"
+#include "matcher/me_journal.h"
+
+/**
+ * MEJournal 和 MatchingEngine 恢复的测试：journal 文件和 checkpoint 文件写在当前目录，每个用例开始时删掉
+ * 进程崩溃用删除 ME / journal 代替：文件里留下的内容和崩溃时一样，没写完的记录直接改坏文件里的字节
+ * 恢复出来的订单簿用 writeCheckpoint() 写出的文件和崩溃前的比较
+ */
+
+namespace
+{
+using namespace Exchange;
+
+const std::string PREFIX = "me_journal_test";
+const std::string JOURNAL_PATH = PREFIX + ".journal";
+
+auto removeFiles() {
+    for (const auto& suffix : {".journal", ".checkpoint", "_expected.checkpoint", "_restored.checkpoint"})
+        std::remove((PREFIX + suffix).c_str());
+}
+
+auto readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+/// The i-th request of a session of two clients whose orders cross each other around 100.
+auto makeRequest(size_t i) {
+    const auto side = (i % 2 ? Side::SELL : Side::BUY);
+    const auto price = static_cast<Price>(side == Side::BUY ? 98 + i % 5 : 102 - i % 5);
+    return MEClientRequest{ClientRequestType::NEW, static_cast<ClientId>(1 + i % 2), 0, i + 1, side, price,
+                           static_cast<Qty>(10 + i % 3)};
+}
+
+/// Flip a byte of the request journaled with seq_num, as if the process crashed while writing it.
+auto corruptRecord(size_t seq_num, size_t capacity) {
+    const auto offset = sysconf(_SC_PAGESIZE) + (seq_num % capacity) * sizeof(MEJournalRecord) +
+                        offsetof(MEJournalRecord, request_);
+    const auto fd = open(JOURNAL_PATH.c_str(), O_RDWR);
+    ASSERT(fd >= 0, "Unable to open journal:" + JOURNAL_PATH);
+    char byte = 0;
+    ASSERT(pread(fd, &byte, 1, offset) == 1, "Unable to read journal:" + JOURNAL_PATH);
+    byte ^= 0x5a;
+    ASSERT(pwrite(fd, &byte, 1, offset) == 1, "Unable to write journal:" + JOURNAL_PATH);
+    close(fd);
+}
+
+/// Replay the journal at JOURNAL_PATH after after_seq_num, returns the requests and the last sequence number.
+auto replayJournal(size_t capacity, size_t after_seq_num, Logger* logger) {
+    MEJournal journal(JOURNAL_PATH, capacity, JournalSyncPolicy::NONE, logger);
+    std::vector<MEClientRequest> requests;
+    const auto last_seq_num =
+        journal.replay(after_seq_num, [&requests](const MEClientRequest* request) { requests.push_back(*request); });
+    return std::make_pair(requests, last_seq_num);
+}
+
+/// The requests are makeRequest() of the sequence numbers from first_seq_num.
+auto checkRequests(const std::vector<MEClientRequest>& requests, size_t first_seq_num, size_t num_requests) {
+    if (!CHECK_EQ(requests.size(), num_requests))
+        return;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const auto expected = makeRequest(first_seq_num + i - 1);
+        if (!CHECK(requests[i].client_id_ == expected.client_id_ && requests[i].order_id_ == expected.order_id_ &&
+                   requests[i].side_ == expected.side_ && requests[i].price_ == expected.price_ &&
+                   requests[i].qty_ == expected.qty_))
+            return;
+    }
+}
+
+/// The queues of a matching engine which is restarted by the test cases.
+class EngineFixture final {
+public:
+    EngineFixture()
+        : client_requests_(ME_MAX_CLIENT_UPDATES), client_responses_(ME_MAX_CLIENT_UPDATES),
+          market_updates_(ME_MAX_MARKET_UPDATES), logger_("me_journal_test.log") {
+    }
+
+    auto makeMatchingEngine() {
+        return new MatchingEngine(&client_requests_, &client_responses_, &market_updates_, nullptr, nullptr);
+    }
+
+    /// Take the client responses and market updates published so far, returns the client responses.
+    auto drain() {
+        std::vector<MEClientResponse> responses;
+        for (auto response = client_responses_.getNextToRead(); response;
+             response = client_responses_.getNextToRead()) {
+            responses.push_back(*response);
+            client_responses_.updateReadIndex();
+        }
+        for (; market_updates_.getNextToRead(); market_updates_.updateReadIndex())
+            ;
+        return responses;
+    }
+
+    ClientRequestLFQueue client_requests_;
+    ClientResponseLFQueue client_responses_;
+    MEMarketUpdateLFQueue market_updates_;
+    Logger logger_;
+};
+
+auto testReplayAfterCheckpoint(EngineFixture& f) {
+    removeFiles();
+    const size_t capacity = 16;
+    {
+        MEJournal journal(JOURNAL_PATH, capacity, JournalSyncPolicy::NONE, &f.logger_);
+        CHECK_EQ(journal.replay(0, [](const MEClientRequest*) {}), 0u);
+        for (size_t i = 0; i < 10; ++i) {
+            const auto request = makeRequest(i);
+            CHECK_EQ(journal.append(&request), i + 1);
+        }
+        journal.setCheckpointed(4);
+    }
+
+    // Only the requests after the checkpoint are replayed, appends carry on after the last one.
+    auto [requests, last_seq_num] = replayJournal(capacity, 4, &f.logger_);
+    CHECK_EQ(last_seq_num, 10u);
+    checkRequests(requests, 5, 6);
+
+    std::vector<MEClientRequest> read;
+    size_t first_seq_num = 0;
+    CHECK(readJournal(JOURNAL_PATH, 0, &read, &first_seq_num));
+    CHECK_EQ(first_seq_num, 1u);
+    checkRequests(read, 1, 10);
+}
+
+auto testDiscardsTornRecord(EngineFixture& f) {
+    removeFiles();
+    const size_t capacity = 16;
+    {
+        MEJournal journal(JOURNAL_PATH, capacity, JournalSyncPolicy::BATCH, &f.logger_);
+        journal.replay(0, [](const MEClientRequest*) {});
+        for (size_t i = 0; i < 8; ++i) {
+            const auto request = makeRequest(i);
+            journal.append(&request);
+        }
+    }
+
+    // The replay stops at the torn record, the complete records after it are discarded.
+    corruptRecord(6, capacity);
+    {
+        MEJournal journal(JOURNAL_PATH, capacity, JournalSyncPolicy::BATCH, &f.logger_);
+        std::vector<MEClientRequest> requests;
+        CHECK_EQ(journal.replay(0, [&requests](const MEClientRequest* request) { requests.push_back(*request); }), 5u);
+        checkRequests(requests, 1, 5);
+        const auto request = makeRequest(5);
+        CHECK_EQ(journal.append(&request), 6u);
+    }
+
+    // The request appended after the restart is not followed by the discarded ones.
+    auto [requests, last_seq_num] = replayJournal(capacity, 0, &f.logger_);
+    CHECK_EQ(last_seq_num, 6u);
+    checkRequests(requests, 1, 6);
+}
+
+auto testRingWraps(EngineFixture& f) {
+    removeFiles();
+    const size_t capacity = 8;
+    {
+        MEJournal journal(JOURNAL_PATH, capacity, JournalSyncPolicy::NONE, &f.logger_);
+        journal.replay(0, [](const MEClientRequest*) {});
+        for (size_t i = 0; i < capacity; ++i) {
+            const auto request = makeRequest(i);
+            journal.append(&request);
+        }
+        CHECK(journal.full());
+
+        // A checkpoint frees the slots of the requests it includes, the appends wrap around the end of the file.
+        journal.setCheckpointed(5);
+        for (size_t i = capacity; i < capacity + 5; ++i) {
+            CHECK(!journal.full());
+            const auto request = makeRequest(i);
+            journal.append(&request);
+        }
+        CHECK(journal.full());
+    }
+
+    auto [requests, last_seq_num] = replayJournal(capacity, 5, &f.logger_);
+    CHECK_EQ(last_seq_num, 13u);
+    checkRequests(requests, 6, 8);
+}
+
+auto testFullJournalCheckpoints(EngineFixture& f) {
+    removeFiles();
+    const size_t capacity = 16, num_requests = 5 * capacity + 3;
+
+    // Without periodic checkpoints a full journal checkpoints the order books itself.
+    auto matching_engine = f.makeMatchingEngine();
+    matching_engine->enableJournal(PREFIX, capacity, JournalSyncPolicy::NONE, 0);
+    for (size_t i = 0; i < num_requests; ++i) {
+        const auto request = makeRequest(i);
+        matching_engine->onClientRequest(&request);
+        f.drain();
+    }
+    CHECK(matching_engine->writeCheckpoint(PREFIX + "_expected.checkpoint"));
+    delete matching_engine;
+
+    matching_engine = f.makeMatchingEngine();
+    const auto num_replayed = matching_engine->enableJournal(PREFIX, capacity, JournalSyncPolicy::NONE, 0);
+    CHECK(num_replayed > 0 && num_replayed <= capacity);
+    f.drain();
+    CHECK(matching_engine->writeCheckpoint(PREFIX + "_restored.checkpoint"));
+    CHECK(readFile(PREFIX + "_restored.checkpoint") == readFile(PREFIX + "_expected.checkpoint"));
+    delete matching_engine;
+}
+
+auto testRestoresMidStream(EngineFixture& f) {
+    removeFiles();
+    const size_t capacity = 64, checkpoint_every = 10, num_requests = 35;
+
+    auto matching_engine = f.makeMatchingEngine();
+    matching_engine->enableJournal(PREFIX, capacity, JournalSyncPolicy::NONE, checkpoint_every);
+    const auto started = f.drain(); // a RESENT response without any response to resend.
+    CHECK(started.size() == 1 && started[0].type_ == ClientResponseType::RESENT && started[0].market_order_id_ == 0);
+    size_t num_responses = 0;
+    for (size_t i = 0; i < num_requests; ++i) {
+        const auto request = makeRequest(i);
+        matching_engine->onClientRequest(&request);
+        num_responses += f.drain().size();
+    }
+    CHECK(matching_engine->writeCheckpoint(PREFIX + "_expected.checkpoint"));
+    delete matching_engine;
+
+    // The requests after the last checkpoint are replayed on top of it, their responses are resent.
+    matching_engine = f.makeMatchingEngine();
+    const auto num_replayed =
+        matching_engine->enableJournal(PREFIX, capacity, JournalSyncPolicy::NONE, checkpoint_every);
+    CHECK(num_replayed > 0 && num_replayed < num_requests);
+    const auto resent = f.drain();
+    CHECK(!resent.empty() && resent[0].type_ == ClientResponseType::RESENT &&
+          resent[0].market_order_id_ + resent.size() - 1 == num_responses);
+
+    CHECK(matching_engine->writeCheckpoint(PREFIX + "_restored.checkpoint"));
+    CHECK(readFile(PREFIX + "_restored.checkpoint") == readFile(PREFIX + "_expected.checkpoint"));
+    delete matching_engine;
+}
+} // namespace
+
+int main(int, char**) {
+    EngineFixture fixture;
+
+    Common::runTest("replay after checkpoint", [&]() { testReplayAfterCheckpoint(fixture); });
+    Common::runTest("discards torn record", [&]() { testDiscardsTornRecord(fixture); });
+    Common::runTest("ring wraps", [&]() { testRingWraps(fixture); });
+    Common::runTest("full journal checkpoints", [&]() { testFullJournalCheckpoints(fixture); });
+    Common::runTest("restores mid stream", [&]() { testRestoresMidStream(fixture); });
+    removeFiles();
+
+    return Common::testResult();
+}
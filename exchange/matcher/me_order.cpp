@@ -13,6 +13,9 @@ auto MEOrder::toString() const -> std::string {
        << "price:" << priceToString(price_) << " "
        << "qty:" << qtyToString(qty_) << " "
        << "prio:" << priorityToString(priority_) << " "
+       << "stop_price:" << priceToString(stop_price_) << " "
+       << "display:" << qtyToString(display_qty_) << " "
+       << "reserve:" << qtyToString(reserve_qty_) << " "
        << "prev:" << orderIdToString(prev_order_ ? prev_order_->market_order_id_ : OrderId_INVALID) << " "
        << "next:" << orderIdToString(next_order_ ? next_order_->market_order_id_ : OrderId_INVALID) << "]";
 
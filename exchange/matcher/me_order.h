@@ -4,6 +4,8 @@
 #include <sstream>
 #include "common/types.h"
 
+#include "order_server/client_request.h"
+
 using namespace Common;
 
 namespace Exchange
@@ -23,6 +25,24 @@ struct MEOrder {
     MEOrder* prev_order_ = nullptr;
     MEOrder* next_order_ = nullptr;
 
+    /// MEOrder is also a node in a doubly linked list of all orders of its client in the order book, so mass cancels
+    /// only visit the client's own orders.
+    MEOrder* prev_client_order_ = nullptr;
+    MEOrder* next_client_order_ = nullptr;
+
+    /// Set while the order is a parked STOP / STOP_LIMIT order, which is in no price level and not visible in the
+    /// market data until it is triggered. ord_type_ and tif_ are what the order becomes when triggered and
+    /// trigger_index_ is its position in the trigger index.
+    Price stop_price_ = Price_INVALID;
+    OrderType ord_type_ = OrderType::LIMIT;
+    TimeInForce tif_ = TimeInForce::DAY;
+    size_t trigger_index_ = 0;
+
+    /// Iceberg orders only rest with up to display_qty_ in qty_, the rest of the order is the hidden reserve_qty_ which
+    /// refills qty_ at the back of the FIFO queue whenever qty_ is exhausted. Qty_INVALID if the order is fully shown.
+    Qty display_qty_ = Qty_INVALID;
+    Qty reserve_qty_ = 0;
+
     /// Only needed for use with MemPool.
     MEOrder() = default;
 
@@ -51,6 +71,13 @@ struct MEOrdersAtPrice {
 
     MEOrder* first_me_order_ = nullptr;
 
+    /// Running total quantity and number of orders at this price level, maintained by MEOrderBook so the aggregated
+    /// price level feed does not have to walk the FIFO queue. reserve_qty_ is the hidden quantity of the iceberg orders
+    /// at this price level, which is not included in qty_.
+    Qty qty_ = 0;
+    uint32_t num_orders_ = 0;
+    Qty reserve_qty_ = 0;
+
     /// MEOrdersAtPrice also serves as a node in a doubly linked list of price levels arranged in order from most
     /// aggressive to least aggressive price.
     MEOrdersAtPrice* prev_entry_ = nullptr;
@@ -70,6 +97,9 @@ struct MEOrdersAtPrice {
         ss << "MEOrdersAtPrice["
            << "side:" << sideToString(side_) << " "
            << "price:" << priceToString(price_) << " "
+           << "qty:" << qtyToString(qty_) << " "
+           << "orders:" << num_orders_ << " "
+           << "reserve:" << qtyToString(reserve_qty_) << " "
            << "first_me_order:" << (first_me_order_ ? first_me_order_->toString() : "null") << " "
            << "prev:" << priceToString(prev_entry_ ? prev_entry_->price_ : Price_INVALID) << " "
            << "next:" << priceToString(next_entry_ ? next_entry_->price_ : Price_INVALID) << "]";
@@ -1,17 +1,27 @@
 #include "me_order_book.h"
 
+#include <cstring>
+#include <fstream>
+#include <vector>
+
 #include "matcher/matching_engine.h"
 
 namespace Exchange
 {
 MEOrderBook::MEOrderBook(TickerId ticker_id, Logger* logger, MatchingEngine* matching_engine)
-    : ticker_id_(ticker_id), matching_engine_(matching_engine), orders_at_price_pool_(ME_MAX_PRICE_LEVELS),
-      order_pool_(ME_MAX_ORDER_IDS), logger_(logger) {
+    : ticker_id_(ticker_id), matching_engine_(matching_engine), orders_at_price_pool_(ME_MAX_PRICE_LEVELS * 2),
+      order_pool_(ME_MAX_ORDER_IDS), publish_levels_(matching_engine->publishesLevelUpdates()),
+      publish_bbo_(matching_engine->publishesBBOUpdates()), logger_(logger) {
+    bbo_update_.ticker_id_ = ticker_id;
 }
 
 MEOrderBook::~MEOrderBook() {
-    logger_->log("%:% %() % OrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                 toString(false, true));
+    logger_->log("%:% %() % OrderBook ticker:% bid:%@% ask:%@%\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), ticker_id_,
+                 qtyToString(bids_by_price_ ? bids_by_price_->qty_ : Qty_INVALID),
+                 priceToString(bids_by_price_ ? bids_by_price_->price_ : Price_INVALID),
+                 qtyToString(asks_by_price_ ? asks_by_price_->qty_ : Qty_INVALID),
+                 priceToString(asks_by_price_ ? asks_by_price_->price_ : Price_INVALID));
 
     matching_engine_ = nullptr;
     bids_by_price_ = asks_by_price_ = nullptr;
@@ -31,20 +41,27 @@ auto MEOrderBook::match(TickerId ticker_id, ClientId client_id, Side side, Order
     const auto order_qty = order->qty_;
     const auto fill_qty = std::min(*leaves_qty, order_qty);
 
+    touchLevel(order->side_, order->price_);
+
     *leaves_qty -= fill_qty;
     order->qty_ -= fill_qty;
+    getOrdersAtPrice(order->side_, order->price_)->qty_ -= fill_qty;
+    recordTrade(itr->price_);
 
-    /* This is sent to the new client */
-    client_response_ = {ClientResponseType::FILLED,
-                        client_id,
-                        ticker_id,
-                        client_order_id,
-                        new_market_order_id,
-                        side,
-                        itr->price_,
-                        fill_qty,
-                        *leaves_qty};
-    matching_engine_->sendClientResponse(&client_response_);
+    /* 合并模式下主动方的成交回报和 TRADE 已经在 checkForMatch 里按价位发过了 */
+    if (!aggregate_fills_) {
+        /* This is sent to the new client */
+        client_response_ = {ClientResponseType::FILLED,
+                            client_id,
+                            ticker_id,
+                            client_order_id,
+                            new_market_order_id,
+                            side,
+                            itr->price_,
+                            fill_qty,
+                            *leaves_qty};
+        matching_engine_->sendClientResponse(&client_response_);
+    }
 
     /* This is sent to the old client that has existed in order book */
     client_response_ = {ClientResponseType::FILLED,
@@ -55,16 +72,20 @@ auto MEOrderBook::match(TickerId ticker_id, ClientId client_id, Side side, Order
                         order->side_,
                         itr->price_,
                         fill_qty,
-                        order->qty_};
+                        order->qty_ + order->reserve_qty_};
     matching_engine_->sendClientResponse(&client_response_);
 
     /* TRADE：仅通知“发生了一笔成交”，用于成交记录和分析 */
-    market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, itr->price_, fill_qty,
-                      Priority_INVALID};
-    matching_engine_->sendMarketUpdate(&market_update_);
+    if (!aggregate_fills_) {
+        market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, itr->price_, fill_qty,
+                          Priority_INVALID};
+        matching_engine_->sendMarketUpdate(&market_update_);
+    }
 
-    /* CANCEL/MODIFY：同步“挂单的状态变化”，用于更新订单簿 */
-    if (!order->qty_) {
+    /* CANCEL/MODIFY：同步“挂单的状态变化”，用于更新订单簿；冰山单显示的部分成交完了就从隐藏数量补充到队尾 */
+    if (UNLIKELY(!order->qty_ && order->reserve_qty_)) {
+        replenishOrder(order);
+    } else if (!order->qty_) {
         market_update_ = {
             MarketUpdateType::CANCEL, order->market_order_id_, ticker_id, order->side_, order->price_, order_qty,
             Priority_INVALID};
@@ -87,53 +108,302 @@ auto MEOrderBook::checkForMatch(ClientId client_id, OrderId client_order_id, Tic
                                 Qty qty, Qty new_market_order_id) noexcept {
     auto leaves_qty = qty;
 
-    if (side == Side::BUY) {
-        /* 检查还有剩下的数量吗？ && 市场中 asks 的链表是空的吗 */
-        while (leaves_qty && asks_by_price_) {
-            const auto ask_itr = asks_by_price_->first_me_order_;
-            // 买价小于卖价直接 break
-            if (LIKELY(price < ask_itr->price_)) {
-                break;
-            }
+    while (leaves_qty) {
+        /* 对手方最优价位，空的或者价格不交叉就停止 */
+        const auto best_orders_by_price = (side == Side::BUY ? asks_by_price_ : bids_by_price_);
+        if (!best_orders_by_price ||
+            LIKELY(side == Side::BUY ? price < best_orders_by_price->price_ : price > best_orders_by_price->price_)) {
+            break;
+        }
 
-            match(ticker_id, client_id, side, client_order_id, new_market_order_id, ask_itr, &leaves_qty);
+        /* 自成交检查只比较已经要访问的被动订单的 client id，不需要额外查找 */
+        const auto first_order = best_orders_by_price->first_me_order_;
+        if (UNLIKELY(stp_ != SelfTradePrevention::NONE && first_order->client_id_ == client_id)) {
+            preventSelfTrade(client_id, client_order_id, ticker_id, side, price, new_market_order_id, first_order,
+                             &leaves_qty);
+            continue;
+        }
+
+        if (!aggregate_fills_) {
+            match(ticker_id, client_id, side, client_order_id, new_market_order_id, first_order, &leaves_qty);
+            continue;
         }
-    }
-    if (side == Side::SELL) {
-        while (leaves_qty && bids_by_price_) {
-            const auto bid_itr = bids_by_price_->first_me_order_;
-            if (LIKELY(price > bid_itr->price_)) {
-                break;
-            }
 
-            match(ticker_id, client_id, side, client_order_id, new_market_order_id, bid_itr, &leaves_qty);
+        /* 价位的累计数量已知，先发这一价位合并后的主动方回报和 TRADE，再逐个撮合被动订单 */
+        const auto level_price = best_orders_by_price->price_;
+        auto level_fill_qty = std::min(leaves_qty, best_orders_by_price->qty_ + best_orders_by_price->reserve_qty_);
+        if (UNLIKELY(stp_ != SelfTradePrevention::NONE)) {
+            /* 只合并到这个价位上第一个同一客户的订单之前，之后的部分在下一轮循环处理；
+               冰山单补充的数量排在队尾，只有这个价位上没有同一客户的订单时才能算进去 */
+            Qty run_qty = 0;
+            auto order = first_order;
+            auto self_order_found = false;
+            do {
+                self_order_found = (order->client_id_ == client_id);
+                if (self_order_found) break;
+                run_qty += order->qty_;
+                order = order->next_order_;
+            } while (order != first_order && run_qty < leaves_qty);
+            if (!self_order_found)
+                run_qty += best_orders_by_price->reserve_qty_;
+            level_fill_qty = std::min(level_fill_qty, run_qty);
         }
+        const auto level_leaves_qty = leaves_qty - level_fill_qty;
+
+        client_response_ = {ClientResponseType::FILLED,
+                            client_id,
+                            ticker_id,
+                            client_order_id,
+                            new_market_order_id,
+                            side,
+                            level_price,
+                            level_fill_qty,
+                            level_leaves_qty};
+        matching_engine_->sendClientResponse(&client_response_);
+
+        market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id, side, level_price, level_fill_qty,
+                          Priority_INVALID};
+        matching_engine_->sendMarketUpdate(&market_update_);
+
+        /* 价位被吃光时最后一次 match 会释放它，所以只看 leaves_qty，不再访问 best_orders_by_price */
+        while (leaves_qty != level_leaves_qty)
+            match(ticker_id, client_id, side, client_order_id, new_market_order_id,
+                  best_orders_by_price->first_me_order_, &leaves_qty);
     }
 
     return leaves_qty;
 }
 
+/// The aggressive order with the provided attributes reached a resting order of the same client at the front of the
+/// other side, apply the self trade prevention mode instead of matching them.
+auto MEOrderBook::preventSelfTrade(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side,
+                                   Price price, OrderId new_market_order_id, MEOrder* resting_order,
+                                   Qty* leaves_qty) noexcept -> void {
+    switch (stp_) {
+    case SelfTradePrevention::CANCEL_OLDEST: {
+        cancelRestingOrder(resting_order);
+        return;
+    }
+    case SelfTradePrevention::DECREMENT_BOTH: {
+        const auto decrement_qty = std::min(*leaves_qty, resting_order->qty_);
+        *leaves_qty -= decrement_qty;
+
+        if (decrement_qty == resting_order->qty_ && !resting_order->reserve_qty_) {
+            cancelRestingOrder(resting_order);
+        } else {
+            touchLevel(resting_order->side_, resting_order->price_);
+            resting_order->qty_ -= decrement_qty;
+            getOrdersAtPrice(resting_order->side_, resting_order->price_)->qty_ -= decrement_qty;
+
+            client_response_ = {ClientResponseType::MODIFIED,
+                                resting_order->client_id_,
+                                ticker_id,
+                                resting_order->client_order_id_,
+                                resting_order->market_order_id_,
+                                resting_order->side_,
+                                resting_order->price_,
+                                0,
+                                resting_order->qty_ + resting_order->reserve_qty_};
+            matching_engine_->sendClientResponse(&client_response_);
+
+            if (!resting_order->qty_) {
+                replenishOrder(resting_order);
+            } else {
+                market_update_ = {MarketUpdateType::MODIFY, resting_order->market_order_id_, ticker_id,
+                                  resting_order->side_,     resting_order->price_,            resting_order->qty_,
+                                  resting_order->priority_};
+                matching_engine_->sendMarketUpdate(&market_update_);
+            }
+        }
+        if (*leaves_qty)
+            return;
+
+        /* 主动单被减到 0：和撤单一样结束，没有剩下的数量 */
+        client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, client_order_id, new_market_order_id,
+                            side, price, Qty_INVALID, 0};
+        matching_engine_->sendClientResponse(&client_response_);
+        return;
+    }
+    case SelfTradePrevention::CANCEL_NEWEST:
+    case SelfTradePrevention::NONE: {
+        client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id, client_order_id, new_market_order_id,
+                            side, price, Qty_INVALID, *leaves_qty};
+        matching_engine_->sendClientResponse(&client_response_);
+        *leaves_qty = 0;
+        return;
+    }
+    }
+}
+
+/// Cancel a resting order from within the matching loop, sends the CANCELED response and the CANCEL update.
+auto MEOrderBook::cancelRestingOrder(MEOrder* order) noexcept -> void {
+    client_response_ = {ClientResponseType::CANCELED,
+                        order->client_id_,
+                        order->ticker_id_,
+                        order->client_order_id_,
+                        order->market_order_id_,
+                        order->side_,
+                        order->price_,
+                        Qty_INVALID,
+                        order->qty_ + order->reserve_qty_};
+    matching_engine_->sendClientResponse(&client_response_);
+
+    market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, order->ticker_id_, order->side_, order->price_,
+                      0, order->priority_};
+    matching_engine_->sendMarketUpdate(&market_update_);
+
+    removeOrder(order);
+}
+
+/// Refill an iceberg order whose shown quantity was just exhausted from its reserve, at the back of the FIFO queue of
+/// its price level with a new priority. Publishes an ADD which replaces the order for the market data consumers.
+/* 和改单重新排队一样，发布同一个 market order id 的 ADD，行情的消费者会用它替换原来的订单 */
+auto MEOrderBook::replenishOrder(MEOrder* order) noexcept -> void {
+    const auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
+    touchLevel(order->side_, order->price_);
+
+    if (order->next_order_ != order) { // move to the back of the queue.
+        if (orders_at_price->first_me_order_ == order)
+            orders_at_price->first_me_order_ = order->next_order_;
+        order->prev_order_->next_order_ = order->next_order_;
+        order->next_order_->prev_order_ = order->prev_order_;
+
+        const auto first_order = orders_at_price->first_me_order_;
+        first_order->prev_order_->next_order_ = order;
+        order->prev_order_ = first_order->prev_order_;
+        order->next_order_ = first_order;
+        first_order->prev_order_ = order;
+    }
+    order->priority_ = order->prev_order_->priority_ + 1;
+
+    order->qty_ = std::min(order->display_qty_, order->reserve_qty_);
+    order->reserve_qty_ -= order->qty_;
+    orders_at_price->qty_ += order->qty_;
+    orders_at_price->reserve_qty_ -= order->qty_;
+
+    market_update_ = {MarketUpdateType::ADD, order->market_order_id_, ticker_id_, order->side_, order->price_,
+                      order->qty_,           order->priority_};
+    matching_engine_->sendMarketUpdate(&market_update_);
+}
+
 /// Create and add a new order in the order book with provided attributes.
 /// It will check to see if this new order matches an existing passive order with opposite side, and perform the
 /// matching if that is the case.
 auto MEOrderBook::add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price,
-                      Qty qty) noexcept -> void {
+                      Qty qty, TimeInForce tif, OrderType ord_type, Price stop_price, Qty display_qty) noexcept
+    -> void {
     const auto new_market_order_id = generateNewMarketOrderId();
     client_response_ = {
         ClientResponseType::ACCEPTED, client_id, ticker_id, client_order_id, new_market_order_id, side, price, 0, qty};
     matching_engine_->sendClientResponse(&client_response_);
 
-    const auto leaves_qty = checkForMatch(client_id, client_order_id, ticker_id, side, price, qty, new_market_order_id);
+    if (UNLIKELY(!display_qty)) // same as not set, the whole order is shown.
+        display_qty = Qty_INVALID;
+    if (UNLIKELY(ord_type == OrderType::STOP || ord_type == OrderType::STOP_LIMIT))
+        parkStopOrder(client_id, client_order_id, new_market_order_id, side, price, qty, tif, ord_type, stop_price,
+                      display_qty);
+    else
+        execute(client_id, client_order_id, new_market_order_id, side, price, qty, tif, ord_type, display_qty);
+    triggerStopOrders();
+
+    validateTouchedLevels();
+    publishLevelUpdates();
+    publishBBOUpdate();
+}
+
+/// Match an accepted order against the other side and rest or cancel the remainder depending on tif and ord_type.
+/// The caller publishes the price level and top of book updates.
+auto MEOrderBook::execute(ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price,
+                          Qty qty, TimeInForce tif, OrderType ord_type, Qty display_qty) noexcept -> void {
+    const auto match_price = (UNLIKELY(ord_type == OrderType::MARKET) ? marketOrderPrice(side) : price);
+
+    /* FOK 先只读地看一下对手方能成交的数量，不够就直接撤单，不会动任何价位；
+       集合竞价阶段不撮合，DAY 订单直接挂单，IOC / FOK 没有可以立即成交的数量，整单撤掉 */
+    const auto leaves_qty =
+        (UNLIKELY(phase_ == TradingPhase::AUCTION) ||
+                 (UNLIKELY(tif == TimeInForce::FOK) && !canFillNow(client_id, side, match_price, qty))
+             ? qty
+             : checkForMatch(client_id, client_order_id, ticker_id_, side, match_price, qty, market_order_id));
 
     if (LIKELY(leaves_qty)) {
-        const auto priority = getNextPriority(price);
+        if (LIKELY(tif == TimeInForce::DAY && ord_type == OrderType::LIMIT)) {
+            const auto priority = getNextPriority(side, price);
 
-        auto order = order_pool_.allocate(ticker_id, client_id, client_order_id, new_market_order_id, side, price,
-                                          leaves_qty, priority, nullptr, nullptr);
-        addOrder(order);
+            /* 冰山单只挂出 display_qty，剩下的作为隐藏数量 */
+            const auto shown_qty = std::min(leaves_qty, display_qty);
+            auto order = order_pool_.allocate(ticker_id_, client_id, client_order_id, market_order_id, side, price,
+                                              shown_qty, priority, nullptr, nullptr);
+            order->display_qty_ = display_qty;
+            order->reserve_qty_ = leaves_qty - shown_qty;
+            addOrder(order);
 
-        market_update_ = {MarketUpdateType::ADD, new_market_order_id, ticker_id, side, price, leaves_qty, priority};
-        matching_engine_->sendMarketUpdate(&market_update_);
+            market_update_ = {MarketUpdateType::ADD, market_order_id, ticker_id_, side, price, shown_qty, priority};
+            matching_engine_->sendMarketUpdate(&market_update_);
+        } else {
+            /* IOC / FOK / MARKET 剩下的数量从来没有进入订单簿，只需要告诉客户端被撤掉了，不发布行情 */
+            client_response_ = {ClientResponseType::CANCELED,
+                                client_id,
+                                ticker_id_,
+                                client_order_id,
+                                market_order_id,
+                                side,
+                                price,
+                                Qty_INVALID,
+                                leaves_qty};
+            matching_engine_->sendClientResponse(&client_response_);
+        }
+    }
+}
+
+/// Park an accepted STOP / STOP_LIMIT order in the trigger index, it is canceled right away without a stop price.
+/* 停止单不进入价位，也不发布行情，触发之前别人看不到 */
+auto MEOrderBook::parkStopOrder(ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side,
+                                Price price, Qty qty, TimeInForce tif, OrderType ord_type, Price stop_price,
+                                Qty display_qty) noexcept -> void {
+    if (UNLIKELY(stop_price == Price_INVALID || (ord_type == OrderType::STOP_LIMIT && price == Price_INVALID))) {
+        client_response_ = {ClientResponseType::CANCELED, client_id, ticker_id_, client_order_id, market_order_id,
+                            side,                         price,     Qty_INVALID, qty};
+        matching_engine_->sendClientResponse(&client_response_);
+        return;
+    }
+
+    auto order = order_pool_.allocate(ticker_id_, client_id, client_order_id, market_order_id, side, price, qty,
+                                      Priority_INVALID, nullptr, nullptr);
+    order->stop_price_ = stop_price;
+    order->ord_type_ = (ord_type == OrderType::STOP ? OrderType::MARKET : OrderType::LIMIT);
+    order->tif_ = tif;
+    order->display_qty_ = display_qty;
+    linkClientOrder(order);
+    (side == Side::BUY ? buy_stops_ : sell_stops_).push(order);
+}
+
+/// Release the stop orders triggered by the trades since the last call as MARKET / LIMIT orders. Released orders can
+/// trade and trigger further stops, at most ME_MAX_STOP_TRIGGERS_PER_REQUEST are released per call.
+/* 每次只看两个堆顶，没有被触发的停止单不会被访问；
+   成交价区间在全部处理完之后重置成最新成交价，这样新挂的停止单如果已经被穿过也会马上触发 */
+auto MEOrderBook::triggerStopOrders() noexcept -> void {
+    if (UNLIKELY(phase_ == TradingPhase::AUCTION)) return;
+
+    for (size_t i = 0; i < ME_MAX_STOP_TRIGGERS_PER_REQUEST; ++i) {
+        const auto buy_triggered = buy_stops_.triggered(high_trade_price_);
+        if (LIKELY(!buy_triggered && !sell_stops_.triggered(low_trade_price_))) {
+            high_trade_price_ = low_trade_price_ = last_trade_price_;
+            return;
+        }
+
+        const auto order = (buy_triggered ? buy_stops_ : sell_stops_).top();
+        const auto client_id = order->client_id_;
+        const auto client_order_id = order->client_order_id_;
+        const auto market_order_id = order->market_order_id_;
+        const auto side = order->side_;
+        const auto price = order->price_;
+        const auto qty = order->qty_;
+        const auto tif = order->tif_;
+        const auto ord_type = order->ord_type_;
+        const auto display_qty = order->display_qty_;
+        removeStopOrder(order);
+
+        execute(client_id, client_order_id, market_order_id, side, price, qty, tif, ord_type, display_qty);
     }
 }
 
@@ -157,7 +427,7 @@ auto MEOrderBook::cancel(ClientId client_id, OrderId order_id, TickerId ticker_i
                             Price_INVALID,
                             Qty_INVALID,
                             Qty_INVALID};
-    } else {
+    } else if (UNLIKELY(exchange_order->stop_price_ != Price_INVALID)) { // parked, never published as market data.
         client_response_ = {ClientResponseType::CANCELED,
                             client_id,
                             ticker_id,
@@ -167,6 +437,18 @@ auto MEOrderBook::cancel(ClientId client_id, OrderId order_id, TickerId ticker_i
                             exchange_order->price_,
                             Qty_INVALID,
                             exchange_order->qty_};
+
+        removeStopOrder(exchange_order);
+    } else {
+        client_response_ = {ClientResponseType::CANCELED,
+                            client_id,
+                            ticker_id,
+                            order_id,
+                            exchange_order->market_order_id_,
+                            exchange_order->side_,
+                            exchange_order->price_,
+                            Qty_INVALID,
+                            exchange_order->qty_ + exchange_order->reserve_qty_};
         market_update_ = {MarketUpdateType::CANCEL, exchange_order->market_order_id_, ticker_id,
                           exchange_order->side_,    exchange_order->price_,           0,
                           exchange_order->priority_};
@@ -174,11 +456,552 @@ auto MEOrderBook::cancel(ClientId client_id, OrderId order_id, TickerId ticker_i
         removeOrder(exchange_order);
 
         matching_engine_->sendMarketUpdate(&market_update_);
+        validateTouchedLevels();
+        publishLevelUpdates();
+        publishBBOUpdate();
     }
 
     matching_engine_->sendClientResponse(&client_response_);
 }
 
+/// Atomically replace the price and quantity of an order, issue a modify-rejection if order does not exist.
+/// Reducing the quantity at the same price keeps the order's priority, otherwise the order is removed, matched against
+/// the other side at its new price like a new order and the remainder is queued behind the level.
+/* 取代 cancel + new：只有一个请求、一个 MODIFIED 回报；
+   保留优先级时发布 MODIFY，重新排队时发布同一个 market order id 的 ADD（替换原订单），完全成交则发布 CANCEL */
+auto MEOrderBook::modify(ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Qty qty) noexcept
+    -> void {
+    MEOrder* exchange_order = nullptr;
+    if (LIKELY(client_id < cid_oid_to_order_.size()))
+        exchange_order = cid_oid_to_order_.at(client_id).at(order_id);
+
+    if (UNLIKELY(!exchange_order || !qty || price == Price_INVALID ||
+                 exchange_order->stop_price_ != Price_INVALID)) {
+        client_response_ = {ClientResponseType::MODIFY_REJECTED,
+                            client_id,
+                            ticker_id,
+                            order_id,
+                            OrderId_INVALID,
+                            Side::INVALID,
+                            price,
+                            Qty_INVALID,
+                            qty};
+        matching_engine_->sendClientResponse(&client_response_);
+        return;
+    }
+
+    const auto market_order_id = exchange_order->market_order_id_;
+    const auto side = exchange_order->side_;
+    client_response_ = {
+        ClientResponseType::MODIFIED, client_id, ticker_id, order_id, market_order_id, side, price, 0, qty};
+
+    if (price == exchange_order->price_ && qty <= exchange_order->qty_ + exchange_order->reserve_qty_) {
+        /* 保留优先级；冰山单先减隐藏数量，不够再减显示的数量 */
+        const auto orders_at_price = getOrdersAtPrice(side, price);
+        const auto reserve_qty = (qty > exchange_order->qty_ ? qty - exchange_order->qty_ : 0);
+        const auto shown_qty = qty - reserve_qty;
+        touchLevel(side, price);
+        orders_at_price->reserve_qty_ -= exchange_order->reserve_qty_ - reserve_qty;
+        orders_at_price->qty_ -= exchange_order->qty_ - shown_qty;
+        exchange_order->reserve_qty_ = reserve_qty;
+        exchange_order->qty_ = shown_qty;
+
+        matching_engine_->sendClientResponse(&client_response_);
+
+        market_update_ = {
+            MarketUpdateType::MODIFY, market_order_id, ticker_id, side, price, shown_qty, exchange_order->priority_};
+        matching_engine_->sendMarketUpdate(&market_update_);
+    } else { // loses priority, same as a cancel followed by a new order but keeping the order ids.
+        const auto old_price = exchange_order->price_;
+        const auto display_qty = exchange_order->display_qty_;
+        removeOrder(exchange_order);
+
+        matching_engine_->sendClientResponse(&client_response_);
+
+        const auto leaves_qty =
+            (UNLIKELY(phase_ == TradingPhase::AUCTION)
+                 ? qty
+                 : checkForMatch(client_id, order_id, ticker_id, side, price, qty, market_order_id));
+        if (LIKELY(leaves_qty)) {
+            const auto priority = getNextPriority(side, price);
+            const auto shown_qty = std::min(leaves_qty, display_qty);
+            auto order = order_pool_.allocate(ticker_id, client_id, order_id, market_order_id, side, price, shown_qty,
+                                              priority, nullptr, nullptr);
+            order->display_qty_ = display_qty;
+            order->reserve_qty_ = leaves_qty - shown_qty;
+            addOrder(order);
+
+            market_update_ = {MarketUpdateType::ADD, market_order_id, ticker_id, side, price, shown_qty, priority};
+        } else { // fully executed at the new price, the consumers still have it at the old price.
+            market_update_ = {
+                MarketUpdateType::CANCEL, market_order_id, ticker_id, side, old_price, 0, Priority_INVALID};
+        }
+        matching_engine_->sendMarketUpdate(&market_update_);
+    }
+    triggerStopOrders();
+
+    validateTouchedLevels();
+    publishLevelUpdates();
+    publishBBOUpdate();
+}
+
+/// Cancel every order of the client on the provided side, or both sides if side is Side::INVALID, and return the number
+/// of orders canceled. No client responses are sent, the price level and top of book updates are published once at the
+/// end.
+/* 只沿着这个客户自己的订单链表走，不需要扫描 cid_oid_to_order_ */
+auto MEOrderBook::massCancel(ClientId client_id, Side side) noexcept -> size_t {
+    size_t num_canceled = 0;
+    for (auto order = client_orders_[client_id]; order;) {
+        const auto next_client_order = order->next_client_order_;
+        if (side == Side::INVALID || order->side_ == side) {
+            if (UNLIKELY(order->stop_price_ != Price_INVALID)) { // parked, never published as market data.
+                removeStopOrder(order);
+            } else {
+                market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id_, order->side_,
+                                  order->price_,            0,                       order->priority_};
+                removeOrder(order);
+                matching_engine_->sendMarketUpdateUnlogged(&market_update_);
+            }
+            ++num_canceled;
+        }
+        order = next_client_order;
+    }
+
+    if (num_canceled) {
+        validateTouchedLevels();
+        publishLevelUpdates();
+        publishBBOUpdate();
+    }
+
+    return num_canceled;
+}
+
+/// Execute every crossing order at the single price which maximizes the executed quantity and switch back to continuous
+/// matching. Publishes one TRADE for the whole uncross, returns the executed quantity and writes the uncross price to
+/// uncross_price, Price_INVALID if nothing crossed.
+/* 第一遍只看两边价位上的累计数量：从最优价位开始两边互相吃，直到买价低于卖价，得到最大成交量和最后一对成交价位；
+   第二遍按价格时间优先逐个成交订单，所有订单都按同一个价格成交 */
+auto MEOrderBook::uncross(Price* uncross_price) noexcept -> Qty {
+    phase_ = TradingPhase::CONTINUOUS;
+
+    Qty uncross_qty = 0;
+    Price last_bid_price = Price_INVALID, last_ask_price = Price_INVALID;
+    auto bid = bids_by_price_, ask = asks_by_price_;
+    auto bid_qty = (bid ? bid->qty_ + bid->reserve_qty_ : 0), ask_qty = (ask ? ask->qty_ + ask->reserve_qty_ : 0);
+    while (bid && ask && bid->price_ >= ask->price_) {
+        const auto qty = std::min(bid_qty, ask_qty);
+        uncross_qty += qty;
+        bid_qty -= qty;
+        ask_qty -= qty;
+        last_bid_price = bid->price_;
+        last_ask_price = ask->price_;
+
+        if (!bid_qty) {
+            bid = (bid->next_entry_ == bids_by_price_ ? nullptr : bid->next_entry_);
+            bid_qty = (bid ? bid->qty_ + bid->reserve_qty_ : 0);
+        }
+        if (!ask_qty) {
+            ask = (ask->next_entry_ == asks_by_price_ ? nullptr : ask->next_entry_);
+            ask_qty = (ask ? ask->qty_ + ask->reserve_qty_ : 0);
+        }
+    }
+
+    if (!uncross_qty) {
+        *uncross_price = Price_INVALID;
+        return 0;
+    }
+
+    /* 任何 [last_ask_price, last_bid_price] 之间的价格成交量都一样，剩下没成交但仍然交叉的一方决定取哪一端 */
+    const auto buy_surplus = (bid && bid->price_ >= last_ask_price);
+    const auto sell_surplus = (ask && ask->price_ <= last_bid_price);
+    const auto surplus_side = (buy_surplus == sell_surplus ? Side::INVALID : (buy_surplus ? Side::BUY : Side::SELL));
+    *uncross_price = (surplus_side == Side::BUY    ? last_bid_price
+                      : surplus_side == Side::SELL ? last_ask_price
+                                                   : (last_bid_price + last_ask_price) / 2);
+
+    market_update_ = {MarketUpdateType::TRADE, OrderId_INVALID, ticker_id_, surplus_side, *uncross_price, uncross_qty,
+                      Priority_INVALID};
+    matching_engine_->sendMarketUpdate(&market_update_);
+
+    executeUncross(Side::BUY, *uncross_price, uncross_qty);
+    executeUncross(Side::SELL, *uncross_price, uncross_qty);
+    recordTrade(*uncross_price);
+    triggerStopOrders();
+
+    validateTouchedLevels();
+    publishLevelUpdates();
+    publishBBOUpdate();
+
+    return uncross_qty;
+}
+
+/// Fill qty from the front of the provided side in price-time priority at the uncross price, every order gets one
+/// execution report and one CANCEL / MODIFY update.
+auto MEOrderBook::executeUncross(Side side, Price uncross_price, Qty qty) noexcept -> void {
+    for (auto leaves_qty = qty; leaves_qty;) {
+        const auto order = (side == Side::BUY ? bids_by_price_ : asks_by_price_)->first_me_order_;
+        const auto order_qty = order->qty_;
+        const auto fill_qty = std::min(leaves_qty, order_qty);
+
+        touchLevel(side, order->price_);
+        leaves_qty -= fill_qty;
+        order->qty_ -= fill_qty;
+        getOrdersAtPrice(side, order->price_)->qty_ -= fill_qty;
+
+        client_response_ = {ClientResponseType::FILLED,
+                            order->client_id_,
+                            ticker_id_,
+                            order->client_order_id_,
+                            order->market_order_id_,
+                            side,
+                            uncross_price,
+                            fill_qty,
+                            order->qty_ + order->reserve_qty_};
+        matching_engine_->sendClientResponse(&client_response_);
+
+        if (UNLIKELY(!order->qty_ && order->reserve_qty_)) {
+            replenishOrder(order);
+        } else if (!order->qty_) {
+            market_update_ = {MarketUpdateType::CANCEL, order->market_order_id_, ticker_id_, side, order->price_,
+                              order_qty,                Priority_INVALID};
+            matching_engine_->sendMarketUpdateUnlogged(&market_update_);
+
+            removeOrder(order);
+        } else {
+            market_update_ = {MarketUpdateType::MODIFY, order->market_order_id_, ticker_id_, side, order->price_,
+                              order->qty_,              order->priority_};
+            matching_engine_->sendMarketUpdateUnlogged(&market_update_);
+        }
+    }
+}
+
+/// Check the price levels touched by the current request if this request is sampled for validation. Walks only the
+/// touched price levels and does not allocate, calls FATAL on corruption.
+/* 取代之前析构时 toString(false, true) 遍历整个订单簿的检查，只检查这次请求改动过的价位 */
+auto MEOrderBook::validateTouchedLevels() noexcept -> void {
+    if (LIKELY(!validation_sample_) || ++num_requests_since_validation_ < validation_sample_) return;
+    num_requests_since_validation_ = 0;
+
+    if (UNLIKELY(phase_ == TradingPhase::CONTINUOUS && bids_by_price_ && asks_by_price_ &&
+                 bids_by_price_->price_ >= asks_by_price_->price_))
+        FATAL("Book crossed bid:" + bids_by_price_->toString() + " ask:" + asks_by_price_->toString());
+
+    for (size_t i = 0; i < num_touched_levels_; ++i) {
+        const auto& touched_level = touched_levels_[i];
+        const auto orders_at_price = getOrdersAtPrice(touched_level.side_, touched_level.price_);
+        if (!orders_at_price || orders_at_price->side_ != touched_level.side_) // level was removed.
+            continue;
+
+        const auto side = orders_at_price->side_;
+        const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+        const auto prev = orders_at_price->prev_entry_;
+        const auto next = orders_at_price->next_entry_;
+
+        // Links to and ordering against the neighbouring price levels, the best level is preceded by the worst one.
+        if (UNLIKELY(!best_orders_by_price || orders_at_price->price_ != touched_level.price_ ||
+                     prev->next_entry_ != orders_at_price || next->prev_entry_ != orders_at_price ||
+                     (orders_at_price != best_orders_by_price &&
+                      (side == Side::BUY ? prev->price_ <= orders_at_price->price_
+                                         : prev->price_ >= orders_at_price->price_)) ||
+                     (next != best_orders_by_price &&
+                      (side == Side::BUY ? next->price_ >= orders_at_price->price_
+                                         : next->price_ <= orders_at_price->price_))))
+            FATAL("Price level out of order:" + orders_at_price->toString());
+
+        // FIFO links and the running totals, bounded by num_orders_ so a corrupted cycle cannot loop forever.
+        Qty qty = 0, reserve_qty = 0;
+        uint32_t num_orders = 0;
+        auto order = orders_at_price->first_me_order_;
+        do {
+            if (UNLIKELY(order->next_order_->prev_order_ != order || order->side_ != side ||
+                         order->price_ != orders_at_price->price_ || !order->qty_ ||
+                         cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) != order ||
+                         (order->prev_client_order_ ? order->prev_client_order_->next_client_order_
+                                                    : client_orders_[order->client_id_]) != order ||
+                         (order->next_client_order_ && order->next_client_order_->prev_client_order_ != order)))
+                FATAL("Order queue corrupted at:" + order->toString() + " level:" + orders_at_price->toString());
+            qty += order->qty_;
+            reserve_qty += order->reserve_qty_;
+            ++num_orders;
+            order = order->next_order_;
+        } while (order != orders_at_price->first_me_order_ && num_orders <= orders_at_price->num_orders_);
+
+        if (UNLIKELY(qty != orders_at_price->qty_ || num_orders != orders_at_price->num_orders_ ||
+                     reserve_qty != orders_at_price->reserve_qty_))
+            FATAL("Running totals out of sync qty:" + qtyToString(qty) + " orders:" + std::to_string(num_orders) +
+                  " reserve:" + qtyToString(reserve_qty) + " level:" + orders_at_price->toString());
+    }
+}
+
+/// Publish one aggregated price level update for every price level touched by the current request.
+/* 在一次请求（add / cancel）全部处理完之后调用，同一个价位无论被撮合了多少笔，都只发布一条最终状态 */
+auto MEOrderBook::publishLevelUpdates() noexcept -> void {
+    for (size_t i = 0; i < num_touched_levels_; ++i) {
+        const auto& touched_level = touched_levels_[i];
+        level_touched_[sideToIndex(touched_level.side_)][priceToIndex(touched_level.price_)] = false;
+        if (!publish_levels_) // levels were only recorded for validation.
+            continue;
+
+        const auto orders_at_price = getOrdersAtPrice(touched_level.side_, touched_level.price_);
+        if (orders_at_price && orders_at_price->side_ == touched_level.side_) {
+            level_update_ = {(touched_level.existed_ ? LevelUpdateType::UPDATE : LevelUpdateType::ADD),
+                             ticker_id_,
+                             touched_level.side_,
+                             touched_level.price_,
+                             orders_at_price->qty_,
+                             orders_at_price->num_orders_};
+        } else if (touched_level.existed_) {
+            level_update_ = {
+                LevelUpdateType::DELETE, ticker_id_, touched_level.side_, touched_level.price_, 0, 0};
+        } else { // level was created and emptied by the same request, nothing changed for the consumers.
+            continue;
+        }
+
+        matching_engine_->sendLevelUpdate(&level_update_);
+    }
+
+    num_touched_levels_ = 0;
+}
+
+/// Publish the top of book if the current request changed it.
+/* 价位上维护了总量，所以这里只需要比较两边最优价位的价格和数量，O(1) */
+auto MEOrderBook::publishBBOUpdate() noexcept -> void {
+    if (!publish_bbo_) return;
+
+    const auto bid_price = (bids_by_price_ ? bids_by_price_->price_ : Price_INVALID);
+    const auto bid_qty = (bids_by_price_ ? bids_by_price_->qty_ : Qty_INVALID);
+    const auto ask_price = (asks_by_price_ ? asks_by_price_->price_ : Price_INVALID);
+    const auto ask_qty = (asks_by_price_ ? asks_by_price_->qty_ : Qty_INVALID);
+
+    if (bid_price == bbo_update_.bid_price_ && bid_qty == bbo_update_.bid_qty_ && ask_price == bbo_update_.ask_price_ &&
+        ask_qty == bbo_update_.ask_qty_)
+        return;
+
+    bbo_update_.bid_price_ = bid_price;
+    bbo_update_.bid_qty_ = bid_qty;
+    bbo_update_.ask_price_ = ask_price;
+    bbo_update_.ask_qty_ = ask_qty;
+    matching_engine_->sendBBOUpdate(&bbo_update_);
+}
+
+/// Write the full order book to the file at path.
+auto MEOrderBook::snapshotToFile(const std::string& path) const -> void {
+    std::ofstream file(path, std::ofstream::out | std::ofstream::trunc);
+    if (!file) {
+        std::string time_str;
+        logger_->log("%:% %() % Unable to open snapshot file:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str), path);
+        return;
+    }
+
+    file << toString(true, true);
+}
+
+/// Append the columnar image of the order book to a checkpoint image, see me_checkpoint.h.
+/* 先数出价位和订单的数量，把镜像扩到足够大，再把每个字段直接写进它那一列，不经过临时的 vector
+ * 订单在内存里是分散的，耗时主要在沿着链表访问订单上：订单数量从价位和停止单的计数得到，每个订单只沿链表访问两次 */
+auto MEOrderBook::appendCheckpoint(std::vector<char>* image) const -> void {
+    MEBookCheckpoint book;
+    book.ticker_id_ = ticker_id_;
+    book.next_market_order_id_ = next_market_order_id_;
+    book.phase_ = static_cast<uint8_t>(phase_);
+    book.last_trade_price_ = last_trade_price_;
+    book.high_trade_price_ = high_trade_price_;
+    book.low_trade_price_ = low_trade_price_;
+    book.bbo_update_ = bbo_update_;
+
+    auto next_level = [](const MEOrdersAtPrice* orders_at_price, const MEOrdersAtPrice* best_orders_by_price) {
+        return (orders_at_price->next_entry_ == best_orders_by_price ? nullptr : orders_at_price->next_entry_);
+    };
+    for (const auto best_orders_by_price : {bids_by_price_, asks_by_price_}) {
+        for (auto orders_at_price = best_orders_by_price; orders_at_price;
+             orders_at_price = next_level(orders_at_price, best_orders_by_price)) {
+            ++book.num_levels_;
+            book.num_orders_ += orders_at_price->num_orders_;
+        }
+    }
+    const auto num_stops = buy_stops_.size() + sell_stops_.size();
+    book.num_orders_ += num_stops;
+
+    /* resize() 把新的部分清零，列之间的对齐填充也就是 0，同样的订单簿写出同样的镜像 */
+    MEBookCheckpointColumns columns;
+    columns.book_ = &book;
+    auto book_size = checkpointAligned(sizeof(MEBookCheckpoint));
+    columns.forEachColumn([&book_size](auto& column, uint64_t num_rows) {
+        book_size += checkpointAligned(num_rows * sizeof(*column));
+    });
+    const auto offset = image->size();
+    image->resize(offset + book_size);
+    const auto book_image = image->data() + offset;
+    std::memcpy(book_image, &book, sizeof(book));
+    columns.read(book_image, book_size);
+
+    // The columns point into the image being written.
+    auto column = []<typename T>(const T* values) { return const_cast<T*>(values); };
+
+    /* 挂着的订单按价位从好到差、价位内按 FIFO 顺序，停止单不在任何价位里，单独从客户订单链表里找出来 */
+    uint64_t level_index = 0, order_index = 0;
+    auto add_order = [&columns, &column, &order_index](const MEOrder* order) {
+        column(columns.client_id_)[order_index] = order->client_id_;
+        column(columns.client_order_id_)[order_index] = order->client_order_id_;
+        column(columns.market_order_id_)[order_index] = order->market_order_id_;
+        column(columns.side_)[order_index] = order->side_;
+        column(columns.price_)[order_index] = order->price_;
+        column(columns.qty_)[order_index] = order->qty_;
+        column(columns.priority_)[order_index] = order->priority_;
+        column(columns.stop_price_)[order_index] = order->stop_price_;
+        column(columns.ord_type_)[order_index] = order->ord_type_;
+        column(columns.tif_)[order_index] = order->tif_;
+        column(columns.display_qty_)[order_index] = order->display_qty_;
+        column(columns.reserve_qty_)[order_index] = order->reserve_qty_;
+        ++order_index;
+    };
+    for (const auto best_orders_by_price : {bids_by_price_, asks_by_price_}) {
+        for (auto orders_at_price = best_orders_by_price; orders_at_price;
+             orders_at_price = next_level(orders_at_price, best_orders_by_price)) {
+            column(columns.level_side_)[level_index] = orders_at_price->side_;
+            column(columns.level_price_)[level_index] = orders_at_price->price_;
+            column(columns.level_qty_)[level_index] = orders_at_price->qty_;
+            column(columns.level_num_orders_)[level_index] = orders_at_price->num_orders_;
+            column(columns.level_reserve_qty_)[level_index] = orders_at_price->reserve_qty_;
+            ++level_index;
+
+            auto order = orders_at_price->first_me_order_;
+            do {
+                add_order(order);
+                order = order->next_order_;
+            } while (order != orders_at_price->first_me_order_);
+        }
+    }
+    for (auto client_orders = client_orders_.begin(); num_stops && client_orders != client_orders_.end();
+         ++client_orders) {
+        for (auto order = *client_orders; order; order = order->next_client_order_) {
+            if (order->stop_price_ != Price_INVALID)
+                add_order(order);
+        }
+    }
+    ASSERT(order_index == book.num_orders_, "Order book of ticker:" + tickerIdToString(ticker_id_) +
+                                                " lost track of its stop orders.");
+
+    /* 每个客户从旧到新：链表头是最新的订单，从最后一个客户开始沿链表往后，从列的末尾往前写，恢复时依次插到链表头 */
+    for (auto client_orders = client_orders_.rbegin(); client_orders != client_orders_.rend(); ++client_orders) {
+        for (auto order = *client_orders; order; order = order->next_client_order_) {
+            ASSERT(order_index, "Order book of ticker:" + tickerIdToString(ticker_id_) +
+                                    " has orders in neither a price level nor the stop orders.");
+            --order_index;
+            column(columns.client_list_client_id_)[order_index] = order->client_id_;
+            column(columns.client_list_order_id_)[order_index] = order->client_order_id_;
+        }
+    }
+    ASSERT(!order_index, "Order book of ticker:" + tickerIdToString(ticker_id_) + " has " +
+                             std::to_string(order_index) + " orders missing from the client order lists.");
+}
+
+/// Rebuild this empty order book from its image at the start of a checkpoint written by appendCheckpoint() without
+/// matching or publishing anything, see publishTopOfBook(). Returns the size of its image or 0 if it is truncated.
+/* 不经过 addOrder()：价位按从好到差的顺序直接接到价位链表尾部，订单按 FIFO 顺序直接接到所在价位的队尾 */
+auto MEOrderBook::restoreCheckpoint(const char* image, size_t size) -> size_t {
+    MEBookCheckpointColumns columns;
+    const auto image_size = columns.read(image, size);
+    if (!image_size)
+        return 0;
+
+    const auto& book = *columns.book_;
+    ASSERT(book.ticker_id_ == ticker_id_, "Checkpoint of ticker:" + tickerIdToString(book.ticker_id_) +
+                                              " restored into order book of ticker:" + tickerIdToString(ticker_id_));
+    ASSERT(!bids_by_price_ && !asks_by_price_ && buy_stops_.empty() && sell_stops_.empty(),
+           "Checkpoint restored into a non empty order book of ticker:" + tickerIdToString(ticker_id_));
+
+    auto make_order = [this, &columns](uint64_t i) {
+        auto order = order_pool_.allocate(ticker_id_, columns.client_id_[i], columns.client_order_id_[i],
+                                          columns.market_order_id_[i], columns.side_[i], columns.price_[i],
+                                          columns.qty_[i], columns.priority_[i], nullptr, nullptr);
+        order->stop_price_ = columns.stop_price_[i];
+        order->ord_type_ = columns.ord_type_[i];
+        order->tif_ = columns.tif_[i];
+        order->display_qty_ = columns.display_qty_[i];
+        order->reserve_qty_ = columns.reserve_qty_[i];
+        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+
+        return order;
+    };
+
+    uint64_t i = 0;
+    for (uint64_t level_index = 0; level_index < book.num_levels_; ++level_index) {
+        const auto side = columns.level_side_[level_index];
+        const auto price = columns.level_price_[level_index];
+        auto orders_at_price = orders_at_price_pool_.allocate(side, price, nullptr, nullptr, nullptr);
+        orders_at_price->qty_ = columns.level_qty_[level_index];
+        orders_at_price->num_orders_ = columns.level_num_orders_[level_index];
+        orders_at_price->reserve_qty_ = columns.level_reserve_qty_[level_index];
+        price_orders_at_price_[sideToIndex(side)].at(priceToIndex(price)) = orders_at_price;
+
+        auto& best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+        if (!best_orders_by_price) {
+            best_orders_by_price = orders_at_price->prev_entry_ = orders_at_price->next_entry_ = orders_at_price;
+        } else {
+            orders_at_price->prev_entry_ = best_orders_by_price->prev_entry_;
+            orders_at_price->next_entry_ = best_orders_by_price;
+            best_orders_by_price->prev_entry_->next_entry_ = orders_at_price;
+            best_orders_by_price->prev_entry_ = orders_at_price;
+        }
+
+        if (UNLIKELY(!orders_at_price->num_orders_ || i + orders_at_price->num_orders_ > book.num_orders_))
+            FATAL("Checkpoint of ticker:" + tickerIdToString(ticker_id_) +
+                  " has an invalid level:" + orders_at_price->toString());
+        for (const auto end = i + orders_at_price->num_orders_; i < end; ++i) {
+            if (UNLIKELY(columns.side_[i] != side || columns.price_[i] != price))
+                FATAL("Checkpoint of ticker:" + tickerIdToString(ticker_id_) + " has order:" +
+                      orderIdToString(columns.market_order_id_[i]) + " in the wrong level:" +
+                      orders_at_price->toString());
+            auto order = make_order(i);
+            auto first_order = orders_at_price->first_me_order_;
+            if (!first_order) {
+                orders_at_price->first_me_order_ = order->prev_order_ = order->next_order_ = order;
+            } else {
+                order->prev_order_ = first_order->prev_order_;
+                order->next_order_ = first_order;
+                first_order->prev_order_->next_order_ = order;
+                first_order->prev_order_ = order;
+            }
+        }
+    }
+
+    for (; i < book.num_orders_; ++i) {
+        auto order = make_order(i);
+        if (UNLIKELY(order->stop_price_ == Price_INVALID))
+            FATAL("Checkpoint of ticker:" + tickerIdToString(ticker_id_) +
+                  " has an order in no price level:" + order->toString());
+        (order->side_ == Side::BUY ? buy_stops_ : sell_stops_).push(order);
+    }
+
+    for (i = 0; i < book.num_orders_; ++i) {
+        const auto client_id = columns.client_list_client_id_[i];
+        const auto client_order_id = columns.client_list_order_id_[i];
+        auto order = cid_oid_to_order_.at(client_id).at(client_order_id);
+        if (UNLIKELY(!order))
+            FATAL("Checkpoint of ticker:" + tickerIdToString(ticker_id_) + " lists unknown order client:" +
+                  clientIdToString(client_id) + " oid:" + orderIdToString(client_order_id));
+        linkClientOrder(order);
+    }
+
+    next_market_order_id_ = book.next_market_order_id_;
+    phase_ = static_cast<TradingPhase>(book.phase_);
+    last_trade_price_ = book.last_trade_price_;
+    high_trade_price_ = book.high_trade_price_;
+    low_trade_price_ = book.low_trade_price_;
+    bbo_update_ = book.bbo_update_;
+
+    return image_size;
+}
+
+/// Publish the top of book after the order book was recovered, its orders and price levels reach the market data
+/// consumers through the snapshot synthesizer seeded from the checkpoint image.
+auto MEOrderBook::publishTopOfBook() noexcept -> void {
+    if (publish_bbo_)
+        matching_engine_->sendBBOUpdate(&bbo_update_);
+}
+
 auto MEOrderBook::toString(bool detailed, bool validity_check) const -> std::string {
     std::stringstream ss;
     std::string time_str;
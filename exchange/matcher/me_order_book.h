@@ -8,13 +8,18 @@
  * 为了时间复杂度为 O(1) 也有 3 个哈希表帮助定位 ME_ORDER 的位置
  */
 
+#include <vector>
+
 #include "common/types.h"
 #include "common/mem_pool.h"
 #include "common/logging.h"
+#include "order_server/client_request.h"
 #include "order_server/client_response.h"
 #include "market_data/market_update.h"
 
 #include "me_order.h"
+#include "me_trigger_index.h"
+#include "me_checkpoint.h"
 
 using namespace Common;
 
@@ -22,6 +27,44 @@ namespace Exchange
 {
 class MatchingEngine;
 
+/// What happens when an aggressive order would trade against a resting order of the same client.
+/// CANCEL_NEWEST cancels the rest of the aggressive order, CANCEL_OLDEST cancels the resting order and keeps matching,
+/// DECREMENT_BOTH reduces both by the smaller quantity without a trade and cancels whichever reaches 0.
+enum class SelfTradePrevention : uint8_t { NONE = 0, CANCEL_NEWEST = 1, CANCEL_OLDEST = 2, DECREMENT_BOTH = 3 };
+
+inline std::string selfTradePreventionToString(SelfTradePrevention stp) {
+    switch (stp) {
+    case SelfTradePrevention::NONE:
+        return "NONE";
+    case SelfTradePrevention::CANCEL_NEWEST:
+        return "CANCEL_NEWEST";
+    case SelfTradePrevention::CANCEL_OLDEST:
+        return "CANCEL_OLDEST";
+    case SelfTradePrevention::DECREMENT_BOTH:
+        return "DECREMENT_BOTH";
+    }
+    return "UNKNOWN";
+}
+
+/// Trading phase of a single ticker. During an AUCTION orders accumulate in the order book without matching, the book
+/// may be crossed until the uncross executes everything that crosses at a single price and the ticker is CONTINUOUS
+/// again.
+enum class TradingPhase : uint8_t { CONTINUOUS = 0, AUCTION = 1 };
+
+inline std::string tradingPhaseToString(TradingPhase phase) {
+    switch (phase) {
+    case TradingPhase::CONTINUOUS:
+        return "CONTINUOUS";
+    case TradingPhase::AUCTION:
+        return "AUCTION";
+    }
+    return "UNKNOWN";
+}
+
+/// Maximum number of triggered stop orders released by a single request, stops triggered beyond it by a cascade are
+/// released by the following requests.
+constexpr size_t ME_MAX_STOP_TRIGGERS_PER_REQUEST = 64;
+
 class MEOrderBook final {
 public:
     explicit MEOrderBook(TickerId ticker_id, Logger* logger, MatchingEngine* matching_engine);
@@ -30,13 +73,78 @@ public:
 
     /// Create and add a new order in the order book with provided attributes.
     /// It will check to see if this new order matches an existing passive order with opposite side, and perform the
-    /// matching if that is the case.
-    auto add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Qty qty) noexcept
-        -> void;
+    /// matching if that is the case. Depending on tif the unfilled remainder rests in the order book (DAY) or is
+    /// canceled (IOC), a FOK order which cannot be filled completely is canceled before matching anything.
+    /// MARKET orders match without a price check and never rest, STOP / STOP_LIMIT orders are parked in the trigger
+    /// index until a trade reaches stop_price. Stop orders triggered by the request are released before it returns.
+    /// An order resting with display_qty below its quantity is an iceberg order, only display_qty of it is shown at a
+    /// time and the rest is kept in reserve.
+    auto add(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Qty qty,
+             TimeInForce tif, OrderType ord_type, Price stop_price, Qty display_qty) noexcept -> void;
 
     /// Attempt to cancel an order in the order book, issue a cancel-rejection if order does not exist.
     auto cancel(ClientId client_id, OrderId order_id, TickerId ticker_id) noexcept -> void;
 
+    /// Atomically replace the price and quantity of an order, issue a modify-rejection if order does not exist.
+    /// Reducing the quantity at the same price keeps the order's priority, otherwise the order is removed, matched
+    /// against the other side at its new price like a new order and the remainder is queued behind the level.
+    /// The quantity of an iceberg order is its total quantity, reductions come out of the reserve first.
+    /// Parked stop orders cannot be modified.
+    auto modify(ClientId client_id, OrderId order_id, TickerId ticker_id, Price price, Qty qty) noexcept -> void;
+
+    /// Cancel every order of the client on the provided side, or both sides if side is Side::INVALID, and return the
+    /// number of orders canceled. No client responses are sent, the price level and top of book updates are published
+    /// once at the end.
+    auto massCancel(ClientId client_id, Side side) noexcept -> size_t;
+
+    /// Stop matching and let orders accumulate until uncross() is called. DAY orders rest without matching, IOC and FOK
+    /// orders are canceled right away since nothing can execute immediately.
+    auto startAuction() noexcept {
+        phase_ = TradingPhase::AUCTION;
+    }
+
+    /// Execute every crossing order at the single price which maximizes the executed quantity and switch back to
+    /// continuous matching. Publishes one TRADE for the whole uncross, returns the executed quantity and writes the
+    /// uncross price to uncross_price, Price_INVALID if nothing crossed.
+    auto uncross(Price* uncross_price) noexcept -> Qty;
+
+    auto getTradingPhase() const noexcept {
+        return phase_;
+    }
+
+    /// Check the invariants of the price levels touched by every sample_every-th request, 0 disables the checks.
+    auto setValidation(size_t sample_every) noexcept {
+        validation_sample_ = sample_every;
+        num_requests_since_validation_ = 0;
+    }
+
+    /// Send the aggressive order a single execution report and publish a single TRADE per price level it sweeps instead
+    /// of one per passive order it matches, the passive orders still get their own execution reports.
+    auto setAggregateFills(bool aggregate_fills) noexcept {
+        aggregate_fills_ = aggregate_fills;
+    }
+
+    /// Prevent aggressive orders from trading against resting orders of the same client, see SelfTradePrevention.
+    auto setSelfTradePrevention(SelfTradePrevention stp) noexcept {
+        stp_ = stp;
+    }
+
+    /// Write the full order book to the file at path.
+    auto snapshotToFile(const std::string& path) const -> void;
+
+    /// Append the columnar image of the order book to a checkpoint image, see me_checkpoint.h. The image only
+    /// allocates when the order book outgrew its capacity, it is reused for every checkpoint.
+    auto appendCheckpoint(std::vector<char>* image) const -> void;
+
+    /// Rebuild this empty order book from its image at the start of a checkpoint written by appendCheckpoint(), returns
+    /// the size of its image or 0 if it is truncated. Nothing is published, see publishTopOfBook().
+    auto restoreCheckpoint(const char* image, size_t size) -> size_t;
+
+    /// Publish the top of book after the order book was recovered, its orders and price levels reach the market data
+    /// consumers through the snapshot synthesizer seeded from the checkpoint image, see
+    /// MarketDataPublisher::seedFromCheckpoint().
+    auto publishTopOfBook() noexcept -> void;
+
     auto toString(bool detailed, bool validity_check) const -> std::string;
 
     /// Deleted default, copy & move constructors and assignment-operators.
@@ -59,6 +167,19 @@ private:
     /// Hash map from ClientId -> OrderId -> MEOrder.
     ClientOrderHashMap cid_oid_to_order_;
 
+    /// Hash map from ClientId -> most recently added order of the client, the head of its list of orders.
+    std::array<MEOrder*, ME_MAX_NUM_CLIENTS> client_orders_{};
+
+    /// Parked stop orders of each side, ordered by the sequence they are triggered in.
+    METriggerIndex buy_stops_{Side::BUY};
+    METriggerIndex sell_stops_{Side::SELL};
+
+    /// Price of the last trade and the range of trade prices since the stop orders were last checked, Price_INVALID if
+    /// nothing traded yet.
+    Price last_trade_price_ = Price_INVALID;
+    Price high_trade_price_ = Price_INVALID;
+    Price low_trade_price_ = Price_INVALID;
+
     /// Memory pool to manage MEOrdersAtPrice objects.
     MemPool<MEOrdersAtPrice> orders_at_price_pool_;
 
@@ -66,8 +187,9 @@ private:
     MEOrdersAtPrice* bids_by_price_ = nullptr;
     MEOrdersAtPrice* asks_by_price_ = nullptr;
 
-    /// Hash map from Price -> MEOrdersAtPrice.
-    OrdersAtPriceHashMap price_orders_at_price_;
+    /// Hash map from Side -> Price -> MEOrdersAtPrice. The sides are kept apart because during an auction both sides
+    /// can have a price level at the same price.
+    std::array<OrdersAtPriceHashMap, sideToIndex(Side::MAX) + 1> price_orders_at_price_{};
 
     /// Memory pool to manage MEOrder objects.
     MemPool<MEOrder> order_pool_;
@@ -76,6 +198,42 @@ private:
     /// it should be the struct to be sent???
     MEClientResponse client_response_;
     MEMarketUpdate market_update_;
+    MELevelUpdate level_update_;
+
+    /// True if the matching engine publishes the aggregated price level feed.
+    bool publish_levels_ = false;
+
+    /// True if aggressive fills and trades are reported once per price level, see setAggregateFills().
+    bool aggregate_fills_ = false;
+
+    /// Self trade prevention mode, see setSelfTradePrevention().
+    SelfTradePrevention stp_ = SelfTradePrevention::NONE;
+
+    /// Current trading phase, see startAuction() and uncross().
+    TradingPhase phase_ = TradingPhase::CONTINUOUS;
+
+    /// True if the matching engine publishes top of book updates, and the last top of book published for this ticker.
+    bool publish_bbo_ = false;
+    MEBBOUpdate bbo_update_;
+
+    /// A price level touched while processing the current request, existed_ records if the level was in the book
+    /// before the request so the right type of level update can be published.
+    struct TouchedLevel {
+        Side side_ = Side::INVALID;
+        Price price_ = Price_INVALID;
+        bool existed_ = false;
+    };
+
+    /* 一次撮合事件可能改动两边的价位，所以按 side 区分 */
+    /// Price levels touched by the current request in the order they were touched, and Side -> Price -> touched flag
+    /// used to record each level only once per request.
+    std::array<TouchedLevel, ME_MAX_PRICE_LEVELS * 2> touched_levels_;
+    size_t num_touched_levels_ = 0;
+    std::array<std::array<bool, ME_MAX_PRICE_LEVELS>, sideToIndex(Side::MAX) + 1> level_touched_{};
+
+    /// Requests are validated once every validation_sample_ requests, 0 if validation is disabled.
+    size_t validation_sample_ = 0;
+    size_t num_requests_since_validation_ = 0;
 
     OrderId next_market_order_id_ = 1;
 
@@ -87,19 +245,31 @@ private:
         return next_market_order_id_++;
     }
 
+    /// Price a MARKET order is matched at, crosses every price level on the other side.
+    static constexpr auto marketOrderPrice(Side side) noexcept {
+        return (side == Side::BUY ? std::numeric_limits<Price>::max() : std::numeric_limits<Price>::min());
+    }
+
+    auto recordTrade(Price price) noexcept {
+        last_trade_price_ = price;
+        high_trade_price_ = (high_trade_price_ == Price_INVALID ? price : std::max(high_trade_price_, price));
+        low_trade_price_ = (low_trade_price_ == Price_INVALID ? price : std::min(low_trade_price_, price));
+    }
+
     auto priceToIndex(Price price) const noexcept {
         return (price % ME_MAX_PRICE_LEVELS);
     }
 
-    /// Fetch and return the MEOrdersAtPrice corresponding to the provided price.
-    auto getOrdersAtPrice(Price price) const noexcept -> MEOrdersAtPrice* {
-        return price_orders_at_price_.at(priceToIndex(price));
+    /// Fetch and return the MEOrdersAtPrice corresponding to the provided side and price.
+    auto getOrdersAtPrice(Side side, Price price) const noexcept -> MEOrdersAtPrice* {
+        return price_orders_at_price_[sideToIndex(side)].at(priceToIndex(price));
     }
 
     /// Add a new MEOrdersAtPrice at the correct price into the containers - the hash map and the doubly linked list of price levels.
     auto addOrdersAtPrice(MEOrdersAtPrice* new_orders_at_price) noexcept {
         /* write on map first */
-        price_orders_at_price_.at(priceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
+        price_orders_at_price_[sideToIndex(new_orders_at_price->side_)].at(priceToIndex(new_orders_at_price->price_)) =
+            new_orders_at_price;
 
         /* the first node */
         const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
@@ -155,7 +325,7 @@ private:
     /// Remove the MEOrdersAtPrice from the containers - the hash map and the doubly linked list of price levels.
     auto removeOrdersAtPrice(Side side, Price price) noexcept {
         const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
-        auto orders_at_price = getOrdersAtPrice(price);
+        auto orders_at_price = getOrdersAtPrice(side, price);
 
         if (UNLIKELY(orders_at_price->next_entry_ == orders_at_price)) { // empty side of book.
             (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
@@ -170,14 +340,35 @@ private:
             orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
         }
 
-        price_orders_at_price_.at(priceToIndex(price)) = nullptr;
+        price_orders_at_price_[sideToIndex(side)].at(priceToIndex(price)) = nullptr;
 
         orders_at_price_pool_.deallocate(orders_at_price);
     }
 
+    /// Record that the price level at the provided side and price is about to be modified by the current request.
+    auto touchLevel(Side side, Price price) noexcept {
+        if (!publish_levels_ && !validation_sample_) return;
+
+        auto& touched = level_touched_[sideToIndex(side)][priceToIndex(price)];
+        if (touched) return;
+        touched = true;
+
+        touched_levels_[num_touched_levels_++] = {side, price, (getOrdersAtPrice(side, price) != nullptr)};
+    }
+
+    /// Check the price levels touched by the current request if this request is sampled for validation. Walks only the
+    /// touched price levels and does not allocate, calls FATAL on corruption.
+    auto validateTouchedLevels() noexcept -> void;
+
+    /// Publish one aggregated price level update for every price level touched by the current request.
+    auto publishLevelUpdates() noexcept -> void;
+
+    /// Publish the top of book if the current request changed it.
+    auto publishBBOUpdate() noexcept -> void;
+
     /* This is for MEOrder */
-    auto getNextPriority(Price price) noexcept {
-        const auto orders_at_price = getOrdersAtPrice(price);
+    auto getNextPriority(Side side, Price price) noexcept {
+        const auto orders_at_price = getOrdersAtPrice(side, price);
         if (!orders_at_price) return 1lu;
 
         /* 'orders_at_price->first_me_order_->prev_order_' is to find the last node */
@@ -197,9 +388,102 @@ private:
     auto checkForMatch(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price, Qty qty,
                        Qty new_market_order_id) noexcept;
 
+    /// True if a new order with the provided attributes can be filled completely right away. Only reads the running
+    /// totals of the price levels on the other side which it would trade against, nothing is modified.
+    /// With self trade prevention the client's own resting orders are not available, so the crossing orders are
+    /// walked one by one in priority order instead. Only CANCEL_OLDEST gets past them, the other modes cancel or
+    /// decrement the aggressive order there without a trade.
+    auto canFillNow(ClientId client_id, Side side, Price price, Qty qty) const noexcept {
+        const auto best_orders_by_price = (side == Side::BUY ? asks_by_price_ : bids_by_price_);
+        Qty available_qty = 0;
+        for (auto orders_at_price = best_orders_by_price; orders_at_price && available_qty < qty;) {
+            if (side == Side::BUY ? orders_at_price->price_ > price : orders_at_price->price_ < price)
+                break;
+            if (LIKELY(stp_ == SelfTradePrevention::NONE)) {
+                available_qty += orders_at_price->qty_ + orders_at_price->reserve_qty_;
+            } else {
+                /* 冰山单的隐藏数量补充到队尾，排在同一客户的订单后面，所以只有整个价位都能成交时才算进去 */
+                Qty reserve_qty = 0;
+                auto order = orders_at_price->first_me_order_;
+                do {
+                    if (order->client_id_ != client_id) {
+                        available_qty += order->qty_;
+                        reserve_qty += order->reserve_qty_;
+                    } else if (stp_ != SelfTradePrevention::CANCEL_OLDEST) { // cannot be filled past this order.
+                        return available_qty >= qty;
+                    }
+                    order = order->next_order_;
+                } while (order != orders_at_price->first_me_order_ && available_qty < qty);
+                available_qty += reserve_qty;
+            }
+            orders_at_price = (orders_at_price->next_entry_ == best_orders_by_price ? nullptr
+                                                                                    : orders_at_price->next_entry_);
+        }
+
+        return available_qty >= qty;
+    }
+
+    /// The aggressive order with the provided attributes reached a resting order of the same client at the front of
+    /// the other side, apply the self trade prevention mode instead of matching them.
+    auto preventSelfTrade(ClientId client_id, OrderId client_order_id, TickerId ticker_id, Side side, Price price,
+                          OrderId new_market_order_id, MEOrder* resting_order, Qty* leaves_qty) noexcept -> void;
+
+    /// Cancel a resting order from within the matching loop, sends the CANCELED response and the CANCEL update.
+    auto cancelRestingOrder(MEOrder* order) noexcept -> void;
+
+    /// Match an accepted order against the other side and rest or cancel the remainder depending on tif and ord_type.
+    /// The caller publishes the price level and top of book updates.
+    auto execute(ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price, Qty qty,
+                 TimeInForce tif, OrderType ord_type, Qty display_qty) noexcept -> void;
+
+    /// Park an accepted STOP / STOP_LIMIT order in the trigger index, it is canceled right away without a stop price.
+    auto parkStopOrder(ClientId client_id, OrderId client_order_id, OrderId market_order_id, Side side, Price price,
+                       Qty qty, TimeInForce tif, OrderType ord_type, Price stop_price, Qty display_qty) noexcept
+        -> void;
+
+    /// Release the stop orders triggered by the trades since the last call as MARKET / LIMIT orders. Released orders
+    /// can trade and trigger further stops, at most ME_MAX_STOP_TRIGGERS_PER_REQUEST are released per call.
+    auto triggerStopOrders() noexcept -> void;
+
+    /// Add the order to the ClientId -> OrderId hash map and at the head of its client's list of orders.
+    auto linkClientOrder(MEOrder* order) noexcept -> void {
+        auto& client_orders = client_orders_[order->client_id_];
+        order->prev_client_order_ = nullptr;
+        order->next_client_order_ = client_orders;
+        if (client_orders)
+            client_orders->prev_client_order_ = order;
+        client_orders = order;
+
+        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+    }
+
+    /// Remove the order from the ClientId -> OrderId hash map and its client's list of orders.
+    auto unlinkClientOrder(MEOrder* order) noexcept -> void {
+        if (order->prev_client_order_)
+            order->prev_client_order_->next_client_order_ = order->next_client_order_;
+        else
+            client_orders_[order->client_id_] = order->next_client_order_;
+        if (order->next_client_order_)
+            order->next_client_order_->prev_client_order_ = order->prev_client_order_;
+
+        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = nullptr;
+    }
+
+    /// Remove and de-allocate a parked stop order.
+    auto removeStopOrder(MEOrder* order) noexcept {
+        (order->side_ == Side::BUY ? buy_stops_ : sell_stops_).remove(order);
+        unlinkClientOrder(order);
+        order_pool_.deallocate(order);
+    }
+
+    /// Fill qty from the front of the provided side in price-time priority at the uncross price, every order gets
+    /// one execution report and one CANCEL / MODIFY update.
+    auto executeUncross(Side side, Price uncross_price, Qty qty) noexcept -> void;
+
     /// Remove and de-allocate provided order from the containers.
     auto removeOrder(MEOrder* order) noexcept {
-        auto orders_at_price = getOrdersAtPrice(order->price_);
+        auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
+        touchLevel(order->side_, order->price_);
 
         if (order->prev_order_ == order) { // only one element.
             removeOrdersAtPrice(order->side_, order->price_);
@@ -212,23 +496,30 @@ private:
             if (orders_at_price->first_me_order_ == order) {
                 orders_at_price->first_me_order_ = order_after;
             }
+            orders_at_price->qty_ -= order->qty_;
+            orders_at_price->reserve_qty_ -= order->reserve_qty_;
+            --orders_at_price->num_orders_;
 
             order->prev_order_ = order->next_order_ = nullptr;
         }
 
-        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = nullptr;
+        unlinkClientOrder(order);
         order_pool_.deallocate(order);
     }
 
     /// Add a single order at the end of the FIFO queue at the price level that this order belongs in.
     auto addOrder(MEOrder* order) noexcept {
-        const auto orders_at_price = getOrdersAtPrice(order->price_);
+        const auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
+        touchLevel(order->side_, order->price_);
 
         if (!orders_at_price) {
             order->next_order_ = order->prev_order_ = order;
 
             auto new_orders_at_price =
                 orders_at_price_pool_.allocate(order->side_, order->price_, order, nullptr, nullptr);
+            new_orders_at_price->qty_ = order->qty_;
+            new_orders_at_price->num_orders_ = 1;
+            new_orders_at_price->reserve_qty_ = order->reserve_qty_;
             addOrdersAtPrice(new_orders_at_price);
         } else {
             auto first_order = (orders_at_price ? orders_at_price->first_me_order_ : nullptr);
@@ -237,10 +528,18 @@ private:
             order->prev_order_ = first_order->prev_order_;
             order->next_order_ = first_order;
             first_order->prev_order_ = order;
+
+            orders_at_price->qty_ += order->qty_;
+            ++orders_at_price->num_orders_;
+            orders_at_price->reserve_qty_ += order->reserve_qty_;
         }
 
-        cid_oid_to_order_.at(order->client_id_).at(order->client_order_id_) = order;
+        linkClientOrder(order);
     }
+
+    /// Refill an iceberg order whose shown quantity was just exhausted from its reserve, at the back of the FIFO queue
+    /// of its price level with a new priority. Publishes an ADD which replaces the order for the market data consumers.
+    auto replenishOrder(MEOrder* order) noexcept -> void;
 };
 
 /// A hash map from TickerId -> MEOrderBook.
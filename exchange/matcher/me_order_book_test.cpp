@@ -0,0 +1,625 @@
+#include <vector>
+
+#include "common/test_utils.h"
+
+#include "matcher/matching_engine.h"
+
+/**
+ * MEOrderBook 的行为测试：逐个请求检查回报和逐笔行情
+ * 订单簿通过 MatchingEngine 的队列发送回报和行情，每个请求之后全部取出来
+ * 创建和释放订单簿要初始化 / 清空按 ME_MAX_ORDER_IDS 分配的哈希表，比所有用例加起来还慢，所以所有用例共用一个订单簿，
+ * 每个用例开始时撤掉所有客户的订单；最新成交价会留到下一个用例，停止单的用例自己先在 100 成交一笔
+ */
+
+namespace
+{
+using namespace Exchange;
+
+constexpr ClientId CLIENT_1 = 1, CLIENT_2 = 2, CLIENT_3 = 3;
+
+/// Sends requests to the order book shared by the test cases and keeps the client responses and market updates of the
+/// last request for the checks.
+class BookFixture final {
+public:
+    BookFixture()
+        : client_requests_(ME_MAX_CLIENT_UPDATES), client_responses_(ME_MAX_CLIENT_UPDATES),
+          market_updates_(ME_MAX_MARKET_UPDATES), logger_("me_order_book_test.log") {
+        matching_engine_ =
+            new MatchingEngine(&client_requests_, &client_responses_, &market_updates_, nullptr, nullptr);
+        book_ = new MEOrderBook(0, &logger_, matching_engine_);
+        book_->setValidation(1);
+    }
+
+    /// Start a test case with an empty order book in the continuous phase.
+    auto reset(SelfTradePrevention stp = SelfTradePrevention::NONE) {
+        for (auto client_id : {CLIENT_1, CLIENT_2, CLIENT_3})
+            book_->massCancel(client_id, Side::INVALID);
+        if (book_->getTradingPhase() == TradingPhase::AUCTION) {
+            Price uncross_price;
+            book_->uncross(&uncross_price);
+        }
+        book_->setSelfTradePrevention(stp);
+        drain();
+    }
+
+    auto add(ClientId client_id, OrderId order_id, Side side, Price price, Qty qty,
+             TimeInForce tif = TimeInForce::DAY) {
+        book_->add(client_id, order_id, 0, side, price, qty, tif, OrderType::LIMIT, Price_INVALID, Qty_INVALID);
+        drain();
+    }
+
+    auto addIceberg(ClientId client_id, OrderId order_id, Side side, Price price, Qty qty, Qty display_qty) {
+        book_->add(client_id, order_id, 0, side, price, qty, TimeInForce::DAY, OrderType::LIMIT, Price_INVALID,
+                   display_qty);
+        drain();
+    }
+
+    auto addStop(ClientId client_id, OrderId order_id, Side side, Price price, Qty qty, OrderType ord_type,
+                 Price stop_price) {
+        book_->add(client_id, order_id, 0, side, price, qty, TimeInForce::DAY, ord_type, stop_price, Qty_INVALID);
+        drain();
+    }
+
+    auto cancel(ClientId client_id, OrderId order_id) {
+        book_->cancel(client_id, order_id, 0);
+        drain();
+    }
+
+    auto modify(ClientId client_id, OrderId order_id, Price price, Qty qty) {
+        book_->modify(client_id, order_id, 0, price, qty);
+        drain();
+    }
+
+    auto startAuction() {
+        book_->startAuction();
+        drain();
+    }
+
+    /// Send a client request through the matching engine instead of straight to the order book.
+    auto process(const MEClientRequest& client_request) {
+        matching_engine_->processClientRequest(&client_request);
+        drain();
+    }
+
+    /// Returns the uncross price and quantity.
+    auto uncross() {
+        auto uncross_price = Price_INVALID;
+        const auto uncross_qty = book_->uncross(&uncross_price);
+        drain();
+        return std::make_pair(uncross_price, uncross_qty);
+    }
+
+    /// The responses of the last request sent to client_id.
+    auto responses(ClientId client_id) const {
+        std::vector<MEClientResponse> client_responses;
+        for (const auto& response : responses_) {
+            if (response.client_id_ == client_id)
+                client_responses.push_back(response);
+        }
+        return client_responses;
+    }
+
+    /// The responses of the last request of the type sent to client_id.
+    auto responses(ClientId client_id, ClientResponseType type) const {
+        std::vector<MEClientResponse> client_responses;
+        for (const auto& response : responses(client_id)) {
+            if (response.type_ == type)
+                client_responses.push_back(response);
+        }
+        return client_responses;
+    }
+
+    /// Quantity filled for client_id by the last request.
+    auto filledQty(ClientId client_id) const {
+        Qty qty = 0;
+        for (const auto& response : responses(client_id, ClientResponseType::FILLED))
+            qty += response.exec_qty_;
+        return qty;
+    }
+
+    /// The market updates of the last request.
+    auto updates() const {
+        return updates_;
+    }
+
+    /// The market updates of the last request of the type.
+    auto updates(MarketUpdateType type) const {
+        std::vector<MEMarketUpdate> type_updates;
+        for (const auto& update : updates_) {
+            if (update.type_ == type)
+                type_updates.push_back(update);
+        }
+        return type_updates;
+    }
+
+private:
+    auto drain() -> void {
+        responses_.clear();
+        updates_.clear();
+        for (auto response = client_responses_.getNextToRead(); response;
+             response = client_responses_.getNextToRead()) {
+            responses_.push_back(*response);
+            client_responses_.updateReadIndex();
+        }
+        for (auto update = market_updates_.getNextToRead(); update; update = market_updates_.getNextToRead()) {
+            updates_.push_back(*update);
+            market_updates_.updateReadIndex();
+        }
+    }
+
+    ClientRequestLFQueue client_requests_;
+    ClientResponseLFQueue client_responses_;
+    MEMarketUpdateLFQueue market_updates_;
+    Logger logger_;
+    MatchingEngine* matching_engine_ = nullptr;
+    MEOrderBook* book_ = nullptr;
+
+    std::vector<MEClientResponse> responses_;
+    std::vector<MEMarketUpdate> updates_;
+};
+
+auto testModifyReduceKeepsPriority(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 100, 100);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+
+    f.modify(CLIENT_1, 0, 100, 60);
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::MODIFIED).size(), 1u);
+    const auto modifies = f.updates(MarketUpdateType::MODIFY);
+    CHECK(modifies.size() == 1 && modifies[0].qty_ == 60 && modifies[0].priority_ == 1);
+
+    f.add(CLIENT_3, 0, Side::BUY, 100, 60);
+    CHECK_EQ(f.filledQty(CLIENT_1), 60);
+    CHECK_EQ(f.filledQty(CLIENT_2), 0);
+}
+
+auto testModifyIncreaseLosesPriority(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 100, 100);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+
+    f.modify(CLIENT_1, 0, 100, 150);
+    const auto adds = f.updates(MarketUpdateType::ADD);
+    CHECK(adds.size() == 1 && adds[0].qty_ == 150 && adds[0].priority_ == 3);
+
+    f.add(CLIENT_3, 0, Side::BUY, 100, 100);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    CHECK_EQ(f.filledQty(CLIENT_2), 100);
+}
+
+auto testModifyPriceLosesPriority(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 101, 100);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+
+    // Same quantity at a new price queues behind the level.
+    f.modify(CLIENT_1, 0, 100, 100);
+    f.add(CLIENT_3, 0, Side::BUY, 100, 100);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    CHECK_EQ(f.filledQty(CLIENT_2), 100);
+}
+
+auto testModifyMatchesAtNewPrice(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::BUY, 99, 50);
+    f.add(CLIENT_2, 0, Side::SELL, 101, 30);
+
+    // Partially fills at the new price, the rest rests there with the same market order id.
+    f.modify(CLIENT_1, 0, 101, 50);
+    CHECK_EQ(f.filledQty(CLIENT_1), 30);
+    CHECK_EQ(f.filledQty(CLIENT_2), 30);
+    const auto adds = f.updates(MarketUpdateType::ADD);
+    CHECK(adds.size() == 1 && adds[0].price_ == 101 && adds[0].qty_ == 20);
+
+    // Fully filled at the new price, the CANCEL removes it at the price the consumers last saw.
+    f.add(CLIENT_2, 1, Side::SELL, 102, 20);
+    f.modify(CLIENT_1, 0, 102, 20);
+    CHECK_EQ(f.filledQty(CLIENT_1), 20);
+    const auto cancels = f.updates(MarketUpdateType::CANCEL);
+    CHECK(cancels.size() == 2 && cancels.back().price_ == 101);
+}
+
+auto testModifyRejected(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::BUY, 99, 50);
+
+    f.modify(CLIENT_1, 1, 99, 10); // unknown order.
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::MODIFY_REJECTED).size(), 1u);
+    f.modify(CLIENT_2, 0, 99, 10); // order of another client.
+    CHECK_EQ(f.responses(CLIENT_2, ClientResponseType::MODIFY_REJECTED).size(), 1u);
+    f.modify(CLIENT_1, 0, 99, 0);
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::MODIFY_REJECTED).size(), 1u);
+    CHECK(f.updates(MarketUpdateType::MODIFY).empty());
+}
+
+auto testFokFillsAcrossLevels(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+    f.add(CLIENT_2, 0, Side::SELL, 101, 30);
+    f.add(CLIENT_2, 1, Side::SELL, 102, 30);
+
+    f.add(CLIENT_3, 0, Side::BUY, 101, 60, TimeInForce::FOK);
+    CHECK_EQ(f.filledQty(CLIENT_3), 60);
+    CHECK(f.responses(CLIENT_3, ClientResponseType::CANCELED).empty());
+    CHECK(f.updates(MarketUpdateType::ADD).empty());
+}
+
+auto testFokAllOrNone(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+    f.add(CLIENT_2, 0, Side::SELL, 101, 30);
+    f.add(CLIENT_2, 1, Side::SELL, 102, 30);
+
+    // 61 is available up to 101 only with the level at 102, which is beyond the limit.
+    f.add(CLIENT_3, 0, Side::BUY, 101, 61, TimeInForce::FOK);
+    const auto canceled = f.responses(CLIENT_3, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].leaves_qty_ == 61);
+    CHECK_EQ(f.filledQty(CLIENT_3), 0);
+    CHECK(f.updates(MarketUpdateType::TRADE).empty() && f.updates(MarketUpdateType::MODIFY).empty());
+
+    // Nothing was touched, the whole 90 is still there.
+    f.add(CLIENT_3, 1, Side::BUY, 102, 90, TimeInForce::FOK);
+    CHECK_EQ(f.filledQty(CLIENT_3), 90);
+}
+
+auto testIocCancelsRemainder(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+
+    f.add(CLIENT_3, 0, Side::BUY, 100, 50, TimeInForce::IOC);
+    CHECK_EQ(f.filledQty(CLIENT_3), 30);
+    const auto canceled = f.responses(CLIENT_3, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].leaves_qty_ == 20);
+    CHECK(f.updates(MarketUpdateType::ADD).empty());
+}
+
+auto testStpCancelNewest(BookFixture& f) {
+    f.reset(SelfTradePrevention::CANCEL_NEWEST);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 20);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+
+    f.add(CLIENT_1, 1, Side::BUY, 100, 50);
+    CHECK_EQ(f.filledQty(CLIENT_2), 20);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].client_order_id_ == 1 && canceled[0].leaves_qty_ == 30);
+    CHECK(f.updates(MarketUpdateType::ADD).empty());
+
+    // The resting order is untouched.
+    f.add(CLIENT_3, 0, Side::BUY, 100, 30);
+    CHECK_EQ(f.filledQty(CLIENT_1), 30);
+}
+
+auto testStpCancelOldest(BookFixture& f) {
+    f.reset(SelfTradePrevention::CANCEL_OLDEST);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 20);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+    f.add(CLIENT_2, 1, Side::SELL, 100, 10);
+
+    // Trades past the canceled resting order and rests the remainder.
+    f.add(CLIENT_1, 1, Side::BUY, 100, 50);
+    CHECK_EQ(f.filledQty(CLIENT_2), 30);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].client_order_id_ == 0 && canceled[0].leaves_qty_ == 30);
+    const auto adds = f.updates(MarketUpdateType::ADD);
+    CHECK(adds.size() == 1 && adds[0].side_ == Side::BUY && adds[0].qty_ == 20);
+}
+
+auto testStpDecrementBoth(BookFixture& f) {
+    f.reset(SelfTradePrevention::DECREMENT_BOTH);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 30);
+
+    // The aggressive order is used up: the resting order is decremented, the aggressive one canceled with nothing left.
+    f.add(CLIENT_1, 1, Side::BUY, 100, 20);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    CHECK(f.updates(MarketUpdateType::TRADE).empty());
+    const auto modified = f.responses(CLIENT_1, ClientResponseType::MODIFIED);
+    CHECK(modified.size() == 1 && modified[0].client_order_id_ == 0 && modified[0].leaves_qty_ == 10);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].client_order_id_ == 1 && canceled[0].leaves_qty_ == 0);
+    const auto modifies = f.updates(MarketUpdateType::MODIFY);
+    CHECK(modifies.size() == 1 && modifies[0].qty_ == 10);
+
+    // The resting order is used up and canceled, the rest of the aggressive order rests.
+    f.add(CLIENT_1, 2, Side::BUY, 100, 50);
+    const auto canceled_resting = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled_resting.size() == 1 && canceled_resting[0].client_order_id_ == 0);
+    const auto adds = f.updates(MarketUpdateType::ADD);
+    CHECK(adds.size() == 1 && adds[0].qty_ == 40);
+}
+
+auto testStpFok(BookFixture& f) {
+    // An own order ahead would decrement the FOK order without a trade, so it cannot be filled completely.
+    f.reset(SelfTradePrevention::DECREMENT_BOTH);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 10);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+    f.add(CLIENT_1, 1, Side::BUY, 100, 50, TimeInForce::FOK);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].client_order_id_ == 1 && canceled[0].leaves_qty_ == 50);
+    CHECK(f.updates().empty());
+
+    f.reset(SelfTradePrevention::CANCEL_NEWEST);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 10);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+    f.add(CLIENT_1, 1, Side::BUY, 100, 50, TimeInForce::FOK);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    CHECK(f.updates().empty());
+
+    // CANCEL_OLDEST cancels the own order and fills from the others.
+    f.reset(SelfTradePrevention::CANCEL_OLDEST);
+    f.add(CLIENT_1, 0, Side::SELL, 100, 10);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 100);
+    f.add(CLIENT_1, 1, Side::BUY, 100, 50, TimeInForce::FOK);
+    CHECK_EQ(f.filledQty(CLIENT_1), 50);
+    const auto canceled_resting = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled_resting.size() == 1 && canceled_resting[0].client_order_id_ == 0);
+}
+
+/// Queue the orders during an auction and uncross, client 1 buys and client 2 sells.
+auto auctionUncross(BookFixture& f, const std::vector<std::pair<Price, Qty>>& bids,
+                    const std::vector<std::pair<Price, Qty>>& asks) {
+    f.reset();
+    f.startAuction();
+    OrderId order_id = 0;
+    for (const auto& [price, qty] : bids)
+        f.add(CLIENT_1, order_id++, Side::BUY, price, qty);
+    for (const auto& [price, qty] : asks)
+        f.add(CLIENT_2, order_id++, Side::SELL, price, qty);
+    CHECK(f.updates(MarketUpdateType::TRADE).empty());
+    return f.uncross();
+}
+
+/// Every fill of the uncross is at its price and there is a single TRADE for the whole quantity.
+auto checkUncrossFills(BookFixture& f, Price price, Qty qty) {
+    for (const auto& response : f.responses(CLIENT_1, ClientResponseType::FILLED))
+        CHECK_EQ(response.price_, price);
+    for (const auto& response : f.responses(CLIENT_2, ClientResponseType::FILLED))
+        CHECK_EQ(response.price_, price);
+    CHECK_EQ(f.filledQty(CLIENT_1), qty);
+    CHECK_EQ(f.filledQty(CLIENT_2), qty);
+    const auto trades = f.updates(MarketUpdateType::TRADE);
+    CHECK(trades.size() == 1 && trades[0].price_ == price && trades[0].qty_ == qty);
+}
+
+auto testUncrossBuySurplus(BookFixture& f) {
+    // 60 executes anywhere in [101, 101], 20 bought at 101 is left over.
+    const auto [price, qty] = auctionUncross(f, {{102, 50}, {101, 30}}, {{100, 40}, {101, 20}});
+    CHECK_EQ(price, 101);
+    CHECK_EQ(qty, 60);
+    checkUncrossFills(f, 101, 60);
+
+    // Continuous again with the surplus resting.
+    f.add(CLIENT_3, 0, Side::SELL, 101, 20);
+    CHECK_EQ(f.filledQty(CLIENT_3), 20);
+}
+
+auto testUncrossSellSurplus(BookFixture& f) {
+    // 30 executes anywhere in [101, 102], the sell surplus at 101 takes the low end.
+    const auto [price, qty] = auctionUncross(f, {{102, 30}}, {{100, 20}, {101, 30}});
+    CHECK_EQ(price, 101);
+    CHECK_EQ(qty, 30);
+    checkUncrossFills(f, 101, 30);
+}
+
+auto testUncrossBalanced(BookFixture& f) {
+    // No surplus on either side, the middle of [100, 104].
+    const auto [price, qty] = auctionUncross(f, {{104, 30}}, {{100, 30}});
+    CHECK_EQ(price, 102);
+    CHECK_EQ(qty, 30);
+    checkUncrossFills(f, 102, 30);
+}
+
+auto testUncrossNoCross(BookFixture& f) {
+    const auto [price, qty] = auctionUncross(f, {{99, 30}}, {{100, 30}});
+    CHECK_EQ(price, Price_INVALID);
+    CHECK_EQ(qty, 0);
+    CHECK(f.updates(MarketUpdateType::TRADE).empty());
+}
+
+auto testAuctionCancelsIoc(BookFixture& f) {
+    f.reset();
+    f.add(CLIENT_2, 0, Side::SELL, 100, 30);
+    f.startAuction();
+    f.add(CLIENT_1, 0, Side::BUY, 100, 30, TimeInForce::IOC);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].leaves_qty_ == 30);
+    f.uncross();
+}
+
+/// Leave the last trade price of the previous test case at 100.
+auto tradeAt100(BookFixture& f) {
+    f.add(CLIENT_2, 100, Side::SELL, 100, 10);
+    f.add(CLIENT_3, 100, Side::BUY, 100, 10);
+}
+
+auto testStopCascade(BookFixture& f) {
+    f.reset();
+    tradeAt100(f);
+    for (OrderId order_id = 0; order_id < 4; ++order_id)
+        f.add(CLIENT_2, order_id, Side::SELL, 105 + order_id, 10);
+
+    // Parked without being published.
+    f.addStop(CLIENT_1, 0, Side::BUY, Price_INVALID, 10, OrderType::STOP, 105);
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::ACCEPTED).size(), 1u);
+    CHECK(f.updates().empty());
+    f.addStop(CLIENT_1, 1, Side::BUY, Price_INVALID, 10, OrderType::STOP, 106);
+    f.addStop(CLIENT_1, 2, Side::BUY, Price_INVALID, 10, OrderType::STOP, 108);
+
+    // The trade at 105 releases the first stop, which trades at 106 and releases the second one, which trades at 107.
+    f.add(CLIENT_3, 0, Side::BUY, 105, 10);
+    const auto trades = f.updates(MarketUpdateType::TRADE);
+    CHECK(trades.size() == 3 && trades[0].price_ == 105 && trades[1].price_ == 106 && trades[2].price_ == 107);
+    const auto fills = f.responses(CLIENT_1, ClientResponseType::FILLED);
+    CHECK(fills.size() == 2 && fills[0].client_order_id_ == 0 && fills[1].client_order_id_ == 1);
+
+    // 107 does not reach the third stop, which is still parked.
+    f.cancel(CLIENT_1, 2);
+    const auto canceled = f.responses(CLIENT_1, ClientResponseType::CANCELED);
+    CHECK(canceled.size() == 1 && canceled[0].leaves_qty_ == 10);
+    CHECK(f.updates().empty());
+}
+
+auto testStopLimitRests(BookFixture& f) {
+    f.reset();
+    tradeAt100(f);
+    f.add(CLIENT_2, 0, Side::BUY, 99, 10);
+    f.add(CLIENT_2, 1, Side::BUY, 97, 10);
+
+    // Released as a limit order at 98 by the trade at 99, it rests after not crossing the bid at 97.
+    f.addStop(CLIENT_1, 0, Side::SELL, 98, 10, OrderType::STOP_LIMIT, 99);
+    f.add(CLIENT_3, 0, Side::SELL, 99, 10);
+    CHECK_EQ(f.filledQty(CLIENT_1), 0);
+    const auto adds = f.updates(MarketUpdateType::ADD);
+    CHECK(adds.size() == 1 && adds[0].side_ == Side::SELL && adds[0].price_ == 98 && adds[0].qty_ == 10);
+}
+
+auto testStopWithoutStopPrice(BookFixture& f) {
+    f.reset();
+    f.addStop(CLIENT_1, 0, Side::BUY, Price_INVALID, 10, OrderType::STOP, Price_INVALID);
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::CANCELED).size(), 1u);
+    f.addStop(CLIENT_1, 1, Side::BUY, Price_INVALID, 10, OrderType::STOP_LIMIT, 105);
+    CHECK_EQ(f.responses(CLIENT_1, ClientResponseType::CANCELED).size(), 1u);
+}
+
+auto testIcebergReplenish(BookFixture& f) {
+    f.reset();
+    f.addIceberg(CLIENT_1, 0, Side::SELL, 100, 100, 30);
+    const auto shown = f.updates(MarketUpdateType::ADD);
+    CHECK(shown.size() == 1 && shown[0].qty_ == 30 && shown[0].priority_ == 1);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 20);
+
+    // The shown 30 is taken, the refill goes to the back of the queue with a new priority under the same order id.
+    f.add(CLIENT_3, 0, Side::BUY, 100, 30);
+    const auto fills = f.responses(CLIENT_1, ClientResponseType::FILLED);
+    CHECK(fills.size() == 1 && fills[0].exec_qty_ == 30 && fills[0].leaves_qty_ == 70);
+    const auto refills = f.updates(MarketUpdateType::ADD);
+    CHECK(refills.size() == 1 && refills[0].order_id_ == shown[0].order_id_ && refills[0].qty_ == 30 &&
+          refills[0].priority_ == 3);
+
+    // The order behind it now goes first.
+    f.add(CLIENT_3, 1, Side::BUY, 100, 30);
+    CHECK_EQ(f.filledQty(CLIENT_2), 20);
+    CHECK_EQ(f.filledQty(CLIENT_1), 10);
+}
+
+auto testIcebergFullQty(BookFixture& f) {
+    f.reset();
+    f.addIceberg(CLIENT_1, 0, Side::SELL, 100, 100, 30);
+
+    // FOK counts the reserve.
+    f.add(CLIENT_3, 0, Side::BUY, 100, 100, TimeInForce::FOK);
+    CHECK_EQ(f.filledQty(CLIENT_3), 100);
+    CHECK_EQ(f.filledQty(CLIENT_1), 100);
+    CHECK(f.responses(CLIENT_3, ClientResponseType::CANCELED).empty());
+}
+
+auto testIcebergModifyReducesReserve(BookFixture& f) {
+    f.reset();
+    f.addIceberg(CLIENT_1, 0, Side::SELL, 100, 100, 30);
+    f.add(CLIENT_2, 0, Side::SELL, 100, 20);
+
+    // 100 -> 40 comes out of the 70 in reserve, the shown 30 keeps its priority.
+    f.modify(CLIENT_1, 0, 100, 40);
+    const auto modifies = f.updates(MarketUpdateType::MODIFY);
+    CHECK(modifies.size() == 1 && modifies[0].qty_ == 30 && modifies[0].priority_ == 1);
+
+    // 40 -> 20 empties the reserve and cuts the shown quantity.
+    f.modify(CLIENT_1, 0, 100, 20);
+    const auto cut = f.updates(MarketUpdateType::MODIFY);
+    CHECK(cut.size() == 1 && cut[0].qty_ == 20 && cut[0].priority_ == 1);
+
+    f.add(CLIENT_3, 0, Side::BUY, 100, 40);
+    CHECK_EQ(f.filledQty(CLIENT_1), 20);
+    CHECK_EQ(f.filledQty(CLIENT_2), 20);
+}
+
+auto testRejectReasons(BookFixture& f) {
+    f.reset();
+    const auto isRejected = [&f](RejectReason reject_reason) {
+        const auto rejected = f.responses(CLIENT_1, ClientResponseType::REJECTED);
+        return f.responses(CLIENT_1).size() == 1 && rejected.size() == 1 && rejected[0].client_order_id_ == 7 &&
+               rejected[0].reject_reason_ == reject_reason && f.updates().empty();
+    };
+
+    for (auto type : {ClientRequestType::NEW, ClientRequestType::CANCEL, ClientRequestType::MODIFY}) {
+        f.process({type, CLIENT_1, ME_MAX_TICKERS, 7, Side::BUY, 100, 10});
+        CHECK(isRejected(RejectReason::UNKNOWN_TICKER));
+    }
+    f.process({ClientRequestType::INVALID, CLIENT_1, 0, 7, Side::BUY, 100, 10});
+    CHECK(isRejected(RejectReason::INVALID_TYPE));
+
+    // Only the admin client changes phases, no ticker gets an AUCTION_STARTED / UNCROSSED.
+    for (auto type : {ClientRequestType::START_AUCTION, ClientRequestType::UNCROSS}) {
+        f.process({type, CLIENT_1, TickerId_INVALID, 7, Side::INVALID, Price_INVALID, Qty_INVALID});
+        CHECK(isRejected(RejectReason::NOT_AUTHORIZED));
+    }
+}
+
+auto testMassCancel(BookFixture& f) {
+    // Through the matching engine's own book of ticker 0, which only ever got rejected requests.
+    const auto newOrder = [&f](ClientId client_id, OrderId order_id, Side side, Price price) {
+        f.process({ClientRequestType::NEW, client_id, 0, order_id, side, price, 10});
+    };
+    newOrder(CLIENT_1, 1, Side::BUY, 98);
+    newOrder(CLIENT_1, 2, Side::BUY, 99);
+    newOrder(CLIENT_1, 3, Side::SELL, 102);
+    newOrder(CLIENT_2, 1, Side::BUY, 97);
+
+    // A single response carries the number of orders canceled, every canceled order is published.
+    f.process({ClientRequestType::MASS_CANCEL, CLIENT_1, TickerId_INVALID, 8, Side::BUY, Price_INVALID, Qty_INVALID});
+    auto mass_canceled = f.responses(CLIENT_1);
+    CHECK(mass_canceled.size() == 1 && mass_canceled[0].type_ == ClientResponseType::MASS_CANCELED &&
+          mass_canceled[0].client_order_id_ == 8 && mass_canceled[0].exec_qty_ == 2);
+    CHECK(f.responses(CLIENT_2).empty());
+    auto cancels = f.updates(MarketUpdateType::CANCEL);
+    CHECK(cancels.size() == 2 && cancels[0].side_ == Side::BUY && cancels[1].side_ == Side::BUY);
+
+    f.process({ClientRequestType::MASS_CANCEL, CLIENT_1, 0, 9, Side::INVALID, Price_INVALID, Qty_INVALID});
+    mass_canceled = f.responses(CLIENT_1);
+    CHECK(mass_canceled.size() == 1 && mass_canceled[0].exec_qty_ == 1);
+    cancels = f.updates(MarketUpdateType::CANCEL);
+    CHECK(cancels.size() == 1 && cancels[0].side_ == Side::SELL && cancels[0].price_ == 102);
+
+    // Nothing left to cancel still gets the response.
+    f.process({ClientRequestType::MASS_CANCEL, CLIENT_1, TickerId_INVALID, 10, Side::INVALID, Price_INVALID,
+               Qty_INVALID});
+    mass_canceled = f.responses(CLIENT_1);
+    CHECK(mass_canceled.size() == 1 && mass_canceled[0].exec_qty_ == 0 && f.updates().empty());
+
+    f.process({ClientRequestType::MASS_CANCEL, CLIENT_2, TickerId_INVALID, 1, Side::INVALID, Price_INVALID,
+               Qty_INVALID});
+    CHECK(f.responses(CLIENT_2).size() == 1 && f.responses(CLIENT_2)[0].exec_qty_ == 1);
+}
+} // namespace
+
+int main(int, char**) {
+    BookFixture fixture;
+
+    Common::runTest("modify reduce keeps priority", [&]() { testModifyReduceKeepsPriority(fixture); });
+    Common::runTest("modify increase loses priority", [&]() { testModifyIncreaseLosesPriority(fixture); });
+    Common::runTest("modify price loses priority", [&]() { testModifyPriceLosesPriority(fixture); });
+    Common::runTest("modify matches at new price", [&]() { testModifyMatchesAtNewPrice(fixture); });
+    Common::runTest("modify rejected", [&]() { testModifyRejected(fixture); });
+    Common::runTest("FOK fills across levels", [&]() { testFokFillsAcrossLevels(fixture); });
+    Common::runTest("FOK all or none", [&]() { testFokAllOrNone(fixture); });
+    Common::runTest("IOC cancels remainder", [&]() { testIocCancelsRemainder(fixture); });
+    Common::runTest("STP cancel newest", [&]() { testStpCancelNewest(fixture); });
+    Common::runTest("STP cancel oldest", [&]() { testStpCancelOldest(fixture); });
+    Common::runTest("STP decrement both", [&]() { testStpDecrementBoth(fixture); });
+    Common::runTest("STP FOK", [&]() { testStpFok(fixture); });
+    Common::runTest("uncross buy surplus", [&]() { testUncrossBuySurplus(fixture); });
+    Common::runTest("uncross sell surplus", [&]() { testUncrossSellSurplus(fixture); });
+    Common::runTest("uncross balanced", [&]() { testUncrossBalanced(fixture); });
+    Common::runTest("uncross no cross", [&]() { testUncrossNoCross(fixture); });
+    Common::runTest("auction cancels IOC", [&]() { testAuctionCancelsIoc(fixture); });
+    Common::runTest("stop cascade", [&]() { testStopCascade(fixture); });
+    Common::runTest("stop limit rests", [&]() { testStopLimitRests(fixture); });
+    Common::runTest("stop without stop price", [&]() { testStopWithoutStopPrice(fixture); });
+    Common::runTest("iceberg replenish", [&]() { testIcebergReplenish(fixture); });
+    Common::runTest("iceberg full qty", [&]() { testIcebergFullQty(fixture); });
+    Common::runTest("iceberg modify reduces reserve", [&]() { testIcebergModifyReducesReserve(fixture); });
+    Common::runTest("reject reasons", [&]() { testRejectReasons(fixture); });
+    Common::runTest("mass cancel", [&]() { testMassCancel(fixture); });
+
+    return Common::testResult();
+}
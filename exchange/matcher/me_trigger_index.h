@@ -0,0 +1,116 @@
+#pragma once
+
+/**
+ * 停止单的触发索引：每个 ticker 每一边一个二叉堆，堆顶是下一个会被触发的停止单
+ * 买方停止单成交价涨到触发价时触发，所以触发价最低的在堆顶；卖方相反
+ * 订单里记录自己在堆里的位置，撤单也是 O(log n)；挂着不触发的停止单除了占位置之外没有任何开销
+ */
+
+#include "common/macros.h"
+#include "common/types.h"
+
+#include "me_order.h"
+
+using namespace Common;
+
+namespace Exchange
+{
+/// Parked stop orders of one side of an order book, kept as a binary heap ordered by the sequence they fire in.
+/// Every order stores its position in the heap in trigger_index_ so it can also be removed in O(log n).
+class METriggerIndex final {
+public:
+    explicit METriggerIndex(Side side) : side_(side) {
+    }
+
+    auto empty() const noexcept {
+        return !size_;
+    }
+
+    auto size() const noexcept {
+        return size_;
+    }
+
+    /// The parked stop order which fires first, the index must not be empty.
+    auto top() const noexcept {
+        return heap_[0];
+    }
+
+    /// True if the top stop order is triggered by a trade at trade_price.
+    auto triggered(Price trade_price) const noexcept {
+        return size_ && trade_price != Price_INVALID &&
+               (side_ == Side::BUY ? heap_[0]->stop_price_ <= trade_price : heap_[0]->stop_price_ >= trade_price);
+    }
+
+    auto push(MEOrder* order) noexcept {
+        if (UNLIKELY(size_ == heap_.size()))
+            FATAL("Trigger index full, increase ME_MAX_STOP_ORDERS.");
+
+        place(order, size_);
+        siftUp(size_++);
+    }
+
+    auto remove(MEOrder* order) noexcept {
+        const auto index = order->trigger_index_;
+        if (UNLIKELY(index >= size_ || heap_[index] != order))
+            FATAL("Order not in trigger index:" + order->toString());
+
+        if (index != --size_) {
+            place(heap_[size_], index);
+            siftDown(index);
+            siftUp(index);
+        }
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    METriggerIndex() = delete;
+
+    METriggerIndex(const METriggerIndex&) = delete;
+
+    METriggerIndex(const METriggerIndex&&) = delete;
+
+    METriggerIndex& operator=(const METriggerIndex&) = delete;
+
+    METriggerIndex& operator=(const METriggerIndex&&) = delete;
+
+private:
+    const Side side_;
+
+    std::array<MEOrder*, ME_MAX_STOP_ORDERS> heap_;
+    size_t size_ = 0;
+
+    /// True if a fires before b - buy stops from the lowest stop price up, sell stops from the highest down, orders
+    /// with the same stop price in arrival order.
+    auto firesBefore(const MEOrder* a, const MEOrder* b) const noexcept {
+        if (a->stop_price_ != b->stop_price_)
+            return (side_ == Side::BUY ? a->stop_price_ < b->stop_price_ : a->stop_price_ > b->stop_price_);
+        return a->market_order_id_ < b->market_order_id_;
+    }
+
+    auto place(MEOrder* order, size_t index) noexcept -> void {
+        heap_[index] = order;
+        order->trigger_index_ = index;
+    }
+
+    auto siftUp(size_t index) noexcept -> void {
+        const auto order = heap_[index];
+        while (index) {
+            const auto parent = (index - 1) / 2;
+            if (!firesBefore(order, heap_[parent])) break;
+            place(heap_[parent], index);
+            index = parent;
+        }
+        place(order, index);
+    }
+
+    auto siftDown(size_t index) noexcept -> void {
+        const auto order = heap_[index];
+        for (auto child = 2 * index + 1; child < size_; child = 2 * index + 1) {
+            if (child + 1 < size_ && firesBefore(heap_[child + 1], heap_[child])) ++child;
+            if (!firesBefore(heap_[child], order)) break;
+            place(heap_[child], index);
+            index = child;
+        }
+        place(order, index);
+    }
+};
+} // namespace Exchange
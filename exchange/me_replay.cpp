@@ -0,0 +1,159 @@
+/**
+ * 撮合引擎的确定性回放，用来复现线上撮合的行为，也是撮合的回归 benchmark：
+ *      从 ME journal 或者抓包文件（连续的 MEClientRequest）读出一段请求流，可选地先从 checkpoint 恢复订单簿
+ *      在绑定的核上直接调用 MatchingEngine::processClientRequest()，不经过 order server 和 TCP
+ *      把每个请求产生的回报 / 逐笔行情 / 价位行情 / BBO 和 golden 文件逐行比较，golden 文件不存在时写一个新的
+ *      按请求类型统计每个请求的处理耗时分布
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include "common/thread_utils.h"
+#include "common/time_utils.h"
+
+#include "matcher/matching_engine.h"
+
+namespace
+{
+/// Read a capture file holding consecutive MEClientRequest structures, returns false if it is not one.
+auto readCapture(const std::string& path, std::vector<Exchange::MEClientRequest>* requests) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    const auto size = static_cast<size_t>(file.tellg());
+    if (size % sizeof(Exchange::MEClientRequest))
+        return false;
+
+    requests->resize(size / sizeof(Exchange::MEClientRequest));
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(requests->data()), size));
+}
+
+auto percentile(const std::vector<Nanos>& sorted_nanos, double p) {
+    return sorted_nanos[std::min(sorted_nanos.size() - 1, static_cast<size_t>(p * sorted_nanos.size()))];
+}
+} // namespace
+
+/// ./me_replay INPUT GOLDEN [CORE] [CHECKPOINT]
+/// INPUT is a matching engine journal or a capture file. GOLDEN is compared against the responses and market updates
+/// of every request, or recorded if it does not exist. CORE pins the replay, -1 does not pin. CHECKPOINT restores the
+/// order books first, only the journaled requests after it are replayed.
+int main(int argc, char** argv) {
+    if (argc < 3)
+        FATAL("USAGE me_replay INPUT GOLDEN [CORE] [CHECKPOINT]");
+    const std::string input_path = argv[1];
+    const std::string golden_path = argv[2];
+    const int core_id = (argc > 3 ? atoi(argv[3]) : -1);
+    const std::string checkpoint_path = (argc > 4 ? argv[4] : "");
+
+    /* 和 exchange_main 一样的设置，否则回放结果和线上不一样 */
+    const bool aggregate_fills = true;
+    const auto self_trade_prevention = Exchange::SelfTradePrevention::CANCEL_NEWEST;
+
+    Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
+    Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
+    Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MEBBOUpdateLFQueue bbo_updates(ME_MAX_MARKET_UPDATES);
+
+    // Holds the order books which are too large for the stack, the matching engine thread is never started.
+    auto matching_engine = new Exchange::MatchingEngine(&client_requests, &client_responses, &market_updates,
+                                                        &level_updates, &bbo_updates);
+    matching_engine->setAggregateFills(aggregate_fills);
+    matching_engine->setSelfTradePrevention(self_trade_prevention);
+
+    size_t checkpoint_seq_num = 0;
+    if (!checkpoint_path.empty())
+        ASSERT(matching_engine->restoreCheckpoint(checkpoint_path, &checkpoint_seq_num),
+               "Unable to read checkpoint:" + checkpoint_path);
+
+    std::vector<Exchange::MEClientRequest> requests;
+    size_t first_seq_num = 0;
+    if (!Exchange::readJournal(input_path, checkpoint_seq_num, &requests, &first_seq_num))
+        ASSERT(readCapture(input_path, &requests), "Unable to read journal or capture file:" + input_path);
+    printf("input:%s %zu requests first seq:%zu checkpoint:%s seq:%zu\n", input_path.c_str(), requests.size(),
+           first_seq_num, (checkpoint_path.empty() ? "none" : checkpoint_path.c_str()), checkpoint_seq_num);
+
+    if (core_id >= 0)
+        ASSERT(Common::setThreadCore(core_id), "Unable to pin me_replay to core:" + std::to_string(core_id));
+
+    std::vector<std::string> outputs;
+    outputs.reserve(requests.size() * 4);
+    std::map<Exchange::ClientRequestType, std::vector<Nanos>> request_nanos;
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const auto start = Common::getCurrentNanos();
+        matching_engine->processClientRequest(&requests[i]);
+        request_nanos[requests[i].type_].push_back(Common::getCurrentNanos() - start);
+
+        /* 每个请求的输出按 回报、逐笔行情、价位行情、BBO 的顺序记录，这个顺序是确定的 */
+        const auto prefix = std::to_string(i) + " ";
+        for (auto response = client_responses.getNextToRead(); response; response = client_responses.getNextToRead()) {
+            outputs.push_back(prefix + response->toString());
+            client_responses.updateReadIndex();
+        }
+        for (auto update = market_updates.getNextToRead(); update; update = market_updates.getNextToRead()) {
+            outputs.push_back(prefix + update->toString());
+            market_updates.updateReadIndex();
+        }
+        for (auto update = level_updates.getNextToRead(); update; update = level_updates.getNextToRead()) {
+            outputs.push_back(prefix + update->toString());
+            level_updates.updateReadIndex();
+        }
+        for (auto update = bbo_updates.getNextToRead(); update; update = bbo_updates.getNextToRead()) {
+            outputs.push_back(prefix + update->toString());
+            bbo_updates.updateReadIndex();
+        }
+    }
+
+    std::vector<Nanos> all_nanos;
+    printf("%-14s %9s %9s %9s %9s %9s %9s %9s (ns)\n", "request", "count", "mean", "p50", "p90", "p99", "p99.9",
+           "max");
+    auto print_distribution = [](const std::string& name, std::vector<Nanos>* nanos) {
+        if (nanos->empty())
+            return;
+        std::sort(nanos->begin(), nanos->end());
+        Nanos total = 0;
+        for (const auto n : *nanos)
+            total += n;
+        printf("%-14s %9zu %9ld %9ld %9ld %9ld %9ld %9ld\n", name.c_str(), nanos->size(),
+               total / static_cast<Nanos>(nanos->size()), percentile(*nanos, 0.5), percentile(*nanos, 0.9),
+               percentile(*nanos, 0.99), percentile(*nanos, 0.999), nanos->back());
+    };
+    for (auto& [type, nanos] : request_nanos) {
+        all_nanos.insert(all_nanos.end(), nanos.begin(), nanos.end());
+        print_distribution(Exchange::clientRequestTypeToString(type), &nanos);
+    }
+    print_distribution("ALL", &all_nanos);
+
+    std::ifstream golden(golden_path);
+    if (!golden) {
+        std::ofstream recorded(golden_path);
+        for (const auto& output : outputs)
+            recorded << output << '\n';
+        recorded.close();
+        ASSERT(static_cast<bool>(recorded), "Unable to write golden file:" + golden_path);
+        printf("recorded %zu outputs to golden file:%s\n", outputs.size(), golden_path.c_str());
+        exit(EXIT_SUCCESS);
+    }
+
+    size_t num_lines = 0, num_mismatched = 0;
+    for (std::string expected; std::getline(golden, expected); ++num_lines) {
+        const auto& actual = (num_lines < outputs.size() ? outputs[num_lines] : std::string("<missing>"));
+        if (expected != actual && ++num_mismatched <= 10)
+            printf("mismatch line:%zu\n  expected:%s\n  actual:  %s\n", num_lines + 1, expected.c_str(),
+                   actual.c_str());
+    }
+    if (num_lines < outputs.size()) {
+        num_mismatched += outputs.size() - num_lines;
+        printf("%zu extra outputs starting with line:%zu %s\n", outputs.size() - num_lines, num_lines + 1,
+               outputs[num_lines].c_str());
+    }
+
+    printf("verified %zu outputs against golden file:%s mismatched:%zu\n", outputs.size(), golden_path.c_str(),
+           num_mismatched);
+    exit(num_mismatched ? EXIT_FAILURE : EXIT_SUCCESS);
+}
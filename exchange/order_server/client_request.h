@@ -10,7 +10,28 @@ using namespace Common;
 namespace Exchange
 {
 /// Type of the order request sent by the trading client to the exchange.
-enum class ClientRequestType : uint8_t { INVALID = 0, NEW = 1, CANCEL = 2 };
+/// MODIFY replaces the price and quantity of a live order in a single request - same price and smaller quantity keeps
+/// the order's priority, anything else loses it as if the order was canceled and sent again.
+/// MASS_CANCEL cancels every order of the client on ticker_id_ and side_, TickerId_INVALID / Side::INVALID select every
+/// ticker / both sides.
+/// START_AUCTION and UNCROSS are admin requests which move ticker_id_, or every ticker if TickerId_INVALID, into the
+/// auction phase and out of it again, they are only accepted from ME_ADMIN_CLIENT_ID.
+/// LOGON starts or resumes a session and never reaches the matching engine. Its seq_num_ is the oldest request the
+/// client can still send again and its order_id_ is the sequence number of the last client response the client
+/// received, the order server answers with LOGGED_ON and replays the client responses after it.
+enum class ClientRequestType : uint8_t {
+    INVALID = 0,
+    NEW = 1,
+    CANCEL = 2,
+    MODIFY = 3,
+    MASS_CANCEL = 4,
+    START_AUCTION = 5,
+    UNCROSS = 6,
+    LOGON = 7
+};
+
+/// The client id reserved for the exchange operator, the only client allowed to send admin requests.
+constexpr ClientId ME_ADMIN_CLIENT_ID = ME_MAX_NUM_CLIENTS - 1;
 
 inline std::string clientRequestTypeToString(ClientRequestType type) {
     switch (type) {
@@ -18,12 +39,59 @@ inline std::string clientRequestTypeToString(ClientRequestType type) {
         return "NEW";
     case ClientRequestType::CANCEL:
         return "CANCEL";
+    case ClientRequestType::MODIFY:
+        return "MODIFY";
+    case ClientRequestType::MASS_CANCEL:
+        return "MASS_CANCEL";
+    case ClientRequestType::START_AUCTION:
+        return "START_AUCTION";
+    case ClientRequestType::UNCROSS:
+        return "UNCROSS";
+    case ClientRequestType::LOGON:
+        return "LOGON";
     case ClientRequestType::INVALID:
         return "INVALID";
     }
     return "UNKNOWN";
 }
 
+/// How long a NEW order stays in the order book.
+/// DAY rests whatever is not filled right away, IOC (immediate or cancel) cancels the unfilled remainder instead of
+/// resting it and FOK (fill or kill) is canceled without trading at all unless it can be filled completely right away.
+enum class TimeInForce : uint8_t { DAY = 0, IOC = 1, FOK = 2 };
+
+inline std::string timeInForceToString(TimeInForce tif) {
+    switch (tif) {
+    case TimeInForce::DAY:
+        return "DAY";
+    case TimeInForce::IOC:
+        return "IOC";
+    case TimeInForce::FOK:
+        return "FOK";
+    }
+    return "UNKNOWN";
+}
+
+/// Type of a NEW order.
+/// LIMIT trades at price_ or better, MARKET sweeps the other side without a price check and never rests. STOP and
+/// STOP_LIMIT are parked out of the order book until a trade at or through stop_price_ (at or above for buys, at or
+/// below for sells) triggers them into a MARKET / LIMIT order.
+enum class OrderType : uint8_t { LIMIT = 0, MARKET = 1, STOP = 2, STOP_LIMIT = 3 };
+
+inline std::string orderTypeToString(OrderType type) {
+    switch (type) {
+    case OrderType::LIMIT:
+        return "LIMIT";
+    case OrderType::MARKET:
+        return "MARKET";
+    case OrderType::STOP:
+        return "STOP";
+    case OrderType::STOP_LIMIT:
+        return "STOP_LIMIT";
+    }
+    return "UNKNOWN";
+}
+
 /// 告诉编译器从这一行开始，将结构体成员按 1 字节对齐，并保存之前的对齐设置
 /// These structures go over the wire / network, so the binary structures are packed to remove system dependent extra
 /// padding.
@@ -39,6 +107,10 @@ struct MEClientRequest {
     Side side_ = Side::INVALID;
     Price price_ = Price_INVALID;
     Qty qty_ = Qty_INVALID;
+    TimeInForce tif_ = TimeInForce::DAY; ///< only used by NEW requests.
+    OrderType ord_type_ = OrderType::LIMIT; ///< only used by NEW requests.
+    Price stop_price_ = Price_INVALID;      ///< trigger price of STOP / STOP_LIMIT orders.
+    Qty display_qty_ = Qty_INVALID;         ///< iceberg orders only show this much of qty_, Qty_INVALID shows all.
 
     auto toString() const {
         std::stringstream ss;
@@ -47,7 +119,8 @@ struct MEClientRequest {
            << "type:" << clientRequestTypeToString(type_) << " client:" << clientIdToString(client_id_)
            << " ticker:" << tickerIdToString(ticker_id_) << " oid:" << orderIdToString(order_id_)
            << " side:" << sideToString(side_) << " qty:" << qtyToString(qty_) << " price:" << priceToString(price_)
-           << "]";
+           << " tif:" << timeInForceToString(tif_) << " type:" << orderTypeToString(ord_type_)
+           << " stop_price:" << priceToString(stop_price_) << " display_qty:" << qtyToString(display_qty_) << "]";
         return ss.str();
     }
 };
@@ -15,7 +15,15 @@ enum class ClientResponseType : uint8_t {
     ACCEPTED = 1,       // 订单被接受
     CANCELED = 2,       // 订单被取消
     FILLED = 3,         // 订单被执行
-    CANCEL_REJECTED = 4 // 取消请求被拒绝
+    CANCEL_REJECTED = 4, // 取消请求被拒绝
+    MODIFIED = 5,        // 改单成功，price_ / leaves_qty_ 是改单后的价格和数量
+    MODIFY_REJECTED = 6, // 改单请求被拒绝（订单不存在或参数无效）
+    MASS_CANCELED = 7,   // 批量撤单完成，每个请求只有一条，exec_qty_ 是撤掉的订单数量
+    AUCTION_STARTED = 8, // ticker 进入集合竞价阶段
+    UNCROSSED = 9,       // 集合竞价结束，price_ / exec_qty_ 是成交价格和成交量，没有成交时 price_ 为 INVALID
+    REJECTED = 10,       // 请求没有被执行，reject_reason_ 是原因，leaves_qty_ 是请求的数量
+    LOGGED_ON = 11,      // order server 对 LOGON 的应答，不占回报序号（seq_num_ 为 0），client_order_id_ 是下一个期望的请求序号
+    RESENT = 12          // ME 重启之后重新发出的回报从这里开始，market_order_id_ 是第一条在 ME 回报流里的位置，不发给客户
 };
 
 inline std::string clientResponseTypeToString(ClientResponseType type) {
@@ -28,12 +36,59 @@ inline std::string clientResponseTypeToString(ClientResponseType type) {
         return "FILLED";
     case ClientResponseType::CANCEL_REJECTED:
         return "CANCEL_REJECTED";
+    case ClientResponseType::MODIFIED:
+        return "MODIFIED";
+    case ClientResponseType::MODIFY_REJECTED:
+        return "MODIFY_REJECTED";
+    case ClientResponseType::MASS_CANCELED:
+        return "MASS_CANCELED";
+    case ClientResponseType::AUCTION_STARTED:
+        return "AUCTION_STARTED";
+    case ClientResponseType::UNCROSSED:
+        return "UNCROSSED";
+    case ClientResponseType::REJECTED:
+        return "REJECTED";
+    case ClientResponseType::LOGGED_ON:
+        return "LOGGED_ON";
+    case ClientResponseType::RESENT:
+        return "RESENT";
     case ClientResponseType::INVALID:
         return "INVALID";
     }
     return "UNKNOWN";
 }
 
+/// Why a client request was answered with a REJECTED response instead of being executed.
+enum class RejectReason : uint8_t {
+    NONE = 0,
+    BAD_SEQ_NUM = 1,    // 请求序号不是期望的序号（跳号或者重复），order server 拒绝
+    BAD_SESSION = 2,    // ClientId 无效或者属于另一个连接，不占回报序号，直接回给发送请求的连接
+    UNKNOWN_TICKER = 3, // ME 里没有这个 ticker
+    THROTTLED = 4,      // 超过了客户的流量限制，order server 拒绝
+    INVALID_TYPE = 5,   // ME 不处理这个请求类型
+    NOT_AUTHORIZED = 6  // 只有 ME_ADMIN_CLIENT_ID 可以发的管理请求（START_AUCTION / UNCROSS）
+};
+
+inline std::string rejectReasonToString(RejectReason reason) {
+    switch (reason) {
+    case RejectReason::NONE:
+        return "NONE";
+    case RejectReason::BAD_SEQ_NUM:
+        return "BAD_SEQ_NUM";
+    case RejectReason::BAD_SESSION:
+        return "BAD_SESSION";
+    case RejectReason::UNKNOWN_TICKER:
+        return "UNKNOWN_TICKER";
+    case RejectReason::THROTTLED:
+        return "THROTTLED";
+    case RejectReason::INVALID_TYPE:
+        return "INVALID_TYPE";
+    case RejectReason::NOT_AUTHORIZED:
+        return "NOT_AUTHORIZED";
+    }
+    return "UNKNOWN";
+}
+
 /// These structures go over the wire / network, so the binary structures are packed to remove system dependent extra
 /// padding.
 #pragma pack(push, 1)
@@ -49,6 +104,7 @@ struct MEClientResponse {
     Price price_ = Price_INVALID;
     Qty exec_qty_ = Qty_INVALID;
     Qty leaves_qty_ = Qty_INVALID;
+    RejectReason reject_reason_ = RejectReason::NONE; ///< only set on REJECTED responses.
 
     auto toString() const {
         std::stringstream ss;
@@ -58,7 +114,10 @@ struct MEClientResponse {
            << " ticker:" << tickerIdToString(ticker_id_) << " coid:" << orderIdToString(client_order_id_)
            << " moid:" << orderIdToString(market_order_id_) << " side:" << sideToString(side_)
            << " exec_qty:" << qtyToString(exec_qty_) << " leaves_qty:" << qtyToString(leaves_qty_)
-           << " price:" << priceToString(price_) << "]";
+           << " price:" << priceToString(price_);
+        if (reject_reason_ != RejectReason::NONE)
+            ss << " reason:" << rejectReasonToString(reject_reason_);
+        ss << "]";
         return ss.str();
     }
 };
@@ -0,0 +1,88 @@
+#pragma once
+
+/**
+ * 每个 ClientId 一个 token bucket，限制客户请求的速率，防止一个客户的突发流量占满 ME 的队列
+ * - 桶里最多 burst_ 个 token，每 1 / requests_per_sec_ 秒补充一个，每个请求消耗一个，没有 token 的请求被拒绝
+ * - 只记录桶重新装满的时间 full_time_，不需要按时间逐个补充 token，检查一次是 O(1) 的整数运算
+ * - 用请求的接收时间检查，不需要再读一次时钟
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+
+#include "common/macros.h"
+#include "common/time_utils.h"
+#include "common/types.h"
+
+using namespace Common;
+
+namespace Exchange
+{
+/// Rate limit of the client requests of every ClientId, requests_per_sec_ of 0 disables throttling.
+struct ClientThrottleCfg {
+    size_t requests_per_sec_ = 0;
+    size_t burst_ = 1; ///< requests accepted back to back after the client was idle.
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "ClientThrottleCfg"
+           << " ["
+           << "requests_per_sec:" << requests_per_sec_ << " burst:" << burst_ << "]";
+        return ss.str();
+    }
+};
+
+/// Number of client requests of a ClientId let through and rejected by its throttle.
+struct ClientThrottleStats {
+    size_t num_accepted_ = 0;
+    size_t num_throttled_ = 0;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "ClientThrottleStats"
+           << " ["
+           << "accepted:" << num_accepted_ << " throttled:" << num_throttled_ << "]";
+        return ss.str();
+    }
+};
+
+/// Token bucket of a single ClientId, checked only by the network thread owning the ClientId. The stats can be read
+/// from any thread.
+class ClientThrottle {
+public:
+    auto configure(const ClientThrottleCfg& cfg) noexcept -> void {
+        interval_ = (cfg.requests_per_sec_ ? NANOS_TO_SECS / static_cast<Nanos>(cfg.requests_per_sec_) : 0);
+        tolerance_ = interval_ * static_cast<Nanos>(cfg.burst_ ? cfg.burst_ - 1 : 0);
+        full_time_ = 0;
+    }
+
+    /// Take a token for a client request received at rx_time, false if the bucket is empty.
+    auto allow(Nanos rx_time) noexcept -> bool {
+        if (LIKELY(!interval_ || full_time_ - tolerance_ <= rx_time)) {
+            full_time_ = std::max(full_time_, rx_time) + interval_;
+            num_accepted_.store(num_accepted_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        num_throttled_.store(num_throttled_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto stats() const noexcept {
+        return ClientThrottleStats{num_accepted_.load(std::memory_order_relaxed),
+                                   num_throttled_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    /// Time it takes to refill a single token and time the bucket takes to refill the other burst_ - 1 tokens.
+    Nanos interval_ = 0;
+    Nanos tolerance_ = 0;
+
+    /// Time at which the bucket is full again, the bucket holds burst_ - (full_time_ - now) / interval_ tokens.
+    Nanos full_time_ = 0;
+
+    std::atomic<size_t> num_accepted_ = 0;
+    std::atomic<size_t> num_throttled_ = 0;
+};
+} // namespace Exchange
@@ -0,0 +1,77 @@
+#include "common/test_utils.h"
+
+#include "order_server/client_throttle.h"
+
+/**
+ * ClientThrottle 的测试：空闲之后最多连续通过 burst_ 个请求，之后每 1 / requests_per_sec_ 秒补充一个 token
+ */
+
+namespace
+{
+using namespace Exchange;
+
+/// 1000 requests per second, a token every millisecond.
+constexpr Nanos INTERVAL = NANOS_TO_MILLIS;
+constexpr Nanos START = 1000 * NANOS_TO_SECS;
+
+/// Number of requests received at rx_time let through.
+auto allowAt(ClientThrottle* throttle, Nanos rx_time, size_t num_requests) {
+    size_t num_allowed = 0;
+    for (size_t i = 0; i < num_requests; ++i)
+        num_allowed += throttle->allow(rx_time);
+    return num_allowed;
+}
+
+auto testDisabled() {
+    ClientThrottle throttle;
+    throttle.configure({0, 1});
+    CHECK_EQ(allowAt(&throttle, START, 10000), 10000u);
+}
+
+auto testBurst() {
+    ClientThrottle throttle;
+    throttle.configure({1000, 5});
+    CHECK_EQ(allowAt(&throttle, START, 10), 5u);
+    const auto stats = throttle.stats();
+    CHECK(stats.num_accepted_ == 5 && stats.num_throttled_ == 5);
+}
+
+auto testRefill() {
+    ClientThrottle throttle;
+    throttle.configure({1000, 5});
+    CHECK_EQ(allowAt(&throttle, START, 5), 5u);
+
+    // A single token per interval.
+    CHECK_EQ(allowAt(&throttle, START + INTERVAL - 1, 1), 0u);
+    CHECK_EQ(allowAt(&throttle, START + INTERVAL, 2), 1u);
+    CHECK_EQ(allowAt(&throttle, START + 3 * INTERVAL, 5), 2u);
+
+    // Refilled after burst_ intervals, never above burst_.
+    CHECK_EQ(allowAt(&throttle, START + 8 * INTERVAL, 10), 5u);
+    CHECK_EQ(allowAt(&throttle, START + 60 * NANOS_TO_SECS, 10), 5u);
+}
+
+auto testSteadyRate() {
+    ClientThrottle throttle;
+    throttle.configure({1000, 1});
+    size_t num_allowed = 0;
+    for (Nanos i = 0; i < 1000; ++i)
+        num_allowed += allowAt(&throttle, START + i * INTERVAL, 1);
+    CHECK_EQ(num_allowed, 1000u);
+
+    // Twice the rate gets half through.
+    num_allowed = 0;
+    for (Nanos i = 0; i < 1000; ++i)
+        num_allowed += allowAt(&throttle, START + 1000 * INTERVAL + i * INTERVAL / 2, 1);
+    CHECK_EQ(num_allowed, 500u);
+}
+} // namespace
+
+int main(int, char**) {
+    Common::runTest("disabled", testDisabled);
+    Common::runTest("burst", testBurst);
+    Common::runTest("refill", testRefill);
+    Common::runTest("steady rate", testSteadyRate);
+
+    return Common::testResult();
+}
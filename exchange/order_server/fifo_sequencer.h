@@ -1,67 +1,156 @@
 #pragma once
 
+/**
+ * FIFO sequencer：把多个来源的客户请求按接收时间合并之后发布给 ME
+ *
+ * - 每个来源是一个单生产者的 LFQueue，生产者保证写进去的请求按接收时间递增，order server 里每个 ClientId 是一个来源，
+ *   同一个客户的请求只从一个 socket 读进来，内核的接收时间戳本身就是递增的
+ * - 所有有待处理请求的来源放在一个按队首接收时间排序的小顶堆里，每次取堆顶发布，然后把这个来源的下一个请求放回堆里，
+ *   不需要每次把所有请求重新排序，接收时间相同时编号小的来源优先
+ * - 生产者写完请求之后在 ready_ 位图里标记这个来源，sequencer 只检查被标记的来源，不用每次扫描所有来源
+ * - 窗口为 0 时有什么就按时间顺序发布什么；窗口大于 0 时只要还有活跃的来源是空的，就只发布 window_ 以前收到的请求，
+ *   给这些来源（比如另一个网络线程上的客户）留出把更早收到的请求送过来的时间，用延迟换公平；
+ *   没有客户连接的 ClientId 不是活跃的来源，不会让其他客户的请求等待
+ * - 不会因为突发流量 FATAL：ME 的队列满了就停止发布，请求留在各自的来源里；来源满了由生产者停止读 socket
+ * - 被 order server 拒绝的请求（比如超过了流量限制、序号不对）也按顺序经过 sequencer，由回调决定不发布给 ME
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <functional>
+
+#include "common/logging.h"
 #include "common/macros.h"
 #include "common/thread_utils.h"
+#include "common/time_utils.h"
 
 #ifdef PERF
 #include "common/perf_utils.h"
 #endif
 
 #include "order_server/client_request.h"
+#include "order_server/client_response.h"
 
 namespace Exchange
 {
-/// Maximum number of unprocessed client request messages across all TCP connections in the order server / FIFO
-/// sequencer.
+/// Maximum number of unprocessed client request messages of a single source of the FIFO sequencer, the producer of a
+/// full source stops reading from its TCP connection.
 constexpr size_t ME_MAX_PENDING_REQUESTS = 1024;
 
+/// Maximum number of sources merged by a FIFO sequencer.
+constexpr size_t ME_MAX_SEQUENCER_SOURCES = ME_MAX_NUM_CLIENTS;
+static_assert(ME_MAX_SEQUENCER_SOURCES % 64 == 0, "The source bitmaps use whole 64-bit words.");
+
+/// A structure that encapsulates the software receive time as well as the client request.
+struct RecvTimeClientRequest {
+    Nanos recv_time_ = 0;
+    MEClientRequest request_;
+    bool session_lost_ = false; ///< the MASS_CANCEL sent by the order server when the client session was lost.
+    /// Why the order server answers the request with a REJECTED response instead of publishing it, e.g. THROTTLED.
+    RejectReason reject_reason_ = RejectReason::NONE;
+    /// The next sequence number the order server expects from the client after this request.
+    size_t next_exp_seq_num_ = 0;
+};
+
+/// Lock free queue of received client requests in ascending receive time order, a source of the FIFO sequencer.
+using RecvTimeClientRequestLFQueue = LFQueue<RecvTimeClientRequest>;
+
 class FIFOSequencer {
 public:
-    FIFOSequencer(ClientRequestLFQueue* client_requests, Logger* logger)
-        : incoming_requests_(client_requests), logger_(logger) {
+    /// With a window of 0 every pending client request is published right away, see sequenceAndPublish().
+    FIFOSequencer(ClientRequestLFQueue* client_requests, Nanos window, Logger* logger)
+        : incoming_requests_(client_requests), window_(window), logger_(logger) {
+        sources_.fill(nullptr);
+        for (auto& word : ready_)
+            word.store(0);
+        for (auto& word : active_)
+            word.store(0);
+        in_heap_.fill(0);
     }
 
     ~FIFOSequencer() {
     }
 
-    /* 在 OrderServer::recvCallback(TCPSocket* socket, Nanos rx_time) 调用 */
-    /// Queue up a client request, not processed immediately, processed when sequenceAndPublish() is called.
-    auto addClientRequest(Nanos rx_time, const MEClientRequest& request) {
-        if (pending_size_ >= pending_client_requests_.size()) {
-            FATAL("Too many pending requests");
-        }
-        pending_client_requests_.at(pending_size_++) = std::move(RecvTimeClientRequest{rx_time, request});
+    /// Merge the client requests written to source by a single producer, in ascending receive time order.
+    auto addSource(RecvTimeClientRequestLFQueue* source) -> void {
+        ASSERT(num_sources_ < sources_.size(), "Too many FIFO sequencer sources:" + std::to_string(num_sources_));
+        sources_[num_sources_++] = source;
     }
 
-    /* 作为 recvFinishedCallback() */
-    /// Sort pending client requests in ascending receive time order and then write them to the lock free queue for the
-    /// matching engine to consume from.
-    auto sequenceAndPublish() {
-        if (UNLIKELY(!pending_size_)) return;
-
-        logger_->log("%:% %() % Processing % requests.\n", __FILE__, __LINE__, __FUNCTION__,
-                     Common::getCurrentTimeStr(&time_str_), pending_size_);
-
-        /* 这里会用到定义的 operator< */
-        std::sort(pending_client_requests_.begin(), pending_client_requests_.begin() + pending_size_);
-
-        /* 写在 incoming_requests_ 上 */
-        for (size_t i = 0; i < pending_size_; ++i) {
-            const auto& client_request = pending_client_requests_.at(i);
+    /// Called by the producer of the source at source_index after writing client requests to it, the sequencer only
+    /// looks at the sources marked ready since its last call.
+    auto sourceReady(size_t source_index) noexcept -> void {
+        ready_[source_index / 64].fetch_or(sourceBit(source_index), std::memory_order_release);
+    }
 
-            logger_->log("%:% %() % Writing RX:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__,
-                         Common::getCurrentTimeStr(&time_str_), client_request.recv_time_,
-                         client_request.request_.toString());
+    /// A source is active while its producer may still write client requests to it, e.g. while a client session owns
+    /// the ClientId. Sources start inactive. With a window only an active source without pending requests holds back
+    /// the recent requests of the other sources.
+    auto setSourceActive(size_t source_index, bool active) noexcept -> void {
+        if (active)
+            active_[source_index / 64].fetch_or(sourceBit(source_index), std::memory_order_release);
+        else
+            active_[source_index / 64].fetch_and(~sourceBit(source_index), std::memory_order_release);
+    }
 
-            auto next_write = incoming_requests_->getNextToWriteTo();
-            *next_write = std::move(client_request.request_);
-            incoming_requests_->updateWriteIndex();
+    /* 由 order server 的 run 循环调用 */
+    /// Merge the pending client requests of all sources in ascending receive time order and write them to the lock
+    /// free queue for the matching engine to consume from. With a window, while any active source has no pending
+    /// request only the requests received window nanoseconds ago are written. Stops when the matching engine's queue is
+    /// full. Calls fn(const RecvTimeClientRequest&) for every request in order before writing it, the request is
+    /// dropped if fn returns false. Returns the number of requests written.
+    template<typename F>
+    auto sequenceAndPublish(F&& fn) noexcept -> size_t {
+        /* 上一次是空的来源现在可能有请求了，只看生产者标记过的 */
+        for (size_t word = 0; word < ready_.size(); ++word) {
+            if (LIKELY(!ready_[word].load(std::memory_order_relaxed)))
+                continue;
+            for (auto bits = ready_[word].exchange(0, std::memory_order_acquire); bits; bits &= bits - 1) {
+                const auto source_index = word * 64 + std::countr_zero(bits);
+                if (!(in_heap_[word] & sourceBit(source_index)) && sources_[source_index]->size())
+                    pushSource(source_index);
+            }
+        }
+        if (!heap_size_)
+            return 0;
+
+        const auto oldest_unpublishable = (window_ ? Common::getCurrentNanos() - window_ : 0);
+        const auto capacity = incoming_requests_->capacity() - incoming_requests_->size();
+        size_t num_published = 0;
+        while (heap_size_ && num_published < capacity) {
+            const auto source_index = heap_.front().source_;
+            auto source = sources_[source_index];
+            const auto client_request = source->getNextToRead();
+            /* 有空的活跃来源时，它之后可能还会送来比堆顶更早收到的请求 */
+            if (window_ && client_request->recv_time_ > oldest_unpublishable && hasEmptyActiveSource())
+                break;
+
+            if (LIKELY(fn(*client_request))) {
+                logger_->log("%:% %() % Writing RX:% Req:% to FIFO.\n", __FILE__, __LINE__, __FUNCTION__,
+                             Common::getCurrentTimeStr(&time_str_), client_request->recv_time_,
+                             client_request->request_.toString());
+
+                auto next_write = incoming_requests_->getNextToWriteTo();
+                *next_write = client_request->request_;
+                incoming_requests_->updateWriteIndex();
+                ++num_published;
 #ifdef PERF
-            TTT_MEASURE(T2_OrderServer_LFQueue_write, (*logger_));
+                TTT_MEASURE(T2_OrderServer_LFQueue_write, (*logger_));
 #endif
+            }
+
+            source->updateReadIndex();
+            popSource();
+            if (source->size())
+                pushSource(source_index);
         }
 
-        pending_size_ = 0;
+        if (num_published)
+            logger_->log("%:% %() % Published % requests, % sources pending.\n", __FILE__, __LINE__, __FUNCTION__,
+                         Common::getCurrentTimeStr(&time_str_), num_published, heap_size_);
+
+        return num_published;
     }
 
     /// Deleted default, copy & move constructors and assignment-operators.
@@ -75,21 +164,60 @@ private:
     /// Lock free queue used to publish client requests to, so that the matching engine can consume them.
     ClientRequestLFQueue* incoming_requests_ = nullptr;
 
+    /// How long a client request may wait for a source without pending requests to deliver an earlier one.
+    const Nanos window_ = 0;
+
     std::string time_str_;
     Logger* logger_ = nullptr;
 
-    /// A structure that encapsulates the software receive time as well as the client request.
-    struct RecvTimeClientRequest {
+    /// The sources of client requests.
+    std::array<RecvTimeClientRequestLFQueue*, ME_MAX_SEQUENCER_SOURCES> sources_;
+    size_t num_sources_ = 0;
+
+    /// Receive time of the oldest pending client request of a source.
+    struct SourceHead {
         Nanos recv_time_ = 0;
-        MEClientRequest request_;
+        size_t source_ = 0;
 
-        auto operator<(const RecvTimeClientRequest& rhs) const {
-            return (recv_time_ < rhs.recv_time_);
+        /// Ordering of the heap, the earliest receive time and then the lowest source is at the front.
+        auto operator>(const SourceHead& rhs) const {
+            return (recv_time_ > rhs.recv_time_ || (recv_time_ == rhs.recv_time_ && source_ > rhs.source_));
         }
     };
 
-    /// Queue of pending client requests, not sorted.
-    std::array<RecvTimeClientRequest, ME_MAX_PENDING_REQUESTS> pending_client_requests_;
-    size_t pending_size_ = 0;
+    /// Min heap of the sources with pending client requests.
+    std::array<SourceHead, ME_MAX_SEQUENCER_SOURCES> heap_;
+    size_t heap_size_ = 0;
+
+    /// Bitmaps with a bit per source: written to since the sequencer last looked, see sourceReady(), active, see
+    /// setSourceActive(), both set by the producers, and in the heap, only used by the sequencer.
+    std::array<std::atomic<uint64_t>, ME_MAX_SEQUENCER_SOURCES / 64> ready_;
+    std::array<std::atomic<uint64_t>, ME_MAX_SEQUENCER_SOURCES / 64> active_;
+    std::array<uint64_t, ME_MAX_SEQUENCER_SOURCES / 64> in_heap_;
+
+    static auto sourceBit(size_t source_index) noexcept -> uint64_t {
+        return uint64_t{1} << (source_index % 64);
+    }
+
+    /// An active source has no pending client requests in the heap.
+    auto hasEmptyActiveSource() const noexcept {
+        for (size_t word = 0; word < in_heap_.size(); ++word) {
+            if (active_[word].load(std::memory_order_acquire) & ~in_heap_[word])
+                return true;
+        }
+        return false;
+    }
+
+    auto pushSource(size_t source_index) noexcept -> void {
+        heap_[heap_size_++] = SourceHead{sources_[source_index]->getNextToRead()->recv_time_, source_index};
+        std::push_heap(heap_.begin(), heap_.begin() + heap_size_, std::greater<SourceHead>());
+        in_heap_[source_index / 64] |= sourceBit(source_index);
+    }
+
+    auto popSource() noexcept -> void {
+        in_heap_[heap_.front().source_ / 64] &= ~sourceBit(heap_.front().source_);
+        std::pop_heap(heap_.begin(), heap_.begin() + heap_size_, std::greater<SourceHead>());
+        --heap_size_;
+    }
 };
 } // namespace Exchange
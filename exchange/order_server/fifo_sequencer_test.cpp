@@ -0,0 +1,127 @@
+#include <vector>
+
+#include "common/test_utils.h"
+
+#include "order_server/fifo_sequencer.h"
+
+/**
+ * FIFOSequencer 的测试：按接收时间归并各个来源，只看标记过 ready 的来源，
+ * fairness window 只在有空的活跃来源时才让最近收到的请求等待
+ */
+
+namespace
+{
+using namespace Exchange;
+
+constexpr size_t NUM_SOURCES = 3;
+constexpr Nanos WINDOW = 1000 * NANOS_TO_SECS;
+
+/// A FIFO sequencer merging NUM_SOURCES sources, the order id of a request tells it apart.
+class SequencerFixture final {
+public:
+    explicit SequencerFixture(Nanos window)
+        : client_requests_(ME_MAX_CLIENT_UPDATES), logger_("fifo_sequencer_test.log"),
+          fifo_sequencer_(&client_requests_, window, &logger_) {
+        for (size_t i = 0; i < NUM_SOURCES; ++i) {
+            sources_.push_back(new RecvTimeClientRequestLFQueue(ME_MAX_PENDING_REQUESTS));
+            fifo_sequencer_.addSource(sources_.back());
+        }
+    }
+
+    ~SequencerFixture() {
+        for (auto source : sources_)
+            delete source;
+    }
+
+    /// Write a request received at recv_time to the source, marked ready unless ready is false.
+    auto receive(size_t source_index, Nanos recv_time, OrderId order_id, bool ready = true) {
+        const MEClientRequest request{ClientRequestType::NEW, static_cast<ClientId>(source_index), 0, order_id,
+                                      Side::BUY, 100, 10};
+        *sources_[source_index]->getNextToWriteTo() = RecvTimeClientRequest{recv_time, request, false};
+        sources_[source_index]->updateWriteIndex();
+        if (ready)
+            fifo_sequencer_.sourceReady(source_index);
+    }
+
+    /// Sequence and publish, returns the order ids published to the matching engine.
+    auto publish() {
+        fifo_sequencer_.sequenceAndPublish([](const RecvTimeClientRequest&) { return true; });
+        std::vector<OrderId> order_ids;
+        for (auto request = client_requests_.getNextToRead(); request; request = client_requests_.getNextToRead()) {
+            order_ids.push_back(request->order_id_);
+            client_requests_.updateReadIndex();
+        }
+        return order_ids;
+    }
+
+    ClientRequestLFQueue client_requests_;
+    Logger logger_;
+    FIFOSequencer fifo_sequencer_;
+    std::vector<RecvTimeClientRequestLFQueue*> sources_;
+};
+
+auto testMergesByRecvTime() {
+    SequencerFixture f(0);
+    f.receive(0, 10, 1);
+    f.receive(0, 30, 2);
+    f.receive(1, 20, 3);
+    f.receive(2, 10, 4);
+    f.receive(2, 40, 5);
+    // The lower source first on the same receive time.
+    CHECK(f.publish() == std::vector<OrderId>({1, 4, 3, 2, 5}));
+}
+
+auto testOnlyReadySourcesLooked() {
+    SequencerFixture f(0);
+    f.receive(1, 10, 1, false);
+    CHECK(f.publish().empty());
+    f.receive(1, 20, 2);
+    CHECK(f.publish() == std::vector<OrderId>({1, 2}));
+}
+
+auto testWindowWaitsForEmptyActiveSource() {
+    SequencerFixture f(WINDOW);
+    f.fifo_sequencer_.setSourceActive(0, true);
+    f.fifo_sequencer_.setSourceActive(1, true);
+
+    // Source 1 could still deliver an earlier request.
+    const auto now = Common::getCurrentNanos();
+    f.receive(0, now, 1);
+    CHECK(f.publish().empty());
+
+    // Held back until every active source has a pending request.
+    f.receive(1, now - 1, 2);
+    f.receive(1, now + 1, 3);
+    CHECK(f.publish() == std::vector<OrderId>({2, 1}));
+
+    // Requests received before the window are published regardless.
+    f.receive(2, now - 2 * WINDOW, 4);
+    CHECK(f.publish() == std::vector<OrderId>({4}));
+}
+
+auto testWindowIgnoresInactiveSources() {
+    SequencerFixture f(WINDOW);
+    f.fifo_sequencer_.setSourceActive(0, true);
+
+    // Sources 1 and 2 have no client.
+    const auto now = Common::getCurrentNanos();
+    f.receive(0, now, 1);
+    CHECK(f.publish() == std::vector<OrderId>({1}));
+
+    // A source going inactive releases the requests it held back.
+    f.fifo_sequencer_.setSourceActive(1, true);
+    f.receive(0, now + 1, 2);
+    CHECK(f.publish().empty());
+    f.fifo_sequencer_.setSourceActive(1, false);
+    CHECK(f.publish() == std::vector<OrderId>({2}));
+}
+} // namespace
+
+int main(int, char**) {
+    Common::runTest("merges by receive time", testMergesByRecvTime);
+    Common::runTest("only ready sources looked at", testOnlyReadySourcesLooked);
+    Common::runTest("window waits for empty active source", testWindowWaitsForEmptyActiveSource);
+    Common::runTest("window ignores inactive sources", testWindowIgnoresInactiveSources);
+
+    return Common::testResult();
+}
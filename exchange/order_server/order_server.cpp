@@ -1,17 +1,45 @@
 #include "order_server.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
 namespace Exchange
 {
 OrderServer::OrderServer(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses,
-                         const std::string& iface, int port)
-    : iface_(iface), port_(port), outgoing_responses_(client_responses), logger_("exchange_order_server.log"),
-      tcp_server_(logger_), fifo_sequencer_(client_requests, &logger_) {
-    cid_next_outgoing_seq_num_.fill(1);
+                         const std::string& iface, int port, size_t num_network_threads, Nanos sequencer_window,
+                         const ClientThrottleCfg& throttle_cfg, bool cancel_on_disconnect,
+                         Common::TCPBackend tcp_backend)
+    : iface_(iface), port_(port), num_network_threads_(num_network_threads), incoming_requests_(client_requests),
+      outgoing_responses_(client_responses), logger_("exchange_order_server.log"), sessions_(new OSSessions),
+      published_requests_(client_requests->capacity()), cancel_on_disconnect_(cancel_on_disconnect),
+      tcp_backend_(tcp_backend), fifo_sequencer_(client_requests, sequencer_window, &logger_) {
+    ASSERT(num_network_threads_ >= 1 && num_network_threads_ <= OS_MAX_NETWORK_THREADS,
+           "Invalid number of network threads:" + std::to_string(num_network_threads_));
+
+    sessions_->next_outgoing_seq_num_.fill(1);
+    sessions_->next_exp_seq_num_.fill(1);
     cid_next_exp_seq_num_.fill(1);
-    cid_tcp_socket_.fill(nullptr);
+    cid_num_published_.fill(0);
+    cid_unpersisted_exp_seq_num_.fill(0);
+    cid_logged_on_.fill(false);
+    for (auto& throttle : cid_throttle_)
+        throttle.configure(throttle_cfg);
+    for (auto& network_thread : cid_network_thread_)
+        network_thread.store(nullptr);
+    for (auto& requests : cid_requests_) {
+        requests = new RecvTimeClientRequestLFQueue(ME_MAX_PENDING_REQUESTS);
+        fifo_sequencer_.addSource(requests);
+    }
 
-    tcp_server_.recv_callback_ = [this](auto socket, auto rx_time) { recvCallback(socket, rx_time); };
-    tcp_server_.recv_finished_callback_ = [this]() { recvFinishedCallback(); };
+    for (size_t i = 0; i < num_network_threads_; ++i)
+        network_threads_.push_back(new NetworkThread(this, i));
+
+    logger_.log("%:% %() % Order server network threads:% sequencer window:% % cancel on disconnect:% tcp backend:%\n",
+                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), num_network_threads_,
+                sequencer_window, throttle_cfg.toString(), cancel_on_disconnect_,
+                Common::tcpBackendToString(tcp_backend_));
 }
 
 OrderServer::~OrderServer() {
@@ -19,15 +47,107 @@ OrderServer::~OrderServer() {
 
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(1s);
+
+    for (auto network_thread : network_threads_)
+        delete network_thread;
+    network_threads_.clear();
+
+    for (auto& requests : cid_requests_) {
+        delete requests;
+        requests = nullptr;
+    }
+
+    if (sessions_fd_ >= 0) {
+        munmap(sessions_, sizeof(OSSessions));
+        close(sessions_fd_);
+        sessions_fd_ = -1;
+    } else {
+        delete sessions_;
+    }
+    sessions_ = nullptr;
+}
+
+/// Keep the session state of every ClientId in the file at path, created if it does not exist, and resume the sessions
+/// left in it by the order server which used it before. Must be called before start().
+/* 和 ME 的 journal 一样用 flock 防止两个 order server 同时写一个文件，进程退出时内核释放，接管的热备才能打开它 */
+auto OrderServer::persistSessions(const std::string& path) -> void {
+    ASSERT(!run_ && sessions_fd_ < 0, "Sessions persisted to:" + path + " after the order server started.");
+
+    sessions_fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    ASSERT(sessions_fd_ >= 0, "Unable to open session file:" + path + " error:" + std::string(std::strerror(errno)));
+    /* 热备拿到 journal 的 flock 的时候，正在退出的主 exchange 可能还没有释放这个文件的 flock，等它一会儿 */
+    using namespace std::literals::chrono_literals;
+    auto locked = false;
+    for (size_t attempt = 0; attempt < 100 && !(locked = (flock(sessions_fd_, LOCK_EX | LOCK_NB) == 0)); ++attempt)
+        std::this_thread::sleep_for(10ms);
+    ASSERT(locked, "Session file:" + path + " is in use by another order server error:" +
+                       std::string(std::strerror(errno)));
+
+    const auto file_size = lseek(sessions_fd_, 0, SEEK_END);
+    const auto created = (file_size == 0);
+    if (created) {
+        ASSERT(posix_fallocate(sessions_fd_, 0, sizeof(OSSessions)) == 0,
+               "Unable to allocate session file:" + path + " size:" + std::to_string(sizeof(OSSessions)));
+    } else {
+        ASSERT(static_cast<size_t>(file_size) == sizeof(OSSessions),
+               "Session file:" + path + " size:" + std::to_string(file_size) +
+                   " expected:" + std::to_string(sizeof(OSSessions)));
+    }
+
+    const auto mapping =
+        mmap(nullptr, sizeof(OSSessions), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sessions_fd_, 0);
+    ASSERT(mapping != MAP_FAILED,
+           "Unable to mmap session file:" + path + " error:" + std::string(std::strerror(errno)));
+    auto sessions = static_cast<OSSessions*>(mapping);
+
+    /* 新的文件从还没有任何会话的状态开始 */
+    if (created) {
+        std::memcpy(mapping, sessions_, sizeof(OSSessions));
+        ASSERT(msync(mapping, sizeof(OSSessions), MS_SYNC) == 0,
+               "Unable to sync session file:" + path + " error:" + std::string(std::strerror(errno)));
+    }
+    ASSERT(sessions->magic_ == OS_SESSIONS_MAGIC && sessions->version_ == OS_SESSIONS_VERSION &&
+               sessions->response_size_ == sizeof(OMClientResponse) && sessions->num_clients_ == ME_MAX_NUM_CLIENTS &&
+               sessions->history_size_ == OS_RESPONSE_HISTORY_SIZE,
+           "Session file:" + path + " has an unexpected layout version:" + std::to_string(sessions->version_) +
+               " response size:" + std::to_string(sessions->response_size_) + " clients:" +
+               std::to_string(sessions->num_clients_) + " history:" + std::to_string(sessions->history_size_));
+
+    delete sessions_;
+    sessions_ = sessions;
+    cid_next_exp_seq_num_ = sessions_->next_exp_seq_num_;
+    me_response_position_ = sessions_->num_me_responses_;
+
+    size_t num_resumed = 0;
+    for (ClientId client_id = 0; client_id < ME_MAX_NUM_CLIENTS; ++client_id) {
+        num_resumed +=
+            (sessions_->next_outgoing_seq_num_[client_id] > 1 || sessions_->next_exp_seq_num_[client_id] > 1);
+    }
+    logger_.log("%:% %() % Persisting sessions to:% created:% resumed sessions:% recorded responses:%\n", __FILE__,
+                __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), path, created, num_resumed,
+                sessions_->num_me_responses_);
 }
 
-/// Start and stop the order server main thread.
+/// Start and stop the order server threads.
 auto OrderServer::start() -> void {
     run_ = true;
-    tcp_server_.listen(iface_, port_);
 
-    ASSERT(Common::createAndStartThread(-1, "Exchange/OrderServer", [this]() { run(); }) != nullptr,
-           "Failed to start OrderServer thread.");
+    if (!isSharded()) {
+        network_threads_[0]->tcp_server_.listen(iface_, port_);
+        ASSERT(Common::createAndStartThread(-1, "Exchange/OrderServer", [this]() { run(); }) != nullptr,
+               "Failed to start OrderServer thread.");
+        return;
+    }
+
+    /* 每个网络线程都用 SO_REUSEPORT 监听同一个端口，由内核把新连接分给它们 */
+    for (auto network_thread : network_threads_) {
+        network_thread->tcp_server_.listen(iface_, port_, true);
+        ASSERT(Common::createAndStartThread(-1, "Exchange/OrderServer/Network" + std::to_string(network_thread->index_),
+                                            [network_thread]() { network_thread->run(); }) != nullptr,
+               "Failed to start OrderServer network thread:" + std::to_string(network_thread->index_));
+    }
+    ASSERT(Common::createAndStartThread(-1, "Exchange/OrderServer/Sequencer", [this]() { runSequencer(); }) != nullptr,
+           "Failed to start OrderServer sequencer thread.");
 }
 
 auto OrderServer::stop() -> void {
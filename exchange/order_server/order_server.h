@@ -11,21 +11,45 @@
  *  tcp_server_.poll() 轮询 TCP 连接
  *  tcp_server_.sendAndRecv() 接收数据
  *      for 循环调用每个 receive_sockets_ 的 TCPSocket::sendAndRecv()：
- *          recvCallback(TCPSocket* socket, Nanos rx_time) 处理接收到的数据
+ *          NetworkThread::recvCallback(TCPSocket* socket, Nanos rx_time) 处理接收到的数据
  *              for 循环处理接收到的 OMClientRequest：
  *                  if (第一次收到这个 ClientId 的请求) 记录这个 socket
- *                  fifo_sequencer_.sequenceAndPublish() 把请求放入 FIFO sequencer 的 array pending_client_requests_ 中
- *      if (有读到讯息) recv_finished_callback_()
- *          fifo_sequencer_.sequenceAndPublish()
- *              按照事件排序 pending_client_requests_ 中的请求
- *              for 循环排序过的请求写在 LFQueue incoming_requests_ 上等待 Matching Engine 来取
+ *                  if (ClientId 无效或者属于另一个 socket) 在这个 socket 上直接回一个不占序号的 REJECTED
+ *                  if (LOGON) 直接回 LOGGED_ON，告诉客户下一个期望的请求序号，LOGON 本身交给 sequencer 补发回报
+ *                  检查请求序号，再用这个 ClientId 的 token bucket 检查流量限制，不通过的请求标记 reject_reason_
+ *                  把请求写到这个 ClientId 自己的 LFQueue cid_requests_ 里，它是 FIFO sequencer 的一个来源
+ *                  if (这个来源满了) 剩下的数据留在 socket 的缓冲区里，之后再读（backpressure）
  *      for 循环调用每个 send_sockets_ 的 TCPSocket::sendAndRecv()：
  *          把该 socket.outbound_data_ 里的bytes 用 ::send() 发送出去
- *  for 循环读取 outgoing_responses_ 的数据
- *      分两次 send() 封装发送到每个 ClientId 的 TCPSocket 上的 outbound_data_ 缓冲区
+ *  sequenceAndPublish()
+ *      fifo_sequencer_ 按接收时间归并所有 ClientId 的来源，写在 LFQueue incoming_requests_ 上等待 Matching Engine 来取
+ *      有 reject_reason_ 的请求不发布给 ME，直接给客户回一个 REJECTED，和 ME 的回报用同一个序号
+ *      LOGON 不发布给 ME，从 response_history_ 里把客户最后收到的回报之后的回报一次性补发出去
+ *  publishResponses() 循环读取 outgoing_responses_ 的数据
+ *      加上每个 ClientId 的序号封装成 OMClientResponse，send() 到这个 ClientId 的 TCPSocket 上的 outbound_data_ 缓冲区
+ *
+ * 多个网络线程（num_network_threads > 1）：
+ *  每个网络线程有自己的 TCPServer，用 SO_REUSEPORT 监听同一个端口，内核把新连接分给各个线程，连接之后一直由这个线程收发
+ *  NetworkThread::run() 循环：
+ *      poll() / sendAndRecv() 同上，请求同样写到各个 ClientId 的来源里
+ *      把 sequencer 线程路由过来的 responses_ 发送到对应的 socket
+ *  runSequencer() 循环：
+ *      sequenceAndPublish() 同上，归并所有网络线程写进来的请求
+ *      publishResponses() 按 ClientId 找到持有这个客户连接的网络线程，把回报写到那个线程的 responses_
+ *  ClientId 第一次出现时由收到它的网络线程 CAS 占有，之后只有这个线程写它的来源；断线时的 MASS_CANCEL 被发布给 ME 之后
+ *  才由 sequencer 释放，所以重连到另一个线程的客户的新请求一定排在撤单之后
+ *
+ * 会话状态（每个 ClientId 的请求 / 回报序号和回报历史）在 sessions_ 里，persistSessions() 之后它是一个共享映射的文件：
+ *  重启或者热备接管之后的 order server 从文件里接着之前的会话，客户 LOGON 时不会重发已经被 ME 执行过的请求
+ *  - 期望的请求序号等 ME 从队列里取走请求（已经写进 journal）之后才写进文件，网络线程检查序号用的是内存里的副本，
+ *    还在队列里的请求随进程一起丢了，客户 LOGON 之后会重发
+ *  - ME 重启之后重新发出 order server 可能还没有记下的回报，前面是一个 RESENT，带着第一条回报在 ME 回报流里的位置，
+ *    文件里记着已经记下的回报数，之前记下过的回报直接丢掉
  */
 
+#include <atomic>
 #include <functional>
+#include <memory>
 
 #include "common/macros.h"
 #include "common/tcp_server.h"
@@ -33,6 +57,7 @@
 
 #include "order_server/client_request.h"
 #include "order_server/client_response.h"
+#include "order_server/client_throttle.h"
 #include "order_server/fifo_sequencer.h"
 
 #ifdef PERF
@@ -41,157 +66,612 @@
 
 namespace Exchange
 {
+/// Maximum number of network threads of an order server.
+constexpr size_t OS_MAX_NETWORK_THREADS = 16;
+
+/// Number of the most recent client responses of every ClientId kept to be replayed when the client logs on again.
+constexpr size_t OS_RESPONSE_HISTORY_SIZE = 1024;
+
+/// Identifies session files and their layout, a session file written with a different layout is rejected.
+constexpr uint64_t OS_SESSIONS_MAGIC = 0x4e53534553534f; // "OSSESSN"
+constexpr uint32_t OS_SESSIONS_VERSION = 2;
+
+/// The state of the client session of every ClientId, the file format of OrderServer::persistSessions().
+struct OSSessions {
+    uint64_t magic_ = OS_SESSIONS_MAGIC;
+    uint32_t version_ = OS_SESSIONS_VERSION;
+    uint32_t response_size_ = sizeof(OMClientResponse);
+    uint64_t num_clients_ = ME_MAX_NUM_CLIENTS;
+    uint64_t history_size_ = OS_RESPONSE_HISTORY_SIZE;
+
+    /// Number of client responses of the matching engine recorded, the position in its response stream of the next one.
+    uint64_t num_me_responses_ = 0;
+
+    /// Hash map from ClientId -> the next sequence number to be sent on outgoing client responses.
+    std::array<size_t, ME_MAX_NUM_CLIENTS> next_outgoing_seq_num_;
+
+    /// Hash map from ClientId -> the next sequence number expected on incoming client requests once the matching
+    /// engine consumed every request published before, only accessed by the thread sequencing client requests.
+    std::array<size_t, ME_MAX_NUM_CLIENTS> next_exp_seq_num_;
+
+    /// The OS_RESPONSE_HISTORY_SIZE most recent client responses of every ClientId, indexed by ClientId and sequence
+    /// number, only accessed by the thread sequencing client requests.
+    std::array<OMClientResponse, ME_MAX_NUM_CLIENTS * OS_RESPONSE_HISTORY_SIZE> response_history_;
+};
+
 class OrderServer {
 public:
+    /// With a single network thread (the default) one thread accepts, reads, sequences and writes everything. With
+    /// more, every network thread listens on the port with SO_REUSEPORT and owns the sessions the kernel hands it, and
+    /// a sequencer thread merges their requests for the matching engine and routes the responses back by ClientId.
+    /// sequencer_window is the fairness window of the FIFO sequencer, see FIFOSequencer::sequenceAndPublish().
+    /// throttle_cfg is the rate limit of every ClientId, requests over it are rejected without reaching the matching
+    /// engine. With cancel_on_disconnect every order of a client is canceled when its session is lost, otherwise the
+    /// orders stay in the book for the client to log on again and resume the session. tcp_backend is how the network
+    /// threads move data between the kernel and the client sessions, see TCPBackend.
     OrderServer(ClientRequestLFQueue* client_requests, ClientResponseLFQueue* client_responses,
-                const std::string& iface, int port);
+                const std::string& iface, int port, size_t num_network_threads = 1, Nanos sequencer_window = 0,
+                const ClientThrottleCfg& throttle_cfg = {}, bool cancel_on_disconnect = true,
+                Common::TCPBackend tcp_backend = Common::TCPBackend::EPOLL);
 
     ~OrderServer();
 
-    /// Start and stop the order server main thread.
+    /// Keep the session state of every ClientId in the file at path, created if it does not exist, and resume the
+    /// sessions left in it by the order server which used it before, e.g. before a restart or on the primary exchange
+    /// a standby took over from. A client logging on again is then told the request sequence number expected before
+    /// and gets the responses it missed replayed, instead of sending requests again which the matching engine already
+    /// journaled. Must be called before start(). The file is not synced, it survives a crash of the process but not of
+    /// the machine.
+    auto persistSessions(const std::string& path) -> void;
+
+    /// Number of client requests of client_id let through and rejected by its throttle, safe to call from any thread.
+    auto throttleStats(ClientId client_id) const noexcept {
+        return cid_throttle_.at(client_id).stats();
+    }
+
+    /// Start and stop the order server threads.
     auto start() -> void;
 
     auto stop() -> void;
 
-    /// Main run loop for this thread - accepts new client connections, receives client requests from them and sends
-    /// client responses to them.
+    /// Main run loop for this thread with a single network thread - accepts new client connections, receives client
+    /// requests from them and sends client responses to them.
     auto run() noexcept {
         logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+        auto network_thread = network_threads_[0];
         while (run_) {
-            /* 轮询的时候遇到新的连接会创建新的 socket，并且把回调函数设置为和 order_server 一样 */
-            tcp_server_.poll();
+            network_thread->retryBacklog();
+
+            /* 轮询的时候遇到新的连接会创建新的 socket，并且把回调函数设置为和 network thread 一样 */
+            network_thread->tcp_server_.poll();
 
-            /** 
+            /**
              * 接收数据如下：
              * 这个会调用每个 socket 的 TCPSocket::sendAndRecv()
              * 而每个 TCPSocket::sendAndRecv() 里又会调用回调函数
-             * 每个回调函数就是下文的 recvCallback(TCPSocket* socket, Nanos rx_time)
+             * 每个回调函数就是下文的 NetworkThread::recvCallback(TCPSocket* socket, Nanos rx_time)
              * 这里面包含向 sequencer 的接口通道
-             * 
+             *
              * 以下这个 TCPServer::sendAndRecv() 过程中首先检查 read 的 socket，
-             * 如果成功读到内容，还会调用 recv_finished_callback_()
-             * 而 recv_finished_callback_() 就是调用 sequenceAndPublish()，把 sequencer 的 data 推送到最上层（可以直接和ME交互的那一层）
-             * 排序就是在 sequenceAndPublish() 这个过程中进行的
+             * 读到的请求写在各个 ClientId 的来源里
+             */
+            network_thread->tcp_server_.sendAndRecv();
+
+            /**
+             * sequenceAndPublish() 把各个来源的 data 推送到最上层（可以直接和ME交互的那一层）
+             * 按接收时间归并就是在这个过程中进行的
              * 推送是通过写 LFQueue 的方式，这个 LFQueue 就可以直接被 ME 取了
+             * 每一轮都要调用：ME 的队列满了或者有 fairness window 的时候，请求会在来源里等到之后的某一轮
              */
-            tcp_server_.sendAndRecv();
+            sequenceAndPublish();
 
             /**
              * 以下代码主要是处理 send，但是不会立马发送，而是写在缓冲区中。待下一轮 run() 循环才真正随前面代码发送。
              * 这里是直接取的 ME 的讯息了。通过 outgoing_responses_。
              * 所以 ME 发送 responses 的情况下是直接一步就到 socket 了，不需要像 requests 那样还要先经过 sequencer。
              */
-            for (auto client_response = outgoing_responses_->getNextToRead();
-                 outgoing_responses_->size() && client_response;
-                 client_response = outgoing_responses_->getNextToRead()) {
-#ifdef PERF
-                TTT_MEASURE(T5t_OrderServer_LFQueue_read, logger_);
-#endif
-                auto& next_outgoing_seq_num = cid_next_outgoing_seq_num_[client_response->client_id_];
-                logger_.log("%:% %() % Processing cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
-                            Common::getCurrentTimeStr(&time_str_), client_response->client_id_, next_outgoing_seq_num,
-                            client_response->toString());
+            publishResponses();
+        }
+    }
 
-                ASSERT(cid_tcp_socket_[client_response->client_id_] != nullptr,
-                       "Dont have a TCPSocket for ClientId:" + std::to_string(client_response->client_id_));
+    /// Run loop of the sequencer thread with several network threads - merges the client requests read by the network
+    /// threads for the matching engine and routes its client responses to the network threads.
+    auto runSequencer() noexcept {
+        logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+        while (run_) {
+            sequenceAndPublish();
 
-#ifdef PERF
-                START_MEASURE(Exchange_TCPSocket_send);
-#endif
-                /* 拆两步发送成 OMClientResponse */
-                cid_tcp_socket_[client_response->client_id_]->send(&next_outgoing_seq_num,
-                                                                   sizeof(next_outgoing_seq_num));
-                cid_tcp_socket_[client_response->client_id_]->send(client_response, sizeof(MEClientResponse));
-#ifdef PERF                
-                END_MEASURE(Exchange_TCPSocket_send, logger_);
-#endif
+            publishResponses();
+        }
+    }
 
-                outgoing_responses_->updateReadIndex();
-#ifdef PERF
-                TTT_MEASURE(T6t_OrderServer_TCP_write, logger_);
-#endif
+    /// Deleted default, copy & move constructors and assignment-operators.
+    OrderServer() = delete;
+    OrderServer(const OrderServer&) = delete;
+    OrderServer(const OrderServer&&) = delete;
+    OrderServer& operator=(const OrderServer&) = delete;
+    OrderServer& operator=(const OrderServer&&) = delete;
+
+private:
+    /// Owns a TCP server and the client sessions it accepted. Runs on its own thread with several network threads, its
+    /// client responses are then routed to responses_ by the sequencer thread.
+    struct NetworkThread {
+        NetworkThread(OrderServer* order_server, size_t index)
+            : order_server_(order_server), index_(index),
+              own_logger_(order_server->isSharded()
+                              ? new Logger("exchange_order_server_" + std::to_string(index) + ".log")
+                              : nullptr),
+              logger_(own_logger_ ? own_logger_.get() : &order_server->logger_),
+              tcp_server_(*logger_, order_server->tcp_backend_),
+              responses_(order_server->isSharded() ? ME_MAX_CLIENT_UPDATES : 1) {
+            cid_tcp_socket_.fill(nullptr);
+            backlogged_sockets_.reserve(ME_MAX_NUM_CLIENTS);
+            retried_sockets_.reserve(ME_MAX_NUM_CLIENTS);
+
+            tcp_server_.recv_callback_ = [this](auto socket, auto rx_time) { recvCallback(socket, rx_time); };
+            tcp_server_.recv_finished_callback_ = [this]() { recvFinishedCallback(); };
+            tcp_server_.disconnect_callback_ = [this](auto socket) { disconnectCallback(socket); };
+        }
+
+        /// Run loop of this network thread with several network threads - accepts its share of the client connections,
+        /// reads their client requests for the sequencer thread and sends them the client responses routed to it.
+        auto run() noexcept {
+            logger_->log("%:% %() % network thread:%\n", __FILE__, __LINE__, __FUNCTION__,
+                         Common::getCurrentTimeStr(&time_str_), index_);
+            while (order_server_->run_) {
+                retryBacklog();
+
+                tcp_server_.poll();
 
-                ++next_outgoing_seq_num;
+                tcp_server_.sendAndRecv();
+
+                for (auto client_response = responses_.getNextToRead(); client_response;
+                     client_response = responses_.getNextToRead()) {
+                    sendResponse(client_response, 1);
+                    responses_.updateReadIndex();
+                }
             }
         }
-    }
 
-    /// Read client request from the TCP receive buffer, check for sequence gaps and forward it to the FIFO sequencer.
-    auto recvCallback(TCPSocket* socket, Nanos rx_time) noexcept {
+        /// Read client request from the TCP receive buffer, check for sequence gaps and forward it to the FIFO
+        /// sequencer. Stops at the first request whose ClientId's source is full, the socket is then read again by
+        /// retryBacklog().
+        auto recvCallback(TCPSocket* socket, Nanos rx_time) noexcept -> void {
 #ifdef PERF
-        TTT_MEASURE(T1_OrderServer_TCP_read, logger_);
+            TTT_MEASURE(T1_OrderServer_TCP_read, (*logger_));
 #endif
-        logger_.log("%:% %() % Received socket:% len:% rx:%\n", __FILE__, __LINE__, __FUNCTION__,
-                    Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, socket->next_rcv_valid_index_, rx_time);
-
-        if (socket->next_rcv_valid_index_ >= sizeof(OMClientRequest)) {
-            size_t i = 0;
-            for (; i + sizeof(OMClientRequest) <= socket->next_rcv_valid_index_; i += sizeof(OMClientRequest)) {
-                auto request = reinterpret_cast<const OMClientRequest*>(socket->inbound_data_.data() + i);
-                logger_.log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__,
-                            Common::getCurrentTimeStr(&time_str_), request->toString());
-
-                if (UNLIKELY(cid_tcp_socket_[request->me_client_request_.client_id_] ==
-                             nullptr)) { // first message from this ClientId.
-                    cid_tcp_socket_[request->me_client_request_.client_id_] = socket;
+            logger_->log("%:% %() % Received socket:% len:% rx:%\n", __FILE__, __LINE__, __FUNCTION__,
+                         Common::getCurrentTimeStr(&time_str_), socket->socket_fd_, socket->next_rcv_valid_index_,
+                         rx_time);
+
+            if (socket->next_rcv_valid_index_ >= sizeof(OMClientRequest)) {
+                size_t i = 0;
+                for (; i + sizeof(OMClientRequest) <= socket->next_rcv_valid_index_; i += sizeof(OMClientRequest)) {
+                    auto request = reinterpret_cast<const OMClientRequest*>(socket->inbound_data_.data() + i);
+                    logger_->log("%:% %() % Received %\n", __FILE__, __LINE__, __FUNCTION__,
+                                 Common::getCurrentTimeStr(&time_str_), request->toString());
+
+                    const auto client_id = request->me_client_request_.client_id_;
+                    if (UNLIKELY(client_id >= cid_tcp_socket_.size())) {
+                        logger_->log("%:% %() % Received ClientRequest from invalid ClientId:% on socket:%\n",
+                                     __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                                     client_id, socket->socket_fd_);
+                        rejectOnSocket(socket, request->me_client_request_);
+                        continue;
+                    }
+
+                    if (UNLIKELY(cid_tcp_socket_[client_id] == nullptr &&
+                                 order_server_->claimClientId(client_id, this))) { // first message from this ClientId.
+                        cid_tcp_socket_[client_id] = socket;
+                    }
+
+                    if (UNLIKELY(cid_tcp_socket_[client_id] != socket)) {
+                        logger_->log("%:% %() % Received ClientRequest from ClientId:% on different socket:% "
+                                     "expected:% network thread:%\n",
+                                     __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                                     client_id, socket->socket_fd_,
+                                     (cid_tcp_socket_[client_id] ? cid_tcp_socket_[client_id]->socket_fd_ : -1),
+                                     index_);
+                        rejectOnSocket(socket, request->me_client_request_);
+                        continue;
+                    }
+
+                    auto& next_exp_seq_num = order_server_->cid_next_exp_seq_num_[client_id];
+                    /* backpressure：剩下的数据留在 socket 的缓冲区里，最后一个位置留给断线时的 MASS_CANCEL */
+                    auto& requests = *order_server_->cid_requests_[client_id];
+                    if (UNLIKELY(requests.size() + 1 >= requests.capacity())) {
+                        /* 重试时用最近一次读到数据的时间，同一个来源的接收时间不会倒退 */
+                        auto backlogged = std::find_if(backlogged_sockets_.begin(), backlogged_sockets_.end(),
+                                                       [socket](const auto& entry) { return entry.first == socket; });
+                        if (backlogged == backlogged_sockets_.end())
+                            backlogged_sockets_.emplace_back(socket, rx_time);
+                        else
+                            backlogged->second = rx_time;
+                        break;
+                    }
+
+                    if (UNLIKELY(request->me_client_request_.type_ == ClientRequestType::LOGON)) {
+                        logon(socket, rx_time, *request);
+                        continue;
+                    }
+
+                    /* 被拒绝的请求照样经过 sequencer，保证 REJECTED 和其他回报的序号由同一个线程分配 */
+                    auto reject_reason = RejectReason::NONE;
+                    if (UNLIKELY(request->seq_num_ != next_exp_seq_num)) {
+                        logger_->log("%:% %() % Incorrect sequence number. ClientId:% SeqNum expected:% received:%\n",
+                                     __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                                     client_id, next_exp_seq_num, request->seq_num_);
+                        reject_reason = RejectReason::BAD_SEQ_NUM;
+                        /* 跳号：中间的请求已经丢了，从这个请求之后重新同步；重复的请求不改变期望的序号 */
+                        if (request->seq_num_ > next_exp_seq_num)
+                            next_exp_seq_num = request->seq_num_ + 1;
+                    } else {
+                        ++next_exp_seq_num;
+                        if (UNLIKELY(!order_server_->cid_throttle_[client_id].allow(rx_time))) {
+                            logger_->log("%:% %() % Throttled ClientId:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                                         Common::getCurrentTimeStr(&time_str_), client_id, request->toString());
+                            reject_reason = RejectReason::THROTTLED;
+                        }
+                    }
+
+                    // 这里是 TCP connection manager 向 sequencer 的交流接口
+                    addClientRequest(rx_time, request->me_client_request_, false, reject_reason, next_exp_seq_num);
                 }
 
-                if (cid_tcp_socket_[request->me_client_request_.client_id_] !=
-                    socket) { // TODO - change this to send a reject back to the client.
-                    logger_.log("%:% %() % Received ClientRequest from ClientId:% on different socket:% expected:%\n",
-                                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                                request->me_client_request_.client_id_, socket->socket_fd_,
-                                cid_tcp_socket_[request->me_client_request_.client_id_]->socket_fd_);
-                    continue;
-                }
+                /* 把前面已经处理过的数据直接覆盖，并修正 next_rcv_valid_index_ */
+                memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i,
+                       socket->next_rcv_valid_index_ - i);
+                socket->next_rcv_valid_index_ -= i;
+            }
+        }
 
-                auto& next_exp_seq_num = cid_next_exp_seq_num_[request->me_client_request_.client_id_];
-                if (request->seq_num_ != next_exp_seq_num) { // TODO - change this to send a reject back to the client.
-                    logger_.log("%:% %() % Incorrect sequence number. ClientId:% SeqNum expected:% received:%\n",
-                                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                                request->me_client_request_.client_id_, next_exp_seq_num, request->seq_num_);
-                    continue;
-                }
+        /// End of reading incoming messages across all the TCP connections, the client requests are sequenced and
+        /// published to the matching engine by the run loop.
+        auto recvFinishedCallback() noexcept -> void {
+        }
+
+        /// Read the sockets again whose client requests were left in their receive buffers by recvCallback().
+        auto retryBacklog() noexcept -> void {
+            if (LIKELY(backlogged_sockets_.empty()))
+                return;
+
+            std::swap(backlogged_sockets_, retried_sockets_);
+            for (const auto& [socket, rx_time] : retried_sockets_)
+                recvCallback(socket, rx_time);
+            retried_sockets_.clear();
+        }
+
+        /// A client logged on to socket, resynchronize the request sequence numbers, answer with LOGGED_ON and have
+        /// the client responses it missed replayed once the LOGON is sequenced.
+        auto logon(TCPSocket* socket, Nanos rx_time, const OMClientRequest& request) noexcept -> void {
+            const auto client_id = request.me_client_request_.client_id_;
+            auto& next_exp_seq_num = order_server_->cid_next_exp_seq_num_[client_id];
+            logger_->log("%:% %() % ClientId:% logged on socket:% oldest request:% expected:% last response:%\n",
+                         __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id,
+                         socket->socket_fd_, request.seq_num_, next_exp_seq_num, request.me_client_request_.order_id_);
+
+            /* 客户已经不能重发的请求只能当作丢失了 */
+            if (UNLIKELY(request.seq_num_ > next_exp_seq_num)) {
+                logger_->log("%:% %() % ClientId:% lost % requests\n", __FILE__, __LINE__, __FUNCTION__,
+                             Common::getCurrentTimeStr(&time_str_), client_id, request.seq_num_ - next_exp_seq_num);
+                next_exp_seq_num = request.seq_num_;
+            }
+
+            /* LOGGED_ON 不占回报序号，可以由网络线程直接发 */
+            const OMClientResponse logged_on{0, {ClientResponseType::LOGGED_ON, client_id, TickerId_INVALID,
+                                                 next_exp_seq_num, OrderId_INVALID, Side::INVALID, Price_INVALID,
+                                                 Qty_INVALID, Qty_INVALID}};
+            socket->send(&logged_on, sizeof(logged_on));
+
+            addClientRequest(rx_time, request.me_client_request_, false, RejectReason::NONE, next_exp_seq_num);
+        }
+
+        /// Answer a client request from a socket which does not own the session of its ClientId with an unnumbered
+        /// REJECTED response on that socket, the session's own response sequence numbers are left alone.
+        auto rejectOnSocket(TCPSocket* socket, const MEClientRequest& request) noexcept -> void {
+            const OMClientResponse rejected{0, {ClientResponseType::REJECTED, request.client_id_, request.ticker_id_,
+                                                request.order_id_, OrderId_INVALID, request.side_, request.price_,
+                                                Qty_INVALID, request.qty_, RejectReason::BAD_SESSION}};
+            socket->send(&rejected, sizeof(rejected));
+        }
+
+        /// A client connection was closed or failed, cancel every order of the clients which were using it unless the
+        /// order server keeps them for the clients to resume their sessions.
+        /* 断线撤单：在 matcher 里按客户的订单链表一次撤掉，而不是一个订单一个 CANCEL */
+        auto disconnectCallback(TCPSocket* socket) noexcept -> void {
+            std::erase_if(backlogged_sockets_, [socket](const auto& entry) { return entry.first == socket; });
+
+            for (ClientId client_id = 0; client_id < cid_tcp_socket_.size(); ++client_id) {
+                if (cid_tcp_socket_[client_id] != socket) continue;
+
+                logger_->log("%:% %() % ClientId:% disconnected socket:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                             Common::getCurrentTimeStr(&time_str_), client_id, socket->socket_fd_,
+                             order_server_->cid_throttle_[client_id].stats().toString());
+                cid_tcp_socket_[client_id] = nullptr;
+
+                const MEClientRequest mass_cancel{ClientRequestType::MASS_CANCEL, client_id, TickerId_INVALID,
+                                                  OrderId_INVALID, Side::INVALID, Price_INVALID, Qty_INVALID};
+                addClientRequest(Common::getCurrentNanos(), mass_cancel, true, RejectReason::NONE,
+                                 order_server_->cid_next_exp_seq_num_[client_id]);
+            }
+        }
 
-                ++next_exp_seq_num;
+        /// Write a client request read by this network thread to the source of its ClientId in the FIFO sequencer, a
+        /// MASS_CANCEL for a lost session releases the ClientId once it is published and a request with a
+        /// reject_reason is rejected once it is sequenced. next_exp_seq_num is persisted once it is, see
+        /// persistExpSeqNum().
+        auto addClientRequest(Nanos rx_time, const MEClientRequest& request, bool session_lost,
+                              RejectReason reject_reason, size_t next_exp_seq_num) noexcept -> void {
 #ifdef PERF
-                START_MEASURE(Exchange_FIFOSequencer_addClientRequest);
+            START_MEASURE(Exchange_FIFOSequencer_addClientRequest);
 #endif
-                // 这里是 TCP connection manager 向 sequencer 的交流接口
-                fifo_sequencer_.addClientRequest(rx_time, request->me_client_request_);
+            auto& requests = *order_server_->cid_requests_[request.client_id_];
+            *requests.getNextToWriteTo() =
+                RecvTimeClientRequest{rx_time, request, session_lost, reject_reason, next_exp_seq_num};
+            requests.updateWriteIndex();
+            order_server_->fifo_sequencer_.sourceReady(request.client_id_);
 #ifdef PERF
-                END_MEASURE(Exchange_FIFOSequencer_addClientRequest, logger_);
+            END_MEASURE(Exchange_FIFOSequencer_addClientRequest, (*logger_));
 #endif
+        }
+
+        /// Write consecutive client responses of a ClientId to its session, dropped if the session was lost since they
+        /// were routed.
+        auto sendResponse(const OMClientResponse* client_response, size_t num_responses) noexcept -> void {
+            const auto client_id = client_response->me_client_response_.client_id_;
+            if (UNLIKELY(cid_tcp_socket_[client_id] == nullptr)) {
+                logger_->log("%:% %() % Dropping response for disconnected ClientId:% %\n", __FILE__, __LINE__,
+                             __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id,
+                             client_response->toString());
+                return;
             }
 
-            /* 把前面已经处理过的数据直接覆盖，并修正 next_rcv_valid_index_ */
-            memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
-            socket->next_rcv_valid_index_ -= i;
+#ifdef PERF
+            START_MEASURE(Exchange_TCPSocket_send);
+#endif
+            cid_tcp_socket_[client_id]->send(client_response, num_responses * sizeof(OMClientResponse));
+#ifdef PERF
+            END_MEASURE(Exchange_TCPSocket_send, (*logger_));
+#endif
+
+#ifdef PERF
+            TTT_MEASURE(T6t_OrderServer_TCP_write, (*logger_));
+#endif
         }
+
+        OrderServer* order_server_ = nullptr;
+        const size_t index_ = 0;
+
+        std::string time_str_;
+        /// The order server's logger with a single network thread, otherwise a logger of this network thread.
+        std::unique_ptr<Logger> own_logger_;
+        Logger* logger_ = nullptr;
+
+        /// TCP server instance listening for new client connections.
+        Common::TCPServer tcp_server_;
+
+        /// Hash map from ClientId -> TCP socket / client connection, for the ClientIds owned by this network thread.
+        std::array<Common::TCPSocket*, ME_MAX_NUM_CLIENTS> cid_tcp_socket_;
+
+        /// Sockets whose client requests were left in their receive buffers because a source was full, with the
+        /// receive time of the data.
+        std::vector<std::pair<TCPSocket*, Nanos>> backlogged_sockets_, retried_sockets_;
+
+        /// Client responses routed from the sequencer thread, with several network threads.
+        LFQueue<OMClientResponse> responses_;
+    };
+
+    auto isSharded() const noexcept -> bool {
+        return (num_network_threads_ > 1);
     }
 
-    /// End of reading incoming messages across all the TCP connections, sequence and publish the client requests to the
-    /// matching engine.
-    auto recvFinishedCallback() noexcept {
+    /// Make network_thread the owner of client_id, false if another network thread still owns it. The source of an
+    /// owned ClientId is active in the FIFO sequencer.
+    auto claimClientId(ClientId client_id, NetworkThread* network_thread) noexcept -> bool {
+        NetworkThread* expected = nullptr;
+        if (!cid_network_thread_[client_id].compare_exchange_strong(expected, network_thread,
+                                                                     std::memory_order_acq_rel))
+            return false;
+        fifo_sequencer_.setSourceActive(client_id, true);
+        return true;
+    }
+
+    /// Sequence and publish the client requests to the matching engine, releasing the ClientIds whose sessions were
+    /// lost with their MASS_CANCEL so that they can reconnect to any network thread, replaying the client responses
+    /// missed by the clients logging on and rejecting the client requests refused by the network threads.
+    /* 释放 ClientId 之后新的网络线程写进来的请求，一定在这个 MASS_CANCEL 之后才被这个线程取出来发布 */
+    auto sequenceAndPublish() noexcept -> void {
 #ifdef PERF
         START_MEASURE(Exchange_FIFOSequencer_sequenceAndPublish);
 #endif
-        fifo_sequencer_.sequenceAndPublish();
+        persistConsumedRequests();
+
+        const auto num_published = fifo_sequencer_.sequenceAndPublish([this](const RecvTimeClientRequest& request) {
+            const auto client_id = request.request_.client_id_;
+            if (UNLIKELY(request.session_lost_)) {
+                cid_logged_on_[client_id] = false;
+                fifo_sequencer_.setSourceActive(client_id, false);
+                cid_network_thread_[client_id].store(nullptr, std::memory_order_release);
+                if (!cancel_on_disconnect_) {
+                    persistExpSeqNum(client_id, request.next_exp_seq_num_);
+                    return false;
+                }
+                addPublishedRequest(request);
+                return true;
+            }
+            if (UNLIKELY(request.request_.type_ == ClientRequestType::LOGON)) {
+                replayResponses(client_id, request.request_.order_id_);
+                cid_logged_on_[client_id] = true;
+                persistExpSeqNum(client_id, request.next_exp_seq_num_);
+                return false;
+            }
+
+            cid_logged_on_[client_id] = true; // a client which never logs on gets the responses from now on.
+            if (UNLIKELY(request.reject_reason_ != RejectReason::NONE)) {
+                rejectClientRequest(request.request_, request.reject_reason_);
+                persistExpSeqNum(client_id, request.next_exp_seq_num_);
+                return false;
+            }
+            addPublishedRequest(request);
+            return true;
+        });
 #ifdef PERF
-        END_MEASURE(Exchange_FIFOSequencer_sequenceAndPublish, logger_);
+        if (num_published)
+            END_MEASURE(Exchange_FIFOSequencer_sequenceAndPublish, logger_);
+#else
+        (void)num_published;
 #endif
     }
 
-    /// Deleted default, copy & move constructors and assignment-operators.
-    OrderServer() = delete;
-    OrderServer(const OrderServer&) = delete;
-    OrderServer(const OrderServer&&) = delete;
-    OrderServer& operator=(const OrderServer&) = delete;
-    OrderServer& operator=(const OrderServer&&) = delete;
+    /// Track a client request about to be published to the matching engine, the next sequence number expected from its
+    /// client is persisted once the matching engine consumed it.
+    auto addPublishedRequest(const RecvTimeClientRequest& request) noexcept -> void {
+        /* 环满了的时候 ME 一定已经取走了一部分：没取走的请求不会比 ME 的队列能放下的多 */
+        if (UNLIKELY(published_end_ - published_begin_ == published_requests_.size()))
+            persistConsumedRequests();
+
+        const auto client_id = request.request_.client_id_;
+        published_requests_[published_end_++ % published_requests_.size()] = {client_id, request.next_exp_seq_num_,
+                                                                              ++num_published_};
+        cid_num_published_[client_id] = num_published_;
+    }
+
+    /// Persist the next sequence number expected from the client after a client request which does not reach the
+    /// matching engine, once the matching engine consumed the requests of the client published before it.
+    auto persistExpSeqNum(ClientId client_id, size_t next_exp_seq_num) noexcept -> void {
+        if (cid_num_published_[client_id] <= num_published_ - incoming_requests_->size())
+            sessions_->next_exp_seq_num_[client_id] = next_exp_seq_num;
+        else
+            cid_unpersisted_exp_seq_num_[client_id] = next_exp_seq_num;
+    }
+
+    /// Persist the next sequence numbers expected after the client requests the matching engine consumed since the last
+    /// call, it journaled them before taking the next request from its queue.
+    auto persistConsumedRequests() noexcept -> void {
+        if (LIKELY(published_begin_ == published_end_))
+            return;
+
+        const auto num_consumed = num_published_ - incoming_requests_->size();
+        for (; published_begin_ != published_end_; ++published_begin_) {
+            const auto& published = published_requests_[published_begin_ % published_requests_.size()];
+            if (published.num_published_ > num_consumed)
+                break;
+
+            /* 客户最后一个发布的请求被取走之后，它之后被拒绝的请求的序号也可以写进文件了，期望的序号只会增加 */
+            const auto client_id = published.client_id_;
+            sessions_->next_exp_seq_num_[client_id] =
+                (published.num_published_ == cid_num_published_[client_id]
+                     ? std::max(published.next_exp_seq_num_, cid_unpersisted_exp_seq_num_[client_id])
+                     : published.next_exp_seq_num_);
+        }
+    }
+
+    /// Number the client responses published by the matching engine per ClientId and write them to the network thread
+    /// owning the session of the ClientId. The responses the matching engine resends after a restart which were
+    /// recorded before it are dropped.
+    auto publishResponses() noexcept -> void {
+        for (auto client_response = outgoing_responses_->getNextToRead();
+             outgoing_responses_->size() && client_response; client_response = outgoing_responses_->getNextToRead()) {
+#ifdef PERF
+            TTT_MEASURE(T5t_OrderServer_LFQueue_read, logger_);
+#endif
+            if (UNLIKELY(client_response->type_ == ClientResponseType::RESENT)) {
+                logger_.log("%:% %() % Matching engine resends responses from position:% recorded:%\n", __FILE__,
+                            __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                            client_response->market_order_id_, sessions_->num_me_responses_);
+                me_response_position_ = client_response->market_order_id_;
+            } else if (LIKELY(me_response_position_++ >= sessions_->num_me_responses_)) {
+                publishResponse(*client_response, true);
+            } else {
+                logger_.log("%:% %() % Dropping response recorded before the restart %\n", __FILE__, __LINE__,
+                            __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_response->toString());
+            }
+            outgoing_responses_->updateReadIndex();
+        }
+    }
+
+    /// Number a client response per ClientId, keep it in the history of the ClientId and write it to the network
+    /// thread owning the session of the ClientId. me_response is false for the responses of the order server itself.
+    auto publishResponse(const MEClientResponse& client_response, bool me_response) noexcept -> void {
+        const auto client_id = client_response.client_id_;
+        auto& next_outgoing_seq_num = sessions_->next_outgoing_seq_num_[client_id];
+        logger_.log("%:% %() % Processing cid:% seq:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), client_id, next_outgoing_seq_num,
+                    client_response.toString());
+
+        auto& om_client_response = sessions_->response_history_[client_id * OS_RESPONSE_HISTORY_SIZE +
+                                                                 next_outgoing_seq_num % OS_RESPONSE_HISTORY_SIZE];
+        om_client_response = {next_outgoing_seq_num, client_response};
+        ++next_outgoing_seq_num;
+        if (me_response)
+            sessions_->num_me_responses_ = me_response_position_;
+
+        /* 连接已经断开的客户端：回报只留在历史里（包括断线触发的 MASS_CANCELED），客户重新 LOGON 的时候补发 */
+        const auto network_thread = cid_network_thread_[client_id].load(std::memory_order_acquire);
+        if (UNLIKELY(network_thread == nullptr || !cid_logged_on_[client_id])) {
+            logger_.log("%:% %() % Holding response for disconnected ClientId:% %\n", __FILE__, __LINE__,
+                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id, client_response.toString());
+            return;
+        }
+        routeResponses(network_thread, &om_client_response, 1);
+    }
+
+    /// Write consecutive client responses of a ClientId to the network thread owning its session.
+    auto routeResponses(NetworkThread* network_thread, const OMClientResponse* client_responses,
+                        size_t num_responses) noexcept -> void {
+        if (!isSharded()) {
+            network_thread->sendResponse(client_responses, num_responses);
+            return;
+        }
+
+        for (size_t i = 0; i < num_responses; ++i) {
+            *network_thread->responses_.getNextToWriteTo() = client_responses[i];
+            network_thread->responses_.updateWriteIndex();
+        }
+    }
+
+    /// Send the client responses after last_seq_num still in the history of client_id again, to the session it just
+    /// logged on to. A last_seq_num of 0 starts a new session without replaying anything.
+    /* 历史是一个环，补发的回报最多分成两段连续的内存，写进 socket 的发送缓冲区之后一次 send() 发出去 */
+    auto replayResponses(ClientId client_id, size_t last_seq_num) noexcept -> void {
+        const auto next_outgoing_seq_num = sessions_->next_outgoing_seq_num_[client_id];
+        const auto network_thread = cid_network_thread_[client_id].load(std::memory_order_acquire);
+        if (!last_seq_num || last_seq_num + 1 >= next_outgoing_seq_num || network_thread == nullptr)
+            return;
+
+        auto first_seq_num = last_seq_num + 1;
+        if (UNLIKELY(next_outgoing_seq_num - first_seq_num > OS_RESPONSE_HISTORY_SIZE)) {
+            logger_.log("%:% %() % ClientId:% lost % responses older than the history\n", __FILE__, __LINE__,
+                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id,
+                        next_outgoing_seq_num - OS_RESPONSE_HISTORY_SIZE - first_seq_num);
+            first_seq_num = next_outgoing_seq_num - OS_RESPONSE_HISTORY_SIZE;
+        }
+        logger_.log("%:% %() % Replaying responses seq:% to seq:% to ClientId:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), first_seq_num, next_outgoing_seq_num - 1, client_id);
+
+        const auto history = &sessions_->response_history_[client_id * OS_RESPONSE_HISTORY_SIZE];
+        const auto first_index = first_seq_num % OS_RESPONSE_HISTORY_SIZE;
+        const auto num_responses = next_outgoing_seq_num - first_seq_num;
+        const auto num_before_wrap = std::min(num_responses, OS_RESPONSE_HISTORY_SIZE - first_index);
+        routeResponses(network_thread, history + first_index, num_before_wrap);
+        if (num_responses > num_before_wrap)
+            routeResponses(network_thread, history, num_responses - num_before_wrap);
+    }
+
+    /// Answer a client request which does not reach the matching engine with a REJECTED response.
+    auto rejectClientRequest(const MEClientRequest& request, RejectReason reject_reason) noexcept -> void {
+        publishResponse({ClientResponseType::REJECTED, request.client_id_, request.ticker_id_, request.order_id_,
+                         OrderId_INVALID, request.side_, request.price_, Qty_INVALID, request.qty_, reject_reason},
+                        false);
+    }
 
-private:
     const std::string iface_;
     const int port_ = 0;
+    const size_t num_network_threads_ = 1;
+
+    /// Lock free queue of client requests published to the matching engine, only used here to tell how many it
+    /// consumed.
+    ClientRequestLFQueue* incoming_requests_ = nullptr;
 
     /// Lock free queue of outgoing client responses to be sent out to connected clients.
     ClientResponseLFQueue* outgoing_responses_ = nullptr;
@@ -201,17 +681,57 @@ private:
     std::string time_str_;
     Logger logger_;
 
-    /// Hash map from ClientId -> the next sequence number to be sent on outgoing client responses.
-    std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_outgoing_seq_num_;
+    /// Sequence numbers and response history of the client sessions, mapped from the session file given to
+    /// persistSessions() or allocated by the order server.
+    OSSessions* sessions_ = nullptr;
+    int sessions_fd_ = -1;
 
-    /// Hash map from ClientId -> the next sequence number expected on incoming client requests.
+    /// Hash map from ClientId -> the next sequence number expected on incoming client requests, only accessed by the
+    /// network thread owning the ClientId. Persisted to sessions_ once the request is consumed by the matching engine.
     std::array<size_t, ME_MAX_NUM_CLIENTS> cid_next_exp_seq_num_;
 
-    /// Hash map from ClientId -> TCP socket / client connection.
-    std::array<Common::TCPSocket*, ME_MAX_NUM_CLIENTS> cid_tcp_socket_;
+    /// A client request published to the matching engine, num_published_ counts the requests published up to it.
+    struct PublishedRequest {
+        ClientId client_id_ = ClientId_INVALID;
+        size_t next_exp_seq_num_ = 0;
+        size_t num_published_ = 0;
+    };
+
+    /// The published client requests whose next expected sequence numbers are not persisted yet, from published_begin_
+    /// to published_end_ in a ring as large as the matching engine's queue. Only accessed by the thread sequencing
+    /// client requests, like the members below.
+    std::vector<PublishedRequest> published_requests_;
+    size_t published_begin_ = 0;
+    size_t published_end_ = 0;
+    size_t num_published_ = 0;
+
+    /// Hash map from ClientId -> num_published_ of its last published client request, and the next sequence number
+    /// expected after its requests rejected since, persisted once the matching engine consumed that request.
+    std::array<size_t, ME_MAX_NUM_CLIENTS> cid_num_published_;
+    std::array<size_t, ME_MAX_NUM_CLIENTS> cid_unpersisted_exp_seq_num_;
+
+    /// Position in the response stream of the matching engine of the next client response read from it, see
+    /// ClientResponseType::RESENT.
+    size_t me_response_position_ = 0;
+
+    /// Hash map from ClientId -> whether its session receives client responses, only accessed by the thread
+    /// sequencing client requests. Set once its LOGON or first client request is sequenced.
+    std::array<bool, ME_MAX_NUM_CLIENTS> cid_logged_on_;
+
+    const bool cancel_on_disconnect_ = true;
+    const Common::TCPBackend tcp_backend_ = Common::TCPBackend::EPOLL;
+
+    /// Hash map from ClientId -> its rate limit, only checked by the network thread owning the ClientId.
+    std::array<ClientThrottle, ME_MAX_NUM_CLIENTS> cid_throttle_;
+
+    /// Hash map from ClientId -> network thread owning its session, nullptr if it has none.
+    std::array<std::atomic<NetworkThread*>, ME_MAX_NUM_CLIENTS> cid_network_thread_;
+
+    /// Hash map from ClientId -> its client requests waiting to be sequenced, a source of the FIFO sequencer written
+    /// only by the network thread owning the ClientId.
+    std::array<RecvTimeClientRequestLFQueue*, ME_MAX_NUM_CLIENTS> cid_requests_;
 
-    /// TCP server instance listening for new client connections.
-    Common::TCPServer tcp_server_;
+    std::vector<NetworkThread*> network_threads_;
 
     /// FIFO sequencer responsible for making sure incoming client requests are processed in the order in which they
     /// were received.
@@ -0,0 +1,395 @@
+#include <vector>
+
+#include "common/test_utils.h"
+
+#include "order_server/order_server.h"
+
+/**
+ * OrderServer 的会话测试：客户端是直接收发 OMClientRequest / OMClientResponse 的 TCPSocket，
+ * 测试代码同时扮演 ME，从请求队列里取请求，往回报队列里写回报；每个 ClientId 的流量限制是 1 个请求每秒，最多连续 3 个
+ * 每个 TCPSocket 有 128MB 的缓冲区，所以只用很少几个连接，各个用例用不同的 ClientId
+ * 重启之前的 order server 不会关闭监听的 socket，重启之后的 order server 换一个端口
+ */
+
+namespace
+{
+using namespace Exchange;
+
+constexpr int PORT = 12700;
+constexpr Nanos TIMEOUT = 5 * NANOS_TO_SECS;
+constexpr ClientThrottleCfg THROTTLE_CFG{1, 3};
+const std::string SESSIONS_PATH = "order_server_test.sessions";
+
+/// A client session talking to the order server.
+class Client final {
+public:
+    explicit Client(Logger& logger) : socket_(logger) {
+        socket_.recv_callback_ = [this](auto socket, auto) {
+            size_t i = 0;
+            for (; i + sizeof(OMClientResponse) <= socket->next_rcv_valid_index_; i += sizeof(OMClientResponse))
+                responses_.push_back(*reinterpret_cast<const OMClientResponse*>(socket->inbound_data_.data() + i));
+            memmove(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+            socket->next_rcv_valid_index_ -= i;
+        };
+    }
+
+    auto connect(int port = PORT) {
+        ASSERT(socket_.connect("127.0.0.1", "lo", port, false) >= 0,
+               "Client failed to connect. error:" + std::string(std::strerror(errno)));
+    }
+
+    auto close() {
+        socket_.close();
+        responses_.clear();
+    }
+
+    auto send(size_t seq_num, const MEClientRequest& request) {
+        const OMClientRequest om_client_request{seq_num, request};
+        socket_.send(&om_client_request, sizeof(om_client_request));
+        socket_.sendAndRecv();
+    }
+
+    /// Log on until the order server answers with LOGGED_ON, returns it. Retried while the order server has not seen
+    /// the previous session of the ClientId go away yet and rejects the LOGON.
+    auto logon(ClientId client_id, size_t oldest_seq_num, size_t last_response_seq_num) {
+        const MEClientRequest logon{ClientRequestType::LOGON, client_id,     TickerId_INVALID, last_response_seq_num,
+                                    Side::INVALID,            Price_INVALID, Qty_INVALID};
+        for (auto start = Common::getCurrentNanos(); Common::getCurrentNanos() - start < TIMEOUT;) {
+            responses_.clear();
+            send(oldest_seq_num, logon);
+            if (waitFor(1)) {
+                const auto response = responses_.front();
+                responses_.erase(responses_.begin());
+                if (response.me_client_response_.type_ == ClientResponseType::LOGGED_ON)
+                    return response.me_client_response_;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        FATAL("Client " + std::to_string(client_id) + " could not log on.");
+        return MEClientResponse{};
+    }
+
+    /// Wait until num_responses responses were received, false on timeout.
+    auto waitFor(size_t num_responses) -> bool {
+        for (auto start = Common::getCurrentNanos(); Common::getCurrentNanos() - start < TIMEOUT;) {
+            socket_.sendAndRecv();
+            if (responses_.size() >= num_responses)
+                return true;
+        }
+        return false;
+    }
+
+    Common::TCPSocket socket_;
+    std::vector<OMClientResponse> responses_;
+};
+
+/// An order server whose matching engine is the test itself.
+class OrderServerFixture final {
+public:
+    OrderServerFixture()
+        : client_requests_(ME_MAX_CLIENT_UPDATES), client_responses_(ME_MAX_CLIENT_UPDATES),
+          logger_("order_server_test.log") {
+        order_server_ = new OrderServer(&client_requests_, &client_responses_, "lo", PORT, 1, 0, THROTTLE_CFG, false);
+        order_server_->start();
+    }
+
+    ~OrderServerFixture() {
+        delete order_server_;
+    }
+
+    /// Replace the order server, once it published every client response, by a new one listening on port and
+    /// persisting its sessions to sessions_path, as after a restart of the exchange. The client requests the matching
+    /// engine did not consume yet are lost with it.
+    auto restart(int port, const std::string& sessions_path, bool cancel_on_disconnect = false) {
+        for (auto start = Common::getCurrentNanos();
+             client_responses_.size() && Common::getCurrentNanos() - start < TIMEOUT;)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        delete order_server_;
+        while (client_requests_.getNextToRead())
+            client_requests_.updateReadIndex();
+        order_server_ = new OrderServer(&client_requests_, &client_responses_, "lo", port, 1, 0, THROTTLE_CFG,
+                                        cancel_on_disconnect);
+        order_server_->persistSessions(sessions_path);
+        order_server_->start();
+    }
+
+    /// Publish a client response from the matching engine.
+    auto respond(const MEClientResponse& client_response) {
+        *client_responses_.getNextToWriteTo() = client_response;
+        client_responses_.updateWriteIndex();
+    }
+
+    /// Wait until num_requests client requests were published to the matching engine, returns them.
+    auto waitForRequests(size_t num_requests) {
+        std::vector<MEClientRequest> requests;
+        for (auto start = Common::getCurrentNanos();
+             requests.size() < num_requests && Common::getCurrentNanos() - start < TIMEOUT;) {
+            for (auto request = client_requests_.getNextToRead(); request; request = client_requests_.getNextToRead()) {
+                requests.push_back(*request);
+                client_requests_.updateReadIndex();
+            }
+        }
+        return requests;
+    }
+
+    ClientRequestLFQueue client_requests_;
+    ClientResponseLFQueue client_responses_;
+    Logger logger_;
+    OrderServer* order_server_ = nullptr;
+};
+
+/// A response the matching engine publishes for client_id, tagged with tag to tell it apart.
+auto makeResponse(ClientId client_id, OrderId tag) {
+    return MEClientResponse{ClientResponseType::ACCEPTED, client_id, 0, tag, tag, Side::BUY, 100, 0, 10};
+}
+
+/// A NEW order of client_id, the order id tells the requests apart.
+auto makeRequest(ClientId client_id, OrderId order_id) {
+    return MEClientRequest{ClientRequestType::NEW, client_id, 0, order_id, Side::BUY, 100, 10};
+}
+
+/// The response is a REJECTED of the order with the sequence number and reason.
+auto isRejected(const OMClientResponse& response, size_t seq_num, OrderId order_id, RejectReason reject_reason) {
+    return response.seq_num_ == seq_num && response.me_client_response_.type_ == ClientResponseType::REJECTED &&
+           response.me_client_response_.client_order_id_ == order_id &&
+           response.me_client_response_.reject_reason_ == reject_reason;
+}
+
+/// The responses are the consecutive responses made by makeResponse() starting at first_seq_num, numbered by their tag.
+auto checkConsecutive(const std::vector<OMClientResponse>& responses, size_t first_seq_num, size_t num_responses) {
+    if (!CHECK_EQ(responses.size(), num_responses))
+        return;
+    for (size_t i = 0; i < responses.size(); ++i) {
+        if (!CHECK(responses[i].seq_num_ == first_seq_num + i &&
+                   responses[i].me_client_response_.client_order_id_ == first_seq_num + i))
+            return;
+    }
+}
+
+auto testReplayWrapsHistory(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 10;
+
+    const auto logged_on = client.logon(client_id, 1, 0);
+    CHECK_EQ(logged_on.client_order_id_, 1u);
+
+    // More responses than the history holds while connected.
+    const size_t num_connected = 2 * OS_RESPONSE_HISTORY_SIZE - 48;
+    for (size_t seq_num = 1; seq_num <= num_connected; ++seq_num)
+        f.respond(makeResponse(client_id, seq_num));
+    CHECK(client.waitFor(num_connected));
+    checkConsecutive(client.responses_, 1, num_connected);
+
+    // Held while disconnected, the ring wraps in the middle of them.
+    client.close();
+    const size_t num_missed = 100;
+    for (auto seq_num = num_connected + 1; seq_num <= num_connected + num_missed; ++seq_num)
+        f.respond(makeResponse(client_id, seq_num));
+
+    client.connect();
+    client.logon(client_id, 1, num_connected);
+    CHECK(client.waitFor(num_missed));
+    checkConsecutive(client.responses_, num_connected + 1, num_missed);
+
+    // Logging on with responses older than the history missing gets the whole history.
+    const auto last_seq_num = num_connected + num_missed;
+    client.close();
+    client.connect();
+    client.logon(client_id, 1, 500);
+    CHECK(client.waitFor(OS_RESPONSE_HISTORY_SIZE));
+    checkConsecutive(client.responses_, last_seq_num - OS_RESPONSE_HISTORY_SIZE + 1, OS_RESPONSE_HISTORY_SIZE);
+
+    // Nothing is replayed when nothing was missed, new responses carry on from the last one.
+    client.close();
+    client.connect();
+    client.logon(client_id, 1, last_seq_num);
+    f.respond(makeResponse(client_id, last_seq_num + 1));
+    CHECK(client.waitFor(1));
+    checkConsecutive(client.responses_, last_seq_num + 1, 1);
+}
+
+auto testBadSeqNum(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 20;
+    client.logon(client_id, 1, 0);
+    client.send(1, makeRequest(client_id, 1));
+    auto requests = f.waitForRequests(1);
+    CHECK(requests.size() == 1 && requests[0].order_id_ == 1);
+
+    // A duplicate is rejected, the expected sequence number stays.
+    client.send(1, makeRequest(client_id, 2));
+    CHECK(client.waitFor(1));
+    CHECK(!client.responses_.empty() && isRejected(client.responses_[0], 1, 2, RejectReason::BAD_SEQ_NUM));
+
+    // A gap is rejected, the sequence numbers resynchronize after it.
+    client.send(5, makeRequest(client_id, 3));
+    CHECK(client.waitFor(2));
+    CHECK(client.responses_.size() == 2 && isRejected(client.responses_[1], 2, 3, RejectReason::BAD_SEQ_NUM));
+    client.send(6, makeRequest(client_id, 4));
+
+    // Only the request after the gap reached the matching engine, its response is numbered after the REJECTED ones.
+    requests = f.waitForRequests(1);
+    CHECK(requests.size() == 1 && requests[0].order_id_ == 4);
+    f.respond(makeResponse(client_id, 4));
+    CHECK(client.waitFor(3));
+    CHECK(client.responses_.size() == 3 && client.responses_[2].seq_num_ == 3 &&
+          client.responses_[2].me_client_response_.type_ == ClientResponseType::ACCEPTED);
+}
+
+auto testThrottled(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 21;
+    client.logon(client_id, 1, 0);
+    const size_t num_sent = THROTTLE_CFG.burst_ + 2;
+    for (size_t seq_num = 1; seq_num <= num_sent; ++seq_num)
+        client.send(seq_num, makeRequest(client_id, seq_num));
+
+    const auto requests = f.waitForRequests(THROTTLE_CFG.burst_);
+    CHECK(requests.size() == THROTTLE_CFG.burst_ && requests.back().order_id_ == THROTTLE_CFG.burst_);
+    CHECK(client.waitFor(num_sent - THROTTLE_CFG.burst_));
+    CHECK(client.responses_.size() == num_sent - THROTTLE_CFG.burst_ &&
+          isRejected(client.responses_[0], 1, THROTTLE_CFG.burst_ + 1, RejectReason::THROTTLED) &&
+          isRejected(client.responses_[1], 2, THROTTLE_CFG.burst_ + 2, RejectReason::THROTTLED));
+}
+
+auto testBadSession(OrderServerFixture& f, Client& client, Client& other) {
+    // ClientId 20 belongs to the session of the first client.
+    const ClientId client_id = 20;
+    other.connect();
+    other.send(7, makeRequest(client_id, 5));
+    other.send(1, {ClientRequestType::LOGON, client_id, TickerId_INVALID, 0, Side::INVALID, Price_INVALID,
+                   Qty_INVALID});
+    other.send(1, makeRequest(ME_MAX_NUM_CLIENTS, 6));
+    CHECK(other.waitFor(3));
+    CHECK(other.responses_.size() == 3 && isRejected(other.responses_[0], 0, 5, RejectReason::BAD_SESSION) &&
+          other.responses_[1].me_client_response_.type_ == ClientResponseType::REJECTED &&
+          other.responses_[1].me_client_response_.reject_reason_ == RejectReason::BAD_SESSION &&
+          isRejected(other.responses_[2], 0, 6, RejectReason::BAD_SESSION));
+    other.close();
+
+    // The session keeps its sequence numbers.
+    client.responses_.clear();
+    f.respond(makeResponse(client_id, 5));
+    CHECK(client.waitFor(1));
+    CHECK(!client.responses_.empty() && client.responses_[0].seq_num_ == 4);
+    CHECK(f.waitForRequests(1).empty());
+}
+
+auto testResumesAcrossRestart(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 30;
+    std::remove(SESSIONS_PATH.c_str());
+    f.restart(PORT + 1, SESSIONS_PATH);
+    client.close();
+    client.connect(PORT + 1);
+    client.logon(client_id, 1, 0);
+    client.send(1, makeRequest(client_id, 1));
+    client.send(2, makeRequest(client_id, 2));
+    CHECK_EQ(f.waitForRequests(2).size(), 2u);
+    for (OrderId tag = 1; tag <= 3; ++tag)
+        f.respond(makeResponse(client_id, tag));
+    CHECK(client.waitFor(3));
+    checkConsecutive(client.responses_, 1, 3);
+
+    // A response published while the client is away, held by the order server going down.
+    client.close();
+    f.respond(makeResponse(client_id, 4));
+    f.restart(PORT + 2, SESSIONS_PATH);
+
+    // The requests the matching engine already has are not expected again, the held response is replayed.
+    client.connect(PORT + 2);
+    const auto logged_on = client.logon(client_id, 1, 3);
+    CHECK_EQ(logged_on.client_order_id_, 3u);
+    CHECK(client.waitFor(1));
+    checkConsecutive(client.responses_, 4, 1);
+
+    // The session carries on.
+    client.send(3, makeRequest(client_id, 3));
+    const auto requests = f.waitForRequests(1);
+    CHECK(requests.size() == 1 && requests[0].order_id_ == 3);
+    f.respond(makeResponse(client_id, 5));
+    CHECK(client.waitFor(2));
+    checkConsecutive(client.responses_, 4, 2);
+}
+
+auto testRestartLosesUnconsumed(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 31;
+    const std::string sessions_path = "order_server_test_2.sessions";
+    std::remove(sessions_path.c_str());
+    f.restart(PORT + 3, sessions_path);
+    client.close();
+    client.connect(PORT + 3);
+    client.logon(client_id, 1, 0);
+    client.send(1, makeRequest(client_id, 1));
+    CHECK_EQ(f.waitForRequests(1).size(), 1u);
+    f.respond(makeResponse(client_id, 1));
+    CHECK(client.waitFor(1));
+
+    // The second request is published but the matching engine goes down before consuming it.
+    client.send(2, makeRequest(client_id, 2));
+    for (auto start = Common::getCurrentNanos();
+         f.client_requests_.size() != 1 && Common::getCurrentNanos() - start < TIMEOUT;)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK_EQ(f.client_requests_.size(), 1u);
+    f.restart(PORT + 4, sessions_path);
+
+    // The restarted matching engine resends the responses from the start of its stream, the recorded one is dropped.
+    f.respond({ClientResponseType::RESENT, ClientId_INVALID, TickerId_INVALID, OrderId_INVALID, 0, Side::INVALID,
+               Price_INVALID, Qty_INVALID, Qty_INVALID});
+    f.respond(makeResponse(client_id, 1));
+    f.respond(makeResponse(client_id, 2));
+
+    // The lost request is expected again, the resent response which was not recorded is replayed.
+    client.close();
+    client.connect(PORT + 4);
+    const auto logged_on = client.logon(client_id, 1, 1);
+    CHECK_EQ(logged_on.client_order_id_, 2u);
+    CHECK(client.waitFor(1));
+    checkConsecutive(client.responses_, 2, 1);
+
+    client.send(2, makeRequest(client_id, 2));
+    const auto requests = f.waitForRequests(1);
+    CHECK(requests.size() == 1 && requests[0].order_id_ == 2);
+    f.respond(makeResponse(client_id, 3));
+    CHECK(client.waitFor(2));
+    checkConsecutive(client.responses_, 2, 2);
+}
+
+auto testCancelOnDisconnect(OrderServerFixture& f, Client& client) {
+    const ClientId client_id = 32;
+    const std::string sessions_path = "order_server_test_3.sessions";
+    std::remove(sessions_path.c_str());
+    f.restart(PORT + 5, sessions_path, true);
+    client.close();
+    client.connect(PORT + 5);
+    client.logon(client_id, 1, 0);
+    client.send(1, makeRequest(client_id, 1));
+    CHECK_EQ(f.waitForRequests(1).size(), 1u);
+
+    // The MASS_CANCEL of the lost session reaches the matching engine before the requests of the new one.
+    client.close();
+    client.connect(PORT + 5);
+    client.logon(client_id, 2, 0);
+    client.send(2, makeRequest(client_id, 2));
+    const auto requests = f.waitForRequests(2);
+    CHECK(requests.size() == 2 && requests[0].type_ == ClientRequestType::MASS_CANCEL &&
+          requests[0].client_id_ == client_id && requests[0].ticker_id_ == TickerId_INVALID &&
+          requests[0].side_ == Side::INVALID && requests[1].type_ == ClientRequestType::NEW &&
+          requests[1].order_id_ == 2);
+}
+} // namespace
+
+int main(int, char**) {
+    OrderServerFixture fixture;
+    Client client(fixture.logger_);
+    client.connect();
+
+    Common::runTest("replay wraps history", [&]() { testReplayWrapsHistory(fixture, client); });
+    Common::runTest("bad seq num", [&]() { testBadSeqNum(fixture, client); });
+    Common::runTest("throttled", [&]() { testThrottled(fixture, client); });
+    Common::runTest("bad session", [&]() {
+        Client other(fixture.logger_);
+        testBadSession(fixture, client, other);
+    });
+    Common::runTest("resumes across restart", [&]() { testResumesAcrossRestart(fixture, client); });
+    Common::runTest("restart loses unconsumed requests", [&]() { testRestartLosesUnconsumed(fixture, client); });
+    Common::runTest("cancel on disconnect", [&]() { testCancelOnDisconnect(fixture, client); });
+
+    return Common::testResult();
+}
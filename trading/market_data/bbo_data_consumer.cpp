@@ -0,0 +1,91 @@
+#include "bbo_data_consumer.h"
+
+namespace Trading
+{
+BBODataConsumer::BBODataConsumer(Common::ClientId client_id, Exchange::MEBBOUpdateLFQueue* bbo_updates,
+                                 const std::string& iface, const Exchange::MDChannelsCfg& channels_cfg,
+                                 const TradeEngineCfgHashMap& ticker_cfg)
+    : incoming_bbo_updates_(bbo_updates), run_(false),
+      logger_("trading_bbo_data_consumer_" + std::to_string(client_id) + ".log"), channels_cfg_(channels_cfg) {
+    ASSERT(channels_cfg_.bbo_feed_, "BBO feed is not enabled in " + channels_cfg_.toString());
+
+    /* 和 MarketDataConsumer 一样，只加入配置了的 ticker 所在的 channel */
+    std::array<bool, Exchange::ME_MAX_MD_CHANNELS> needed_channels{};
+    auto have_configured_ticker = false;
+    for (TickerId ticker_id = 0; ticker_id < ticker_cfg.size(); ++ticker_id) {
+        if (ticker_cfg.at(ticker_id).clip_) {
+            needed_channels.at(channels_cfg_.channelForTicker(ticker_id)) = true;
+            have_configured_ticker = true;
+        }
+    }
+    if (!have_configured_ticker) // no per ticker configuration, join every channel.
+        needed_channels.fill(true);
+
+    for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+        if (!needed_channels.at(channel)) continue;
+
+        const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+        auto& channel_state = channels_.at(channel);
+        logger_.log("%:% %() % Joining channel:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), channel, channel_cfg.toString());
+
+        channel_state.mcast_socket_ = new Common::McastSocket(logger_);
+        channel_state.mcast_socket_->recv_callback_ = [this, channel](auto socket) { recvCallback(socket, channel); };
+        ASSERT(channel_state.mcast_socket_->init(channel_cfg.bbo_ip_, iface, channel_cfg.bbo_port_,
+                                                 /*is_listening*/ true) >= 0,
+               "Unable to create BBO mcast socket. error:" + std::string(std::strerror(errno)));
+
+        ASSERT(channel_state.mcast_socket_->join(channel_cfg.bbo_ip_),
+               "Join failed on:" + std::to_string(channel_state.mcast_socket_->socket_fd_) +
+                   " error:" + std::string(std::strerror(errno)));
+    }
+}
+
+/// Main loop for this thread - reads and processes messages from the multicast sockets.
+auto BBODataConsumer::run() noexcept -> void {
+    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+    while (run_) {
+        for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+            if (channels_[channel].mcast_socket_)
+                channels_[channel].mcast_socket_->sendAndRecv();
+        }
+    }
+}
+
+/// Process top of book updates received on the provided channel.
+auto BBODataConsumer::recvCallback(McastSocket* socket, size_t channel) noexcept -> void {
+    auto& channel_state = channels_.at(channel);
+
+    if (socket->next_rcv_valid_index_ >= sizeof(Exchange::MDPBBOUpdate)) {
+        size_t i = 0;
+        for (; i + sizeof(Exchange::MDPBBOUpdate) <= socket->next_rcv_valid_index_;
+             i += sizeof(Exchange::MDPBBOUpdate)) {
+            auto request = reinterpret_cast<const Exchange::MDPBBOUpdate*>(socket->inbound_data_.data() + i);
+            logger_.log("%:% %() % Received socket len:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), sizeof(Exchange::MDPBBOUpdate), request->toString());
+
+            if (UNLIKELY(request->seq_num_ < channel_state.next_exp_seq_num_)) { // older than what we already have.
+                logger_.log("%:% %() % Discarding stale update channel:% expected:% received:%\n", __FILE__,
+                            __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), channel,
+                            channel_state.next_exp_seq_num_, request->seq_num_);
+                continue;
+            }
+
+            if (UNLIKELY(request->seq_num_ != channel_state.next_exp_seq_num_)) {
+                channel_state.num_dropped_ += request->seq_num_ - channel_state.next_exp_seq_num_;
+                logger_.log("%:% %() % Packet drops on channel:%. SeqNum expected:% received:% total dropped:%\n",
+                            __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), channel,
+                            channel_state.next_exp_seq_num_, request->seq_num_, channel_state.num_dropped_);
+            }
+
+            channel_state.next_exp_seq_num_ = request->seq_num_ + 1;
+
+            auto next_write = incoming_bbo_updates_->getNextToWriteTo();
+            *next_write = request->me_bbo_update_;
+            incoming_bbo_updates_->updateWriteIndex();
+        }
+        memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+        socket->next_rcv_valid_index_ -= i;
+    }
+}
+} // namespace Trading
@@ -0,0 +1,93 @@
+#pragma once
+
+/**
+ * BBO Data Consumer
+ * 接收交易所合并后的 BBO 行情，最终结果是把盘口更新写进 incoming_bbo_updates_ 等待 TE 来取
+ *
+ * 每条消息都是某个 ticker 最新的完整盘口，所以不需要 snapshot 恢复：
+ * 序号跳跃只记录下来，下一条消息（或者交易所定期的刷新）会自动纠正；序号倒退的是乱序的旧消息，直接丢弃
+ */
+
+#include <functional>
+
+#include "common/thread_utils.h"
+#include "common/lf_queue.h"
+#include "common/macros.h"
+#include "common/mcast_socket.h"
+
+#include "exchange/market_data/market_update.h"
+#include "exchange/market_data/md_channel.h"
+
+namespace Trading
+{
+class BBODataConsumer {
+public:
+    /// Only the top of book streams of the market data channels carrying tickers configured in ticker_cfg are joined.
+    BBODataConsumer(Common::ClientId client_id, Exchange::MEBBOUpdateLFQueue* bbo_updates, const std::string& iface,
+                    const Exchange::MDChannelsCfg& channels_cfg, const TradeEngineCfgHashMap& ticker_cfg);
+
+    ~BBODataConsumer() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(5s);
+
+        for (auto& channel : channels_) {
+            delete channel.mcast_socket_;
+            channel.mcast_socket_ = nullptr;
+        }
+    }
+
+    /// Start and stop the BBO data consumer main thread.
+    auto start() {
+        run_ = true;
+        ASSERT(Common::createAndStartThread(-1, "Trading/BBODataConsumer", [this]() { run(); }) != nullptr,
+               "Failed to start BBOData thread.");
+    }
+
+    auto stop() -> void {
+        run_ = false;
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    BBODataConsumer() = delete;
+    BBODataConsumer(const BBODataConsumer&) = delete;
+    BBODataConsumer(const BBODataConsumer&&) = delete;
+    BBODataConsumer& operator=(const BBODataConsumer&) = delete;
+    BBODataConsumer& operator=(const BBODataConsumer&&) = delete;
+
+private:
+    /// Lock free queue on which decoded top of book updates are pushed to, to be consumed by the trade engine.
+    Exchange::MEBBOUpdateLFQueue* incoming_bbo_updates_ = nullptr;
+
+    volatile bool run_ = false;
+
+    std::string time_str_;
+    Logger logger_;
+
+    /// Information for the market data channels.
+    const Exchange::MDChannelsCfg channels_cfg_;
+
+    /// Sequencing state kept independently for every market data channel.
+    struct ChannelState {
+        size_t next_exp_seq_num_ = 1;
+
+        /// Number of updates lost on this channel, they do not need to be recovered since every update is a full top
+        /// of book.
+        size_t num_dropped_ = 0;
+
+        /// Multicast subscriber socket for the top of book stream, nullptr if this channel was not joined.
+        Common::McastSocket* mcast_socket_ = nullptr;
+    };
+
+    /// Hash map from channel index -> ChannelState.
+    std::array<ChannelState, Exchange::ME_MAX_MD_CHANNELS> channels_;
+
+private:
+    /// Main loop for this thread - reads and processes messages from the multicast sockets.
+    auto run() noexcept -> void;
+
+    /// Process top of book updates received on the provided channel.
+    auto recvCallback(McastSocket* socket, size_t channel) noexcept -> void;
+};
+} // namespace Trading
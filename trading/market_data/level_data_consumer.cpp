@@ -0,0 +1,235 @@
+#include "level_data_consumer.h"
+
+namespace Trading
+{
+LevelDataConsumer::LevelDataConsumer(Common::ClientId client_id, Exchange::MELevelUpdateLFQueue* level_updates,
+                                     const std::string& iface, const Exchange::MDChannelsCfg& channels_cfg,
+                                     const TradeEngineCfgHashMap& ticker_cfg)
+    : incoming_level_updates_(level_updates), run_(false),
+      logger_("trading_level_data_consumer_" + std::to_string(client_id) + ".log"), iface_(iface),
+      channels_cfg_(channels_cfg) {
+    ASSERT(channels_cfg_.level_feed_, "Price level feed is not enabled in " + channels_cfg_.toString());
+
+    /* 和 MarketDataConsumer 一样，只加入配置了的 ticker 所在的 channel */
+    std::array<bool, Exchange::ME_MAX_MD_CHANNELS> needed_channels{};
+    auto have_configured_ticker = false;
+    for (TickerId ticker_id = 0; ticker_id < ticker_cfg.size(); ++ticker_id) {
+        if (ticker_cfg.at(ticker_id).clip_) {
+            needed_channels.at(channels_cfg_.channelForTicker(ticker_id)) = true;
+            have_configured_ticker = true;
+        }
+    }
+    if (!have_configured_ticker) // no per ticker configuration, join every channel.
+        needed_channels.fill(true);
+
+    for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+        if (!needed_channels.at(channel)) continue;
+
+        const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+        auto& channel_state = channels_.at(channel);
+        logger_.log("%:% %() % Joining channel:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), channel, channel_cfg.toString());
+
+        auto recv_callback = [this, channel](auto socket) { recvCallback(socket, channel); };
+
+        channel_state.incremental_mcast_socket_ = new Common::McastSocket(logger_);
+        channel_state.incremental_mcast_socket_->recv_callback_ = recv_callback;
+        ASSERT(channel_state.incremental_mcast_socket_->init(channel_cfg.level_incremental_ip_, iface,
+                                                             channel_cfg.level_incremental_port_,
+                                                             /*is_listening*/ true) >= 0,
+               "Unable to create level incremental mcast socket. error:" + std::string(std::strerror(errno)));
+
+        ASSERT(channel_state.incremental_mcast_socket_->join(channel_cfg.level_incremental_ip_),
+               "Join failed on:" + std::to_string(channel_state.incremental_mcast_socket_->socket_fd_) +
+                   " error:" + std::string(std::strerror(errno)));
+
+        channel_state.snapshot_mcast_socket_ = new Common::McastSocket(logger_);
+        channel_state.snapshot_mcast_socket_->recv_callback_ = recv_callback;
+    }
+}
+
+/// Main loop for this thread - reads and processes messages from the multicast sockets.
+auto LevelDataConsumer::run() noexcept -> void {
+    logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+    while (run_) {
+        for (size_t channel = 0; channel < channels_cfg_.num_channels_; ++channel) {
+            auto& channel_state = channels_[channel];
+            if (!channel_state.incremental_mcast_socket_) continue;
+
+            channel_state.incremental_mcast_socket_->sendAndRecv();
+            if (channel_state.snapshot_mcast_socket_->socket_fd_ != -1)
+                channel_state.snapshot_mcast_socket_->sendAndRecv();
+        }
+    }
+}
+
+/// Start the process of snapshot synchronization by subscribing to the price level snapshot stream of the channel.
+auto LevelDataConsumer::startSnapshotSync(size_t channel) -> void {
+    auto& channel_state = channels_.at(channel);
+    const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+
+    channel_state.snapshot_queued_msgs_.clear();
+    channel_state.incremental_queued_msgs_.clear();
+
+    ASSERT(channel_state.snapshot_mcast_socket_->init(channel_cfg.level_snapshot_ip_, iface_,
+                                                      channel_cfg.level_snapshot_port_, /*is_listening*/ true) >= 0,
+           "Unable to create level snapshot mcast socket. error:" + std::string(std::strerror(errno)));
+    ASSERT(channel_state.snapshot_mcast_socket_->join(channel_cfg.level_snapshot_ip_), // IGMP multicast subscription.
+           "Join failed on:" + std::to_string(channel_state.snapshot_mcast_socket_->socket_fd_) +
+               " error:" + std::string(std::strerror(errno)));
+}
+
+/// Check if a recovery / synchronization is possible from the queued up price level updates of the channel.
+auto LevelDataConsumer::checkSnapshotSync(size_t channel) -> void {
+    auto& channel_state = channels_.at(channel);
+    if (channel_state.snapshot_queued_msgs_.empty()) {
+        return;
+    }
+
+    const auto& first_snapshot_msg = channel_state.snapshot_queued_msgs_.begin()->second;
+    if (first_snapshot_msg.type_ != Exchange::LevelUpdateType::SNAPSHOT_START) {
+        logger_.log("%:% %() % Returning because have not seen a SNAPSHOT_START yet.\n", __FILE__, __LINE__,
+                    __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
+        channel_state.snapshot_queued_msgs_.clear();
+        return;
+    }
+
+    std::vector<Exchange::MELevelUpdate> final_events;
+
+    size_t next_snapshot_seq = 0;
+    for (auto& [seq, msgs] : channel_state.snapshot_queued_msgs_) {
+        if (seq != next_snapshot_seq) {
+            logger_.log("%:% %() % Detected gap in snapshot stream expected:% found:% %.\n", __FILE__, __LINE__,
+                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), next_snapshot_seq, seq, msgs.toString());
+            channel_state.snapshot_queued_msgs_.clear();
+            return;
+        }
+
+        if (msgs.type_ != Exchange::LevelUpdateType::SNAPSHOT_START &&
+            msgs.type_ != Exchange::LevelUpdateType::SNAPSHOT_END)
+            final_events.push_back(msgs);
+
+        ++next_snapshot_seq;
+    }
+
+    const auto& last_snapshot_msg = channel_state.snapshot_queued_msgs_.rbegin()->second;
+    if (last_snapshot_msg.type_ != Exchange::LevelUpdateType::SNAPSHOT_END) {
+        logger_.log("%:% %() % Returning because have not seen a SNAPSHOT_END yet.\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_));
+        return;
+    }
+
+    /* price_ 中存放的是快照对应的最后一条 L2 增量序号 */
+    size_t num_incrementals = 0;
+    channel_state.next_exp_inc_seq_num_ = static_cast<size_t>(last_snapshot_msg.price_) + 1;
+    for (const auto& [seq, msg] : channel_state.incremental_queued_msgs_) {
+        if (seq < channel_state.next_exp_inc_seq_num_) continue;
+
+        if (seq != channel_state.next_exp_inc_seq_num_) {
+            logger_.log("%:% %() % Detected gap in incremental stream expected:% found:% %.\n", __FILE__, __LINE__,
+                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), channel_state.next_exp_inc_seq_num_, seq,
+                        msg.toString());
+            channel_state.snapshot_queued_msgs_.clear();
+            return;
+        }
+
+        final_events.push_back(msg);
+
+        ++channel_state.next_exp_inc_seq_num_;
+        ++num_incrementals;
+    }
+
+    for (const auto& itr : final_events) {
+        auto next_write = incoming_level_updates_->getNextToWriteTo();
+        *next_write = itr;
+        incoming_level_updates_->updateWriteIndex();
+    }
+
+    logger_.log("%:% %() % Recovered % snapshot and % incremental levels.\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), channel_state.snapshot_queued_msgs_.size() - 2,
+                num_incrementals);
+
+    channel_state.snapshot_queued_msgs_.clear();
+    channel_state.incremental_queued_msgs_.clear();
+    channel_state.in_recovery_ = false;
+
+    const auto& channel_cfg = channels_cfg_.channels_.at(channel);
+    channel_state.snapshot_mcast_socket_->leave(channel_cfg.level_snapshot_ip_, channel_cfg.level_snapshot_port_);
+}
+
+/// Queue up a message in the *_queued_msgs_ containers of the channel, first parameter specifies if this update came
+/// from the snapshot or the incremental streams.
+auto LevelDataConsumer::queueMessage(bool is_snapshot, const Exchange::MDPLevelUpdate* request, size_t channel) {
+    auto& channel_state = channels_.at(channel);
+    if (is_snapshot) {
+        if (channel_state.snapshot_queued_msgs_.find(request->seq_num_) != channel_state.snapshot_queued_msgs_.end()) {
+            logger_.log("%:% %() % Packet drops on snapshot socket. Received for a 2nd time:%\n", __FILE__, __LINE__,
+                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), request->toString());
+            channel_state.snapshot_queued_msgs_.clear();
+        }
+        channel_state.snapshot_queued_msgs_[request->seq_num_] = request->me_level_update_;
+    } else {
+        channel_state.incremental_queued_msgs_[request->seq_num_] = request->me_level_update_;
+    }
+
+    logger_.log("%:% %() % size snapshot:% incremental:% % => %\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), channel_state.snapshot_queued_msgs_.size(),
+                channel_state.incremental_queued_msgs_.size(), request->seq_num_, request->toString());
+
+    checkSnapshotSync(channel);
+}
+
+/// Process a price level update on the provided channel, the socket parameter tells whether this came from the snapshot
+/// or the incremental stream.
+auto LevelDataConsumer::recvCallback(McastSocket* socket, size_t channel) noexcept -> void {
+    auto& channel_state = channels_.at(channel);
+
+    const auto is_snapshot = (socket->socket_fd_ == channel_state.snapshot_mcast_socket_->socket_fd_);
+    if (UNLIKELY(is_snapshot && !channel_state.in_recovery_)) { // not in recovery, discard the snapshot.
+        socket->next_rcv_valid_index_ = 0;
+
+        logger_.log("%:% %() % WARN Not expecting snapshot messages.\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_));
+
+        return;
+    }
+
+    if (socket->next_rcv_valid_index_ >= sizeof(Exchange::MDPLevelUpdate)) {
+        size_t i = 0;
+        for (; i + sizeof(Exchange::MDPLevelUpdate) <= socket->next_rcv_valid_index_;
+             i += sizeof(Exchange::MDPLevelUpdate)) {
+            auto request = reinterpret_cast<const Exchange::MDPLevelUpdate*>(socket->inbound_data_.data() + i);
+            logger_.log("%:% %() % Received % socket len:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                        Common::getCurrentTimeStr(&time_str_), (is_snapshot ? "snapshot" : "incremental"),
+                        sizeof(Exchange::MDPLevelUpdate), request->toString());
+
+            const bool already_in_recovery = channel_state.in_recovery_;
+            channel_state.in_recovery_ =
+                (already_in_recovery || request->seq_num_ != channel_state.next_exp_inc_seq_num_);
+
+            if (UNLIKELY(channel_state.in_recovery_)) {
+                if (UNLIKELY(!already_in_recovery)) { // just entered recovery, subscribe to the snapshot stream.
+                    logger_.log("%:% %() % Packet drops on % socket channel:%. SeqNum expected:% received:%\n",
+                                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                                (is_snapshot ? "snapshot" : "incremental"), channel,
+                                channel_state.next_exp_inc_seq_num_, request->seq_num_);
+                    startSnapshotSync(channel);
+                }
+
+                queueMessage(is_snapshot, request, channel);
+            } else if (!is_snapshot) { // not in recovery and received a packet in the correct order, process it.
+                logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                            request->toString());
+
+                ++channel_state.next_exp_inc_seq_num_;
+
+                auto next_write = incoming_level_updates_->getNextToWriteTo();
+                *next_write = std::move(request->me_level_update_);
+                incoming_level_updates_->updateWriteIndex();
+            }
+        }
+        memcpy(socket->inbound_data_.data(), socket->inbound_data_.data() + i, socket->next_rcv_valid_index_ - i);
+        socket->next_rcv_valid_index_ -= i;
+    }
+}
+} // namespace Trading
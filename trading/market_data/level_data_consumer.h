@@ -0,0 +1,116 @@
+#pragma once
+
+/**
+ * Level Data Consumer
+ * 接收 L2 聚合价位行情的 update 和 snapshot
+ * 最终结果是把价位更新写进 incoming_level_updates_ 等待 TE 来取
+ *
+ * 序号检测、丢包后按 channel 从 snapshot 恢复的流程和 MarketDataConsumer 完全一样，只是消息换成了 MDPLevelUpdate，
+ * SNAPSHOT_START / SNAPSHOT_END 中存放增量序号的字段是 price_
+ */
+
+#include <functional>
+#include <map>
+
+#include "common/thread_utils.h"
+#include "common/lf_queue.h"
+#include "common/macros.h"
+#include "common/mcast_socket.h"
+
+#include "exchange/market_data/market_update.h"
+#include "exchange/market_data/md_channel.h"
+
+namespace Trading
+{
+class LevelDataConsumer {
+public:
+    /// Only the price level streams of the market data channels carrying tickers configured in ticker_cfg are joined.
+    LevelDataConsumer(Common::ClientId client_id, Exchange::MELevelUpdateLFQueue* level_updates,
+                      const std::string& iface, const Exchange::MDChannelsCfg& channels_cfg,
+                      const TradeEngineCfgHashMap& ticker_cfg);
+
+    ~LevelDataConsumer() {
+        stop();
+
+        using namespace std::literals::chrono_literals;
+        std::this_thread::sleep_for(5s);
+
+        for (auto& channel : channels_) {
+            delete channel.incremental_mcast_socket_;
+            channel.incremental_mcast_socket_ = nullptr;
+            delete channel.snapshot_mcast_socket_;
+            channel.snapshot_mcast_socket_ = nullptr;
+        }
+    }
+
+    /// Start and stop the level data consumer main thread.
+    auto start() {
+        run_ = true;
+        ASSERT(Common::createAndStartThread(-1, "Trading/LevelDataConsumer", [this]() { run(); }) != nullptr,
+               "Failed to start LevelData thread.");
+    }
+
+    auto stop() -> void {
+        run_ = false;
+    }
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    LevelDataConsumer() = delete;
+    LevelDataConsumer(const LevelDataConsumer&) = delete;
+    LevelDataConsumer(const LevelDataConsumer&&) = delete;
+    LevelDataConsumer& operator=(const LevelDataConsumer&) = delete;
+    LevelDataConsumer& operator=(const LevelDataConsumer&&) = delete;
+
+private:
+    /// Lock free queue on which decoded price level updates are pushed to, to be consumed by the trade engine.
+    Exchange::MELevelUpdateLFQueue* incoming_level_updates_ = nullptr;
+
+    volatile bool run_ = false;
+
+    std::string time_str_;
+    Logger logger_;
+
+    /// Information for the market data channels, only the snapshot streams are joined on demand.
+    const std::string iface_;
+    const Exchange::MDChannelsCfg channels_cfg_;
+
+    /// Containers to queue up price level updates from the snapshot and incremental streams, queued up in order of
+    /// increasing sequence numbers.
+    using QueuedLevelUpdates = std::map<size_t, Exchange::MELevelUpdate>;
+
+    /// Sequencing and recovery state kept independently for every market data channel.
+    struct ChannelState {
+        size_t next_exp_inc_seq_num_ = 1;
+
+        /// Multicast subscriber sockets for the incremental and snapshot price level streams, nullptr if this channel
+        /// was not joined.
+        Common::McastSocket* incremental_mcast_socket_ = nullptr;
+        Common::McastSocket* snapshot_mcast_socket_ = nullptr;
+
+        bool in_recovery_ = false;
+
+        QueuedLevelUpdates snapshot_queued_msgs_, incremental_queued_msgs_;
+    };
+
+    /// Hash map from channel index -> ChannelState.
+    std::array<ChannelState, Exchange::ME_MAX_MD_CHANNELS> channels_;
+
+private:
+    /// Main loop for this thread - reads and processes messages from the multicast sockets.
+    auto run() noexcept -> void;
+
+    /// Process a price level update on the provided channel, the socket parameter tells whether this came from the
+    /// snapshot or the incremental stream.
+    auto recvCallback(McastSocket* socket, size_t channel) noexcept -> void;
+
+    /// Queue up a message in the *_queued_msgs_ containers of the channel, first parameter specifies if this update
+    /// came from the snapshot or the incremental streams.
+    auto queueMessage(bool is_snapshot, const Exchange::MDPLevelUpdate* request, size_t channel);
+
+    /// Start the process of snapshot synchronization by subscribing to the price level snapshot stream of the channel.
+    auto startSnapshotSync(size_t channel) -> void;
+
+    /// Check if a recovery / synchronization is possible from the queued up price level updates of the channel.
+    auto checkSnapshotSync(size_t channel) -> void;
+};
+} // namespace Trading
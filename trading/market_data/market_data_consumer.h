@@ -7,7 +7,10 @@
  */
 
 /**
- * 调用链：
+ * 行情按 ticker 分片到多个 channel，每个 channel 的序号、恢复状态（ChannelState）都是独立的，
+ * 构造时只加入 TradeEngineCfg 里配置了的 ticker 所在的 channel
+ *
+ * 调用链（对每个加入了的 channel）：
  *  run() 循环
  *      incremental_mcast_socket_.sendAndRecv()
  *          读到信息会调用 recvCallback()
@@ -67,20 +70,30 @@
 #endif
 
 #include "exchange/market_data/market_update.h"
+#include "exchange/market_data/md_channel.h"
+#include "exchange/market_data/md_codec.h"
 
 namespace Trading
 {
 class MarketDataConsumer {
 public:
+    /// Only the market data channels carrying tickers configured in ticker_cfg are joined.
     MarketDataConsumer(Common::ClientId client_id, Exchange::MEMarketUpdateLFQueue* market_updates,
-                       const std::string& iface, const std::string& snapshot_ip, int snapshot_port,
-                       const std::string& incremental_ip, int incremental_port);
+                       const std::string& iface, const Exchange::MDChannelsCfg& channels_cfg,
+                       const TradeEngineCfgHashMap& ticker_cfg);
 
     ~MarketDataConsumer() {
         stop();
 
         using namespace std::literals::chrono_literals;
         std::this_thread::sleep_for(5s);
+
+        for (auto& channel : channels_) {
+            delete channel.incremental_mcast_socket_;
+            channel.incremental_mcast_socket_ = nullptr;
+            delete channel.snapshot_mcast_socket_;
+            channel.snapshot_mcast_socket_ = nullptr;
+        }
     }
 
     /// Start and stop the market data consumer main thread.
@@ -102,9 +115,6 @@ public:
     MarketDataConsumer& operator=(const MarketDataConsumer&&) = delete;
 
 private:
-    /// Track the next expected sequence number on the incremental market data stream, used to detect gaps / drops.
-    size_t next_exp_inc_seq_num_ = 1;
-
     /// Lock free queue on which decoded market data updates are pushed to, to be consumed by the trade engine.
     Exchange::MEMarketUpdateLFQueue* incoming_md_updates_ = nullptr;
 
@@ -113,40 +123,53 @@ private:
     std::string time_str_;
     Logger logger_;
 
-    /// Multicast subscriber sockets for the incremental and market data streams.
-    Common::McastSocket incremental_mcast_socket_, snapshot_mcast_socket_;
-
-    /// Tracks if we are currently in the process of recovering / synchronizing with the snapshot market data stream
-    /// either because we just started up or we dropped a packet.
-    bool in_recovery_ = false;
-
-    /// Information for the snapshot multicast stream.
-    const std::string iface_, snapshot_ip_;
-    const int snapshot_port_;
+    /// Information for the market data channels, only the snapshot streams are joined on demand.
+    const std::string iface_;
+    const Exchange::MDChannelsCfg channels_cfg_;
 
     /// Containers to queue up market data updates from the snapshot and incremental channels, queued up in order of
     /// increasing sequence numbers.
     using QueuedMarketUpdates = std::map<size_t, Exchange::MEMarketUpdate>;
-    QueuedMarketUpdates snapshot_queued_msgs_, incremental_queued_msgs_;
+
+    /// Sequencing and recovery state kept independently for every market data channel, since each channel has its own
+    /// sequence numbers and snapshot cycles.
+    struct ChannelState {
+        /// Track the next expected sequence number on the incremental market data stream, used to detect gaps / drops.
+        size_t next_exp_inc_seq_num_ = 1;
+
+        /// Multicast subscriber sockets for the incremental and market data streams, nullptr if this channel was not
+        /// joined.
+        Common::McastSocket* incremental_mcast_socket_ = nullptr;
+        Common::McastSocket* snapshot_mcast_socket_ = nullptr;
+
+        /// Tracks if we are currently in the process of recovering / synchronizing with the snapshot market data
+        /// stream either because we just started up or we dropped a packet.
+        bool in_recovery_ = false;
+
+        QueuedMarketUpdates snapshot_queued_msgs_, incremental_queued_msgs_;
+    };
+
+    /// Hash map from channel index -> ChannelState.
+    std::array<ChannelState, Exchange::ME_MAX_MD_CHANNELS> channels_;
 
 private:
     /// Main loop for this thread - reads and processes messages from the multicast sockets - the heavy lifting is in
     /// the recvCallback() and checkSnapshotSync() methods.
     auto run() noexcept -> void;
 
-    /// Process a market data update, the consumer needs to use the socket parameter to figure out whether this came
-    /// from the snapshot or the incremental stream.
-    auto recvCallback(McastSocket* socket) noexcept -> void;
+    /// Process a market data update on the provided channel, the consumer needs to use the socket parameter to figure
+    /// out whether this came from the snapshot or the incremental stream.
+    auto recvCallback(McastSocket* socket, size_t channel) noexcept -> void;
 
-    /// Queue up a message in the *_queued_msgs_ containers, first parameter specifies if this update came from the
-    /// snapshot or the incremental streams.
-    auto queueMessage(bool is_snapshot, const Exchange::MDPMarketUpdate* request);
+    /// Queue up a message in the *_queued_msgs_ containers of the channel, first parameter specifies if this update came
+    /// from the snapshot or the incremental streams.
+    auto queueMessage(bool is_snapshot, const Exchange::MDPMarketUpdate* request, size_t channel);
 
-    /// Start the process of snapshot synchronization by subscribing to the snapshot multicast stream.
-    auto startSnapshotSync() -> void;
+    /// Start the process of snapshot synchronization by subscribing to the snapshot multicast stream of the channel.
+    auto startSnapshotSync(size_t channel) -> void;
 
     /// Check if a recovery / synchronization is possible from the queued up market data updates from the snapshot and
-    /// incremental market data streams.
-    auto checkSnapshotSync() -> void;
+    /// incremental market data streams of the channel.
+    auto checkSnapshotSync(size_t channel) -> void;
 };
 } // namespace Trading
@@ -4,10 +4,10 @@ namespace Trading
 {
 OrderGateway::OrderGateway(ClientId client_id, Exchange::ClientRequestLFQueue* client_requests,
                            Exchange::ClientResponseLFQueue* client_responses, std::string ip, const std::string& iface,
-                           int port)
+                           int port, Common::TCPBackend tcp_backend)
     : client_id_(client_id), ip_(ip), iface_(iface), port_(port), outgoing_requests_(client_requests),
       incoming_responses_(client_responses), logger_("trading_order_gateway_" + std::to_string(client_id) + ".log"),
-      tcp_socket_(logger_) {
+      tcp_socket_(logger_, tcp_backend) {
     tcp_socket_.recv_callback_ = [this](auto socket, auto rx_time) { recvCallback(socket, rx_time); };
 }
 
@@ -15,8 +15,20 @@ OrderGateway::OrderGateway(ClientId client_id, Exchange::ClientRequestLFQueue* c
 auto OrderGateway::run() noexcept -> void {
     logger_.log("%:% %() %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_));
     while (run_) {
+        if (UNLIKELY(tcp_socket_.connection_lost_)) {
+            reconnect();
+            continue;
+        }
+
         tcp_socket_.sendAndRecv();
 
+        /* 没有 LOGGED_ON 之前新的请求留在 outgoing_requests_ 里，order server 没有应答（比如上一个会话还没释放）就重新 LOGON */
+        if (UNLIKELY(!logged_on_)) {
+            if (Common::getCurrentNanos() - logon_time_ > OG_LOGON_TIMEOUT)
+                logon();
+            continue;
+        }
+
         for (auto client_request = outgoing_requests_->getNextToRead(); client_request;
              client_request = outgoing_requests_->getNextToRead()) {
 #ifdef PERF
@@ -28,8 +40,9 @@ auto OrderGateway::run() noexcept -> void {
 #ifdef PERF
             START_MEASURE(Trading_TCPSocket_send);
 #endif
-            tcp_socket_.send(&next_outgoing_seq_num_, sizeof(next_outgoing_seq_num_));
-            tcp_socket_.send(client_request, sizeof(Exchange::MEClientRequest));
+            auto& sent_request = sent_requests_[next_outgoing_seq_num_ % sent_requests_.size()];
+            sent_request = {next_outgoing_seq_num_, *client_request};
+            tcp_socket_.send(&sent_request, sizeof(sent_request));
 #ifdef PERF
             END_MEASURE(Trading_TCPSocket_send, logger_);
 #endif
@@ -43,6 +56,55 @@ auto OrderGateway::run() noexcept -> void {
     }
 }
 
+/// Connect to the order server and log on, and close the lost connection first when reconnecting.
+auto OrderGateway::connect() noexcept -> void {
+    ASSERT(tcp_socket_.connect(ip_, iface_, port_, false) >= 0,
+           "Unable to connect to ip:" + ip_ + " port:" + std::to_string(port_) + " on iface:" + iface_ +
+               " error:" + std::string(std::strerror(errno)));
+    logon();
+}
+
+auto OrderGateway::reconnect() noexcept -> void {
+    logger_.log("%:% %() % Lost the connection to the order server socket:%, reconnecting\n", __FILE__, __LINE__,
+                __FUNCTION__, Common::getCurrentTimeStr(&time_str_), tcp_socket_.socket_fd_);
+    tcp_socket_.close();
+    logged_on_ = false;
+
+    std::this_thread::sleep_for(std::chrono::nanoseconds(OG_RECONNECT_INTERVAL));
+    connect();
+}
+
+/// Log on to the order server with the last client response received, to have the ones after it replayed.
+auto OrderGateway::logon() noexcept -> void {
+    const auto oldest_seq_num =
+        (next_outgoing_seq_num_ > sent_requests_.size() ? next_outgoing_seq_num_ - sent_requests_.size() : 1);
+    const Exchange::OMClientRequest logon{oldest_seq_num,
+                                          {Exchange::ClientRequestType::LOGON, client_id_, TickerId_INVALID,
+                                           next_exp_seq_num_ - 1, Side::INVALID, Price_INVALID, Qty_INVALID}};
+    logger_.log("%:% %() % Logging on %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                logon.toString());
+    tcp_socket_.send(&logon, sizeof(logon));
+    logon_time_ = Common::getCurrentNanos();
+}
+
+/// The order server answered the LOGON and expects next_exp_request_seq_num next, send the client requests it missed
+/// again.
+auto OrderGateway::onLoggedOn(size_t next_exp_request_seq_num) noexcept -> void {
+    /* 比如这个进程重启过：order server 期望的序号比我们的还大，直接跳过去 */
+    if (next_exp_request_seq_num > next_outgoing_seq_num_) {
+        logger_.log("%:% %() % Order server expects request seq:% ahead of seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), next_exp_request_seq_num, next_outgoing_seq_num_);
+        next_outgoing_seq_num_ = next_exp_request_seq_num;
+    }
+
+    logger_.log("%:% %() % Logged on, resending % requests from seq:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), next_outgoing_seq_num_ - next_exp_request_seq_num,
+                next_exp_request_seq_num);
+    for (auto seq_num = next_exp_request_seq_num; seq_num < next_outgoing_seq_num_; ++seq_num)
+        tcp_socket_.send(&sent_requests_[seq_num % sent_requests_.size()], sizeof(Exchange::OMClientRequest));
+    logged_on_ = true;
+}
+
 /// Callback when an incoming client response is read, we perform some checks and forward it to the lock free queue
 /// connected to the trade engine.
 auto OrderGateway::recvCallback(TCPSocket* socket, Nanos rx_time) noexcept -> void {
@@ -72,15 +134,32 @@ auto OrderGateway::recvCallback(TCPSocket* socket, Nanos rx_time) noexcept -> vo
                             response->me_client_response_.client_id_);
                 continue;
             }
-            if (response->seq_num_ != next_exp_seq_num_) { // this should never happen since we use a reliable TCP
-                                                           // protocol, unless there is a bug at the exchange.
-                logger_.log("%:% %() % ERROR Incorrect sequence number. ClientId:%. SeqNum expected:% received:%.\n",
-                            __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id_,
-                            next_exp_seq_num_, response->seq_num_);
+            if (UNLIKELY(response->me_client_response_.type_ == Exchange::ClientResponseType::LOGGED_ON)) {
+                onLoggedOn(response->me_client_response_.client_order_id_);
                 continue;
             }
+            /* 不占序号的 REJECTED：这个连接不是 order server 上这个 ClientId 的会话，没有 LOGGED_ON 时拒绝的是 LOGON */
+            if (UNLIKELY(!response->seq_num_)) {
+                logger_.log("%:% %() % Rejected by the order server. ClientId:% logged on:%\n", __FILE__, __LINE__,
+                            __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id_, logged_on_);
+                if (!logged_on_)
+                    continue;
+            } else {
+                if (response->seq_num_ < next_exp_seq_num_) { // replayed again after logging on twice.
+                    logger_.log("%:% %() % Duplicate sequence number. ClientId:%. SeqNum expected:% received:%.\n",
+                                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id_,
+                                next_exp_seq_num_, response->seq_num_);
+                    continue;
+                }
+                if (response->seq_num_ > next_exp_seq_num_) { // older than the order server's history at logon.
+                    logger_.log("%:% %() % ERROR Lost responses. ClientId:%. SeqNum expected:% received:%.\n",
+                                __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_), client_id_,
+                                next_exp_seq_num_, response->seq_num_);
+                    next_exp_seq_num_ = response->seq_num_;
+                }
 
-            ++next_exp_seq_num_;
+                ++next_exp_seq_num_;
+            }
 
             auto next_write = incoming_responses_->getNextToWriteTo();
             *next_write = std::move(response->me_client_response_);
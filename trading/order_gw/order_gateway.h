@@ -11,11 +11,13 @@
 /**
  * 调用链：
  * run() 主循环
+ *  if (连接断了) reconnect() 重新连接，发送 LOGON
  *  tcp_socket_.sendAndRecv() 接收与发送数据
  *      触发 tcp_socket 的回调函数 OrderGateway::recvCallback(TCPSocket* socket, Nanos rx_time)
- *          写入 LFQueue incoming_responses_
+ *          if (LOGGED_ON) 重发 order server 没有收到的请求，之后才发送新的请求
+ *          写入 LFQueue incoming_responses_，断线期间的回报由 order server 在 LOGON 之后补发
  *  for 循环获取 LFQueue outgoing_requests_ 的数据
- *      send() 发送到 socket 的发送缓存中
+ *      send() 发送到 socket 的发送缓存中，同时留在 sent_requests_ 里以便重连之后重发
  */
 
 #include <functional>
@@ -33,10 +35,19 @@
 
 namespace Trading
 {
+/// Number of the most recent client requests kept to be sent again when the order server did not receive them before
+/// the connection was lost.
+constexpr size_t OG_MAX_RESENT_REQUESTS = 1024;
+
+/// Time between attempts to reconnect to the order server, and to log on again while it does not answer.
+constexpr Nanos OG_RECONNECT_INTERVAL = 100 * Common::NANOS_TO_MILLIS;
+constexpr Nanos OG_LOGON_TIMEOUT = 1000 * Common::NANOS_TO_MILLIS;
+
 class OrderGateway {
 public:
     OrderGateway(ClientId client_id, Exchange::ClientRequestLFQueue* client_requests,
-                 Exchange::ClientResponseLFQueue* client_responses, std::string ip, const std::string& iface, int port);
+                 Exchange::ClientResponseLFQueue* client_responses, std::string ip, const std::string& iface, int port,
+                 Common::TCPBackend tcp_backend = Common::TCPBackend::EPOLL);
 
     ~OrderGateway() {
         stop();
@@ -48,9 +59,7 @@ public:
     /// Start and stop the order gateway main thread.
     auto start() {
         run_ = true;
-        ASSERT(tcp_socket_.connect(ip_, iface_, port_, false) >= 0,
-               "Unable to connect to ip:" + ip_ + " port:" + std::to_string(port_) + " on iface:" + iface_ +
-                   " error:" + std::string(std::strerror(errno)));
+        connect();
         ASSERT(Common::createAndStartThread(-1, "Trading/OrderGateway", [this]() { run(); }) != nullptr,
                "Failed to start OrderGateway thread.");
     }
@@ -95,10 +104,29 @@ private:
     /// TCP connection to the exchange's order server.
     Common::TCPSocket tcp_socket_;
 
+    /// Client requests are only sent once the order server answered the LOGON of the current connection.
+    bool logged_on_ = false;
+    Nanos logon_time_ = 0;
+
+    /// Ring of the OG_MAX_RESENT_REQUESTS most recent client requests, indexed by sequence number.
+    std::array<Exchange::OMClientRequest, OG_MAX_RESENT_REQUESTS> sent_requests_;
+
 private:
     /// Main thread loop - sends out client requests to the exchange and reads and dispatches incoming client responses.
     auto run() noexcept -> void;
 
+    /// Connect to the order server and log on, and close the lost connection first when reconnecting.
+    auto connect() noexcept -> void;
+
+    auto reconnect() noexcept -> void;
+
+    /// Log on to the order server with the last client response received, to have the ones after it replayed.
+    auto logon() noexcept -> void;
+
+    /// The order server answered the LOGON and expects next_exp_request_seq_num next, send the client requests it
+    /// missed again.
+    auto onLoggedOn(size_t next_exp_request_seq_num) noexcept -> void;
+
     /// Callback when an incoming client response is read, we perform some checks and forward it to the lock free queue
     /// connected to the trade engine.
     auto recvCallback(TCPSocket* socket, Nanos rx_time) noexcept -> void;
@@ -20,12 +20,10 @@ public:
     }
 
     /// Process a change in order book and in this case compute the fair market price.
-    auto onOrderBookUpdate(TickerId ticker_id, Price price, Side side, MarketOrderBook* book) noexcept -> void {
-        const auto bbo = book->getBBO();
-        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID)) {
-            mkt_price_ = (bbo->bid_price_ * bbo->ask_qty_ + bbo->ask_price_ * bbo->bid_qty_) /
-                         static_cast<double>(bbo->bid_qty_ + bbo->ask_qty_);
-        }
+    /// Works with both the MarketOrderBook and the MarketLevelBook since only the BBO is needed.
+    template<typename BookT>
+    auto onOrderBookUpdate(TickerId ticker_id, Price price, Side side, const BookT* book) noexcept -> void {
+        updateMktPrice(book->getBBO());
 
         logger_->log("%:% %() % ticker:% price:% side:% mkt-price:% agg-trade-ratio:%\n", __FILE__, __LINE__,
                      __FUNCTION__, Common::getCurrentTimeStr(&time_str_), ticker_id,
@@ -33,11 +31,22 @@ public:
                      agg_trade_qty_ratio_);
     }
 
+    /// Process a conflated top of book update, same as onOrderBookUpdate() for trading algorithms without a book.
+    auto onBBOUpdate(TickerId ticker_id, const BBO* bbo) noexcept -> void {
+        updateMktPrice(bbo);
+
+        logger_->log("%:% %() % ticker:% % mkt-price:% agg-trade-ratio:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str_), ticker_id, bbo->toString().c_str(), mkt_price_,
+                     agg_trade_qty_ratio_);
+    }
+
     /// Process a trade event and in this case compute the feature to capture aggressive trade quantity ratio against
     /// the BBO quantity.
     auto onTradeUpdate(const Exchange::MEMarketUpdate* market_update, MarketOrderBook* book) noexcept -> void {
         const auto bbo = book->getBBO();
-        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID)) {
+        /* 集合竞价的成交没有主动方（Side::INVALID），不更新这个特征 */
+        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID &&
+                   market_update->side_ != Side::INVALID)) {
             agg_trade_qty_ratio_ = static_cast<double>(market_update->qty_) /
                                    (market_update->side_ == Side::BUY ? bbo->ask_qty_ : bbo->bid_qty_);
         }
@@ -68,5 +77,14 @@ private:
 
     /// The two features we compute in our feature engine.
     double mkt_price_ = Feature_INVALID, agg_trade_qty_ratio_ = Feature_INVALID;
+
+private:
+    /// Compute the fair market price as the quantity weighted mid price of the BBO.
+    auto updateMktPrice(const BBO* bbo) noexcept -> void {
+        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID)) {
+            mkt_price_ = (bbo->bid_price_ * bbo->ask_qty_ + bbo->ask_price_ * bbo->bid_qty_) /
+                         static_cast<double>(bbo->bid_qty_ + bbo->ask_qty_);
+        }
+    }
 };
 } // namespace Trading
@@ -36,7 +36,7 @@ public:
         const auto agg_qty_ratio = feature_engine_->getAggTradeQtyRatio();
 
         if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID &&
-                   agg_qty_ratio != Feature_INVALID)) {
+                   agg_qty_ratio != Feature_INVALID && market_update->side_ != Side::INVALID)) {
             logger_->log("%:% %() % % agg-qty-ratio:%\n", __FILE__, __LINE__, __FUNCTION__,
                          Common::getCurrentTimeStr(&time_str_), bbo->toString().c_str(), agg_qty_ratio);
 
@@ -44,15 +44,16 @@ public:
             const auto threshold = ticker_cfg_.at(market_update->ticker_id_).threshold_;
 
             if (agg_qty_ratio >= threshold) {
+                /* IOC：没成交的部分交易所直接撤掉，不需要再发撤单，也不会在对面留下挂单 */
 #ifdef PERF
-                START_MEASURE(Trading_OrderManager_moveOrders);
+                START_MEASURE(Trading_OrderManager_takeLiquidity);
 #endif
                 if (market_update->side_ == Side::BUY)
-                    order_manager_->moveOrders(market_update->ticker_id_, bbo->ask_price_, Price_INVALID, clip);
+                    order_manager_->takeLiquidity(market_update->ticker_id_, bbo->ask_price_, Side::BUY, clip);
                 else
-                    order_manager_->moveOrders(market_update->ticker_id_, Price_INVALID, bbo->bid_price_, clip);
-#ifdef PERF                
-                END_MEASURE(Trading_OrderManager_moveOrders, (*logger_));
+                    order_manager_->takeLiquidity(market_update->ticker_id_, bbo->bid_price_, Side::SELL, clip);
+#ifdef PERF
+                END_MEASURE(Trading_OrderManager_takeLiquidity, (*logger_));
 #endif
             }
         }
@@ -0,0 +1,92 @@
+#include "market_level_book.h"
+
+#include <algorithm>
+
+#include "trade_engine.h"
+
+namespace Trading
+{
+MarketLevelBook::MarketLevelBook(TickerId ticker_id, Logger* logger) : ticker_id_(ticker_id), logger_(logger) {
+}
+
+MarketLevelBook::~MarketLevelBook() {
+    logger_->log("%:% %() % LevelBook\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                 toString());
+
+    trade_engine_ = nullptr;
+    num_levels_.fill(0);
+}
+
+/// Process a price level update and update the price levels.
+auto MarketLevelBook::onLevelUpdate(const Exchange::MELevelUpdate* level_update) noexcept -> void {
+    switch (level_update->type_) {
+    case Exchange::LevelUpdateType::ADD:
+    case Exchange::LevelUpdateType::UPDATE: {
+        setLevel(level_update);
+    } break;
+    case Exchange::LevelUpdateType::DELETE: {
+        removeLevel(level_update);
+    } break;
+    case Exchange::LevelUpdateType::CLEAR: {
+        num_levels_.fill(0);
+    } break;
+    case Exchange::LevelUpdateType::INVALID:
+    case Exchange::LevelUpdateType::SNAPSHOT_START:
+    case Exchange::LevelUpdateType::SNAPSHOT_END:
+        return;
+    }
+
+    updateBBO();
+
+    logger_->log("%:% %() % % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                 level_update->toString(), bbo_.toString());
+
+    trade_engine_->onLevelBookUpdate(level_update->ticker_id_, level_update->price_, level_update->side_, this);
+}
+
+/// Insert or overwrite the price level described by the level update.
+auto MarketLevelBook::setLevel(const Exchange::MELevelUpdate* level_update) noexcept -> void {
+    auto& levels = levels_[sideToIndex(level_update->side_)];
+    auto& num_levels = num_levels_[sideToIndex(level_update->side_)];
+    const auto index = findLevel(level_update->side_, level_update->price_);
+
+    if (index == num_levels || levels[index].price_ != level_update->price_) { // new price level.
+        ASSERT(num_levels < levels.size(), "Too many price levels on update:" + level_update->toString());
+        std::copy_backward(levels.begin() + index, levels.begin() + num_levels, levels.begin() + num_levels + 1);
+        ++num_levels;
+    }
+
+    levels[index] = {level_update->price_, level_update->qty_, level_update->num_orders_};
+}
+
+/// Remove the price level described by the level update, if it exists.
+auto MarketLevelBook::removeLevel(const Exchange::MELevelUpdate* level_update) noexcept -> void {
+    auto& levels = levels_[sideToIndex(level_update->side_)];
+    auto& num_levels = num_levels_[sideToIndex(level_update->side_)];
+    const auto index = findLevel(level_update->side_, level_update->price_);
+
+    if (index == num_levels || levels[index].price_ != level_update->price_) {
+        logger_->log("%:% %() % Ignoring delete of unknown level %\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str_), level_update->toString());
+        return;
+    }
+
+    std::copy(levels.begin() + index + 1, levels.begin() + num_levels, levels.begin() + index);
+    --num_levels;
+}
+
+auto MarketLevelBook::toString() const -> std::string {
+    std::stringstream ss;
+
+    ss << "Ticker:" << tickerIdToString(ticker_id_) << std::endl;
+    for (size_t depth = numLevels(Side::SELL); depth > 0; --depth)
+        ss << "ASKS L:" << depth - 1 << " => " << getLevel(Side::SELL, depth - 1)->toString() << std::endl;
+
+    ss << std::endl << "                          X" << std::endl << std::endl;
+
+    for (size_t depth = 0; depth < numLevels(Side::BUY); ++depth)
+        ss << "BIDS L:" << depth << " => " << getLevel(Side::BUY, depth)->toString() << std::endl;
+
+    return ss.str();
+}
+} // namespace Trading
@@ -0,0 +1,123 @@
+#pragma once
+
+/**
+ * 只维护价位（L2）的轻量订单簿，由交易所的聚合价位行情驱动
+ * 不保存逐笔订单，适合只关心深度 / BBO 的策略
+ */
+
+#include "common/types.h"
+#include "common/logging.h"
+
+#include "market_order.h"
+#include "exchange/market_data/market_update.h"
+
+namespace Trading
+{
+class TradeEngine;
+
+/// Aggregated information for a single price level in the MarketLevelBook.
+struct MarketLevel {
+    Price price_ = Price_INVALID;
+    Qty qty_ = 0;
+    uint32_t num_orders_ = 0;
+
+    auto toString() const {
+        std::stringstream ss;
+        ss << "MarketLevel[" << qtyToString(qty_) << "@" << priceToString(price_) << "(" << num_orders_ << ")]";
+
+        return ss.str();
+    }
+};
+
+class MarketLevelBook final {
+public:
+    MarketLevelBook(TickerId ticker_id, Logger* logger);
+
+    ~MarketLevelBook();
+
+    /// Process a price level update and update the price levels.
+    auto onLevelUpdate(const Exchange::MELevelUpdate* level_update) noexcept -> void;
+
+    auto setTradeEngine(TradeEngine* trade_engine) {
+        trade_engine_ = trade_engine;
+    }
+
+    auto getBBO() const noexcept -> const BBO* {
+        return &bbo_;
+    }
+
+    /// Number of price levels on the provided side.
+    auto numLevels(Side side) const noexcept {
+        return num_levels_[sideToIndex(side)];
+    }
+
+    /// Price level at the provided depth on the provided side, depth 0 is the best price, nullptr if there is no such
+    /// level.
+    auto getLevel(Side side, size_t depth) const noexcept -> const MarketLevel* {
+        const auto num_levels = num_levels_[sideToIndex(side)];
+        return (depth < num_levels ? &levels_[sideToIndex(side)][num_levels - 1 - depth] : nullptr);
+    }
+
+    auto toString() const -> std::string;
+
+    /// Deleted default, copy & move constructors and assignment-operators.
+    MarketLevelBook() = delete;
+    MarketLevelBook(const MarketLevelBook&) = delete;
+    MarketLevelBook(const MarketLevelBook&&) = delete;
+    MarketLevelBook& operator=(const MarketLevelBook&) = delete;
+    MarketLevelBook& operator=(const MarketLevelBook&&) = delete;
+
+private:
+    const TickerId ticker_id_;
+
+    /// Parent trade engine that owns this price level book, used to send notifications when the book changes.
+    TradeEngine* trade_engine_ = nullptr;
+
+    /* 每一边都按从最差到最好的价格排序，最优价在数组末尾，这样靠近盘口的改动只需要移动很少的元素 */
+    /// Hash map from Side -> price levels sorted from least to most aggressive price, and the number of valid levels.
+    std::array<std::array<MarketLevel, ME_MAX_PRICE_LEVELS>, sideToIndex(Side::MAX) + 1> levels_;
+    std::array<size_t, sideToIndex(Side::MAX) + 1> num_levels_{};
+
+    BBO bbo_;
+
+    std::string time_str_;
+    Logger* logger_ = nullptr;
+
+private:
+    /// True if price a is less aggressive than price b on the provided side.
+    static auto lessAggressive(Side side, Price a, Price b) noexcept {
+        return (side == Side::BUY ? a < b : a > b);
+    }
+
+    /// Index of the first level on the provided side which is not less aggressive than price, searched from the top of
+    /// the book since most updates happen close to the best price.
+    auto findLevel(Side side, Price price) const noexcept {
+        const auto& levels = levels_[sideToIndex(side)];
+        auto index = num_levels_[sideToIndex(side)];
+        while (index && !lessAggressive(side, levels[index - 1].price_, price))
+            --index;
+
+        return index;
+    }
+
+    /// Insert or overwrite the price level described by the level update.
+    auto setLevel(const Exchange::MELevelUpdate* level_update) noexcept -> void;
+
+    /// Remove the price level described by the level update, if it exists.
+    auto removeLevel(const Exchange::MELevelUpdate* level_update) noexcept -> void;
+
+    /// Update the BBO abstraction from the top of the price levels.
+    auto updateBBO() noexcept {
+        const auto best_bid = getLevel(Side::BUY, 0);
+        bbo_.bid_price_ = (best_bid ? best_bid->price_ : Price_INVALID);
+        bbo_.bid_qty_ = (best_bid ? best_bid->qty_ : Qty_INVALID);
+
+        const auto best_ask = getLevel(Side::SELL, 0);
+        bbo_.ask_price_ = (best_ask ? best_ask->price_ : Price_INVALID);
+        bbo_.ask_qty_ = (best_ask ? best_ask->qty_ : Qty_INVALID);
+    }
+};
+
+/// Hash map from TickerId -> MarketLevelBook.
+typedef std::array<MarketLevelBook*, ME_MAX_TICKERS> MarketLevelBookHashMap;
+} // namespace Trading
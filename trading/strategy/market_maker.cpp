@@ -12,5 +12,9 @@ MarketMaker::MarketMaker(Common::Logger* logger, TradeEngine* trade_engine, cons
     };
     trade_engine->algoOnTradeUpdate_ = [this](auto market_update, auto book) { onTradeUpdate(market_update, book); };
     trade_engine->algoOnOrderUpdate_ = [this](auto client_response) { onOrderUpdate(client_response); };
+    trade_engine->algoOnLevelBookUpdate_ = [this](auto ticker_id, auto price, auto side, auto book) {
+        onOrderBookUpdate(ticker_id, price, side, book);
+    };
+    trade_engine->algoOnBBOUpdate_ = [this](auto ticker_id, auto bbo) { onBBOUpdate(ticker_id, bbo); };
 }
 } // namespace Trading
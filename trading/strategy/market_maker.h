@@ -21,35 +21,22 @@ public:
 
     /// Process order book updates, fetch the fair market price from the feature engine, check against the trading
     /// threshold and modify the passive orders.
-    auto onOrderBookUpdate(TickerId ticker_id, Price price, Side side, const MarketOrderBook* book) noexcept -> void {
+    /// Only the BBO is used, so this works with both the MarketOrderBook and the MarketLevelBook.
+    template<typename BookT>
+    auto onOrderBookUpdate(TickerId ticker_id, Price price, Side side, const BookT* book) noexcept -> void {
         logger_->log("%:% %() % ticker:% price:% side:%\n", __FILE__, __LINE__, __FUNCTION__,
                      Common::getCurrentTimeStr(&time_str_), ticker_id, Common::priceToString(price).c_str(),
                      Common::sideToString(side).c_str());
 
-        const auto bbo = book->getBBO();
-        const auto fair_price = feature_engine_->getMktPrice();
-
-        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID &&
-                   fair_price != Feature_INVALID)) {
-            logger_->log("%:% %() % % fair-price:%\n", __FILE__, __LINE__, __FUNCTION__,
-                         Common::getCurrentTimeStr(&time_str_), bbo->toString().c_str(), fair_price);
-
-            const auto clip = ticker_cfg_.at(ticker_id).clip_;
-            const auto threshold = ticker_cfg_.at(ticker_id).threshold_;
+        updateQuotes(ticker_id, book->getBBO());
+    }
 
-            /* 这个地方价格一但不一样了，其实就是 moveOrder 触发 CANCEL 操作了 */
-            const auto bid_price = bbo->bid_price_ - (fair_price - bbo->bid_price_ >= threshold ? 0 : 1);
-            const auto ask_price = bbo->ask_price_ + (bbo->ask_price_ - fair_price >= threshold ? 0 : 1);
+    /// Process conflated top of book updates, same as onOrderBookUpdate() without a book.
+    auto onBBOUpdate(TickerId ticker_id, const BBO* bbo) noexcept -> void {
+        logger_->log("%:% %() % ticker:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                     ticker_id, bbo->toString().c_str());
 
-#ifdef PERF
-            START_MEASURE(Trading_OrderManager_moveOrders);
-#endif
-            /* 同时送进去买卖两种挂单 */
-            order_manager_->moveOrders(ticker_id, bid_price, ask_price, clip);
-#ifdef PERF
-            END_MEASURE(Trading_OrderManager_moveOrders, (*logger_));
-#endif
-        }
+        updateQuotes(ticker_id, bbo);
     }
 
     /// Process trade events, which for the market making algorithm is none.
@@ -91,5 +78,34 @@ private:
 
     /// Holds the trading configuration for the market making algorithm.
     const TradeEngineCfgHashMap ticker_cfg_;
+
+private:
+    /// Check the BBO against the fair market price from the feature engine and the trading threshold and modify the
+    /// passive orders.
+    auto updateQuotes(TickerId ticker_id, const BBO* bbo) noexcept -> void {
+        const auto fair_price = feature_engine_->getMktPrice();
+
+        if (LIKELY(bbo->bid_price_ != Price_INVALID && bbo->ask_price_ != Price_INVALID &&
+                   fair_price != Feature_INVALID)) {
+            logger_->log("%:% %() % % fair-price:%\n", __FILE__, __LINE__, __FUNCTION__,
+                         Common::getCurrentTimeStr(&time_str_), bbo->toString().c_str(), fair_price);
+
+            const auto clip = ticker_cfg_.at(ticker_id).clip_;
+            const auto threshold = ticker_cfg_.at(ticker_id).threshold_;
+
+            /* 这个地方价格一但不一样了，其实就是 moveOrder 触发 CANCEL 操作了 */
+            const auto bid_price = bbo->bid_price_ - (fair_price - bbo->bid_price_ >= threshold ? 0 : 1);
+            const auto ask_price = bbo->ask_price_ + (bbo->ask_price_ - fair_price >= threshold ? 0 : 1);
+
+#ifdef PERF
+            START_MEASURE(Trading_OrderManager_moveOrders);
+#endif
+            /* 同时送进去买卖两种挂单 */
+            order_manager_->moveOrders(ticker_id, bid_price, ask_price, clip);
+#ifdef PERF
+            END_MEASURE(Trading_OrderManager_moveOrders, (*logger_));
+#endif
+        }
+    }
 };
 } // namespace Trading
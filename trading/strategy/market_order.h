@@ -47,6 +47,11 @@ struct MarketOrdersAtPrice {
 
     MarketOrder* first_mkt_order_ = nullptr;
 
+    /// Running total quantity and number of orders at this price level, maintained by MarketOrderBook so the BBO and
+    /// depth queries do not have to walk the FIFO queue.
+    Qty qty_ = 0;
+    uint32_t num_orders_ = 0;
+
     /// MarketOrdersAtPrice also serves as a node in a doubly linked list of price levels arranged in order from most
     /// aggressive to least aggressive price.
     MarketOrdersAtPrice* prev_entry_ = nullptr;
@@ -66,6 +71,8 @@ struct MarketOrdersAtPrice {
         ss << "MarketOrdersAtPrice["
            << "side:" << sideToString(side_) << " "
            << "price:" << priceToString(price_) << " "
+           << "qty:" << qtyToString(qty_) << " "
+           << "orders:" << num_orders_ << " "
            << "first_mkt_order:" << (first_mkt_order_ ? first_mkt_order_->toString() : "null") << " "
            << "prev:" << priceToString(prev_entry_ ? prev_entry_->price_ : Price_INVALID) << " "
            << "next:" << priceToString(next_entry_ ? next_entry_->price_ : Price_INVALID) << "]";
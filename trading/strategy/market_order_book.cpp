@@ -1,17 +1,19 @@
 #include "market_order_book.h"
 
+#include <fstream>
+
 #include "trade_engine.h"
 
 namespace Trading
 {
 MarketOrderBook::MarketOrderBook(TickerId ticker_id, Logger* logger)
-    : ticker_id_(ticker_id), orders_at_price_pool_(ME_MAX_PRICE_LEVELS), order_pool_(ME_MAX_ORDER_IDS),
+    : ticker_id_(ticker_id), orders_at_price_pool_(ME_MAX_PRICE_LEVELS * 2), order_pool_(ME_MAX_ORDER_IDS),
       logger_(logger) {
 }
 
 MarketOrderBook::~MarketOrderBook() {
-    logger_->log("%:% %() % OrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                 toString(false, true));
+    logger_->log("%:% %() % OrderBook ticker:% %\n", __FILE__, __LINE__, __FUNCTION__,
+                 Common::getCurrentTimeStr(&time_str_), ticker_id_, bbo_.toString());
 
     trade_engine_ = nullptr;
     bids_by_price_ = asks_by_price_ = nullptr;
@@ -20,22 +22,27 @@ MarketOrderBook::~MarketOrderBook() {
 
 /// Process market data update and update the limit order book.
 auto MarketOrderBook::onMarketUpdate(const Exchange::MEMarketUpdate* market_update) noexcept -> void {
-    logger_->log("%:% %() % OrderBook\n%\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
-                 toString(false, true));
     // bool was_empty = (!bids_by_price_ && !asks_by_price_);
-    const auto bid_updated =
+    auto bid_updated =
         (!bids_by_price_ || (bids_by_price_ && market_update->side_ == Side::BUY && market_update->price_ >= bids_by_price_->price_));
-    const auto ask_updated =
+    auto ask_updated =
         (!asks_by_price_ || (asks_by_price_ && market_update->side_ == Side::SELL && market_update->price_ <= asks_by_price_->price_));
 
     switch (market_update->type_) {
     case Exchange::MarketUpdateType::ADD: {
+        if (UNLIKELY(oid_to_order_.at(market_update->order_id_))) { // modified and re-queued, replaces the old order.
+            const auto old_order = oid_to_order_.at(market_update->order_id_);
+            (old_order->side_ == Side::BUY ? bid_updated : ask_updated) = true;
+            removeOrder(old_order);
+        }
         auto order = order_pool_.allocate(market_update->order_id_, market_update->side_, market_update->price_,
                                           market_update->qty_, market_update->priority_, nullptr, nullptr);
         addOrder(order);
     } break;
     case Exchange::MarketUpdateType::MODIFY: {
         auto order = oid_to_order_.at(market_update->order_id_);
+        auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
+        orders_at_price->qty_ += market_update->qty_ - order->qty_;
         order->qty_ = market_update->qty_;
     } break;
     case Exchange::MarketUpdateType::CANCEL: {
@@ -54,24 +61,8 @@ auto MarketOrderBook::onMarketUpdate(const Exchange::MEMarketUpdate* market_upda
     } break;
     case Exchange::MarketUpdateType::CLEAR: { // Clear the full limit order book and deallocate MarketOrdersAtPrice and
                                               // MarketOrder objects.
-        for (auto& order : oid_to_order_) {
-            if (order) order_pool_.deallocate(order);
-        }
-        oid_to_order_.fill(nullptr);
-
-        if (bids_by_price_) {
-            for (auto bid = bids_by_price_->next_entry_; bid != bids_by_price_; bid = bid->next_entry_)
-                orders_at_price_pool_.deallocate(bid);
-            orders_at_price_pool_.deallocate(bids_by_price_);
-        }
-
-        if (asks_by_price_) {
-            for (auto ask = asks_by_price_->next_entry_; ask != asks_by_price_; ask = ask->next_entry_)
-                orders_at_price_pool_.deallocate(ask);
-            orders_at_price_pool_.deallocate(asks_by_price_);
-        }
-
-        bids_by_price_ = asks_by_price_ = nullptr;
+        clear();
+        updateBBO(true, true);
     } break;
     case Exchange::MarketUpdateType::INVALID:
     case Exchange::MarketUpdateType::SNAPSHOT_START:
@@ -79,7 +70,18 @@ auto MarketOrderBook::onMarketUpdate(const Exchange::MEMarketUpdate* market_upda
         break;
     }
 
+#ifdef PERF
+    START_MEASURE(Trading_MarketOrderBook_updateBBO);
+#endif
     updateBBO(bid_updated, ask_updated);
+#ifdef PERF
+    END_MEASURE(Trading_MarketOrderBook_updateBBO, (*logger_));
+#endif
+
+    if (UNLIKELY(validation_sample_) && ++num_updates_since_validation_ >= validation_sample_) {
+        num_updates_since_validation_ = 0;
+        validateUpdate(market_update);
+    }
 
     logger_->log("%:% %() % % %", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                  market_update->toString(), bbo_.toString());
@@ -87,6 +89,87 @@ auto MarketOrderBook::onMarketUpdate(const Exchange::MEMarketUpdate* market_upda
     trade_engine_->onOrderBookUpdate(market_update->ticker_id_, market_update->price_, market_update->side_, this);
 }
 
+/// Check the parts of the book touched by the market update - the order, its price level, the neighbouring price levels
+/// and the BBO. Walks only the touched price level and does not allocate, calls FATAL on corruption.
+/* 取代之前每条行情都 toString(false, true) 遍历整个订单簿的做法，只检查这条行情改动过的地方 */
+auto MarketOrderBook::validateUpdate(const Exchange::MEMarketUpdate* market_update) const noexcept -> void {
+    switch (market_update->type_) {
+    case Exchange::MarketUpdateType::ADD:
+    case Exchange::MarketUpdateType::MODIFY: {
+        const auto order = oid_to_order_.at(market_update->order_id_);
+        if (UNLIKELY(!order || order->side_ != market_update->side_ || order->price_ != market_update->price_ ||
+                     order->qty_ != market_update->qty_))
+            FATAL("Order does not match update:" + market_update->toString() +
+                  " order:" + (order ? order->toString() : "null"));
+    } break;
+    case Exchange::MarketUpdateType::CANCEL: {
+        if (UNLIKELY(oid_to_order_.at(market_update->order_id_)))
+            FATAL("Canceled order still in book:" + market_update->toString());
+    } break;
+    case Exchange::MarketUpdateType::CLEAR: {
+        if (UNLIKELY(bids_by_price_ || asks_by_price_))
+            FATAL("Book not empty after:" + market_update->toString());
+    } break;
+    default:
+        break;
+    }
+
+    const auto orders_at_price = getOrdersAtPrice(market_update->side_, market_update->price_);
+    if (market_update->price_ != Price_INVALID && orders_at_price && orders_at_price->price_ == market_update->price_) {
+        const auto side = orders_at_price->side_;
+        const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+        const auto prev = orders_at_price->prev_entry_;
+        const auto next = orders_at_price->next_entry_;
+
+        // Links to and ordering against the neighbouring price levels, the best level is preceded by the worst one.
+        if (UNLIKELY(!best_orders_by_price || prev->next_entry_ != orders_at_price ||
+                     next->prev_entry_ != orders_at_price ||
+                     (orders_at_price != best_orders_by_price &&
+                      (side == Side::BUY ? prev->price_ <= orders_at_price->price_
+                                         : prev->price_ >= orders_at_price->price_)) ||
+                     (next != best_orders_by_price &&
+                      (side == Side::BUY ? next->price_ >= orders_at_price->price_
+                                         : next->price_ <= orders_at_price->price_))))
+            FATAL("Price level out of order:" + orders_at_price->toString());
+
+        // FIFO links and the running totals, bounded by num_orders_ so a corrupted cycle cannot loop forever.
+        Qty qty = 0;
+        uint32_t num_orders = 0;
+        auto order = orders_at_price->first_mkt_order_;
+        do {
+            if (UNLIKELY(order->next_order_->prev_order_ != order || order->side_ != side ||
+                         order->price_ != orders_at_price->price_ || oid_to_order_.at(order->order_id_) != order))
+                FATAL("Order queue corrupted at:" + order->toString() + " level:" + orders_at_price->toString());
+            qty += order->qty_;
+            ++num_orders;
+            order = order->next_order_;
+        } while (order != orders_at_price->first_mkt_order_ && num_orders <= orders_at_price->num_orders_);
+
+        if (UNLIKELY(qty != orders_at_price->qty_ || num_orders != orders_at_price->num_orders_))
+            FATAL("Running totals out of sync qty:" + qtyToString(qty) + " orders:" + std::to_string(num_orders) +
+                  " level:" + orders_at_price->toString());
+    }
+
+    if (UNLIKELY(bbo_.bid_price_ != (bids_by_price_ ? bids_by_price_->price_ : Price_INVALID) ||
+                 bbo_.bid_qty_ != (bids_by_price_ ? bids_by_price_->qty_ : Qty_INVALID) ||
+                 bbo_.ask_price_ != (asks_by_price_ ? asks_by_price_->price_ : Price_INVALID) ||
+                 bbo_.ask_qty_ != (asks_by_price_ ? asks_by_price_->qty_ : Qty_INVALID)))
+        FATAL("BBO out of sync:" + bbo_.toString() + " after:" + market_update->toString());
+}
+
+/// Write the full order book to the file at path.
+auto MarketOrderBook::snapshotToFile(const std::string& path) const -> void {
+    std::ofstream file(path, std::ofstream::out | std::ofstream::trunc);
+    if (!file) {
+        std::string time_str;
+        logger_->log("%:% %() % Unable to open snapshot file:%\n", __FILE__, __LINE__, __FUNCTION__,
+                     Common::getCurrentTimeStr(&time_str), path);
+        return;
+    }
+
+    file << toString(true, true);
+}
+
 auto MarketOrderBook::toString(bool detailed, bool validity_check) const -> std::string {
     std::stringstream ss;
     std::string time_str;
@@ -120,6 +203,10 @@ auto MarketOrderBook::toString(bool detailed, bool validity_check) const -> std:
         ss << std::endl;
 
         if (sanity_check) {
+            if (qty != itr->qty_ || num_orders != itr->num_orders_) {
+                FATAL("Running totals out of sync qty:" + qtyToString(qty) + " orders:" + std::to_string(num_orders) +
+                      " itr:" + itr->toString());
+            }
             if ((side == Side::SELL && last_price >= itr->price_) || (side == Side::BUY && last_price <= itr->price_)) {
                 FATAL("Bids/Asks not sorted by ascending/descending prices last:" + priceToString(last_price) +
                       " itr:" + itr->toString());
@@ -34,29 +34,13 @@ public:
     /// need to be updated.
     auto updateBBO(bool update_bid, bool update_ask) noexcept {
         if (update_bid) {
-            if (bids_by_price_) {
-                bbo_.bid_price_ = bids_by_price_->price_;
-                bbo_.bid_qty_ = bids_by_price_->first_mkt_order_->qty_;
-                for (auto order = bids_by_price_->first_mkt_order_->next_order_;
-                     order != bids_by_price_->first_mkt_order_; order = order->next_order_)
-                    bbo_.bid_qty_ += order->qty_;
-            } else {
-                bbo_.bid_price_ = Price_INVALID;
-                bbo_.bid_qty_ = Qty_INVALID;
-            }
+            bbo_.bid_price_ = (bids_by_price_ ? bids_by_price_->price_ : Price_INVALID);
+            bbo_.bid_qty_ = (bids_by_price_ ? bids_by_price_->qty_ : Qty_INVALID);
         }
 
         if (update_ask) {
-            if (asks_by_price_) {
-                bbo_.ask_price_ = asks_by_price_->price_;
-                bbo_.ask_qty_ = asks_by_price_->first_mkt_order_->qty_;
-                for (auto order = asks_by_price_->first_mkt_order_->next_order_;
-                     order != asks_by_price_->first_mkt_order_; order = order->next_order_)
-                    bbo_.ask_qty_ += order->qty_;
-            } else {
-                bbo_.ask_price_ = Price_INVALID;
-                bbo_.ask_qty_ = Qty_INVALID;
-            }
+            bbo_.ask_price_ = (asks_by_price_ ? asks_by_price_->price_ : Price_INVALID);
+            bbo_.ask_qty_ = (asks_by_price_ ? asks_by_price_->qty_ : Qty_INVALID);
         }
     }
 
@@ -64,6 +48,40 @@ public:
         return &bbo_;
     }
 
+    /// Price level at the provided depth on the provided side, depth 0 is the best price, nullptr if there is no such
+    /// level. Walks depth entries of the price level list.
+    auto getLevel(Side side, size_t depth) const noexcept -> const MarketOrdersAtPrice* {
+        const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
+        auto orders_at_price = best_orders_by_price;
+        for (size_t i = 0; orders_at_price && i < depth; ++i) {
+            orders_at_price = orders_at_price->next_entry_;
+            if (orders_at_price == best_orders_by_price)
+                orders_at_price = nullptr;
+        }
+
+        return orders_at_price;
+    }
+
+    /// Total quantity and number of orders resting at the provided price, 0 if there is no such level.
+    auto qtyAtPrice(Side side, Price price) const noexcept -> Qty {
+        const auto orders_at_price = getOrdersAtPrice(side, price);
+        return (orders_at_price && orders_at_price->price_ == price ? orders_at_price->qty_ : 0);
+    }
+
+    auto numOrdersAtPrice(Side side, Price price) const noexcept -> uint32_t {
+        const auto orders_at_price = getOrdersAtPrice(side, price);
+        return (orders_at_price && orders_at_price->price_ == price ? orders_at_price->num_orders_ : 0);
+    }
+
+    /// Check the invariants of the price level touched by every sample_every-th market update, 0 disables the checks.
+    auto setValidation(size_t sample_every) noexcept {
+        validation_sample_ = sample_every;
+        num_updates_since_validation_ = 0;
+    }
+
+    /// Write the full order book to the file at path.
+    auto snapshotToFile(const std::string& path) const -> void;
+
     auto toString(bool detailed, bool validity_check) const -> std::string;
 
     /// Deleted default, copy & move constructors and assignment-operators.
@@ -90,31 +108,41 @@ private:
     MarketOrdersAtPrice* bids_by_price_ = nullptr;
     MarketOrdersAtPrice* asks_by_price_ = nullptr;
 
-    /// Hash map from Price -> MarketOrdersAtPrice.
-    OrdersAtPriceHashMap price_orders_at_price_;
+    /// Hash map from Side -> Price -> MarketOrdersAtPrice, during an auction both sides can have a level at the same
+    /// price.
+    std::array<OrdersAtPriceHashMap, sideToIndex(Side::MAX) + 1> price_orders_at_price_{};
 
     /// Memory pool to manage MarketOrder objects.
     MemPool<MarketOrder> order_pool_;
 
     BBO bbo_;
 
+    /// Market updates are validated once every validation_sample_ updates, 0 if validation is disabled.
+    size_t validation_sample_ = 0;
+    size_t num_updates_since_validation_ = 0;
+
     std::string time_str_;
     Logger* logger_ = nullptr;
 
 private:
+    /// Check the parts of the book touched by the market update - the order, its price level, the neighbouring price
+    /// levels and the BBO. Walks only the touched price level and does not allocate, calls FATAL on corruption.
+    auto validateUpdate(const Exchange::MEMarketUpdate* market_update) const noexcept -> void;
+
     auto priceToIndex(Price price) const noexcept {
         return (price % ME_MAX_PRICE_LEVELS);
     }
 
-    /// Fetch and return the MarketOrdersAtPrice corresponding to the provided price.
-    auto getOrdersAtPrice(Price price) const noexcept -> MarketOrdersAtPrice* {
-        return price_orders_at_price_.at(priceToIndex(price));
+    /// Fetch and return the MarketOrdersAtPrice corresponding to the provided side and price.
+    auto getOrdersAtPrice(Side side, Price price) const noexcept -> MarketOrdersAtPrice* {
+        return price_orders_at_price_[sideToIndex(side)].at(priceToIndex(price));
     }
 
     /// Add a new MarketOrdersAtPrice at the correct price into the containers - the hash map and the doubly linked list
     /// of price levels.
     auto addOrdersAtPrice(MarketOrdersAtPrice* new_orders_at_price) noexcept {
-        price_orders_at_price_.at(priceToIndex(new_orders_at_price->price_)) = new_orders_at_price;
+        price_orders_at_price_[sideToIndex(new_orders_at_price->side_)].at(priceToIndex(new_orders_at_price->price_)) =
+            new_orders_at_price;
 
         const auto best_orders_by_price = (new_orders_at_price->side_ == Side::BUY ? bids_by_price_ : asks_by_price_);
         if (UNLIKELY(!best_orders_by_price)) {
@@ -167,7 +195,7 @@ private:
     /// Remove the MarketOrdersAtPrice from the containers - the hash map and the doubly linked list of price levels.
     auto removeOrdersAtPrice(Side side, Price price) noexcept {
         const auto best_orders_by_price = (side == Side::BUY ? bids_by_price_ : asks_by_price_);
-        auto orders_at_price = getOrdersAtPrice(price);
+        auto orders_at_price = getOrdersAtPrice(side, price);
 
         if (UNLIKELY(orders_at_price->next_entry_ == orders_at_price)) { // empty side of book.
             (side == Side::BUY ? bids_by_price_ : asks_by_price_) = nullptr;
@@ -182,14 +210,16 @@ private:
             orders_at_price->prev_entry_ = orders_at_price->next_entry_ = nullptr;
         }
 
-        price_orders_at_price_.at(priceToIndex(price)) = nullptr;
+        price_orders_at_price_[sideToIndex(side)].at(priceToIndex(price)) = nullptr;
 
         orders_at_price_pool_.deallocate(orders_at_price);
     }
 
     /// Remove and de-allocate provided order from the containers.
     auto removeOrder(MarketOrder* order) noexcept -> void {
-        auto orders_at_price = getOrdersAtPrice(order->price_);
+        auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
+        orders_at_price->qty_ -= order->qty_;
+        --orders_at_price->num_orders_;
 
         if (order->prev_order_ == order) { // only one element.
             removeOrdersAtPrice(order->side_, order->price_);
@@ -210,15 +240,47 @@ private:
         order_pool_.deallocate(order);
     }
 
+    /// Remove and de-allocate every order and price level. Only the live orders reachable from the price levels are
+    /// visited, so this is proportional to the size of the book and not to ME_MAX_ORDER_IDS.
+    /* snapshot 恢复时每个 ticker 都会收到 CLEAR，之前遍历整个 oid_to_order_ 并 fill(nullptr)（8MB）；
+       存活的订单都挂在价位的 FIFO 链表上，沿着链表释放即可 */
+    auto clear() noexcept -> void {
+        for (const auto best_orders_by_price : {bids_by_price_, asks_by_price_}) {
+            if (!best_orders_by_price) continue;
+
+            auto orders_at_price = best_orders_by_price;
+            do {
+                const auto next_entry = orders_at_price->next_entry_;
+                const auto first_order = orders_at_price->first_mkt_order_;
+                auto order = first_order;
+                do {
+                    const auto next_order = order->next_order_;
+                    oid_to_order_.at(order->order_id_) = nullptr;
+                    order_pool_.deallocate(order);
+                    order = next_order;
+                } while (order != first_order);
+
+                price_orders_at_price_[sideToIndex(orders_at_price->side_)].at(priceToIndex(orders_at_price->price_)) =
+                    nullptr;
+                orders_at_price_pool_.deallocate(orders_at_price);
+                orders_at_price = next_entry;
+            } while (orders_at_price != best_orders_by_price);
+        }
+
+        bids_by_price_ = asks_by_price_ = nullptr;
+    }
+
     /// Add a single order at the end of the FIFO queue at the price level that this order belongs in.
     auto addOrder(MarketOrder* order) noexcept -> void {
-        const auto orders_at_price = getOrdersAtPrice(order->price_);
+        const auto orders_at_price = getOrdersAtPrice(order->side_, order->price_);
 
         if (!orders_at_price) {
             order->next_order_ = order->prev_order_ = order;
 
             auto new_orders_at_price =
                 orders_at_price_pool_.allocate(order->side_, order->price_, order, nullptr, nullptr);
+            new_orders_at_price->qty_ = order->qty_;
+            new_orders_at_price->num_orders_ = 1;
             addOrdersAtPrice(new_orders_at_price);
         } else {
             auto first_order = (orders_at_price ? orders_at_price->first_mkt_order_ : nullptr);
@@ -227,6 +289,9 @@ private:
             order->prev_order_ = first_order->prev_order_;
             order->next_order_ = first_order;
             first_order->prev_order_ = order;
+
+            orders_at_price->qty_ += order->qty_;
+            ++orders_at_price->num_orders_;
         }
 
         oid_to_order_.at(order->order_id_) = order;
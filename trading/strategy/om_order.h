@@ -12,7 +12,14 @@ using namespace Common;
 namespace Trading
 {
 /// Represents the type / action in the order structure in the order manager.
-enum class OMOrderState : int8_t { INVALID = 0, PENDING_NEW = 1, LIVE = 2, PENDING_CANCEL = 3, DEAD = 4 };
+enum class OMOrderState : int8_t {
+    INVALID = 0,
+    PENDING_NEW = 1,
+    LIVE = 2,
+    PENDING_CANCEL = 3,
+    DEAD = 4,
+    PENDING_MODIFY = 5
+};
 
 inline auto OMOrderStateToString(OMOrderState side) -> std::string {
     switch (side) {
@@ -24,6 +31,8 @@ inline auto OMOrderStateToString(OMOrderState side) -> std::string {
         return "PENDING_CANCEL";
     case OMOrderState::DEAD:
         return "DEAD";
+    case OMOrderState::PENDING_MODIFY:
+        return "PENDING_MODIFY";
     case OMOrderState::INVALID:
         return "INVALID";
     }
@@ -40,6 +49,11 @@ struct OMOrder {
     Qty qty_ = Qty_INVALID;
     OMOrderState order_state_ = OMOrderState::INVALID;
 
+    /// The price and quantity requested by a MODIFY in flight, price_ and qty_ stay the confirmed ones until the
+    /// MODIFIED response.
+    Price pending_price_ = Price_INVALID;
+    Qty pending_qty_ = Qty_INVALID;
+
     auto toString() const {
         std::stringstream ss;
         ss << "OMOrder" << "["
@@ -48,7 +62,9 @@ struct OMOrder {
            << "side:" << sideToString(side_) << " "
            << "price:" << priceToString(price_) << " "
            << "qty:" << qtyToString(qty_) << " "
-           << "state:" << OMOrderStateToString(order_state_) << "]";
+           << "state:" << OMOrderStateToString(order_state_) << " "
+           << "pending price:" << priceToString(pending_price_) << " "
+           << "pending qty:" << qtyToString(pending_qty_) << "]";
 
         return ss.str();
     }
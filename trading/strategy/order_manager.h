@@ -12,6 +12,7 @@
 #include "common/perf_utils.h"
 #endif
 
+#include "exchange/order_server/client_request.h"
 #include "exchange/order_server/client_response.h"
 
 #include "om_order.h"
@@ -34,7 +35,24 @@ public:
     auto onOrderUpdate(const Exchange::MEClientResponse* client_response) noexcept -> void {
         logger_->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                      client_response->toString().c_str());
-        
+
+        /* 批量撤单的回报可能覆盖所有 ticker / 两边，不对应某一个槽 */
+        if (UNLIKELY(client_response->type_ == Exchange::ClientResponseType::MASS_CANCELED)) {
+            for (TickerId ticker_id = 0; ticker_id < ticker_side_order_.size(); ++ticker_id) {
+                if (client_response->ticker_id_ != TickerId_INVALID && client_response->ticker_id_ != ticker_id)
+                    continue;
+                for (auto& order : ticker_side_order_.at(ticker_id)) {
+                    if (client_response->side_ == Side::INVALID || order.side_ == client_response->side_)
+                        order.order_state_ = OMOrderState::DEAD;
+                }
+            }
+            return;
+        }
+
+        /* 被拒绝的请求可能带着一个不存在的 ticker，不对应任何槽 */
+        if (UNLIKELY(client_response->ticker_id_ >= ticker_side_order_.size()))
+            return;
+
         /* 一个合约的买一只有一个 OMOrder 记录槽；卖一也是一个，各自只保留最新的那张单 */
         auto order = &(ticker_side_order_.at(client_response->ticker_id_).at(sideToIndex(client_response->side_)));
         logger_->log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
@@ -51,18 +69,52 @@ public:
             order->qty_ = client_response->leaves_qty_;
             if (!order->qty_) order->order_state_ = OMOrderState::DEAD;
         } break;
+        case Exchange::ClientResponseType::MODIFIED: { // the pending price, the quantity less what filled meanwhile.
+            order->price_ = client_response->price_;
+            order->qty_ = client_response->leaves_qty_;
+            order->pending_price_ = Price_INVALID;
+            order->pending_qty_ = Qty_INVALID;
+            order->order_state_ = OMOrderState::LIVE;
+        } break;
+        case Exchange::ClientResponseType::MODIFY_REJECTED: { // the order was already gone, e.g. fully filled.
+            order->pending_price_ = Price_INVALID;
+            order->pending_qty_ = Qty_INVALID;
+            order->order_state_ = OMOrderState::DEAD;
+        } break;
+        case Exchange::ClientResponseType::REJECTED: { // never reached the book, see reject_reason_.
+            if (order->order_id_ != client_response->client_order_id_)
+                break;
+            if (order->order_state_ == OMOrderState::PENDING_NEW)
+                order->order_state_ = OMOrderState::DEAD;
+            else if (order->order_state_ == OMOrderState::PENDING_CANCEL ||
+                     order->order_state_ == OMOrderState::PENDING_MODIFY) {
+                /* 改单被拒绝：价格和数量还是之前确认过的 */
+                order->pending_price_ = Price_INVALID;
+                order->pending_qty_ = Qty_INVALID;
+                order->order_state_ = OMOrderState::LIVE;
+            }
+        } break;
         case Exchange::ClientResponseType::CANCEL_REJECTED:
+        case Exchange::ClientResponseType::MASS_CANCELED:
+        case Exchange::ClientResponseType::AUCTION_STARTED:
+        case Exchange::ClientResponseType::UNCROSSED:
+        case Exchange::ClientResponseType::LOGGED_ON:
+        case Exchange::ClientResponseType::RESENT:
         case Exchange::ClientResponseType::INVALID: {
         } break;
         }
     }
 
     /// Send a new order with specified attribute, and update the OMOrder object passed here.
-    auto newOrder(OMOrder* order, TickerId ticker_id, Price price, Side side, Qty qty) noexcept -> void;
+    auto newOrder(OMOrder* order, TickerId ticker_id, Price price, Side side, Qty qty,
+                  Exchange::TimeInForce tif) noexcept -> void;
 
     /// Send a cancel for the specified order, and update the OMOrder object passed here.
     auto cancelOrder(OMOrder* order) noexcept -> void;
 
+    /// Send a modify replacing the price and quantity of the specified order, and update the OMOrder passed here.
+    auto modifyOrder(OMOrder* order, Price price, Qty qty) noexcept -> void;
+
     /// Move a single order on the specified side so that it has the specified price and quantity.
     /// This will perform risk checks prior to sending the order, and update the OMOrder object passed here.
     auto moveOrder(OMOrder* order, TickerId ticker_id, Price price, Side side, Qty qty) noexcept {
@@ -86,21 +138,13 @@ public:
                 END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
 #endif
                 if (r == RiskCheckResult::ALLOWED) {
-                    // 先撤单
+                    // 一个 MODIFY 请求完成改价 / 改量，不再是撤单 + 新单
 #ifdef PERF
-                    START_MEASURE(Trading_OrderManager_cancelOrder);
+                    START_MEASURE(Trading_OrderManager_modifyOrder);
 #endif
-                    cancelOrder(order);
+                    modifyOrder(order, price, qty);
 #ifdef PERF
-                    END_MEASURE(Trading_OrderManager_cancelOrder, (*logger_));
-#endif
-                    // 再新单
-#ifdef PERF
-                    START_MEASURE(Trading_OrderManager_newOrder);
-#endif
-                    newOrder(order, ticker_id, price, side, qty);
-#ifdef PERF
-                    END_MEASURE(Trading_OrderManager_newOrder, (*logger_));
+                    END_MEASURE(Trading_OrderManager_modifyOrder, (*logger_));
 #endif
                 } else {
                     logger_->log("%:% %() % Ticker:% Side:% Qty:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
@@ -123,7 +167,7 @@ public:
 #ifdef PERF                    
                     START_MEASURE(Trading_OrderManager_newOrder);
 #endif                    
-                    newOrder(order, ticker_id, price, side, qty);
+                    newOrder(order, ticker_id, price, side, qty, Exchange::TimeInForce::DAY);
 #ifdef PERF                    
                     END_MEASURE(Trading_OrderManager_newOrder, (*logger_));
 #endif                
@@ -135,6 +179,7 @@ public:
         } break;
         case OMOrderState::PENDING_NEW:
         case OMOrderState::PENDING_CANCEL:
+        case OMOrderState::PENDING_MODIFY:
             break;
         }
     }
@@ -167,6 +212,35 @@ public:
         }
     }
 
+    /// Send an IOC order of quantity qty at the specified price on the specified side, whatever does not trade right
+    /// away is canceled by the exchange so there is never a resting order to cancel afterwards.
+    /// Nothing is sent while the previous order on that side is still waiting for its fills / cancel.
+    auto takeLiquidity(TickerId ticker_id, Price price, Side side, Qty qty) noexcept {
+        auto order = &(ticker_side_order_.at(ticker_id).at(sideToIndex(side)));
+        if (order->order_state_ != OMOrderState::INVALID && order->order_state_ != OMOrderState::DEAD)
+            return;
+
+#ifdef PERF
+        START_MEASURE(Trading_RiskManager_checkPreTradeRisk);
+#endif
+        const auto risk_result = risk_manager_.checkPreTradeRisk(ticker_id, side, qty);
+#ifdef PERF
+        END_MEASURE(Trading_RiskManager_checkPreTradeRisk, (*logger_));
+#endif
+        if (LIKELY(risk_result == RiskCheckResult::ALLOWED)) {
+#ifdef PERF
+            START_MEASURE(Trading_OrderManager_newOrder);
+#endif
+            newOrder(order, ticker_id, price, side, qty, Exchange::TimeInForce::IOC);
+#ifdef PERF
+            END_MEASURE(Trading_OrderManager_newOrder, (*logger_));
+#endif
+        } else
+            logger_->log("%:% %() % Ticker:% Side:% Qty:% RiskCheckResult:%\n", __FILE__, __LINE__, __FUNCTION__,
+                         Common::getCurrentTimeStr(&time_str_), tickerIdToString(ticker_id), sideToString(side),
+                         qtyToString(qty), riskCheckResultToString(risk_result));
+    }
+
     /// Helper method to fetch the buy and sell OMOrders for the specified TickerId.
     auto getOMOrderSideHashMap(TickerId ticker_id) const {
         return &(ticker_side_order_.at(ticker_id));
@@ -25,6 +25,13 @@
  *              posision_keeper_.updateBBO() 更新持仓信息中的 BBO
  *              feature_engine_.onOrderBookUpdate() 更新特征引擎（mkt_price_）
  *              algoOnOrderBookUpdate_() 通知 algo 调用对应的 onOrderBookUpdate() 函数
+ *  if (订阅了 L2 价位行情) for 循环获取 LFQueue incoming_level_updates_ 的数据
+ *      通过哈希表获取对应的 MarketLevelBook 并调用 MarketLevelBook::onLevelUpdate() 更新价位
+ *          MarketLevelBook::updateBBO() 从最优价位更新 BBO
+ *          trade_engine_->onLevelBookUpdate() 和 onOrderBookUpdate() 一样更新持仓、特征引擎并通知 algo
+ *  if (订阅了合并 BBO 行情) for 循环获取 LFQueue incoming_bbo_updates_ 的数据
+ *      覆盖 ticker_bbo_ 中对应 ticker 的 BBO（不维护任何订单簿）
+ *      onBBOUpdate() 和 onOrderBookUpdate() 一样更新持仓、特征引擎并通知 algo
  */
 
 namespace Trading
@@ -32,15 +39,20 @@ namespace Trading
 TradeEngine::TradeEngine(Common::ClientId client_id, AlgoType algo_type, const TradeEngineCfgHashMap& ticker_cfg,
                          Exchange::ClientRequestLFQueue* client_requests,
                          Exchange::ClientResponseLFQueue* client_responses,
-                         Exchange::MEMarketUpdateLFQueue* market_updates)
+                         Exchange::MEMarketUpdateLFQueue* market_updates,
+                         Exchange::MELevelUpdateLFQueue* level_updates,
+                         Exchange::MEBBOUpdateLFQueue* bbo_updates)
     : client_id_(client_id), outgoing_ogw_requests_(client_requests), incoming_ogw_responses_(client_responses),
-      incoming_md_updates_(market_updates), logger_("trading_engine_" + std::to_string(client_id) + ".log"),
+      incoming_md_updates_(market_updates), incoming_level_updates_(level_updates),
+      incoming_bbo_updates_(bbo_updates), logger_("trading_engine_" + std::to_string(client_id) + ".log"),
       feature_engine_(&logger_), position_keeper_(&logger_), order_manager_(&logger_, this, risk_manager_),
       risk_manager_(&logger_, &position_keeper_, ticker_cfg) {
     /* 就是为每一个 ticker 初始化一个 order book 并绑定到这个 TE */
     for (size_t i = 0; i < ticker_order_book_.size(); ++i) {
         ticker_order_book_[i] = new MarketOrderBook(i, &logger_);
         ticker_order_book_[i]->setTradeEngine(this);
+        ticker_level_book_[i] = new MarketLevelBook(i, &logger_);
+        ticker_level_book_[i]->setTradeEngine(this);
     }
 
     // Initialize the function wrappers for the callbacks for order book changes, trade events and client responses.
@@ -49,6 +61,10 @@ TradeEngine::TradeEngine(Common::ClientId client_id, AlgoType algo_type, const T
     };
     algoOnTradeUpdate_ = [this](auto market_update, auto book) { defaultAlgoOnTradeUpdate(market_update, book); };
     algoOnOrderUpdate_ = [this](auto client_response) { defaultAlgoOnOrderUpdate(client_response); };
+    algoOnLevelBookUpdate_ = [this](auto ticker_id, auto price, auto side, auto book) {
+        defaultAlgoOnLevelBookUpdate(ticker_id, price, side, book);
+    };
+    algoOnBBOUpdate_ = [this](auto ticker_id, auto bbo) { defaultAlgoOnBBOUpdate(ticker_id, bbo); };
 
     // Create the trading algorithm instance based on the AlgoType provided.
     // The constructor will override the callbacks above for order book changes, trade events and client responses.
@@ -85,10 +101,16 @@ TradeEngine::~TradeEngine() {
         delete order_book;
         order_book = nullptr;
     }
+    for (auto& level_book : ticker_level_book_) {
+        delete level_book;
+        level_book = nullptr;
+    }
 
     outgoing_ogw_requests_ = nullptr;
     incoming_ogw_responses_ = nullptr;
     incoming_md_updates_ = nullptr;
+    incoming_level_updates_ = nullptr;
+    incoming_bbo_updates_ = nullptr;
 }
 
 /// Write a client request to the lock free queue for the order server to consume and send to the exchange.
@@ -135,6 +157,37 @@ auto TradeEngine::run() noexcept -> void {
             incoming_md_updates_->updateReadIndex();
             last_event_time_ = Common::getCurrentNanos();
         }
+
+        if (incoming_level_updates_) {
+            for (auto level_update = incoming_level_updates_->getNextToRead(); level_update;
+                 level_update = incoming_level_updates_->getNextToRead()) {
+                logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
+                            Common::getCurrentTimeStr(&time_str_), level_update->toString().c_str());
+                ASSERT(level_update->ticker_id_ < ticker_level_book_.size(),
+                       "Unknown ticker-id on update:" + level_update->toString());
+                ticker_level_book_[level_update->ticker_id_]->onLevelUpdate(level_update);
+                incoming_level_updates_->updateReadIndex();
+                last_event_time_ = Common::getCurrentNanos();
+            }
+        }
+
+        if (incoming_bbo_updates_) {
+            for (auto bbo_update = incoming_bbo_updates_->getNextToRead(); bbo_update;
+                 bbo_update = incoming_bbo_updates_->getNextToRead()) {
+                logger_.log("%:% %() % Processing %\n", __FILE__, __LINE__, __FUNCTION__,
+                            Common::getCurrentTimeStr(&time_str_), bbo_update->toString().c_str());
+                ASSERT(bbo_update->ticker_id_ < ticker_bbo_.size(),
+                       "Unknown ticker-id on update:" + bbo_update->toString());
+                auto& bbo = ticker_bbo_[bbo_update->ticker_id_];
+                bbo.bid_price_ = bbo_update->bid_price_;
+                bbo.bid_qty_ = bbo_update->bid_qty_;
+                bbo.ask_price_ = bbo_update->ask_price_;
+                bbo.ask_qty_ = bbo_update->ask_qty_;
+                onBBOUpdate(bbo_update->ticker_id_, &bbo);
+                incoming_bbo_updates_->updateReadIndex();
+                last_event_time_ = Common::getCurrentNanos();
+            }
+        }
     }
 }
 
@@ -174,6 +227,30 @@ auto TradeEngine::onOrderBookUpdate(TickerId ticker_id, Price price, Side side,
 #endif
 }
 
+/// Process changes to the price level book - same as onOrderBookUpdate() for trading algorithms fed the aggregated
+/// price level feed.
+auto TradeEngine::onLevelBookUpdate(TickerId ticker_id, Price price, Side side, MarketLevelBook* book) noexcept
+    -> void {
+    logger_.log("%:% %() % ticker:% price:% side:%\n", __FILE__, __LINE__, __FUNCTION__,
+                Common::getCurrentTimeStr(&time_str_), ticker_id, Common::priceToString(price).c_str(),
+                Common::sideToString(side).c_str());
+
+    position_keeper_.updateBBO(ticker_id, book->getBBO());
+    feature_engine_.onOrderBookUpdate(ticker_id, price, side, book);
+    algoOnLevelBookUpdate_(ticker_id, price, side, book);
+}
+
+/// Process conflated top of book updates - same as onOrderBookUpdate() for trading algorithms fed only the top of book,
+/// no book is kept.
+auto TradeEngine::onBBOUpdate(TickerId ticker_id, const BBO* bbo) noexcept -> void {
+    logger_.log("%:% %() % ticker:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                ticker_id, bbo->toString().c_str());
+
+    position_keeper_.updateBBO(ticker_id, bbo);
+    feature_engine_.onBBOUpdate(ticker_id, bbo);
+    algoOnBBOUpdate_(ticker_id, bbo);
+}
+
 /// Process trade events - updates the  feature engine and informs the trading algorithm about the trade event.
 auto TradeEngine::onTradeUpdate(const Exchange::MEMarketUpdate* market_update, MarketOrderBook* book) noexcept -> void {
     logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
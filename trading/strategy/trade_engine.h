@@ -17,6 +17,7 @@
 #include "exchange/market_data/market_update.h"
 
 #include "market_order_book.h"
+#include "market_level_book.h"
 
 #include "feature_engine.h"
 #include "position_keeper.h"
@@ -31,9 +32,12 @@ namespace Trading
 {
 class TradeEngine {
 public:
+    /// level_updates and bbo_updates can be nullptr if the trade engine is not fed the aggregated price level feed and
+    /// the conflated top of book feed respectively.
     TradeEngine(Common::ClientId client_id, AlgoType algo_type, const TradeEngineCfgHashMap& ticker_cfg,
                 Exchange::ClientRequestLFQueue* client_requests, Exchange::ClientResponseLFQueue* client_responses,
-                Exchange::MEMarketUpdateLFQueue* market_updates);
+                Exchange::MEMarketUpdateLFQueue* market_updates, Exchange::MELevelUpdateLFQueue* level_updates,
+                Exchange::MEBBOUpdateLFQueue* bbo_updates);
 
     ~TradeEngine();
 
@@ -45,10 +49,15 @@ public:
     }
 
     auto stop() -> void {
-        while (incoming_ogw_responses_->size() || incoming_md_updates_->size()) {
-            logger_.log("%:% %() % Sleeping till all updates are consumed ogw-size:% md-size:%\n", __FILE__, __LINE__,
-                        __FUNCTION__, Common::getCurrentTimeStr(&time_str_), incoming_ogw_responses_->size(),
-                        incoming_md_updates_->size());
+        while (incoming_ogw_responses_->size() || incoming_md_updates_->size() ||
+               (incoming_level_updates_ && incoming_level_updates_->size()) ||
+               (incoming_bbo_updates_ && incoming_bbo_updates_->size())) {
+            logger_.log("%:% %() % Sleeping till all updates are consumed ogw-size:% md-size:% level-size:% "
+                        "bbo-size:%\n",
+                        __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                        incoming_ogw_responses_->size(), incoming_md_updates_->size(),
+                        (incoming_level_updates_ ? incoming_level_updates_->size() : 0),
+                        (incoming_bbo_updates_ ? incoming_bbo_updates_->size() : 0));
 
             using namespace std::literals::chrono_literals;
             std::this_thread::sleep_for(10ms);
@@ -71,6 +80,14 @@ public:
     /// algorithm about the update.
     auto onOrderBookUpdate(TickerId ticker_id, Price price, Side side, MarketOrderBook* book) noexcept -> void;
 
+    /// Process changes to the price level book - same as onOrderBookUpdate() for trading algorithms fed the aggregated
+    /// price level feed.
+    auto onLevelBookUpdate(TickerId ticker_id, Price price, Side side, MarketLevelBook* book) noexcept -> void;
+
+    /// Process conflated top of book updates - same as onOrderBookUpdate() for trading algorithms fed only the top of
+    /// book, no book is kept.
+    auto onBBOUpdate(TickerId ticker_id, const BBO* bbo) noexcept -> void;
+
     /// Process trade events - updates the  feature engine and informs the trading algorithm about the trade event.
     auto onTradeUpdate(const Exchange::MEMarketUpdate* market_update, MarketOrderBook* book) noexcept -> void;
 
@@ -81,6 +98,8 @@ public:
     std::function<void(TickerId ticker_id, Price price, Side side, MarketOrderBook* book)> algoOnOrderBookUpdate_;
     std::function<void(const Exchange::MEMarketUpdate* market_update, MarketOrderBook* book)> algoOnTradeUpdate_;
     std::function<void(const Exchange::MEClientResponse* client_response)> algoOnOrderUpdate_;
+    std::function<void(TickerId ticker_id, Price price, Side side, MarketLevelBook* book)> algoOnLevelBookUpdate_;
+    std::function<void(TickerId ticker_id, const BBO* bbo)> algoOnBBOUpdate_;
 
     auto initLastEventTime() {
         last_event_time_ = Common::getCurrentNanos();
@@ -94,6 +113,18 @@ public:
         return client_id_;
     }
 
+    /// Validate the order books on every sample_every-th market update, 0 disables validation.
+    auto setBookValidation(size_t sample_every) noexcept {
+        for (auto order_book : ticker_order_book_)
+            order_book->setValidation(sample_every);
+    }
+
+    /// Write the full order book of every ticker to <prefix>_<ticker_id>.book, only safe once the trade engine stopped.
+    auto snapshotOrderBooks(const std::string& prefix) const -> void {
+        for (TickerId ticker_id = 0; ticker_id < ticker_order_book_.size(); ++ticker_id)
+            ticker_order_book_[ticker_id]->snapshotToFile(prefix + "_" + std::to_string(ticker_id) + ".book");
+    }
+
     /// Deleted default, copy & move constructors and assignment-operators.
     TradeEngine() = delete;
     TradeEngine(const TradeEngine&) = delete;
@@ -108,14 +139,23 @@ private:
     /// Hash map container from TickerId -> MarketOrderBook.
     MarketOrderBookHashMap ticker_order_book_;
 
+    /// Hash map container from TickerId -> MarketLevelBook, only fed if the price level feed is consumed.
+    MarketLevelBookHashMap ticker_level_book_;
+
+    /// Hash map container from TickerId -> latest BBO, only fed if the conflated top of book feed is consumed.
+    std::array<BBO, ME_MAX_TICKERS> ticker_bbo_;
+
     /// Lock free queues.
     /// One to publish outgoing client requests to be consumed by the order gateway and sent to the exchange.
     /// Second to consume incoming client responses from, written to by the order gateway based on data received from
     /// the exchange. Third to consume incoming market data updates from, written to by the market data consumer based
-    /// on data received from the exchange.
+    /// on data received from the exchange. Fourth and fifth, optional, to consume incoming price level updates and top
+    /// of book updates from.
     Exchange::ClientRequestLFQueue* outgoing_ogw_requests_ = nullptr;
     Exchange::ClientResponseLFQueue* incoming_ogw_responses_ = nullptr;
     Exchange::MEMarketUpdateLFQueue* incoming_md_updates_ = nullptr;
+    Exchange::MELevelUpdateLFQueue* incoming_level_updates_ = nullptr;
+    Exchange::MEBBOUpdateLFQueue* incoming_bbo_updates_ = nullptr;
 
     Nanos last_event_time_ = 0; // Last time an event was processed by this trade engine.
     volatile bool run_ = false;
@@ -157,5 +197,16 @@ private:
         logger_.log("%:% %() % %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
                     client_response->toString().c_str());
     }
+
+    auto defaultAlgoOnLevelBookUpdate(TickerId ticker_id, Price price, Side side, MarketLevelBook*) noexcept -> void {
+        logger_.log("%:% %() % ticker:% price:% side:%\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str_), ticker_id, Common::priceToString(price).c_str(),
+                    Common::sideToString(side).c_str());
+    }
+
+    auto defaultAlgoOnBBOUpdate(TickerId ticker_id, const BBO* bbo) noexcept -> void {
+        logger_.log("%:% %() % ticker:% %\n", __FILE__, __LINE__, __FUNCTION__, Common::getCurrentTimeStr(&time_str_),
+                    ticker_id, bbo->toString().c_str());
+    }
 };
 } // namespace Trading
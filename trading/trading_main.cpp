@@ -4,6 +4,8 @@
 #include "strategy/trade_engine.h"
 #include "order_gw/order_gateway.h"
 #include "market_data/market_data_consumer.h"
+#include "market_data/level_data_consumer.h"
+#include "market_data/bbo_data_consumer.h"
 
 #include "common/logging.h"
 
@@ -11,6 +13,8 @@
 Common::Logger* logger = nullptr;
 Trading::TradeEngine* trade_engine = nullptr;
 Trading::MarketDataConsumer* market_data_consumer = nullptr;
+Trading::LevelDataConsumer* level_data_consumer = nullptr;
+Trading::BBODataConsumer* bbo_data_consumer = nullptr;
 Trading::OrderGateway* order_gateway = nullptr;
 
 /// ./trading_main CLIENT_ID ALGO_TYPE [CLIP_1 THRESH_1 MAX_ORDER_SIZE_1 MAX_POS_1 MAX_LOSS_1] [CLIP_2 THRESH_2
@@ -35,9 +39,21 @@ int main(int argc, char** argv) {
     Exchange::ClientRequestLFQueue client_requests(ME_MAX_CLIENT_UPDATES);
     Exchange::ClientResponseLFQueue client_responses(ME_MAX_CLIENT_UPDATES);
     Exchange::MEMarketUpdateLFQueue market_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MELevelUpdateLFQueue level_updates(ME_MAX_MARKET_UPDATES);
+    Exchange::MEBBOUpdateLFQueue bbo_updates(ME_MAX_MARKET_UPDATES);
 
     std::string time_str;
 
+    /**
+     * 做市策略只用到 BBO，订阅合并后的 BBO 行情就够了，处理不过来时拿到的也是最新的盘口而不是积压的历史
+     * 只需要深度的策略可以订阅聚合的 L2 价位行情（目前没有这样的策略）；其它策略需要逐笔的 L3 行情（例如成交）
+     */
+    const bool use_bbo_feed = (algo_type == AlgoType::MAKER);
+    const bool use_level_feed = false;
+
+    /* 每 N 条行情检查一次订单簿被改动的部分（0 表示不检查），完整的订单簿只在退出时写到文件里 */
+    const size_t book_validation_sample = 100;
+
     TradeEngineCfgHashMap ticker_cfg;
 
     // Parse and initialize the TradeEngineCfgHashMap above from the command line arguments.
@@ -73,30 +89,59 @@ int main(int argc, char** argv) {
     logger->log("%:% %() % Starting Trade Engine...\n", __FILE__, __LINE__, __FUNCTION__,
                 Common::getCurrentTimeStr(&time_str));
     trade_engine = new Trading::TradeEngine(client_id, algo_type, ticker_cfg, &client_requests, &client_responses,
-                                            &market_updates);
+                                            &market_updates, (use_level_feed ? &level_updates : nullptr),
+                                            (use_bbo_feed ? &bbo_updates : nullptr));
+    trade_engine->setBookValidation(book_validation_sample);
     trade_engine->start();
 
     const std::string order_gw_ip = "127.0.0.1";
     const std::string order_gw_iface = "lo";
     const int order_gw_port = 12345;
+    /* IO_URING：连接自己有一个 ring，每一轮最多一次 io_uring_enter()，见 common/tcp_ring.h */
+    const auto order_gw_tcp_backend = Common::TCPBackend::EPOLL;
 
     logger->log("%:% %() % Starting Order Gateway...\n", __FILE__, __LINE__, __FUNCTION__,
                 Common::getCurrentTimeStr(&time_str));
     order_gateway = new Trading::OrderGateway(client_id, &client_requests, &client_responses, order_gw_ip,
-                                              order_gw_iface, order_gw_port);
+                                              order_gw_iface, order_gw_port, order_gw_tcp_backend);
     order_gateway->start();
 
     const std::string mkt_data_iface = "lo";
-    const std::string snapshot_ip = "233.252.14.1";
-    const int snapshot_port = 20000;
-    const std::string incremental_ip = "233.252.14.3";
-    const int incremental_port = 20001;
-
-    logger->log("%:% %() % Starting Market Data Consumer...\n", __FILE__, __LINE__, __FUNCTION__,
-                Common::getCurrentTimeStr(&time_str));
-    market_data_consumer = new Trading::MarketDataConsumer(client_id, &market_updates, mkt_data_iface, snapshot_ip,
-                                                           snapshot_port, incremental_ip, incremental_port);
-    market_data_consumer->start();
+    const std::string md_ip_prefix = "233.252.14.";
+    const int snapshot_ip_suffix = 1, incremental_ip_suffix = 3;
+    const int snapshot_port = 20000, incremental_port = 20001;
+
+    /* 必须与交易所侧的 channel 配置保持一致，consumer 只会加入 ticker_cfg 中配置了的 ticker 所在的 channel */
+    const size_t num_md_channels = 2;
+    auto md_channels_cfg = Exchange::makeMDChannelsCfg(num_md_channels, md_ip_prefix, snapshot_ip_suffix,
+                                                       snapshot_port, incremental_ip_suffix, incremental_port);
+    const int level_snapshot_ip_suffix = 2, level_incremental_ip_suffix = 4;
+    const int level_snapshot_port = 20100, level_incremental_port = 20101;
+    Exchange::addMDLevelFeed(&md_channels_cfg, md_ip_prefix, level_snapshot_ip_suffix, level_snapshot_port,
+                             level_incremental_ip_suffix, level_incremental_port);
+    const int bbo_ip_suffix = 101;
+    const int bbo_port = 20200;
+    Exchange::addMDBBOFeed(&md_channels_cfg, md_ip_prefix, bbo_ip_suffix, bbo_port, /* interval */ 0);
+
+    if (use_bbo_feed) {
+        logger->log("%:% %() % Starting BBO Data Consumer... %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), md_channels_cfg.toString());
+        bbo_data_consumer = new Trading::BBODataConsumer(client_id, &bbo_updates, mkt_data_iface, md_channels_cfg,
+                                                         ticker_cfg);
+        bbo_data_consumer->start();
+    } else if (use_level_feed) {
+        logger->log("%:% %() % Starting Level Data Consumer... %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), md_channels_cfg.toString());
+        level_data_consumer = new Trading::LevelDataConsumer(client_id, &level_updates, mkt_data_iface,
+                                                             md_channels_cfg, ticker_cfg);
+        level_data_consumer->start();
+    } else {
+        logger->log("%:% %() % Starting Market Data Consumer... %\n", __FILE__, __LINE__, __FUNCTION__,
+                    Common::getCurrentTimeStr(&time_str), md_channels_cfg.toString());
+        market_data_consumer = new Trading::MarketDataConsumer(client_id, &market_updates, mkt_data_iface,
+                                                               md_channels_cfg, ticker_cfg);
+        market_data_consumer->start();
+    }
 
     usleep(10 * 1000 * 1000);
 
@@ -146,18 +191,26 @@ int main(int argc, char** argv) {
     }
 
     trade_engine->stop();
-    market_data_consumer->stop();
+    if (market_data_consumer) market_data_consumer->stop();
+    if (level_data_consumer) level_data_consumer->stop();
+    if (bbo_data_consumer) bbo_data_consumer->stop();
     order_gateway->stop();
 
     using namespace std::literals::chrono_literals;
     std::this_thread::sleep_for(10s);
 
+    trade_engine->snapshotOrderBooks("trading_order_book_" + std::to_string(client_id));
+
     delete logger;
     logger = nullptr;
     delete trade_engine;
     trade_engine = nullptr;
     delete market_data_consumer;
     market_data_consumer = nullptr;
+    delete level_data_consumer;
+    level_data_consumer = nullptr;
+    delete bbo_data_consumer;
+    bbo_data_consumer = nullptr;
     delete order_gateway;
     order_gateway = nullptr;
 